@@ -0,0 +1,298 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/Abort.h"
+#include "src/Application.h"
+#include "src/ArrayList.h"
+#include "src/Domain.h"
+#include "src/FileSystem.h"
+#include "src/HashMap.h"
+#include "src/Path.h"
+
+using namespace skizo::core;
+using namespace skizo::io;
+using namespace skizo::collections;
+using namespace skizo::script;
+
+struct SBenchmarkResult
+{
+    Auto<const CString> Name;
+    bool Failed;
+    so_long MedianUs;
+    so_long P95Us;
+    so_long StartupMedianUs;
+    SMemoryStats MemoryStats; // of the last run
+    so_long Cost; // of the last run, -1 if cost counting is disabled
+};
+
+static int cmpPaths(const CString* path1, const CString* path2)
+{
+    return path1->CompareTo(path2);
+}
+
+static int cmpTimes(const void* a, const void* b)
+{
+    const so_long t1 = *(const so_long*)a;
+    const so_long t2 = *(const so_long*)b;
+    return t1 < t2? -1: (t1 > t2? 1: 0);
+}
+
+// Sorts the array.
+static so_long percentile(so_long* times, int count, int percent)
+{
+    qsort(times, count, sizeof(so_long), cmpTimes);
+    int index = (count * percent + 99) / 100 - 1;
+    if(index < 0) {
+        index = 0;
+    }
+    return times[index];
+}
+
+// Creates a domain for the benchmark, runs it and destroys it. The startup time includes parsing and compilation,
+// the total time includes the startup time and the entrypoint.
+static bool runBenchmarkOnce(SDomainCreation& domainCreation,
+                             const CString* path,
+                             so_long* out_startupTime,
+                             so_long* out_totalTime,
+                             SMemoryStats* out_memoryStats,
+                             so_long* out_cost)
+{
+    domainCreation.Source = path;
+
+    const so_long startTime = Application::MicroTickCount();
+    Auto<CDomain> domain;
+    try {
+        try {
+            domain.SetPtr(CDomain::CreateDomain(domainCreation));
+        } catch (SoDomainAbortException& e) {
+            printf("%s\n", e.Message);
+            return false;
+        }
+        *out_startupTime = Application::MicroTickCount() - startTime;
+
+        if(!domain->InvokeEntryPoint()) {
+            return false;
+        }
+    } catch(SException& e) {
+        printf("%s\n", e.Message());
+        return false;
+    }
+    *out_totalTime = Application::MicroTickCount() - startTime;
+    *out_memoryStats = domain->MemoryManager().Stats();
+    *out_cost = domain->CostCounter().IsEnabled()? domain->CostCounter().TotalCost(): -1;
+
+    return true;
+}
+
+// Reads medians (and costs into "costs", if any) from a file previously written by writeBenchmarkResults(..)
+// Returns null if the file can't be read.
+// Only understands the layout writeBenchmarkResults(..) produces: one benchmark per line.
+static CHashMap<const CString*, so_long>* readBaseline(const CString* path, CHashMap<const CString*, so_long>* costs)
+{
+    Utf8Auto cPath (path->ToUtf8());
+    FILE* f = fopen(cPath, "r");
+    if(!f) {
+        return nullptr;
+    }
+
+    CHashMap<const CString*, so_long>* r = new CHashMap<const CString*, so_long>();
+    char line[1024];
+    while(fgets(line, sizeof(line), f)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* median = strstr(line, "\"medianMs\": ");
+        if(!name || !median) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        const char* nameEnd = strchr(name, '"');
+        if(!nameEnd) {
+            continue;
+        }
+
+        char* cName = new char[nameEnd - name + 1];
+        memcpy(cName, name, nameEnd - name);
+        cName[nameEnd - name] = 0;
+        Auto<const CString> key (CString::FromUtf8(cName));
+        delete [] cName;
+
+        r->Set(key, (so_long)(atof(median + strlen("\"medianMs\": ")) * 1000.0));
+
+        const char* cost = strstr(line, "\"cost\": ");
+        if(cost) {
+            costs->Set(key, (so_long)atoll(cost + strlen("\"cost\": ")));
+        }
+    }
+
+    fclose(f);
+    return r;
+}
+
+static bool writeBenchmarkResults(const SBenchmarkSettings& settings, const SBenchmarkResult* results, int count)
+{
+    Utf8Auto cPath (settings.OutputPath->ToUtf8());
+    FILE* f = fopen(cPath, "w");
+    if(!f) {
+        printf("Failed to open '%s' for writing.\n", (char*)cPath);
+        return false;
+    }
+
+    fprintf(f, "{\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [\n", settings.Runs, settings.Warmup);
+    for(int i = 0; i < count; i++) {
+        const SBenchmarkResult& result = results[i];
+        Utf8Auto cName (result.Name->ToUtf8());
+
+        if(result.Failed) {
+            fprintf(f, "    {\"name\": \"%s\", \"failed\": true}", (char*)cName);
+        } else {
+            fprintf(f, "    {\"name\": \"%s\", \"medianMs\": %.3f, \"p95Ms\": %.3f, \"startupMedianMs\": %.3f, "
+                       "\"allocations\": %lld, \"allocatedBytes\": %lld, "
+                       "\"gcCount\": %d, \"gcTotalMs\": %.3f, \"gcMaxMs\": %.3f",
+                    (char*)cName,
+                    result.MedianUs / 1000.0,
+                    result.P95Us / 1000.0,
+                    result.StartupMedianUs / 1000.0,
+                    (long long)result.MemoryStats.AllocationCount,
+                    (long long)result.MemoryStats.AllocatedBytes,
+                    result.MemoryStats.GCCount,
+                    result.MemoryStats.TotalGCTimeInUs / 1000.0,
+                    result.MemoryStats.MaxGCTimeInUs / 1000.0);
+            if(result.Cost != -1) {
+                fprintf(f, ", \"cost\": %lld}", (long long)result.Cost);
+            } else {
+                fprintf(f, "}");
+            }
+        }
+        fprintf(f, i < count - 1? ",\n": "\n");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    fclose(f);
+    return true;
+}
+
+int RunBenchmarks(SDomainCreation& domainCreation, const SBenchmarkSettings& settings)
+{
+    Auto<CArrayList<const CString*> > paths;
+    Auto<CHashMap<const CString*, so_long> > baseline;
+    Auto<CHashMap<const CString*, so_long> > baselineCosts (new CHashMap<const CString*, so_long>());
+    try {
+        paths.SetPtr(FileSystem::ListFiles(settings.Directory, true));
+
+        if(settings.BaselinePath) {
+            baseline.SetPtr(readBaseline(settings.BaselinePath, baselineCosts));
+            if(!baseline) {
+                Utf8Auto cBaselinePath (settings.BaselinePath->ToUtf8());
+                printf("Failed to read the baseline '%s'.\n", (char*)cBaselinePath);
+                return 1;
+            }
+        }
+    } catch(SException& e) {
+        printf("%s\n", e.Message());
+        return 1;
+    }
+    paths->Sort(cmpPaths);
+
+    SBenchmarkResult* results = new SBenchmarkResult[paths->Count()];
+    so_long* totalTimes = new so_long[settings.Runs];
+    so_long* startupTimes = new so_long[settings.Runs];
+    int resultCount = 0;
+    int r = 0;
+
+    for(int i = 0; i < paths->Count(); i++) {
+        const CString* path = paths->Array()[i];
+        if(!path->EndsWithASCII(".skizo")) {
+            continue;
+        }
+
+        SBenchmarkResult& result = results[resultCount++];
+        {
+            Auto<const CString> fileName (Path::GetFileName(path));
+            result.Name.SetPtr(Path::ChangeExtension(fileName, (const CString*)nullptr));
+        }
+        result.Failed = false;
+
+        Utf8Auto cName (result.Name->ToUtf8());
+        printf("%-16s", (char*)cName);
+        fflush(stdout);
+
+        for(int j = -settings.Warmup; j < settings.Runs; j++) {
+            so_long startupTime, totalTime;
+            if(!runBenchmarkOnce(domainCreation, path, &startupTime, &totalTime, &result.MemoryStats, &result.Cost)) {
+                result.Failed = true;
+                break;
+            }
+            if(j >= 0) {
+                startupTimes[j] = startupTime;
+                totalTimes[j] = totalTime;
+            }
+        }
+
+        if(result.Failed) {
+            printf("FAILED\n");
+            r = 1;
+            continue;
+        }
+
+        result.MedianUs = percentile(totalTimes, settings.Runs, 50);
+        result.P95Us = percentile(totalTimes, settings.Runs, 95);
+        result.StartupMedianUs = percentile(startupTimes, settings.Runs, 50);
+
+        printf("median %10.3f ms | p95 %10.3f ms | startup %8.3f ms | %10lld allocs | %4d GCs (max %.3f ms)",
+                result.MedianUs / 1000.0,
+                result.P95Us / 1000.0,
+                result.StartupMedianUs / 1000.0,
+                (long long)result.MemoryStats.AllocationCount,
+                result.MemoryStats.GCCount,
+                result.MemoryStats.MaxGCTimeInUs / 1000.0);
+
+        so_long baselineUs;
+        if(baseline && baseline->TryGet(result.Name, &baselineUs) && baselineUs > 0) {
+            const double delta = (double)(result.MedianUs - baselineUs) * 100.0 / (double)baselineUs;
+            if(delta > settings.Threshold) {
+                printf(" | %+.1f%% REGRESSION", delta);
+                r = 1;
+            } else {
+                printf(" | %+.1f%%", delta);
+            }
+        }
+
+        // Counts are deterministic: any growth is a regression.
+        if(result.Cost != -1) {
+            printf(" | cost %lld", (long long)result.Cost);
+
+            so_long baselineCost;
+            if(baselineCosts->TryGet(result.Name, &baselineCost) && baselineCost != result.Cost) {
+                if(result.Cost > baselineCost) {
+                    printf(" (+%lld COST REGRESSION)", (long long)(result.Cost - baselineCost));
+                    r = 1;
+                } else {
+                    printf(" (%lld)", (long long)(result.Cost - baselineCost));
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    if(!writeBenchmarkResults(settings, results, resultCount)) {
+        r = 1;
+    }
+
+    delete [] startupTimes;
+    delete [] totalTimes;
+    delete [] results;
+    return r;
+}
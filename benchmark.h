@@ -0,0 +1,43 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include "src/DomainCreation.h"
+
+// *******************
+//   Benchmark mode.
+// *******************
+
+/**
+ * See the /bench* options of the launcher.
+ */
+struct SBenchmarkSettings
+{
+    const skizo::core::CString* Directory;
+    int Runs;
+    int Warmup;
+    const skizo::core::CString* OutputPath;
+    const skizo::core::CString* BaselinePath; // can be null
+    int Threshold; // in percent
+};
+
+/**
+ * Runs every .skizo file in the directory (subdirectories are for helper modules) as a separate domain,
+ * settings.Warmup times without measuring, then settings.Runs times. Returns the exit code: non-zero if
+ * a benchmark failed or regressed by more than settings.Threshold percent compared to the baseline.
+ */
+int RunBenchmarks(skizo::script::SDomainCreation& domainCreation, const SBenchmarkSettings& settings);
+
+#endif // BENCHMARK_H_INCLUDED
@@ -0,0 +1 @@
+skizo /source:bench/gen/startup.skizo && skizo /bench:bench %*
\ No newline at end of file
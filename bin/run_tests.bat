@@ -1 +1,6 @@
-skizo /source:tests_win.skizo /paths:tests
\ No newline at end of file
+skizo /source:tests_win.skizo /paths:tests
+skizo /source:tests_win.skizo /paths:tests /lazy:true
+skizo /source:dcetest.skizo /paths:tests /dce:true
+skizo /source:tests_win.skizo /paths:tests /nullcheck:false
+(echo cont& echo cont) | skizo /source:breakpointtest.skizo /paths:tests /patchbp:true /bp:breakpointtest.skizo:13 > "%TEMP%\bptest.log"
+findstr /c:"product: int = 42" "%TEMP%\bptest.log" >nul && findstr /c:"product: int = 6" "%TEMP%\bptest.log" >nul && findstr /c:"Breakpoint test passed." "%TEMP%\bptest.log" >nul || echo Breakpoint test failed.
\ No newline at end of file
@@ -1 +1,7 @@
-./skizo /source:tests_unix.skizo /paths:tests
\ No newline at end of file
+./skizo /source:tests_unix.skizo /paths:tests
+./skizo /source:tests_unix.skizo /paths:tests /lazy:true
+./skizo /source:dcetest.skizo /paths:tests /dce:true
+./skizo /source:tests_unix.skizo /paths:tests /nullcheck:false
+./skizo /source:gcstresstest.skizo /paths:tests /cc:cc /maxgcmemory:1048576
+out=$(printf 'cont\ncont\n' | ./skizo /source:breakpointtest.skizo /paths:tests /patchbp:true /bp:breakpointtest.skizo:13)
+echo "$out" | grep -q "product: int = 42" && echo "$out" | grep -q "product: int = 6" && echo "$out" | grep -q "Breakpoint test passed." || echo "Breakpoint test failed."
\ No newline at end of file
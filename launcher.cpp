@@ -18,6 +18,7 @@
 // **************************************************************************************************
 
 #include <stdio.h>
+#include "benchmark.h"
 #include "src/Abort.h"
 #include "src/ApplicationOptions.h"
 #include "src/ArrayList.h"
@@ -43,6 +44,45 @@ static void addOptionDescr(CArrayList<CApplicationOptionDescription*>& descrs, c
     descrs.Add(descr);
 }
 
+// Sets breakpoints specified as "file:line;file:line" (see /bp) The file can be a trailing part of the module's path.
+static bool setBreakpoints(CDomain* domain, const CString* breakpoints)
+{
+    Auto<CArrayList<const CString*> > list (breakpoints->Split(SKIZO_CHAR(';')));
+    for(int i = 0; i < list->Count(); i++) {
+        const CString* breakpoint = list->Array()[i];
+        if(breakpoint->Length() == 0) {
+            continue;
+        }
+
+        // The last colon: Windows paths can have drive letters.
+        int colon = -1;
+        for(int j = breakpoint->Length() - 1; j >= 0; j--) {
+            if(breakpoint->Chars()[j] == SKIZO_CHAR(':')) {
+                colon = j;
+                break;
+            }
+        }
+
+        Utf8Auto pBreakpoint (breakpoint->ToUtf8());
+        int lineNumber;
+        if(colon <= 0
+        || colon == breakpoint->Length() - 1
+        || !breakpoint->TryParseInt(&lineNumber, colon + 1, breakpoint->Length() - colon - 1))
+        {
+            printf("Ill-formed breakpoint '%s' (expected file:line).\n", (char*)pBreakpoint);
+            return false;
+        }
+
+        Auto<const CString> filePath (breakpoint->Substring(0, colon));
+        if(!domain->SetBreakpoint(filePath, lineNumber, true)) {
+            printf("No statement found for breakpoint '%s'.\n", (char*)pBreakpoint);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // ******************
 //   SKIZOLaunchMain
 // ******************
@@ -76,14 +116,42 @@ static int mainImpl(int argc, char **argv)
     addOptionDescr(descrs, "inline", "inlines branching", "true");
     addOptionDescr(descrs, "maxgcmemory", "sets maximum GC memory", "134217728");
     addOptionDescr(descrs, "gcstats", "gc stats on every garbage collection", "false");
+    addOptionDescr(descrs, "cc", "compiles with the specified optimizing system C compiler (cc, gcc, clang) instead of TCC", 0);
+    addOptionDescr(descrs, "tiered", "starts with TCC and switches hot methods to code compiled with /cc in the background", "false");
+    addOptionDescr(descrs, "dce", "doesn't emit classes and methods unreachable from the entrypoint", "false");
+    addOptionDescr(descrs, "lazy", "compiles methods on first call", "false");
+    addOptionDescr(descrs, "starttrace", "saves startup phase timings to the specified file (Chrome trace event format)", 0);
+    addOptionDescr(descrs, "perfmap", "writes /tmp/perf-<pid>.map so that Linux perf could symbolize generated code", "false");
+    addOptionDescr(descrs, "sample", "samples the stack the specified number of times per second of CPU time and saves folded stacks for flame graphs (Unix only)", "0");
+    addOptionDescr(descrs, "debuginfo", "registers generated code with GDB and maps it to .skizo lines (Unix only)", "false");
+    addOptionDescr(descrs, "patchbp", "allows breakpoints at any line without recompilation, at almost no cost until hit (see /bp)", "false");
+    addOptionDescr(descrs, "bp", "sets breakpoints before running: a list of file:line separated by ';' (requires /patchbp)", 0);
+    addOptionDescr(descrs, "costs", "counts executed statements and runtime helper calls deterministically and saves the counts to the specified file (JSON); with /bench, total costs are compared with the baseline exactly", 0);
+    addOptionDescr(descrs, "stacksize", "sets the stack size of threads of remote domains, in KB (0 for the default)", "0");
+    addOptionDescr(descrs, "bench", "runs every .skizo file in the specified directory as a benchmark instead of /source", 0);
+    addOptionDescr(descrs, "benchruns", "the number of measured runs of every benchmark", "10");
+    addOptionDescr(descrs, "benchwarmup", "the number of unmeasured runs of every benchmark before the measured ones", "2");
+    addOptionDescr(descrs, "benchout", "the file to save benchmark results to (JSON)", "bench.json");
+    addOptionDescr(descrs, "benchbaseline", "benchmark results to compare with (a file previously saved with /benchout)", 0);
+    addOptionDescr(descrs, "benchthreshold", "fails if a median time is worse than the baseline by more than the specified percent", "10");
 
     Auto<const CString> source;
     Auto<CArrayList<const CString*> > searchPaths;
     Auto<CArrayList<const CString*> > permissions;
+    Auto<const CString> nativeCompiler;
+    Auto<const CString> startupTracePath;
+    Auto<const CString> breakpoints;
+    Auto<const CString> costsPath;
     bool dumpCode, profilingEnabled, stackTraceEnabled, softDebuggingEnabled,
-         explicitNullCheck, safeCallbacks, doinline, gcstats;
+         explicitNullCheck, safeCallbacks, doinline, gcstats, tiered, dce, lazy, perfMap, debugInfo, patchableBreakpoints;
     bool isSecure = false;
     int maxGCMemory = -1;
+    int samplingFrequency = 0;
+    int stackSize = 0;
+    Auto<const CString> benchDirectory;
+    Auto<const CString> benchOutputPath;
+    Auto<const CString> benchBaselinePath;
+    SBenchmarkSettings benchSettings;
 
     try {
 
@@ -100,7 +168,8 @@ static int mainImpl(int argc, char **argv)
         }
 
         source.SetPtr(options->GetStringOption("source"));
-        if(!source) {
+        benchDirectory.SetPtr(options->GetStringOption("bench"));
+        if(!source && !benchDirectory) {
             printf("No source specified.\n");
             return 1;
         }
@@ -131,6 +200,43 @@ static int mainImpl(int argc, char **argv)
             return 1;
         }
         gcstats = options->GetBoolOption("gcstats");
+        nativeCompiler.SetPtr(options->GetStringOption("cc"));
+        startupTracePath.SetPtr(options->GetStringOption("starttrace"));
+        tiered = options->GetBoolOption("tiered");
+        dce = options->GetBoolOption("dce");
+        lazy = options->GetBoolOption("lazy");
+        samplingFrequency = options->GetIntOption("sample");
+        perfMap = options->GetBoolOption("perfmap");
+        debugInfo = options->GetBoolOption("debuginfo");
+        patchableBreakpoints = options->GetBoolOption("patchbp");
+        breakpoints.SetPtr(options->GetStringOption("bp"));
+        costsPath.SetPtr(options->GetStringOption("costs"));
+        if(!CString::IsNullOrEmpty(breakpoints) && !patchableBreakpoints) {
+            printf("Breakpoints require /patchbp.\n");
+            return 1;
+        }
+        if(patchableBreakpoints && !CString::IsNullOrEmpty(nativeCompiler)) {
+            printf("/patchbp can't be combined with /cc.\n");
+            return 1;
+        }
+        stackSize = options->GetIntOption("stacksize");
+        if(stackSize < 0 || stackSize > (1024 * 1024)) {
+            printf("The stack size must be between 0 and 1048576 KB.\n");
+            return 1;
+        }
+
+        benchOutputPath.SetPtr(options->GetStringOption("benchout"));
+        benchBaselinePath.SetPtr(options->GetStringOption("benchbaseline"));
+        benchSettings.Directory = benchDirectory;
+        benchSettings.Runs = options->GetIntOption("benchruns");
+        benchSettings.Warmup = options->GetIntOption("benchwarmup");
+        benchSettings.OutputPath = benchOutputPath;
+        benchSettings.BaselinePath = benchBaselinePath;
+        benchSettings.Threshold = options->GetIntOption("benchthreshold");
+        if(benchDirectory && (benchSettings.Runs < 1 || benchSettings.Warmup < 0)) {
+            printf("The number of benchmark runs must be greater than zero.\n");
+            return 1;
+        }
 
     } catch(SException& e) {
         printf("%s\n", e.Message());
@@ -178,6 +284,30 @@ static int mainImpl(int argc, char **argv)
     }
     domainCreation.GCStatsEnabled = gcstats;
 
+    Utf8Auto pNativeCompiler (CString::IsNullOrEmpty(nativeCompiler)? nullptr: nativeCompiler->ToUtf8());
+    domainCreation.NativeCompiler = pNativeCompiler;
+    domainCreation.TieredCompilation = tiered;
+    domainCreation.DeadCodeElimination = dce;
+    domainCreation.LazyCompilation = lazy;
+
+    Utf8Auto pStartupTracePath (CString::IsNullOrEmpty(startupTracePath)? nullptr: startupTracePath->ToUtf8());
+    domainCreation.StartupTracePath = pStartupTracePath;
+    domainCreation.SamplingFrequency = samplingFrequency;
+    domainCreation.PerfMapEnabled = perfMap;
+    domainCreation.DebugInfoEnabled = debugInfo;
+    domainCreation.PatchableBreakpoints = patchableBreakpoints;
+    domainCreation.CostCountingEnabled = !CString::IsNullOrEmpty(costsPath);
+    domainCreation.StackSize = stackSize * 1024;
+
+    if(benchDirectory) {
+        r = RunBenchmarks(domainCreation, benchSettings);
+
+        for(int i = 0; i < pSearchPaths.Count(); i++) {
+            CString::FreeUtf8(pSearchPaths.Array()[i]);
+        }
+        return r;
+    }
+
     Auto<CDomain> domain;
 
     try {
@@ -189,6 +319,10 @@ static int mainImpl(int argc, char **argv)
             return 1;
         }
 
+        if(!CString::IsNullOrEmpty(breakpoints) && !setBreakpoints(domain, breakpoints)) {
+            return 1;
+        }
+
         // RunMain automatically catches aborts.
         if(!domain->InvokeEntryPoint()) {
             r = 1;
@@ -206,11 +340,28 @@ static int mainImpl(int argc, char **argv)
 
     if(profilingEnabled) {
         Auto<CProfilingInfo> profInfo (domain->GetProfilingInfo());
-        profInfo->SortByAverageTimeInMs();
+        profInfo->SortBySelfTime();
         profInfo->DumpToDisk();
-        printf("\n====================================================================\n"
-                 "Profiling information saved to profile.txt in the current directory.\n"
-                 "====================================================================\n");
+        profInfo->DumpCallgrindToDisk();
+        printf("\n=====================================================================\n"
+                 "Profiling information saved to profile.txt and callgrind.out in the\n"
+                 "current directory.\n"
+                 "=====================================================================\n");
+    }
+
+    if(domain->CostCounter().IsEnabled()) {
+        Utf8Auto pCostsPath (costsPath->ToUtf8());
+        if(domain->CostCounter().Save(pCostsPath)) {
+            printf("\nCost counts saved to %s (total cost: %lld).\n", (char*)pCostsPath, (long long)domain->CostCounter().TotalCost());
+        }
+    }
+
+    if(domain->SamplingProfiler().IsEnabled()) {
+        domain->SamplingProfiler().DumpToDisk(domain);
+        printf("\n=============================================================================\n"
+                 "Sampled stacks saved to profile.folded and profile_samples.txt in the current\n"
+                 "directory.\n"
+                 "=============================================================================\n");
     }
   }
 
@@ -0,0 +1,513 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+// ****************************************************************************************************
+// Micro-benchmarks of the runtime's containers, allocators and strings (the "skizo_microbench" target).
+//
+// Every benchmark performs `size` operations per call, with setup excluded from measurement (see
+// SMicroTimer). The harness calls it repeatedly until SKIZO_MICROBENCH_MIN_TIME microseconds are measured,
+// and reports operations per second and heap allocations per operation, for every size in g_sizes.
+//
+// Usage: skizo_microbench [filter] -- runs only benchmarks whose names contain the filter.
+// ****************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "src/Application.h"
+#include "src/ArrayList.h"
+#include "src/BumpPointerAllocator.h"
+#include "src/HashMap.h"
+#include "src/init.h"
+#include "src/LinkedList.h"
+#include "src/PoolAllocator.h"
+#include "src/Queue.h"
+#include "src/String.h"
+#include "src/TextBuilder.h"
+
+using namespace skizo::core;
+using namespace skizo::collections;
+using namespace skizo::script;
+
+#define SKIZO_MICROBENCH_MIN_TIME 200000
+
+// *************************
+//   Allocation counting.
+// *************************
+
+// The harness is single-threaded.
+static so_long g_allocationCount = 0;
+
+#if defined(__GLIBC__)
+
+// Most of the runtime allocates with malloc directly (strings, pools, arenas), so on glibc the whole malloc
+// family is interposed. Operator new ends up here as well.
+extern "C" {
+    void* __libc_malloc(size_t sz);
+    void* __libc_calloc(size_t count, size_t sz);
+    void* __libc_realloc(void* ptr, size_t sz);
+
+    void* malloc(size_t sz)
+    {
+        g_allocationCount++;
+        return __libc_malloc(sz);
+    }
+
+    void* calloc(size_t count, size_t sz)
+    {
+        g_allocationCount++;
+        return __libc_calloc(count, sz);
+    }
+
+    void* realloc(void* ptr, size_t sz)
+    {
+        g_allocationCount++;
+        return __libc_realloc(ptr, sz);
+    }
+}
+
+#else
+
+// Elsewhere, only operator new is counted.
+void* operator new(size_t sz)
+{
+    g_allocationCount++;
+    void* r = malloc(sz? sz: 1);
+    if(!r) {
+        throw std::bad_alloc();
+    }
+    return r;
+}
+
+void* operator new[](size_t sz)
+{
+    return operator new(sz);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+#endif
+
+// *************
+//   Harness.
+// *************
+
+// Results are accumulated here, so that the compiler couldn't throw away the measured code.
+static volatile int g_sink = 0;
+
+/**
+ * Measures the part of a benchmark call between Start() and Stop(), accumulated over calls.
+ */
+struct SMicroTimer
+{
+    so_long ElapsedUs;
+    so_long Allocations;
+
+    SMicroTimer()
+        : ElapsedUs(0),
+          Allocations(0),
+          m_startTime(0),
+          m_startAllocations(0)
+    {
+    }
+
+    void Start()
+    {
+        m_startAllocations = g_allocationCount;
+        m_startTime = Application::MicroTickCount();
+    }
+
+    void Stop()
+    {
+        ElapsedUs += Application::MicroTickCount() - m_startTime;
+        Allocations += g_allocationCount - m_startAllocations;
+    }
+
+private:
+    so_long m_startTime;
+    so_long m_startAllocations;
+};
+
+typedef void (*FMicroBenchmark)(SMicroTimer& timer, int size);
+
+struct SMicroBenchmark
+{
+    const char* Name;
+    FMicroBenchmark Func;
+};
+
+static const int g_sizes[] = { 16, 1024, 65536 };
+
+// ****************
+//   CArrayList
+// ****************
+
+static void benchArrayListAdd(SMicroTimer& timer, int size)
+{
+    Auto<CArrayList<int> > list (new CArrayList<int>());
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        list->Add(i);
+    }
+    timer.Stop();
+
+    g_sink += list->Count();
+}
+
+static void benchArrayListItem(SMicroTimer& timer, int size)
+{
+    Auto<CArrayList<int> > list (new CArrayList<int>());
+    for(int i = 0; i < size; i++) {
+        list->Add(i);
+    }
+
+    int sum = 0;
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        sum += list->Item(i);
+    }
+    timer.Stop();
+
+    g_sink += sum;
+}
+
+static void benchArrayListRemove(SMicroTimer& timer, int size)
+{
+    Auto<CArrayList<int> > list (new CArrayList<int>());
+    for(int i = 0; i < size; i++) {
+        list->Add(i);
+    }
+
+    // From the end, as CArrayList::RemoveAt(0) is O(n).
+    timer.Start();
+    for(int i = size - 1; i >= 0; i--) {
+        list->RemoveAt(i);
+    }
+    timer.Stop();
+
+    g_sink += list->Count();
+}
+
+// **************
+//   CHashMap
+// **************
+
+static void benchHashMapSet(SMicroTimer& timer, int size)
+{
+    Auto<CHashMap<int, int> > map (new CHashMap<int, int>());
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        map->Set(i, i);
+    }
+    timer.Stop();
+
+    g_sink += map->Size();
+}
+
+static void benchHashMapTryGet(SMicroTimer& timer, int size)
+{
+    Auto<CHashMap<int, int> > map (new CHashMap<int, int>());
+    for(int i = 0; i < size; i++) {
+        map->Set(i, i);
+    }
+
+    int sum = 0;
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        int value;
+        if(map->TryGet(i, &value)) {
+            sum += value;
+        }
+    }
+    timer.Stop();
+
+    g_sink += sum;
+}
+
+static void benchHashMapTryGetString(SMicroTimer& timer, int size)
+{
+    Auto<CHashMap<const CString*, int> > map (new CHashMap<const CString*, int>());
+    Auto<CArrayList<const CString*> > keys (new CArrayList<const CString*>());
+    for(int i = 0; i < size; i++) {
+        char buf[32];
+        sprintf(buf, "key%d", i);
+        Auto<const CString> key (CString::FromASCII(buf));
+        keys->Add(key);
+        map->Set(key, i);
+    }
+
+    int sum = 0;
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        int value;
+        if(map->TryGet(keys->Array()[i], &value)) {
+            sum += value;
+        }
+    }
+    timer.Stop();
+
+    g_sink += sum;
+}
+
+static void benchHashMapRemove(SMicroTimer& timer, int size)
+{
+    Auto<CHashMap<int, int> > map (new CHashMap<int, int>());
+    for(int i = 0; i < size; i++) {
+        map->Set(i, i);
+    }
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        map->Remove(i);
+    }
+    timer.Stop();
+
+    g_sink += map->Size();
+}
+
+// ************
+//   CQueue
+// ************
+
+static void benchQueue(SMicroTimer& timer, int size)
+{
+    Auto<CQueue<int> > queue (new CQueue<int>());
+
+    // Half of the operations are enqueues, the other half are dequeues.
+    timer.Start();
+    for(int i = 0; i < size / 2; i++) {
+        queue->Enqueue(i);
+    }
+    int sum = 0;
+    for(int i = 0; i < size / 2; i++) {
+        sum += queue->Dequeue();
+    }
+    timer.Stop();
+
+    g_sink += sum;
+}
+
+// *****************
+//   CLinkedList
+// *****************
+
+static void benchLinkedList(SMicroTimer& timer, int size)
+{
+    Auto<CLinkedList<int> > list (new CLinkedList<int>());
+
+    // Half of the operations are additions, the other half are removals of the first node.
+    timer.Start();
+    for(int i = 0; i < size / 2; i++) {
+        list->Add(i);
+    }
+    for(int i = 0; i < size / 2; i++) {
+        list->Remove(list->FirstNode());
+    }
+    timer.Stop();
+
+    g_sink += list->Count();
+}
+
+// ****************
+//   Allocators.
+// ****************
+
+static void benchPoolAllocator(SMicroTimer& timer, int size)
+{
+    SPoolAllocator allocator;
+    void** ptrs = new void*[size / 2];
+
+    // Half of the operations are allocations of GC-object-sized blocks, the other half frees them.
+    timer.Start();
+    for(int i = 0; i < size / 2; i++) {
+        ptrs[i] = allocator.Allocate(16 + (i % 4) * 8);
+    }
+    for(int i = 0; i < size / 2; i++) {
+        allocator.Free(ptrs[i]);
+    }
+    timer.Stop();
+
+    g_sink += allocator.GetObjectCount();
+    delete [] ptrs;
+}
+
+static void benchBumpPointerAllocator(SMicroTimer& timer, int size)
+{
+    SBumpPointerAllocator allocator;
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        void* ptr = allocator.Allocate(16 + (i % 4) * 8, E_SKIZOALLOCATIONTYPE_EXPRESSION);
+        g_sink += (int)(size_t)ptr;
+    }
+    timer.Stop();
+}
+
+// *************
+//   CString
+// *************
+
+static void benchStringFromUtf8(SMicroTimer& timer, int size)
+{
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        Auto<const CString> str (CString::FromUtf8("Hello, World! \xC3\xA9t\xC3\xA9"));
+        g_sink += str->Length();
+    }
+    timer.Stop();
+}
+
+static void benchStringConcat(SMicroTimer& timer, int size)
+{
+    Auto<const CString> a (CString::FromASCII("Hello, "));
+    Auto<const CString> b (CString::FromASCII("World"));
+    Auto<const CString> c (CString::FromASCII("!"));
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        Auto<const CString> str (a->Concat(b, c));
+        g_sink += str->Length();
+    }
+    timer.Stop();
+}
+
+static void benchStringEqualsHashCode(SMicroTimer& timer, int size)
+{
+    Auto<const CString> a (CString::FromASCII("_soX_vtbl_SomeLongClassName"));
+    Auto<const CString> b (CString::FromASCII("_soX_vtbl_SomeLongClassName"));
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        g_sink += a->Equals(b) + b->GetHashCode();
+    }
+    timer.Stop();
+}
+
+static void benchStringFindSubstring(SMicroTimer& timer, int size)
+{
+    Auto<const CString> str (CString::FromASCII("The quick brown fox jumps over the lazy dog"));
+    Auto<const CString> substr (CString::FromASCII("lazy"));
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        g_sink += str->FindSubstring(substr);
+    }
+    timer.Stop();
+}
+
+static void benchStringSplit(SMicroTimer& timer, int size)
+{
+    Auto<const CString> str (CString::FromASCII("alpha;beta;gamma;delta"));
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        Auto<CArrayList<const CString*> > parts (str->Split(SKIZO_CHAR(';')));
+        g_sink += parts->Count();
+    }
+    timer.Stop();
+}
+
+// ******************
+//   STextBuilder
+// ******************
+
+static void benchTextBuilderEmit(SMicroTimer& timer, int size)
+{
+    STextBuilder cb;
+
+    timer.Start();
+    for(int i = 0; i < size; i++) {
+        cb.Emit("_soX_pushframe((void*)%p, %d); /* %S */\n", (void*)&cb, i, "method");
+    }
+    timer.Stop();
+
+    g_sink += (int)strlen(cb.Chars());
+}
+
+// **********
+//   Main
+// **********
+
+static const SMicroBenchmark g_benchmarks[] = {
+    { "arraylist_add", benchArrayListAdd },
+    { "arraylist_item", benchArrayListItem },
+    { "arraylist_remove", benchArrayListRemove },
+    { "hashmap_set", benchHashMapSet },
+    { "hashmap_tryget", benchHashMapTryGet },
+    { "hashmap_tryget_string", benchHashMapTryGetString },
+    { "hashmap_remove", benchHashMapRemove },
+    { "queue_enqueue_dequeue", benchQueue },
+    { "linkedlist_add_remove", benchLinkedList },
+    { "poolallocator_alloc_free", benchPoolAllocator },
+    { "bumppointer_alloc", benchBumpPointerAllocator },
+    { "string_fromutf8", benchStringFromUtf8 },
+    { "string_concat", benchStringConcat },
+    { "string_equals_hashcode", benchStringEqualsHashCode },
+    { "string_findsubstring", benchStringFindSubstring },
+    { "string_split", benchStringSplit },
+    { "textbuilder_emit", benchTextBuilderEmit }
+};
+
+static void runMicroBenchmark(const SMicroBenchmark& benchmark, int size)
+{
+    // Warms up caches and the allocators.
+    {
+        SMicroTimer warmupTimer;
+        benchmark.Func(warmupTimer, size);
+    }
+
+    SMicroTimer timer;
+    so_long ops = 0;
+    do {
+        benchmark.Func(timer, size);
+        ops += size;
+    } while(timer.ElapsedUs < SKIZO_MICROBENCH_MIN_TIME);
+
+    printf("%-28s %8d %16.0f %12.3f\n",
+            benchmark.Name,
+            size,
+            (double)ops * 1000000.0 / (double)timer.ElapsedUs,
+            (double)timer.Allocations / (double)ops);
+}
+
+int main(int argc, char **argv)
+{
+    InitSkizo();
+
+    const char* filter = argc > 1? argv[1]: nullptr;
+
+    printf("%-28s %8s %16s %12s\n", "benchmark", "size", "ops/sec", "allocs/op");
+    for(size_t i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); i++) {
+        if(filter && !strstr(g_benchmarks[i].Name, filter)) {
+            continue;
+        }
+
+        for(size_t j = 0; j < sizeof(g_sizes) / sizeof(g_sizes[0]); j++) {
+            runMicroBenchmark(g_benchmarks[i], g_sizes[j]);
+        }
+    }
+
+    DeinitSkizo();
+    return 0;
+}
@@ -126,6 +126,17 @@ so_long GetMemoryUsage();
  */
 so_long TickCount();
 
+/**
+ * Same as ::TickCount(), but in microseconds, using the most precise clock available.
+ * Used to profile the startup.
+ */
+so_long MicroTickCount();
+
+/**
+ * Same as ::MicroTickCount(), but in nanoseconds. Used by the instrumented profiler.
+ */
+so_long NanoTickCount();
+
 /**
  * Returns platform-specific strings.
  */
@@ -0,0 +1,199 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "BreakpointPatcher.h"
+#include "ArrayList.h"
+#include "Contract.h"
+#include "Method.h"
+#include "ModuleDesc.h"
+#include "String.h"
+#include "third-party/tcc/libtcc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// "nopl 0x0(%eax,%eax,1)", the recommended 8-byte NOP. Should be synchronized with the emitter.
+static const so_byte g_nop8[8] = { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+struct SPatchPoint
+{
+    const CMethod* Method;
+    int LineNumber;
+
+    so_byte* Site;  // the NOP, null if not resolved
+    void* Handler;  // the cold block
+    bool IsSet;
+
+    SPatchPoint(const CMethod* method, int lineNumber)
+        : Method(method),
+          LineNumber(lineNumber),
+          Site(nullptr),
+          Handler(nullptr),
+          IsSet(false)
+    {
+    }
+};
+
+struct BreakpointPatcherPrivate
+{
+    // Indexed by the ids of patch points.
+    Auto<CArrayList<SPatchPoint*> > m_patchPoints;
+
+    BreakpointPatcherPrivate()
+        : m_patchPoints(new CArrayList<SPatchPoint*>())
+    {
+    }
+
+    ~BreakpointPatcherPrivate()
+    {
+        for(int i = 0; i < m_patchPoints->Count(); i++) {
+            delete m_patchPoints->Array()[i];
+        }
+    }
+
+    // NOTE TCC makes the pages of relocated code writable as well (see set_pages_executable(..) in tccrun.c),
+    // so they can be patched in place. The site is a single aligned 8-byte instruction replaced by a single
+    // atomic store (like in SThunkManager::PatchFunctionEntry(..)): another thread which runs the code either
+    // hasn't started executing it yet or is already past it, so it never sees a partially patched instruction.
+    void patch(SPatchPoint* patchPoint, bool set)
+    {
+        so_byte code[8];
+        if(set) {
+            code[0] = 0xE9; // jmp rel32
+            const int rel = (int)((char*)patchPoint->Handler - (char*)(patchPoint->Site + 5));
+            memcpy(&code[1], &rel, sizeof(int));
+            code[5] = code[6] = code[7] = 0xCC; // never reached
+        } else {
+            memcpy(code, g_nop8, sizeof(g_nop8));
+        }
+
+        so_long value;
+        memcpy(&value, code, sizeof(value));
+        __atomic_store_n((so_long*)patchPoint->Site, value, __ATOMIC_SEQ_CST);
+
+        patchPoint->IsSet = set;
+    }
+};
+
+static bool isPathSeparator(so_char16 c)
+{
+    return c == SKIZO_CHAR('/') || c == SKIZO_CHAR('\\');
+}
+
+static bool matchesModulePath(const CString* modulePath, const CString* filePath)
+{
+    if(modulePath->Equals(filePath)) {
+        return true;
+    }
+
+    const int offset = modulePath->Length() - filePath->Length();
+    return offset > 0
+        && isPathSeparator(modulePath->Chars()[offset - 1])
+        && modulePath->EndsWith(filePath);
+}
+
+SBreakpointPatcher::SBreakpointPatcher()
+    : p(nullptr)
+{
+}
+
+SBreakpointPatcher::~SBreakpointPatcher()
+{
+    delete p;
+}
+
+void SBreakpointPatcher::Enable()
+{
+    if(!p) {
+        p = new BreakpointPatcherPrivate();
+    }
+}
+
+int SBreakpointPatcher::AddPatchPoint(const CMethod* method, int lineNumber)
+{
+    SKIZO_REQ_PTR(p);
+    SKIZO_REQ_PTR(method);
+
+    p->m_patchPoints->Add(new SPatchPoint(method, lineNumber));
+    return p->m_patchPoints->Count() - 1;
+}
+
+void SBreakpointPatcher::Resolve(TCCState* tccState)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ_PTR(tccState);
+
+    char name[32];
+    for(int i = 0; i < p->m_patchPoints->Count(); i++) {
+        SPatchPoint* patchPoint = p->m_patchPoints->Array()[i];
+
+        sprintf(name, "_soX_bp%d", i);
+        so_byte* site = (so_byte*)tcc_get_symbol(tccState, name);
+        sprintf(name, "_soX_bpx%d", i);
+        void* handler = tcc_get_symbol(tccState, name);
+
+        // Just in case: the breakpoint is never set if the emitted code doesn't look like what we expect.
+        if(site && handler && ((size_t)site & 7) == 0 && memcmp(site, g_nop8, sizeof(g_nop8)) == 0) {
+            patchPoint->Site = site;
+            patchPoint->Handler = handler;
+        }
+    }
+}
+
+int SBreakpointPatcher::SetBreakpoint(const CString* filePath, int lineNumber, bool enable)
+{
+    SKIZO_REQ_PTR(filePath);
+    if(!p) {
+        return 0;
+    }
+
+    int r = 0;
+    for(int i = 0; i < p->m_patchPoints->Count(); i++) {
+        SPatchPoint* patchPoint = p->m_patchPoints->Array()[i];
+        if(!patchPoint->Site || patchPoint->LineNumber != lineNumber) {
+            continue;
+        }
+
+        const CModuleDesc* module = patchPoint->Method->Source().Module;
+        if(!module || !module->FilePath || !matchesModulePath(module->FilePath, filePath)) {
+            continue;
+        }
+
+        if(patchPoint->IsSet != enable) {
+            p->patch(patchPoint, enable);
+        }
+        r++;
+    }
+
+    return r;
+}
+
+const CMethod* SBreakpointPatcher::MethodOf(int patchPointId) const
+{
+    SKIZO_REQ_PTR(p);
+    return p->m_patchPoints->Item(patchPointId)->Method;
+}
+
+int SBreakpointPatcher::LineNumberOf(int patchPointId) const
+{
+    SKIZO_REQ_PTR(p);
+    return p->m_patchPoints->Item(patchPointId)->LineNumber;
+}
+
+} }
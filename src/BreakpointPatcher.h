@@ -0,0 +1,82 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef BREAKPOINTPATCHER_H_INCLUDED
+#define BREAKPOINTPATCHER_H_INCLUDED
+
+#include "basedefs.h"
+
+struct TCCState;
+
+namespace skizo { namespace core {
+    class CString;
+} }
+
+namespace skizo { namespace script {
+
+class CMethod;
+
+/**
+ * Breakpoints which cost nothing until they're set. Unlike "break" statements, which register locals at runtime
+ * (see _soX_reglocals), the emitter places a patch point before every statement: an aligned 8-byte NOP in the machine
+ * code (labeled "_soX_bp<id>") and, out of the normal flow at the end of the function, a cold block ("_soX_bpx<id>")
+ * which collects references to the locals and calls _soX_breakat(..) before jumping back. Setting a breakpoint
+ * overwrites the NOP with a jump to the cold block, clearing it restores the NOP.
+ *
+ * Patch points are resolved in the relocated TCC state, so the mode is incompatible with lazy compilation. The cold
+ * blocks rely on TCC keeping locals on the stack and no values in registers between statements, so the domain isn't
+ * created with the native compiler (see CDomain::CreateDomain). x86 only, as is the rest of the backend.
+ * Sites are patched atomically, so breakpoints can be set while other threads run the code, although they're
+ * normally set on the domain's thread (from a breakpoint callback, for example) or before the entrypoint is invoked.
+ *
+ * See SDomainCreation::PatchableBreakpoints
+ * To be embedded into CDomain.
+ */
+struct SBreakpointPatcher
+{
+public:
+    SBreakpointPatcher();
+    ~SBreakpointPatcher();
+
+    void Enable();
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * Registers a patch point for a statement of the method. To be called by the emitter.
+     * @return the id of the patch point, which the emitter uses in the labels
+     */
+    int AddPatchPoint(const CMethod* method, int lineNumber);
+
+    /**
+     * Finds the addresses of the patch points. To be called after the state is relocated.
+     */
+    void Resolve(TCCState* tccState);
+
+    /**
+     * Sets or clears breakpoints at every patch point of the given line.
+     * The file path is matched against file paths of modules either fully, or by its trailing path components
+     * ("main.skizo" matches "tests/main.skizo").
+     * @return the number of patch points affected; 0 if nothing was found.
+     */
+    int SetBreakpoint(const skizo::core::CString* filePath, int lineNumber, bool enable);
+
+    const CMethod* MethodOf(int patchPointId) const;
+    int LineNumberOf(int patchPointId) const;
+
+private:
+    struct BreakpointPatcherPrivate* p;
+};
+
+} }
+
+#endif // BREAKPOINTPATCHER_H_INCLUDED
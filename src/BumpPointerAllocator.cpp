@@ -57,6 +57,7 @@ void SBumpPointerAllocator::initBase(CBumpPointerPageAllocator* pageAllocator, i
 
     for(int i = 0; i < E_SKIZOALLOCATIONTYPE_COUNT_DONT_USE; i++) {
         m_memoryByAllocationType[i] = 0;
+        m_countByAllocationType[i] = 0;
     }
 
     addPage(); // adds the first page
@@ -105,6 +106,7 @@ void* SBumpPointerAllocator::Allocate(int sizeRequest, ESkizoAllocationType allo
 
     if(m_profilingEnabled) {
         m_memoryByAllocationType[allocType] += sz;
+        m_countByAllocationType[allocType]++;
     }
 
     if((m_lastPage->Size + sz) >= (SKIZO_ALLOCATOR_PAGE - (int)sizeof(SBumpPointerAllocatorPage))) {
@@ -127,4 +129,10 @@ size_t SBumpPointerAllocator::GetMemoryByAllocationType(ESkizoAllocationType all
     return m_memoryByAllocationType[allocType];
 }
 
+int SBumpPointerAllocator::GetCountByAllocationType(ESkizoAllocationType allocType) const
+{
+    SKIZO_REQ_RANGE_D(allocType, (ESkizoAllocationType)0, E_SKIZOALLOCATIONTYPE_COUNT_DONT_USE);
+    return m_countByAllocationType[allocType];
+}
+
 } }
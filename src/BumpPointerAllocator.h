@@ -72,6 +72,11 @@ public:
      */
     size_t GetMemoryByAllocationType(ESkizoAllocationType allocType) const;
 
+    /**
+     * Returns the number of allocations of a particular allocation type (for example, the number of expressions).
+     */
+    int GetCountByAllocationType(ESkizoAllocationType allocType) const;
+
 private:
     void initBase(CBumpPointerPageAllocator* pageAllocator, int alignment);
 
@@ -83,6 +88,7 @@ private:
 
     bool m_profilingEnabled;
     size_t m_memoryByAllocationType[E_SKIZOALLOCATIONTYPE_COUNT_DONT_USE];
+    int m_countByAllocationType[E_SKIZOALLOCATIONTYPE_COUNT_DONT_USE];
 
     void addPage();
 };
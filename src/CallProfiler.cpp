@@ -0,0 +1,124 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "CallProfiler.h"
+#include "Application.h"
+#include "Domain.h"
+#include "Method.h"
+
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+
+SCallProfiler::SCallProfiler(CDomain* domain)
+    : m_domain(domain),
+      m_frames(nullptr),
+      m_count(0),
+      m_cap(0)
+{
+}
+
+SCallProfiler::~SCallProfiler()
+{
+    delete [] m_frames;
+}
+
+SCallEdge* SCallProfiler::findEdge(CMethod* caller, CMethod* callee)
+{
+    SMethodProfile& callerProfile = caller->Profile();
+
+    SCallEdge* prev = nullptr;
+    for(SCallEdge* edge = callerProfile.Callees; edge; edge = edge->Next) {
+        if(edge->Callee == callee) {
+            // Moves the edge to the front: a caller usually calls the same callee many times in a row (loops).
+            if(prev) {
+                prev->Next = edge->Next;
+                edge->Next = callerProfile.Callees;
+                callerProfile.Callees = edge;
+            }
+            return edge;
+        }
+        prev = edge;
+    }
+
+    SCallEdge* edge = (SCallEdge*)m_domain->MemoryManager().BumpPointerAllocator().Allocate(sizeof(SCallEdge), E_SKIZOALLOCATIONTYPE_MEMBER);
+    edge->Callee = callee;
+    edge->NumberOfCalls = 0;
+    edge->TotalTimeInNs = 0;
+    edge->Next = callerProfile.Callees;
+    callerProfile.Callees = edge;
+    return edge;
+}
+
+void SCallProfiler::unwindTo(int depth, so_long now)
+{
+    while(m_count > depth) {
+        const SCallProfilerFrame& frame = m_frames[--m_count];
+        const so_long elapsed = now - frame.StartTime;
+
+        SMethodProfile& profile = frame.Method->Profile();
+        profile.SelfTimeInNs += elapsed - frame.ChildTimeInNs;
+        if(--profile.ActivationCount == 0) {
+            profile.TotalTimeInNs += elapsed;
+        }
+
+        if(frame.Edge) {
+            frame.Edge->TotalTimeInNs += elapsed;
+        }
+        if(m_count > 0) {
+            m_frames[m_count - 1].ChildTimeInNs += elapsed;
+        }
+    }
+}
+
+void SCallProfiler::Enter(CMethod* method, int depth)
+{
+    const so_long now = Application::NanoTickCount();
+    unwindTo(depth, now);
+
+    if(m_count == m_cap) {
+        const int newCap = m_cap? m_cap * 2: 64;
+        SCallProfilerFrame* newFrames = new SCallProfilerFrame[newCap];
+        if(m_frames) {
+            memcpy(newFrames, m_frames, m_count * sizeof(SCallProfilerFrame));
+            delete [] m_frames;
+        }
+        m_frames = newFrames;
+        m_cap = newCap;
+    }
+
+    SCallEdge* edge = nullptr;
+    if(m_count > 0) {
+        edge = findEdge(m_frames[m_count - 1].Method, method);
+        edge->NumberOfCalls++;
+    }
+
+    SMethodProfile& profile = method->Profile();
+    profile.NumberOfCalls++;
+    profile.ActivationCount++;
+
+    SCallProfilerFrame& frame = m_frames[m_count++];
+    frame.Method = method;
+    frame.Edge = edge;
+    frame.ChildTimeInNs = 0;
+    // Read last, so that the bookkeeping above isn't attributed to the method.
+    frame.StartTime = Application::NanoTickCount();
+}
+
+void SCallProfiler::Leave(int depth)
+{
+    unwindTo(depth, Application::NanoTickCount());
+}
+
+} }
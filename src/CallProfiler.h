@@ -0,0 +1,126 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef CALLPROFILER_H_INCLUDED
+#define CALLPROFILER_H_INCLUDED
+
+#include "basedefs.h"
+
+namespace skizo { namespace script {
+
+class CMethod;
+
+/**
+ * Calls from one method to another, as seen by the instrumented profiler.
+ * Allocated with the domain's bump pointer allocator, so they live as long as the domain.
+ */
+struct SCallEdge
+{
+    CMethod* Callee;
+    so_long NumberOfCalls;
+
+    /**
+     * Time spent in the callee (including its own callees) when called from this caller.
+     */
+    so_long TotalTimeInNs;
+
+    /**
+     * The next callee of the same caller.
+     */
+    SCallEdge* Next;
+};
+
+/**
+ * Per-method data collected by the instrumented profiler (see SDomainCreation::ProfilingEnabled)
+ * Embedded into CMethod.
+ */
+struct SMethodProfile
+{
+    so_long NumberOfCalls;
+
+    /**
+     * Time spent in the method, including its callees. For recursive methods, only the outermost activation is
+     * accounted for, so that time isn't counted twice.
+     */
+    so_long TotalTimeInNs;
+
+    /**
+     * Time spent in the method itself, excluding its callees.
+     */
+    so_long SelfTimeInNs;
+
+    /**
+     * The number of activations of the method currently on the stack.
+     */
+    int ActivationCount;
+
+    /**
+     * The methods this method called (a linked list, the most recently called callee first).
+     */
+    SCallEdge* Callees;
+
+    SMethodProfile()
+        : NumberOfCalls(0),
+          TotalTimeInNs(0),
+          SelfTimeInNs(0),
+          ActivationCount(0),
+          Callees(nullptr)
+    {
+    }
+};
+
+/**
+ * The instrumented profiler's own stack of frames, updated by _soX_pushframe_prf/_soX_popframe_prf along with
+ * the domain's shadow stack. Timestamps come from Application::NanoTickCount().
+ * The domain's shadow stack can be unwound without calling _soX_popframe_prf (domain aborts, see SVirtualUnwinder),
+ * so every call passes the current depth of the domain's shadow stack (see SStackFrame::Depth), and frames deeper
+ * than that are closed before anything else is done.
+ *
+ * To be embedded into CDomain.
+ */
+struct SCallProfiler
+{
+public:
+    SCallProfiler(class CDomain* domain);
+    ~SCallProfiler();
+
+    /**
+     * @param depth the depth of the domain's shadow stack before the method's frame was pushed
+     */
+    void Enter(CMethod* method, int depth);
+
+    /**
+     * @param depth the depth of the domain's shadow stack after the method's frame was popped
+     */
+    void Leave(int depth);
+
+private:
+    struct SCallProfilerFrame
+    {
+        CMethod* Method;
+        SCallEdge* Edge; // null for the outermost frame
+        so_long StartTime;
+        so_long ChildTimeInNs;
+    };
+
+    class CDomain* m_domain;
+    SCallProfilerFrame* m_frames;
+    int m_count, m_cap;
+
+    void unwindTo(int depth, so_long now);
+    SCallEdge* findEdge(CMethod* caller, CMethod* callee);
+};
+
+} }
+
+#endif // CALLPROFILER_H_INCLUDED
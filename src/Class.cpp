@@ -54,6 +54,11 @@ CClass::CClass(class CDomain* declaringDomain)
       m_pRuntimeObj(nullptr),
       m_pvtbl(nullptr),
       m_invokeMethod(nullptr),
+      m_itable(nullptr),
+      m_display(nullptr),
+      m_depth(0),
+      m_interfaceId(-1),
+      m_interfaceBits(nullptr),
       m_instanceFields(new CArrayList<CField*>()),
       m_staticFields(new CArrayList<CField*>()),
       m_instanceCtors(new CArrayList<CMethod*>()),
@@ -979,6 +984,11 @@ bool CClass::Is(const CClass* other) const
     if(this == other) {
         return true;
     } else if(other->m_specialClass == E_SPECIALCLASS_INTERFACE) {
+        // Constant-time check (see CDomain::buildTypeTests()).
+        if(m_interfaceBits && other->m_interfaceId != -1) {
+            return (m_interfaceBits[other->m_interfaceId >> 5] >> (other->m_interfaceId & 31)) & 1;
+        }
+
         return this->DoesImplementInterface(other);
     } else {
         return this->IsSubclassOf(other);
@@ -989,6 +999,9 @@ bool CClass::IsSubclassOf(const CClass* other) const
 {
     if(this == other) {
         return false;
+    } else if(m_display && other->m_display) {
+        // Constant-time check (see CDomain::buildTypeTests()).
+        return other->m_depth < m_depth && m_display[other->m_depth] == other;
     } else {
         if(!this->m_baseClass.IsVoid()) {
             if(this->m_baseClass.ResolvedClass == other) {
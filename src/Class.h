@@ -57,6 +57,8 @@ typedef int EClassFlags;
 #define E_CLASSFLAGS_IS_INITIALIZED (1 << 9)
 // m_pvtbl isn't governed by TCC, get rid of it
 #define E_CLASSFLAGS_FREE_VTABLE (1 << 10)
+// Set by the dead code elimination pass; unreachable classes get no vtables and no method bodies.
+#define E_CLASSFLAGS_IS_REACHABLE (1 << 11)
 
 // *************
 //   For maps.
@@ -201,6 +203,7 @@ public:
     bool IsInferred() const { return m_flags & E_CLASSFLAGS_IS_INFERRED; }
     bool IsInitialized() const { return m_flags & E_CLASSFLAGS_IS_INITIALIZED; }
     bool FreeVTable() const { return m_flags & E_CLASSFLAGS_FREE_VTABLE; }
+    bool IsReachable() const { return m_flags & E_CLASSFLAGS_IS_REACHABLE; }
 
     /**
      * Tells if this class is an "Error" or one of its descendants.
@@ -307,6 +310,38 @@ public:
     void* TryGetMethodImplForInterfaceMethod(CMethod* intrfcMethod) const;
     void SetMethodImplForInterfaceMethod(CMethod* intrfcMethod, void* methodImpl);
 
+    /**
+     * Maps interface methods (by CMethod::ITableIndex()) to vtable indices of their implementations in this class,
+     * -1 if there's no implementation. Precomputed by CDomain::buildITables() for reachable classes which
+     * implement at least one interface; null otherwise.
+     * Used by _soX_findmethod(..)
+     */
+    const int* ITable() const { return m_itable; }
+    void SetITable(int* itable) { m_itable = itable; }
+
+    /**
+     * The class hierarchy display: ancestors of this class from the root down to the class itself
+     * (Display()[Depth()] == this). Precomputed by CDomain::buildTypeTests() for reachable classes; null otherwise.
+     * Used by CClass::Is(..)
+     */
+    const CClass* const* Display() const { return m_display; }
+    int Depth() const { return m_depth; }
+    void SetDisplay(const CClass** display, int depth) { m_display = display; m_depth = depth; }
+
+    /**
+     * A dense ID of a reachable interface, an index into CClass::InterfaceBits(); -1 for other classes.
+     */
+    int InterfaceId() const { return m_interfaceId; }
+    void SetInterfaceId(int id) { m_interfaceId = id; }
+
+    /**
+     * Bit N is set if this class implements the interface with the InterfaceId() equal to N. Precomputed by
+     * CDomain::buildTypeTests() for reachable classes; null otherwise.
+     * Used by CClass::Is(..)
+     */
+    const so_uint32* InterfaceBits() const { return m_interfaceBits; }
+    void SetInterfaceBits(so_uint32* bits) { m_interfaceBits = bits; }
+
     /**
      * The invoke method in method classes (faster access).
      */
@@ -577,6 +612,11 @@ private:
     void** m_pvtbl;
     CMethod* m_invokeMethod;
     skizo::core::Auto<skizo::collections::CHashMap<void*, void*> > m_pIntrfcMethodToImplPtr;
+    int* m_itable; // allocated by the bump pointer allocator
+    const CClass** m_display; // allocated by the bump pointer allocator
+    int m_depth;
+    int m_interfaceId;
+    so_uint32* m_interfaceBits; // allocated by the bump pointer allocator
 
     skizo::core::Auto<skizo::collections::CArrayList<CField*> > m_instanceFields;
     skizo::core::Auto<skizo::collections::CArrayList<CField*> > m_staticFields;
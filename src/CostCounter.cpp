@@ -0,0 +1,221 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "CostCounter.h"
+#include "ArrayList.h"
+#include "Class.h"
+#include "Contract.h"
+#include "HashMap.h"
+#include "Method.h"
+#include "String.h"
+#include "TextBuilder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// Helpers which do real work at runtime (allocations, method lookups, type tests, marshaling) and are called
+// from the emitted code. Helpers called once per class (vtable registration etc.) aren't interesting.
+static const char* const g_helperNames[] = {
+    "_soX_gc_alloc",
+    "_soX_gc_alloc_env",
+    "_soX_stackclosure",
+    "_soX_newarray",
+    "_soX_downcast",
+    "_soX_unbox",
+    "_soX_findmethod",
+    "_soX_findmethod2",
+    "_soX_icfind",
+    "_soX_is",
+    "_soX_biteq",
+    "_soX_zero",
+    "_soX_checktype",
+    "_soX_addhandler",
+    "_soX_msgsnd_sync",
+    "_soX_msgsnd_async",
+    "_soX_unpack"
+};
+
+#define SKIZO_COSTCOUNTER_HELPER_COUNT ((int)(sizeof(g_helperNames) / sizeof(g_helperNames[0])))
+
+struct CostCounterPrivate
+{
+    Auto<CHashMap<void*, SMethodCost*> > m_methodMap;
+    Auto<CArrayList<SMethodCost*> > m_methodList; // owns the counters
+    so_long m_helperCounters[SKIZO_COSTCOUNTER_HELPER_COUNT];
+
+    CostCounterPrivate()
+        : m_methodMap(new CHashMap<void*, SMethodCost*>()),
+          m_methodList(new CArrayList<SMethodCost*>())
+    {
+        memset(m_helperCounters, 0, sizeof(m_helperCounters));
+    }
+
+    ~CostCounterPrivate()
+    {
+        for(int i = 0; i < m_methodList->Count(); i++) {
+            delete m_methodList->Array()[i];
+        }
+    }
+};
+
+SCostCounter::SCostCounter()
+    : p(nullptr)
+{
+}
+
+SCostCounter::~SCostCounter()
+{
+    delete p;
+}
+
+void SCostCounter::Enable()
+{
+    if(!p) {
+        p = new CostCounterPrivate();
+    }
+}
+
+SMethodCost* SCostCounter::ForMethod(const CMethod* method)
+{
+    SKIZO_REQ_PTR(p);
+    SKIZO_REQ_PTR(method);
+
+    SMethodCost* methodCost;
+    if(!p->m_methodMap->TryGet((void*)method, &methodCost)) {
+        methodCost = new SMethodCost(method);
+        p->m_methodMap->Set((void*)method, methodCost);
+        p->m_methodList->Add(methodCost);
+    }
+
+    return methodCost;
+}
+
+int SCostCounter::HelperCount() const
+{
+    return SKIZO_COSTCOUNTER_HELPER_COUNT;
+}
+
+const char* SCostCounter::HelperName(int index) const
+{
+    SKIZO_REQ_RANGE_D(index, 0, SKIZO_COSTCOUNTER_HELPER_COUNT);
+    return g_helperNames[index];
+}
+
+so_long* SCostCounter::HelperCounter(int index)
+{
+    SKIZO_REQ_PTR(p);
+    SKIZO_REQ_RANGE_D(index, 0, SKIZO_COSTCOUNTER_HELPER_COUNT);
+    return &p->m_helperCounters[index];
+}
+
+so_long SCostCounter::TotalCost() const
+{
+    if(!p) {
+        return 0;
+    }
+
+    so_long r = 0;
+    for(int i = 0; i < p->m_methodList->Count(); i++) {
+        r += p->m_methodList->Array()[i]->Cost;
+    }
+    for(int i = 0; i < SKIZO_COSTCOUNTER_HELPER_COUNT; i++) {
+        r += p->m_helperCounters[i];
+    }
+
+    return r;
+}
+
+struct SMethodCostEntry
+{
+    const SMethodCost* MethodCost;
+    char* Name;
+};
+
+// By cost, then by the number of calls, then by name, so that the output is the same from run to run.
+static int cmpMethodCostEntries(SMethodCostEntry* entry1, SMethodCostEntry* entry2)
+{
+    if(entry1->MethodCost->Cost != entry2->MethodCost->Cost) {
+        return entry1->MethodCost->Cost < entry2->MethodCost->Cost? 1: -1;
+    }
+    if(entry1->MethodCost->Calls != entry2->MethodCost->Calls) {
+        return entry1->MethodCost->Calls < entry2->MethodCost->Calls? 1: -1;
+    }
+    return strcmp(entry1->Name, entry2->Name);
+}
+
+bool SCostCounter::Save(const char* path) const
+{
+    SKIZO_REQ_PTR(path);
+
+    if(!p) {
+        return false;
+    }
+
+    FILE* f = fopen(path, "w");
+    if(!f) {
+        printf("Failed to write the cost counts to '%s'.\n", path);
+        return false;
+    }
+
+    Auto<CArrayList<SMethodCostEntry*> > entries (new CArrayList<SMethodCostEntry*>());
+    for(int i = 0; i < p->m_methodList->Count(); i++) {
+        const SMethodCost* methodCost = p->m_methodList->Array()[i];
+        if(methodCost->Calls == 0 && methodCost->Cost == 0) {
+            continue;
+        }
+
+        STextBuilder cb;
+        cb.Emit("%C::%s", methodCost->Method->DeclaringClass(), &methodCost->Method->Name());
+
+        SMethodCostEntry* entry = new SMethodCostEntry();
+        entry->MethodCost = methodCost;
+        entry->Name = CString::CloneUtf8(cb.Chars());
+        entries->Add(entry);
+    }
+    entries->Sort(cmpMethodCostEntries);
+
+    fprintf(f, "{\n  \"totalCost\": %lld,\n  \"methods\": [\n", (long long)TotalCost());
+    for(int i = 0; i < entries->Count(); i++) {
+        const SMethodCostEntry* entry = entries->Array()[i];
+        fprintf(f, "    {\"name\": \"%s\", \"calls\": %lld, \"cost\": %lld}%s\n",
+                entry->Name,
+                (long long)entry->MethodCost->Calls,
+                (long long)entry->MethodCost->Cost,
+                i < entries->Count() - 1? ",": "");
+    }
+    fprintf(f, "  ],\n  \"helpers\": [\n");
+
+    bool isFirst = true;
+    for(int i = 0; i < SKIZO_COSTCOUNTER_HELPER_COUNT; i++) {
+        if(p->m_helperCounters[i]) {
+            fprintf(f, "%s    {\"name\": \"%s\", \"calls\": %lld}", isFirst? "": ",\n", g_helperNames[i], (long long)p->m_helperCounters[i]);
+            isFirst = false;
+        }
+    }
+    fprintf(f, "%s  ]\n}\n", isFirst? "": "\n");
+    fclose(f);
+
+    for(int i = 0; i < entries->Count(); i++) {
+        SMethodCostEntry* entry = entries->Array()[i];
+        CString::FreeUtf8(entry->Name);
+        delete entry;
+    }
+
+    return true;
+}
+
+} }
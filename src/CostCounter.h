@@ -0,0 +1,89 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef COSTCOUNTER_H_INCLUDED
+#define COSTCOUNTER_H_INCLUDED
+
+#include "basedefs.h"
+
+namespace skizo { namespace script {
+
+class CMethod;
+
+/**
+ * Counters of a single method. The emitter bakes their addresses into the code.
+ */
+struct SMethodCost
+{
+    const CMethod* Method;
+    so_long Calls;
+    so_long Cost; // of statements executed in the method itself, in abstract units
+
+    explicit SMethodCost(const CMethod* method)
+        : Method(method), Calls(0), Cost(0)
+    {
+    }
+};
+
+/**
+ * Deterministic cost accounting, independent of the hardware and the load of the machine: unlike timings,
+ * the counts are exactly the same from run to run, so that CI could catch performance regressions reliably.
+ *
+ * The emitted code increments a counter once per basic block (a run of statements up to an inlined condition
+ * or loop) by the sum of the weights of its statements, which depend on the kind of the statement (see the
+ * emitter) Calls of every method are counted in the prolog. Calls of runtime helpers (_soX_gc_alloc,
+ * _soX_findmethod, _soX_is etc.) from the emitted code are counted by macros which wrap the helpers.
+ * Inlined methods are attributed to their callers; the runtime and native code are not counted.
+ *
+ * See SDomainCreation::CostCountingEnabled
+ * To be embedded into CDomain.
+ */
+struct SCostCounter
+{
+public:
+    SCostCounter();
+    ~SCostCounter();
+
+    void Enable();
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * Returns the counters of the method, creating them on first use. To be called by the emitter.
+     */
+    SMethodCost* ForMethod(const CMethod* method);
+
+    /**
+     * Runtime helpers whose calls are counted, and their counters.
+     */
+    int HelperCount() const;
+    const char* HelperName(int index) const;
+    so_long* HelperCounter(int index);
+
+    /**
+     * Costs of all statements plus calls of all runtime helpers.
+     */
+    so_long TotalCost() const;
+
+    /**
+     * Writes every non-zero counter to the file as JSON: methods sorted by cost, then helpers.
+     * Prints an error to the console if the file can't be written.
+     */
+    bool Save(const char* path) const;
+
+private:
+    struct CostCounterPrivate* p;
+};
+
+} }
+
+#endif // COSTCOUNTER_H_INCLUDED
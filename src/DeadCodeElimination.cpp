@@ -0,0 +1,498 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "Domain.h"
+#include "ArrayInitializationType.h"
+#include "Const.h"
+#include "Contract.h"
+#include "CoreUtils.h"
+#include "Expression.h"
+#include "Local.h"
+#include "Method.h"
+#include "String.h"
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// The reachability analysis works on two levels:
+// * Classes. A reachable class gets all of its constructors, instance methods (including the destructor) and
+//   static constructors/destructors emitted, because they're referenced by the vtable or called by the runtime
+//   (virtual/interface dispatch, remoting, boxing, reflection thunks etc.)
+// * Static methods. They're emitted only if something reachable calls them.
+// Everything the runtime can look up by name at runtime (reflection, templates, snapshots, dependency injection)
+// is impossible to track statically, so if any of such classes are reachable, nothing is eliminated.
+// Classes and methods marked with the [preserve] attribute are always kept.
+
+// NOTE Must be kept in sync with the base module.
+static const char* g_reflectiveClasses[] = {
+    "Type", "Method", "Property", "Template", "Snapshot", "Domain"
+};
+
+static bool hasPreserveAttribute(const CArrayList<CAttribute*>* attrs)
+{
+    if(attrs) {
+        for(int i = 0; i < attrs->Count(); i++) {
+            if(attrs->Array()[i]->Name.EqualsAscii("preserve")) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+struct SDeadCodeEliminator
+{
+    CDomain* domain;
+
+    CArrayList<CClass*> classQueue;
+    CArrayList<CMethod*> methodQueue;
+
+    explicit SDeadCodeEliminator(CDomain* _domain)
+        : domain(_domain)
+    {
+    }
+
+    void markClass(CClass* klass)
+    {
+        if(klass && !klass->IsReachable()) {
+            klass->Flags() |= E_CLASSFLAGS_IS_REACHABLE;
+            classQueue.Add(klass);
+        }
+    }
+
+    void markType(const STypeRef& typeRef)
+    {
+        markClass(typeRef.ResolvedClass);
+    }
+
+    void markMethod(CMethod* method)
+    {
+        if(method && !method->IsReachable()) {
+            method->Flags() |= E_METHODFLAGS_IS_REACHABLE;
+            methodQueue.Add(method);
+            markClass(method->DeclaringClass());
+        }
+    }
+
+    void markMethods(const CArrayList<CMethod*>* methods)
+    {
+        for(int i = 0; i < methods->Count(); i++) {
+            markMethod(methods->Array()[i]);
+        }
+    }
+
+    void markFieldTypes(const CArrayList<CField*>* fields)
+    {
+        for(int i = 0; i < fields->Count(); i++) {
+            markType(fields->Array()[i]->Type);
+        }
+    }
+
+    void visitClass(CClass* klass)
+    {
+        markType(klass->BaseClass());
+        markType(klass->WrappedClass());
+        markFieldTypes(klass->InstanceFields());
+        markFieldTypes(klass->StaticFields());
+
+        markMethods(klass->InstanceCtors());
+        markMethods(klass->InstanceMethods());
+        markMethod(klass->InstanceDtor());
+        markMethod(klass->StaticCtor());
+        markMethod(klass->StaticDtor());
+
+        if(hasPreserveAttribute(klass->Attributes())) {
+            markMethods(klass->StaticMethods());
+        }
+    }
+
+    void visitMethod(CMethod* method)
+    {
+        const CSignature& sig = method->Signature();
+        markType(sig.ReturnType);
+        for(int i = 0; i < sig.Params->Count(); i++) {
+            markType(sig.Params->Array()[i]->Type);
+        }
+
+        if(method->Locals()) {
+            SHashMapEnumerator<SStringSlice, CLocal*> localsEnum (method->Locals());
+            CLocal* local;
+            while(localsEnum.MoveNext(nullptr, &local)) {
+                markType(local->Type);
+            }
+        }
+
+        // Allocated directly by the emitted code and described by the class's GC map.
+        markClass(method->ClosureEnvClass());
+
+        visitExpr(method->Expression());
+    }
+
+    void visitExprs(const CArrayList<CExpression*>* exprs)
+    {
+        for(int i = 0; i < exprs->Count(); i++) {
+            visitExpr(exprs->Array()[i]);
+        }
+    }
+
+    void visitExpr(const CExpression* expr);
+    void visitCCode(const SStringSlice& code);
+
+    void run(CMethod* entryPoint);
+    void keepEverything();
+};
+
+void SDeadCodeEliminator::visitExpr(const CExpression* expr)
+{
+    if(!expr) {
+        return;
+    }
+
+    markType(expr->InferredType);
+
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_BODY:
+        {
+            const CBodyExpression* bodyExpr = static_cast<const CBodyExpression*>(expr);
+
+            // Closures are visited as part of their generated classes.
+            if(bodyExpr->GeneratedClosureClass) {
+                markClass(bodyExpr->GeneratedClosureClass);
+            } else {
+                visitExprs(bodyExpr->Exprs);
+            }
+        }
+        break;
+
+        case E_EXPRESSIONKIND_CALL:
+        {
+            const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+            if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL) {
+                markMethod(callExpr->uTargetMethod);
+            } else if(callExpr->CallType == E_CALLEXPRESSION_CONSTACCESS) {
+                markType(callExpr->uTargetConst->Type);
+            }
+            visitExprs(callExpr->Exprs);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_IDENT:
+        {
+            const CIdentExpression* identExpr = static_cast<const CIdentExpression*>(expr);
+            markType(identExpr->TypeAsInCode);
+
+            const SResolvedIdentType& resolvedIdent = identExpr->ResolvedIdent;
+            switch(resolvedIdent.EType) {
+                case E_RESOLVEDIDENTTYPE_CLASS:
+                    markClass(resolvedIdent.AsClass_);
+                    break;
+                case E_RESOLVEDIDENTTYPE_FIELD:
+                    // Static fields are initialized by static constructors of their declaring classes.
+                    markClass(resolvedIdent.AsField_->DeclaringClass);
+                    break;
+                case E_RESOLVEDIDENTTYPE_METHOD:
+                    markMethod(resolvedIdent.AsMethod_);
+                    break;
+                default:
+                    break;
+            }
+        }
+        break;
+
+        case E_EXPRESSIONKIND_RETURN:
+            visitExpr(static_cast<const CReturnExpression*>(expr)->Expr);
+            break;
+
+        case E_EXPRESSIONKIND_CCODE:
+            visitCCode(static_cast<const CCCodeExpression*>(expr)->Code);
+            break;
+
+        case E_EXPRESSIONKIND_CAST:
+        {
+            const CCastExpression* castExpr = static_cast<const CCastExpression*>(expr);
+            if(castExpr->CastInfo.IsCastable && castExpr->CastInfo.CastType == E_CASTTYPE_BOX) {
+                // The emitter calls the boxed class's ctor directly (see SEmitter::emitCastExpr).
+                markClass(domain->BoxedClass(castExpr->Expr->InferredType, true));
+            }
+            visitExpr(castExpr->Expr);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_SIZEOF:
+            markType(static_cast<const CSizeofExpression*>(expr)->TargetType);
+            break;
+
+        case E_EXPRESSIONKIND_ARRAYCREATION:
+            visitExpr(static_cast<const CArrayCreationExpression*>(expr)->Expr);
+            break;
+
+        case E_EXPRESSIONKIND_ARRAYINIT:
+            visitExprs(static_cast<const CArrayInitExpression*>(expr)->Exprs);
+            break;
+
+        case E_EXPRESSIONKIND_IDENTITYCOMPARISON:
+        {
+            const CIdentityComparisonExpression* identCompExpr = static_cast<const CIdentityComparisonExpression*>(expr);
+            visitExpr(identCompExpr->Expr1);
+            visitExpr(identCompExpr->Expr2);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+        {
+            const CAssignmentExpression* assignExpr = static_cast<const CAssignmentExpression*>(expr);
+            visitExpr(assignExpr->Expr1);
+            visitExpr(assignExpr->Expr2);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_ABORT:
+            visitExpr(static_cast<const CAbortExpression*>(expr)->Expr);
+            break;
+
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+        {
+            const CInlinedConditionExpression* condExpr = static_cast<const CInlinedConditionExpression*>(expr);
+            visitExpr(condExpr->IfCondition);
+            visitExpr(condExpr->ElseCondition);
+            visitExpr(condExpr->Body);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+        {
+            const CInlinedLoopExpression* loopExpr = static_cast<const CInlinedLoopExpression*>(expr);
+            visitExpr(loopExpr->RangeExpr);
+            visitExpr(loopExpr->StepExpr);
+            visitExpr(loopExpr->Condition);
+            visitExpr(loopExpr->Body);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_IS:
+        {
+            const CIsExpression* isExpr = static_cast<const CIsExpression*>(expr);
+            markType(isExpr->TypeAsInCode);
+            visitExpr(isExpr->Expr);
+        }
+        break;
+
+        case E_EXPRESSIONKIND_ASSERT:
+            visitExpr(static_cast<const CAssertExpression*>(expr)->Expr);
+            break;
+
+        case E_EXPRESSIONKIND_REF:
+            visitExpr(static_cast<const CRefExpression*>(expr)->Expr);
+            break;
+
+        default:
+            // Constants, literals, "this", "break": nothing to visit.
+            break;
+    }
+}
+
+// Inline C code can refer to any function by its C name ("_so_ClassName_methodName"), so every such identifier
+// found in the code keeps the corresponding class (and the static method, if any) alive.
+void SDeadCodeEliminator::visitCCode(const SStringSlice& code)
+{
+    const so_char16* cs = code.String->Chars();
+
+    for(int i = code.Start; i + 4 <= code.End; i++) {
+        if(!(cs[i] == SKIZO_CHAR('_') && cs[i + 1] == SKIZO_CHAR('s') && cs[i + 2] == SKIZO_CHAR('o')
+          && cs[i + 3] == SKIZO_CHAR('_')))
+        {
+            continue;
+        }
+
+        const int nameStart = i + 4;
+        int nameEnd = nameStart;
+        while(nameEnd < code.End && (CoreUtils::IsLetter(cs[nameEnd]) || CoreUtils::IsDigit(cs[nameEnd]) || cs[nameEnd] == SKIZO_CHAR('_'))) {
+            nameEnd++;
+        }
+
+        // Class names can contain underscores, too: tries every split.
+        for(int j = nameStart + 1; j < nameEnd; j++) {
+            if(cs[j] != SKIZO_CHAR('_')) {
+                continue;
+            }
+
+            CClass* klass = domain->ClassByFlatName(SStringSlice(code.String, nameStart, j));
+            if(klass) {
+                markClass(klass);
+
+                CMethod* staticMethod = klass->MyMethod(SStringSlice(code.String, j + 1, nameEnd),
+                                                        true,
+                                                        E_METHODKIND_NORMAL);
+                if(staticMethod) {
+                    markMethod(staticMethod);
+                } else {
+                    markMethods(klass->StaticMethods());
+                }
+            }
+        }
+
+        i = nameEnd - 1;
+    }
+}
+
+void SDeadCodeEliminator::run(CMethod* entryPoint)
+{
+    const CArrayList<CClass*>* klasses = domain->Classes();
+
+    // ***********
+    //   Roots.
+    // ***********
+
+    markMethod(entryPoint);
+
+    for(int i = 0; i < klasses->Count(); i++) {
+        CClass* klass = klasses->Array()[i];
+
+        // Classes defined inside the runtime itself (string, int, Range etc.) are used by the runtime and by the
+        // emitter directly (for example, "int::to" is a C macro which calls "Range::create").
+        const bool isIntrinsic = !klass->Source().Module && !klass->IsCompilerGenerated();
+
+        // Static constructors/destructors can have side effects.
+        if(isIntrinsic || klass->StaticCtor() || klass->StaticDtor() || hasPreserveAttribute(klass->Attributes())) {
+            markClass(klass);
+        }
+        if(isIntrinsic) {
+            markMethods(klass->StaticMethods());
+        }
+
+        const CArrayList<CMethod*>* staticMethods = klass->StaticMethods();
+        for(int j = 0; j < staticMethods->Count(); j++) {
+            CMethod* staticMethod = staticMethods->Array()[j];
+            if(hasPreserveAttribute(staticMethod->Attributes())) {
+                markMethod(staticMethod);
+            }
+        }
+
+        const CArrayList<CMethod*>* instanceMethods = klass->InstanceMethods();
+        for(int j = 0; j < instanceMethods->Count(); j++) {
+            if(hasPreserveAttribute(instanceMethods->Array()[j]->Attributes())) {
+                markClass(klass);
+                break;
+            }
+        }
+    }
+
+    // Types listed in "force" statements are required by native code.
+    const CArrayList<CForcedTypeRef*>* forcedTypeRefs = domain->ForcedTypeRefs();
+    for(int i = 0; i < forcedTypeRefs->Count(); i++) {
+        markType(forcedTypeRefs->Array()[i]->TypeRef);
+    }
+
+    // The emitter emits helpers and server stubs for every entry in these registries.
+    {
+        CArrayInitializationType* initType;
+        SHashMapEnumerator<CArrayInitializationType*, int> mapEnum (domain->ArrayInitHelperRegistry());
+        while(mapEnum.MoveNext(&initType, nullptr)) {
+            markType(initType->ArrayType);
+        }
+    }
+    {
+        CClass* foreignProxyClass;
+        SHashMapEnumerator<SStringSlice, CClass*> mapEnum (domain->ForeignProxies());
+        while(mapEnum.MoveNext(nullptr, &foreignProxyClass)) {
+            markClass(foreignProxyClass);
+        }
+    }
+
+    // *****************
+    //   Propagation.
+    // *****************
+
+    while(classQueue.Count() || methodQueue.Count()) {
+        while(classQueue.Count()) {
+            CClass* klass = classQueue.Array()[classQueue.Count() - 1];
+            classQueue.RemoveAt(classQueue.Count() - 1);
+            visitClass(klass);
+        }
+
+        while(methodQueue.Count()) {
+            CMethod* method = methodQueue.Array()[methodQueue.Count() - 1];
+            methodQueue.RemoveAt(methodQueue.Count() - 1);
+            visitMethod(method);
+        }
+    }
+
+    // ***************
+    //   Reflection.
+    // ***************
+
+    for(size_t i = 0; i < sizeof(g_reflectiveClasses) / sizeof(g_reflectiveClasses[0]); i++) {
+        const CClass* klass = domain->ClassByFlatName(domain->NewSlice(g_reflectiveClasses[i]));
+        if(klass && klass->IsReachable()) {
+            keepEverything();
+            return;
+        }
+    }
+}
+
+void SDeadCodeEliminator::keepEverything()
+{
+    const CArrayList<CClass*>* klasses = domain->Classes();
+
+    for(int i = 0; i < klasses->Count(); i++) {
+        CClass* klass = klasses->Array()[i];
+        klass->Flags() |= E_CLASSFLAGS_IS_REACHABLE;
+
+        const CArrayList<CMethod*>* staticMethods = klass->StaticMethods();
+        for(int j = 0; j < staticMethods->Count(); j++) {
+            staticMethods->Array()[j]->Flags() |= E_METHODFLAGS_IS_REACHABLE;
+        }
+    }
+}
+
+void CDomain::eliminateDeadCode()
+{
+    SDeadCodeEliminator eliminator (this);
+
+    if(!m_deadCodeElimination) {
+        eliminator.keepEverything();
+        return;
+    }
+
+    // NOTE If the entrypoint isn't found, nothing is going to run anyway (see ::InvokeEntryPoint())
+    CMethod* entryPoint = nullptr;
+    {
+        Auto<const CString> epClassName, epMethodName;
+        getEntryPointNames(epClassName, epMethodName);
+
+        const CClass* epClass = this->ClassByNiceName(epClassName);
+        if(epClass) {
+            entryPoint = epClass->MyMethod(SStringSlice(epMethodName), true, E_METHODKIND_NORMAL);
+        }
+    }
+
+    eliminator.run(entryPoint);
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        const CClass* klass = m_klasses->Array()[i];
+        if(!klass->IsReachable()) {
+            m_deadClassCount++;
+        }
+
+        const CArrayList<CMethod*>* staticMethods = klass->StaticMethods();
+        for(int j = 0; j < staticMethods->Count(); j++) {
+            if(!staticMethods->Array()[j]->IsReachable()) {
+                m_deadMethodCount++;
+            }
+        }
+    }
+}
+
+} }
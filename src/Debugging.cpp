@@ -56,13 +56,13 @@ struct SDebuggerCommandDesc
 
 struct SDebuggerCommandContext
 {
-    const CDomain* Domain;
+    CDomain* Domain;
     const CArrayList<const CString*>* CmdArgs;
     const CLocalDebugInfoMap* DebugInfoMap;
     const class CDebuggerCommandList* CommandList;
 
     SDebuggerCommandContext(
-        const CDomain* domain,
+        CDomain* domain,
         const CArrayList<const CString*>* cmdArgs,
         const CLocalDebugInfoMap* debugInfoMap,
         const CDebuggerCommandList* cmdList
@@ -192,6 +192,28 @@ public:
     virtual const CString* Process(const SDebuggerCommandContext& context) const override;
 };
 
+class CSetBreakpointCommand: public CDebuggerCommand
+{
+public:
+    virtual SDebuggerCommandDesc GetDesc() const override
+    {
+        return SDebuggerCommandDesc("bp", 2, "$file$ $line$\tset a breakpoint (requires patchable breakpoints)");
+    }
+
+    virtual const CString* Process(const SDebuggerCommandContext& context) const override;
+};
+
+class CClearBreakpointCommand: public CDebuggerCommand
+{
+public:
+    virtual SDebuggerCommandDesc GetDesc() const override
+    {
+        return SDebuggerCommandDesc("bp-clear", 2, "$file$ $line$\tclear a breakpoint");
+    }
+
+    virtual const CString* Process(const SDebuggerCommandContext& context) const override;
+};
+
 class CHelpCommand: public CDebuggerCommand
 {
 public:
@@ -514,7 +536,7 @@ CProfilingInfo* CDomain::GetProfilingInfo() const
             if(member->MemberKind() == E_RUNTIMEOBJECTKIND_METHOD) {
                 CMethod* method = static_cast<CMethod*>(member);
 
-                if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE && (method->NumberOfCalls() != 0)) {
+                if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE && (method->Profile().NumberOfCalls != 0)) {
                     prfInfo->m_methods->Add(method);
                 }
             }
@@ -531,8 +553,19 @@ const CString* CDomain::GetStackTraceInfo() const
     if(m_stackTraceEnabled || m_profilingEnabled) {
         STextBuilder textBuilder;
 
-        for(int i = m_stackFrames->Count() - 1; i >= 0; i--) {
-            const CMethod* pMethod = (CMethod*)m_stackFrames->Item(i);
+        // After an abort, the shadow stack is already reset, and the frames come from the snapshot
+        // (see CDomain::abortImpl(..))
+        const SStackFrame* frame = m_topFrame;
+        const int abortFrameCount = frame? 0: m_abortFrames->Count();
+
+        for(int i = 0; frame || i < abortFrameCount; i++) {
+            const CMethod* pMethod;
+            if(frame) {
+                pMethod = frame->Method;
+                frame = frame->Prev;
+            } else {
+                pMethod = (CMethod*)m_abortFrames->Array()[i];
+            }
 
             if(pMethod->Source().Module) {
                 textBuilder.Emit("  at %C::%s (\"%o\":%d)\n",
@@ -646,13 +679,45 @@ const CString* CListInstancePropertiesCommand::Process(const SDebuggerCommandCon
     return nullptr;
 }
 
+static void processBreakpointCommand(const SDebuggerCommandContext& context, bool enable)
+{
+    const CArrayList<const CString*>* cmdArgs = context.CmdArgs;
+    SKIZO_REQ(cmdArgs->Count() >= 3, EC_ILLEGAL_ARGUMENT);
+    const CString* filePath = cmdArgs->Array()[1];
+
+    int lineNumber;
+    if(!cmdArgs->Array()[2]->TryParseInt(&lineNumber)) {
+        printf("Ill-formed line number.\n");
+        return;
+    }
+
+    CDomain* domain = context.Domain;
+    if(!domain->PatchableBreakpoints()) {
+        printf("Patchable breakpoints are disabled.\n");
+    } else if(!domain->SetBreakpoint(filePath, lineNumber, enable)) {
+        printf("No statement found at the line.\n");
+    }
+}
+
+const CString* CSetBreakpointCommand::Process(const SDebuggerCommandContext& context) const
+{
+    processBreakpointCommand(context, true);
+    return nullptr;
+}
+
+const CString* CClearBreakpointCommand::Process(const SDebuggerCommandContext& context) const
+{
+    processBreakpointCommand(context, false);
+    return nullptr;
+}
+
 const CString* CHelpCommand::Process(const SDebuggerCommandContext& context) const
 {
     context.CommandList->PrintHelp();
     return nullptr;
 }
 
-static void promptLoop(const CDomain* domain, const CLocalDebugInfoMap* debugInfoMap)
+static void promptLoop(CDomain* domain, const CLocalDebugInfoMap* debugInfoMap)
 {
     // ****************
     //   Prompt loop.
@@ -662,6 +727,8 @@ static void promptLoop(const CDomain* domain, const CLocalDebugInfoMap* debugInf
     cmdList->AddCommand<CContinueCommand>();
     cmdList->AddCommand<CShowInstancePropertyCommand>();
     cmdList->AddCommand<CListInstancePropertiesCommand>();
+    cmdList->AddCommand<CSetBreakpointCommand>();
+    cmdList->AddCommand<CClearBreakpointCommand>();
     cmdList->AddCommand<CHelpCommand>();
 
     while(true) {
@@ -746,6 +813,26 @@ static void SKIZO_API builtin_callback_console(SKIZO_BREAKPOINTINFO* info)
 }
 
 void CDomain::Break()
+{
+    const int sz = (int)m_debugDataStack->Pop();
+    void** localRefs = (void**)m_debugDataStack->Pop();
+    m_debugDataStack->Push((void*)localRefs);
+    m_debugDataStack->Push((void*)sz);
+
+    breakImpl(m_topFrame->Method, localRefs, sz);
+}
+
+void CDomain::BreakAt(int patchPointId, void** localRefs, int size)
+{
+    breakImpl(m_bpPatcher.MethodOf(patchPointId), localRefs, size);
+}
+
+bool CDomain::SetBreakpoint(const CString* filePath, int lineNumber, bool enable)
+{
+    return m_bpPatcher.SetBreakpoint(filePath, lineNumber, enable) > 0;
+}
+
+void CDomain::breakImpl(const CMethod* method, void** localRefs, int size)
 {
    if(m_disableBreak) {
         return;
@@ -754,13 +841,7 @@ void CDomain::Break()
     SKIZO_BREAKPOINTINFO bInfo;
     bInfo.Domain = this;
 
-    const int sz = (int)m_debugDataStack->Pop();
-    void** localRefs = (void**)m_debugDataStack->Pop();
-    Auto<CWatchIterator> watchIterator (new CWatchIterator((CMethod*)m_stackFrames->Peek(),
-                                                            localRefs,
-                                                            sz));
-    m_debugDataStack->Push((void*)localRefs);
-    m_debugDataStack->Push((void*)sz);
+    Auto<CWatchIterator> watchIterator (new CWatchIterator(method, localRefs, size));
     bInfo.WatchIterator = (skizo_watchiterator)watchIterator.Ptr();
 
     SKIZO_BREAKPOINTCALLBACK callback;
@@ -791,6 +872,11 @@ void SKIZO_API _soX_break()
     CDomain::ForCurrentThread()->Break();
 }
 
+void SKIZO_API _soX_breakat(CDomain* domain, int patchPointId, void** localRefs, int size)
+{
+    domain->BreakAt(patchPointId, localRefs, size);
+}
+
 }
 
 } }
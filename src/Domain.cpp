@@ -17,6 +17,7 @@
 #include "FileSystem.h"
 #include "FileUtils.h"
 #include "Emitter.h"
+#include "HardwareExceptions.h"
 #include "icall.h"
 #include "ModuleDesc.h"
 #include "NativeHeaders.h"
@@ -30,6 +31,10 @@
 #include <assert.h>
 #include <stdarg.h>
 
+#ifdef SKIZO_X
+    #include <pthread.h>
+#endif
+
 namespace skizo { namespace script {
 using namespace skizo::core;
 using namespace skizo::collections;
@@ -109,35 +114,6 @@ public:
 
 // TODO move this to native/win32
 #ifdef SKIZO_WIN
-static LONG WINAPI unhandledExceptionFilter(struct _EXCEPTION_POINTERS *lpTopLevelExceptionFilter)
-{
-    switch(lpTopLevelExceptionFilter->ExceptionRecord->ExceptionCode) {
-        case EXCEPTION_ACCESS_VIOLATION:
-        {
-            // TODO estimate whether it's access violation or null reference check
-            const uintptr_t addr = (uintptr_t)lpTopLevelExceptionFilter->ExceptionRecord->ExceptionInformation[1];
-
-            // Tries to conservatively discern a random access violation from a simple null dereference.
-            // NOTE The number is equal to ROTOR's value.
-            if(addr < (64 * 1024)) {
-                CDomain::Abort("Null dereference.");
-            }
-        }
-        break;
-
-        case EXCEPTION_STACK_OVERFLOW:
-        {
-            // Can get here if proactive stack overflow detection is disabled or there's a bug in the runtime.
-            // Not recoverable.
-            // TODO don't kill other threads
-            Application::FailFast("Stack overflow.")
-        }
-        break;
-    }
-
-    return EXCEPTION_CONTINUE_SEARCH;
-}
-
 void CDomain::chkstkHack()
 {
     HMODULE hmodule = LoadLibrary(L"ntdll.dll");
@@ -148,6 +124,33 @@ void CDomain::chkstkHack()
 }
 #endif
 
+// Returns the lowest address of the current thread's stack, or null if it's unknown.
+static void* getStackEnd()
+{
+#ifdef SKIZO_WIN
+    // The allocation base of the region which contains a local is where the stack is reserved from.
+    MEMORY_BASIC_INFORMATION memInfo;
+    if(VirtualQuery(&memInfo, &memInfo, sizeof(memInfo)) == 0) {
+        return nullptr;
+    }
+    return memInfo.AllocationBase;
+#elif defined(SKIZO_X)
+    // NOTE For the main thread, glibc derives the end from the stack's resource limit.
+    void* stackAddr = nullptr;
+    size_t stackSize = 0;
+    pthread_attr_t attr;
+    if(pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if(pthread_attr_getstack(&attr, &stackAddr, &stackSize) != 0) {
+            stackAddr = nullptr;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return stackAddr;
+#else
+    return nullptr;
+#endif
+}
+
 // **************************
 //     SDomainCreation.
 // **************************
@@ -193,6 +196,7 @@ CDomain::CDomain()
      m_arrayInitHelperRegistry(new CHashMap<CArrayInitializationType*, int>()),
      m_icallMethodSet(new CHashMap<void*, void*>()),
      m_eCalls(new CArrayList<void*>()),
+     m_samplingFrequency(0),
      m_activator(this),
      m_stackTraceEnabled(false),
      m_profilingEnabled(false),
@@ -200,10 +204,26 @@ CDomain::CDomain()
      m_explicitNullCheck(true),
      m_safeCallbacks(false),
      m_inlineBranching(true),
-     m_stackFrames(new CStack<void*>()),
+     m_tieredCompilation(false),
+     m_deadCodeElimination(false),
+     m_lazyCompilation(false),
+     m_stackSize(0),
+     m_lazyUnitHeader(nullptr),
+     m_lazyUnitExternals(new CHashMap<const char*, void*>()),
+     m_lazyUnits(new CArrayList<TCCState*>()),
+     m_lazyNames(new CArrayList<char*>()),
+     m_devirtualizedCallCount(0),
+     m_deadClassCount(0),
+     m_deadMethodCount(0),
+     m_tailCallCount(0),
+     m_topFrame(nullptr),
+     m_stackLimit(nullptr),
+     m_stackEnd(nullptr),
+     m_abortFrames(new CArrayList<void*>()),
      m_disableBreak(false),
      m_debugDataStack(new CStack<void*>()),
      m_time(0),
+     m_callProfiler(this),
      m_id(0),
      m_tccState(nullptr),
      m_readyForEpilog(false),
@@ -221,13 +241,16 @@ CDomain::CDomain()
 
 CDomain::~CDomain()
 {
+    // The second tier may be still compiling in the background.
+    joinTierUp();
+
     // **********************************************************************************
     //   Calls the epilog (static destructors).
     /* TODO I am not sure if it's safe to do it here, in a destructor. */
-    if(m_tccState && m_readyForEpilog) {
+    if((m_tccState || m_nativeImage) && m_readyForEpilog) {
         void (SKIZO_API *epilog)() = nullptr;
         SKIZO_LOCK_AB(CDomain::g_globalMutex) {
-            epilog = (void(SKIZO_API *)())tcc_get_symbol(m_tccState, "_soX_epilog");
+            epilog = (void(SKIZO_API *)())GetSymbol((char*)"_soX_epilog");
         } SKIZO_END_LOCK_AB_NOEXCEPT(CDomain::g_globalMutex);
 
         try {
@@ -271,11 +294,15 @@ CDomain::~CDomain()
     // destroying this message. When a handler is found, the message is corrupted.
     // g_lastError->SetNothing();
 
-    if(tccState) {
+    if(tccState || m_nativeImage) {
         SKIZO_LOCK_AB(CDomain::g_globalMutex) {
             m_securityMngr.DeinitSecureIO();
 
-            tcc_delete(tccState);
+            if(tccState) {
+                tcc_delete(tccState);
+            }
+            deleteLazyUnits();
+            m_nativeImage.SetPtr(nullptr);
         } SKIZO_END_LOCK_AB_NOEXCEPT(CDomain::g_globalMutex);
     }
 }
@@ -346,6 +373,9 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
     if(!creation.StackBase) {
         SKIZO_THROW_WITH_MSG(EC_ILLEGAL_ARGUMENT, "StackBase of the domain not specified.");
     }
+    if(creation.StackSize < 0) {
+        SKIZO_THROW_WITH_MSG(EC_ILLEGAL_ARGUMENT, "StackSize of the domain can't be negative.");
+    }
 
     if(!creation.Source) {
         SKIZO_THROW_WITH_MSG(EC_ILLEGAL_ARGUMENT, "No source specified.");
@@ -356,6 +386,14 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
         return nullptr;
     }
 
+    // Cold blocks of patch points read the locals from memory, with the state of registers at the patch point unknown
+    // to the compiler: that only holds for TCC, which keeps locals on the stack and no values in registers between
+    // statements (see SBreakpointPatcher).
+    if(creation.PatchableBreakpoints && creation.NativeCompiler) {
+        ScriptUtils::Fail_("Patchable breakpoints aren't supported with the native compiler.", 0, 0);
+        return nullptr;
+    }
+
     Auto<CDomain> domain (new CDomain());
 
     // *******************************************************************************
@@ -369,6 +407,25 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
     // *******************************************************************************
 
     domain->m_memMngr.SetStackBase(creation.StackBase);
+    domain->m_stackSize = creation.StackSize;
+    domain->m_stackEnd = getStackEnd();
+    // NOTE: The emitted code detects stack overflows proactively: we leave 100k at the end of the stack for internal
+    // functions to run which will abort the domain, print the stack trace etc. On Unix, trusted domains rely on the
+    // guard page at the end of the stack instead (see HardwareExceptions.h), which saves a check per call. Untrusted
+    // domains can't: an overflow inside the runtime itself isn't recoverable and brings the whole process down.
+#ifdef SKIZO_WIN
+    const bool isProactiveCheck = true;
+#else
+    const bool isProactiveCheck = creation.IsUntrusted;
+#endif
+    if(isProactiveCheck) {
+        if(domain->m_stackEnd) {
+            domain->m_stackLimit = (char*)domain->m_stackEnd + 100 * 1024;
+        } else {
+            // The standard stack size on Win32 is 1 MB.
+            domain->m_stackLimit = (char*)creation.StackBase - 900 * 1024;
+        }
+    }
     domain->m_memMngr.SetMaxGCMemory(creation.MaxGCMemory);
 
     domain->m_entryPointClass.SetVal(creation.EntryPointClass);
@@ -376,20 +433,55 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
 
     domain->m_stackTraceEnabled = creation.StackTraceEnabled;
     domain->m_profilingEnabled = creation.ProfilingEnabled;
-    domain->m_memMngr.BumpPointerAllocator().EnableProfiling(creation.ProfilingEnabled);
+    if(creation.StartupTracePath) {
+        domain->m_startupTrace.Enable(creation.StartupTracePath);
+    }
+    domain->m_samplingFrequency = creation.SamplingFrequency;
+    if(creation.PerfMapEnabled) {
+        domain->m_perfMap.Enable(domain);
+    }
+    if(creation.DebugInfoEnabled) {
+        domain->m_gdbJit.Enable();
+    }
+    domain->m_memMngr.BumpPointerAllocator().EnableProfiling(creation.ProfilingEnabled || creation.StartupTracePath);
     domain->m_softDebuggingEnabled = creation.SoftDebuggingEnabled;
     domain->m_explicitNullCheck = creation.ExplicitNullCheck;
     domain->m_safeCallbacks = creation.SafeCallbacks;
     domain->m_inlineBranching = creation.InlineBranching;
+    if(creation.NativeCompiler) {
+        domain->m_nativeCompiler.SetPtr(CString::FromUtf8(creation.NativeCompiler));
+        domain->m_tieredCompilation = creation.TieredCompilation;
+        domain->m_memMngr.EnableInteriorPointers(true);
+    }
+    domain->m_deadCodeElimination = creation.DeadCodeElimination;
+    // Patch points are found in the relocated TCC state of the main image (see SBreakpointPatcher).
+    domain->m_lazyCompilation = creation.LazyCompilation && !domain->m_nativeCompiler && !creation.PatchableBreakpoints;
+    if(creation.PatchableBreakpoints) {
+        domain->m_bpPatcher.Enable();
+    }
+    if(creation.CostCountingEnabled) {
+        domain->m_costCounter.Enable();
+    }
     domain->m_memMngr.EnableGCStats(creation.GCStatsEnabled);
 
-    // _soX_reglocals & _soX_unreglocals rely on frames registered by _soX_pushframe/_soX_popframe
+    // _soX_reglocals & _soX_unreglocals rely on frames of the shadow stack
     // + debugger wants to know stack traces in any case.
     if(domain->m_softDebuggingEnabled && !domain->m_stackTraceEnabled) {
         domain->m_stackTraceEnabled = true;
     }
 
-    // Untrusted domains always use stack traces because we must detect stack overflows inside them.
+    // Breakpoints print stack traces.
+    if(domain->m_bpPatcher.IsEnabled() && !domain->m_stackTraceEnabled) {
+        domain->m_stackTraceEnabled = true;
+    }
+
+    // The sampling profiler walks frames of the shadow stack.
+    if(domain->m_samplingFrequency && !domain->m_stackTraceEnabled) {
+        domain->m_stackTraceEnabled = true;
+    }
+
+    // Untrusted domains always use stack traces because we must detect stack overflows inside them
+    // (on Windows, it's done on frame entry).
     if(creation.IsUntrusted) {
         domain->m_stackTraceEnabled = true;
     }
@@ -409,12 +501,19 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
         domain->m_domainName.SetPtr(CString::Format("<domain at %p>", (void*)domain));
     }
 
+    SStartupTrace& startupTrace = domain->m_startupTrace;
+    startupTrace.Begin("startup", "startup");
+    startupTrace.AddArg("domain", domain->m_domainName);
+
+    startupTrace.Begin("startup", "initBasicClasses");
     domain->initBasicClasses();
+    startupTrace.End();
 
     int dt = Application::TickCount(), tmpDt;
     int earliestDt = dt;
 
     {
+        startupTrace.Begin("startup", "parsing");
         domain->m_sourceQueue.Enqueue(creation.Source); // initiates
         int sourceIndex = 0;
         while(!domain->m_sourceQueue.IsEmpty()) {
@@ -428,7 +527,11 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
                 // used as code rather than path).
                 code.SetVal(source);
             } else {
+                startupTrace.Begin("parsing", "read");
+                startupTrace.AddArg("module", source);
                 code.SetPtr(domain->readSource(source, &isBaseModule));
+                startupTrace.AddArg("chars", code? code->Length(): 0);
+                startupTrace.End();
             }
 
             if(!code) {
@@ -446,6 +549,12 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
 
             sourceIndex++;
         }
+
+        startupTrace.AddArg("modules", sourceIndex);
+        startupTrace.AddArg("classes", domain->m_klasses->Count());
+        startupTrace.AddArg("tokens", domain->m_memMngr.BumpPointerAllocator().GetCountByAllocationType(E_SKIZOALLOCATIONTYPE_TOKEN));
+        startupTrace.AddArg("expressions", domain->m_memMngr.BumpPointerAllocator().GetCountByAllocationType(E_SKIZOALLOCATIONTYPE_EXPRESSION));
+        startupTrace.End();
     }
 
     if(domain->m_profilingEnabled) {
@@ -454,8 +563,33 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
         dt = tmpDt;
     }
 
+    startupTrace.Begin("startup", "transform");
     SkizoTransform(domain);
+
+    startupTrace.Begin("transform", "verifyIntrinsicClasses");
     domain->verifyIntrinsicClasses();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "eliminateDeadCode");
+    domain->eliminateDeadCode();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "buildITables");
+    domain->buildITables();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "buildTypeTests");
+    domain->buildTypeTests();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "markLazyMethods");
+    domain->markLazyMethods();
+    startupTrace.End();
+
+    // Generated classes (arrays, closures, boxed classes etc.) are added during transformation.
+    startupTrace.AddArg("classes", domain->m_klasses->Count());
+    startupTrace.AddArg("expressions", domain->m_memMngr.BumpPointerAllocator().GetCountByAllocationType(E_SKIZOALLOCATIONTYPE_EXPRESSION));
+    startupTrace.End();
 
     if(domain->m_profilingEnabled) {
         tmpDt = Application::TickCount();
@@ -463,8 +597,10 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
         dt = tmpDt;
     }
 
+    startupTrace.Begin("startup", "emit");
     STextBuilder cb;
     SkizoEmit(domain, cb);
+    startupTrace.End();
 
     if(domain->m_profilingEnabled) {
         tmpDt = Application::TickCount();
@@ -474,32 +610,57 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
 
     {
         char* cCode = cb.Chars();
+        startupTrace.Begin("startup", "compile");
+        startupTrace.AddArg("cCodeSize", (so_long)strlen(cCode));
 
         // *******************************
         if(creation.DumpCCode) {
             FILE* f = fopen("skizodump.c", "w");
+            const SConstantFoldingStats& foldingStats = domain->m_constantFoldingStats;
+            fprintf(f, "/* Constant folding: %d expressions folded, %d uses of immutable locals propagated, %d dead branches removed. */\n",
+                    foldingStats.FoldedExprCount,
+                    foldingStats.PropagatedLocalCount,
+                    foldingStats.DeadBranchCount);
+            fprintf(f, "/* Tail calls: %d self-recursive calls turned into jumps. */\n", domain->m_tailCallCount);
             fwrite(cCode, 1, strlen(cCode), f);
             fclose(f);
         }
         // *******************************
 
         SKIZO_LOCK_AB(CDomain::g_globalMutex) {
-            domain->m_tccState = tcc_new();
-            SKIZO_REQ_PTR(domain->m_tccState);
+            // If a native compiler is used, the code is compiled only after all the icalls are registered
+            // (see below). With tiered compilation, TCC is still used first.
+            if(!domain->m_nativeCompiler || domain->m_tieredCompilation) {
+                domain->m_tccState = tcc_new();
+                SKIZO_REQ_PTR(domain->m_tccState);
+
+                // Must be set before the output type, which creates the debug sections.
+                if(domain->DebugInfoEnabled()) {
+                    tcc_set_options(domain->m_tccState, "-g");
+                }
+                tcc_set_output_type(domain->m_tccState, TCC_OUTPUT_MEMORY);
+                // First-tier entries are patched while other threads can be running them (see CDomain::TierUp(..)).
+                if(domain->m_tieredCompilation) {
+                    tcc_set_patchable_entries(domain->m_tccState, 1);
+                }
 
-            tcc_set_output_type(domain->m_tccState, TCC_OUTPUT_MEMORY);
+                startupTrace.Begin("compile", "tcc");
+                if(tcc_compile_string(domain->m_tccState, cCode) == -1) {
+                    CDomain::Abort("Couldn't compile the output machine code (invalid inline C code or a bug in the backend).");
+                }
+                startupTrace.End();
 
-            if(tcc_compile_string(domain->m_tccState, cCode) == -1) {
-                CDomain::Abort("Couldn't compile the output machine code (invalid inline C code or a bug in the backend).");
+                // **************************************************************
+            #ifdef SKIZO_WIN
+                domain->chkstkHack();
+            #endif
             }
 
-            // **************************************************************
-        #ifdef SKIZO_WIN
-            domain->chkstkHack();
-        #endif
-
+            startupTrace.Begin("compile", "registerICalls");
             domain->registerICall("_soX_gc_alloc", (void*)_soX_gc_alloc);
             domain->registerICall("_soX_gc_alloc_env", (void*)_soX_gc_alloc_env);
+            domain->registerICall("_soX_stackenv", (void*)_soX_stackenv);
+            domain->registerICall("_soX_stackclosure", (void*)_soX_stackclosure);
             domain->registerICall("_soX_gc_roots", (void*)_soX_gc_roots);
             domain->registerICall("_soX_static_vt", (void*)_soX_static_vt);
             domain->registerICall("_soX_regvtable", (void*)_soX_regvtable);
@@ -508,12 +669,14 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
             domain->registerICall("_soX_unbox", (void*)_soX_unbox);
             domain->registerICall("_soX_findmethod", (void*)_soX_findmethod);
             domain->registerICall("_soX_findmethod2", (void*)_soX_findmethod2);
+            domain->registerICall("_soX_icfind", (void*)_soX_icfind);
             domain->registerICall("_soX_is", (void*)_soX_is);
             domain->registerICall("_soX_biteq", (void*)_soX_biteq);
             domain->registerICall("_soX_zero", (void*)_soX_zero);
             domain->registerICall("_soX_abort0", (void*)_soX_abort0);
             domain->registerICall("_soX_abort", (void*)_soX_abort);
             domain->registerICall("_soX_abort_e", (void*)_soX_abort_e);
+            domain->registerICall("_soX_abort_inl", (void*)_soX_abort_inl);
             domain->registerICall("_soX_cctor", (void*)_soX_cctor);
             domain->registerICall("_soX_checktype", (void*)_soX_checktype);
             domain->registerICall("_soX_newarray", (void*)_soX_newarray);
@@ -522,20 +685,23 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
             domain->registerICall("_soX_msgsnd_async", (void*)_soX_msgsnd_async);
             domain->registerICall("_soX_unpack", (void*)_soX_unpack);
             domain->registerICall("_so_int_op_divide", (void*)_so_int_op_divide);
+            domain->registerICall("_so_int_op_modulo", (void*)_so_int_op_modulo);
 
-            if(domain->m_stackTraceEnabled) {
-                domain->registerICall("_soX_pushframe", (void*)_soX_pushframe);
-                domain->registerICall("_soX_popframe", (void*)_soX_popframe);
-            }
             if(domain->m_profilingEnabled) {
                 domain->registerICall("_soX_pushframe_prf", (void*)_soX_pushframe_prf);
                 domain->registerICall("_soX_popframe_prf", (void*)_soX_popframe_prf);
             }
+            if(domain->m_tieredCompilation) {
+                domain->registerICall("_soX_tierup", (void*)_soX_tierup);
+            }
             if(domain->m_softDebuggingEnabled) {
                 domain->registerICall("_soX_reglocals", (void*)_soX_reglocals);
                 domain->registerICall("_soX_unreglocals", (void*)_soX_unreglocals);
                 domain->registerICall("_soX_break", (void*)_soX_break);
             }
+            if(domain->m_bpPatcher.IsEnabled()) {
+                domain->registerICall("_soX_breakat", (void*)_soX_breakat);
+            }
 
             // Registers icalls defined in SDomainCreation.
             {
@@ -551,18 +717,26 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
 
             // **************************************************************
             // Registers ecalls.
-            for(int i = 0; i < domain->m_eCalls->Count(); i++) {
-                CMethod* pMethod = (CMethod*)domain->m_eCalls->Array()[i];
-                Utf8Auto methodName (pMethod->GetCName());
-
-                tcc_add_symbol(domain->m_tccState,
-                               methodName,
-                               pMethod->ECallDesc().ImplPtr);
+            // NOTE The native compiler links in ecalls by itself (see compileNativeImage(..))
+            if(domain->m_tccState) {
+                for(int i = 0; i < domain->m_eCalls->Count(); i++) {
+                    CMethod* pMethod = (CMethod*)domain->m_eCalls->Array()[i];
+                    Utf8Auto methodName (pMethod->GetCName());
+
+                    tcc_add_symbol(domain->m_tccState,
+                                   methodName,
+                                   pMethod->ECallDesc().ImplPtr);
+                }
             }
             // **************************************************************
 
+            startupTrace.End();
+
             // For ThunkManager
+            startupTrace.Begin("compile", "thunks");
             domain->m_thunkMngr.CompileAndLinkMethods(domain);
+            domain->registerLazyMethods();
+            startupTrace.End();
 
             // ****************************************************
             // Checks if all the icalls have their impls linked in.
@@ -584,12 +758,24 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
 
             // ******************************
 
-            if(tcc_relocate(domain->m_tccState, TCC_RELOCATE_AUTO) < 0) {
-                //SKIZO_THROW(EC_EXECUTION_ERROR); // TODO ?
-                CDomain::Abort("Relocation error (invalid inline C code or a bug in the backend).");
+            if(domain->m_tccState) {
+                startupTrace.Begin("compile", "relocate");
+                if(tcc_relocate(domain->m_tccState, TCC_RELOCATE_AUTO) < 0) {
+                    //SKIZO_THROW(EC_EXECUTION_ERROR); // TODO ?
+                    CDomain::Abort("Relocation error (invalid inline C code or a bug in the backend).");
+                }
+                domain->m_perfMap.AddTCCState(domain->m_tccState);
+                domain->m_gdbJit.RegisterTCCState(domain->m_tccState);
+                domain->m_bpPatcher.Resolve(domain->m_tccState);
+                startupTrace.End();
+            } else {
+                startupTrace.Begin("compile", "nativeCompiler");
+                domain->compileNativeImage(cCode);
+                startupTrace.End();
             }
 
         } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+        startupTrace.End();
 
         if(domain->m_profilingEnabled) {
             tmpDt = Application::TickCount();
@@ -599,17 +785,9 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
             printf("Total startup time: %d ms.\n\n", tmpDt - earliestDt);
         }
 
-    #ifdef SKIZO_WIN
-        // Sets an exception handler to catch null reference errors without testing for them at runtime.
-        // NOTE One handler for all threads. See MSDN:
-        // "Issuing SetUnhandledExceptionFilter replaces the existing top-level exception filter for all
-        // existing and all future threads in the calling process".
-        static bool isHandlerSet = false;
-        if(!isHandlerSet && !domain->m_explicitNullCheck) {
-            isHandlerSet = true;
-            //SetUnhandledExceptionFilter(unhandledExceptionFilter);
-            AddVectoredExceptionHandler(0, unhandledExceptionFilter);
-        }
+    #if defined(SKIZO_WIN) || defined(SKIZO_X)
+        // Null dereferences and stack overflows in generated code are converted to domain aborts.
+        HardwareExceptions::Install(domain);
     #else
         if(!domain->m_explicitNullCheck) {
             CDomain::Abort("Hardware checks for null aren't supported for this platform.");
@@ -623,22 +801,40 @@ CDomain* CDomain::CreateDomain(const SDomainCreation& creation)
         SKIZO_LOCK_AB(CDomain::g_globalMutex) {
             domain->m_securityMngr.InitSecureIO(); // !!
 
-            prolog = (void(SKIZO_API *)())tcc_get_symbol(domain->m_tccState, "_soX_prolog");
+            prolog = (void(SKIZO_API *)())domain->GetSymbol((char*)"_soX_prolog");
             SKIZO_REQ_PTR(prolog);
         } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
 
+        startupTrace.Begin("startup", "prolog");
         if(prolog) {
             prolog();
         }
+        startupTrace.End();
         // **********************
 
         domain->m_readyForEpilog = true;
     }
 
+    startupTrace.End();
+    startupTrace.Save();
+
     domain->Ref();
     return domain;
 }
 
+void CDomain::getEntryPointNames(Auto<const CString>& epClassName, Auto<const CString>& epMethodName) const
+{
+    // NOTE only when both the entrypoint class and the entrypoint method are specified,
+    // this works. Otherwise, it's ignored and default values are used.
+    if(m_entryPointClass && m_entryPointMethod) {
+        epClassName.SetVal(m_entryPointClass);
+        epMethodName.SetVal(m_entryPointMethod);
+    } else {
+        epClassName.SetPtr(CString::FromUtf8("Program"));
+        epMethodName.SetPtr(CString::FromUtf8("main"));
+    }
+}
+
 bool CDomain::InvokeEntryPoint()
 {
     // ***************************
@@ -672,16 +868,7 @@ bool CDomain::InvokeEntryPoint()
 
         Auto<const CString> epClassName;
         Auto<const CString> epMethodName;
-
-        // NOTE only when both the entrypoint class and the entrypoint method are specified,
-        // this works. Otherwise, it's ignored and default values are used.
-        if(m_entryPointClass && m_entryPointMethod) {
-            epClassName.SetVal(m_entryPointClass);
-            epMethodName.SetVal(m_entryPointMethod);
-        } else {
-            epClassName.SetPtr(CString::FromUtf8("Program"));
-            epMethodName.SetPtr(CString::FromUtf8("main"));
-        }
+        getEntryPointNames(epClassName, epMethodName);
 
         CClass* epClass = this->ClassByNiceName(epClassName); // NOTE Nice names.
         if(!epClass) {
@@ -716,10 +903,12 @@ bool CDomain::InvokeEntryPoint()
         fwrite((char*)mainFunc, 1, 300, ftmp);
         fclose(ftmp);*/
 
+        m_samplingProfiler.Start(m_samplingFrequency, &m_topFrame);
+
         if(m_profilingEnabled) {
-            m_time = Application::TickCount();
+            m_time = Application::NanoTickCount();
             mainFunc();
-            m_time = Application::TickCount() - m_time;
+            m_time = Application::NanoTickCount() - m_time;
         } else {
             mainFunc();
         }
@@ -731,6 +920,9 @@ bool CDomain::InvokeEntryPoint()
         r = false;
     }
 
+    // NOTE If a C++ exception escapes, the profiler is stopped by the domain's destructor instead.
+    m_samplingProfiler.Stop();
+
     return r;
 }
 
@@ -765,6 +957,18 @@ void CDomain::abortImpl(char* msg, bool free)
         error->Free = free;
     }
 
+    // Frames of the shadow stack are C locals which die once the stack unwinds, and catch sites are free
+    // to reuse their memory, so the frames are remembered for stack traces (see CDomain::GetStackTraceInfo())
+    // and the list is reset to not point to dead frames. SVirtualUnwinder restores it where execution resumes.
+    CDomain* domain = CDomain::ForCurrentThread();
+    if(domain) {
+        domain->m_abortFrames->Clear();
+        for(SStackFrame* frame = domain->m_topFrame; frame; frame = frame->Prev) {
+            domain->m_abortFrames->Add((void*)frame->Method);
+        }
+        domain->m_topFrame = nullptr;
+    }
+
     // This trick unwinds the stack back to InvokeEntryPoint (or whatever the top function is) using
     // C++'s unwinding mechanism.
     throw SoDomainAbortException(msg);
@@ -805,8 +1009,8 @@ void CDomain::Abort(int errorCode)
             CDomain::Abort("ECalls and unsafe code are disallowed in untrusted contexts in non-base modules.");
             break;
         case SKIZO_ERRORCODE_STACK_OVERFLOW:
-            // NOTE We detect stackoverflows in a proactive manner, meaning there's still a lot
-            // of stack space to run functions like these.
+            // NOTE We detect stackoverflows either in a proactive manner, meaning there's still a lot
+            // of stack space to run functions like these, or on the alternate signal stack (Unix).
             CDomain::ForCurrentThread()->correctStackTraceAfterStackOverflow();
             CDomain::Abort("Stack overflow detected.");
             break;
@@ -825,8 +1029,8 @@ void CDomain::correctStackTraceAfterStackOverflow()
 
     Auto<CArrayList<void*> > pattern (new CArrayList<void*>());
 
-    for(int i = m_stackFrames->Count() - 1; i >= 0; i--) {
-        void* item = m_stackFrames->Item(i);
+    for(SStackFrame* frame = m_topFrame; frame; frame = frame->Prev) {
+        void* item = (void*)frame->Method;
         if(pattern->Count() > 0 && item == pattern->Array()[0]) {
             break;
         } else {
@@ -842,8 +1046,8 @@ void CDomain::correctStackTraceAfterStackOverflow()
 
     int elementsToRemove = 0;
     int patternIndex = 0;
-    for(int i = m_stackFrames->Count() - 1; i >= 0; i--) {
-        void* item = m_stackFrames->Item(i);
+    for(SStackFrame* frame = m_topFrame; frame; frame = frame->Prev) {
+        void* item = (void*)frame->Method;
         if(item == pattern->Array()[patternIndex]) {
             elementsToRemove++;
         } else {
@@ -865,8 +1069,9 @@ void CDomain::correctStackTraceAfterStackOverflow()
 
     elementsToRemove = patternsToRemove * pattern->Count();
 
+    // NOTE The domain is about to abort, so the frames are simply skipped (see CDomain::abortImpl(..))
     for(int i = 0; i < elementsToRemove; i++) {
-        m_stackFrames->Pop();
+        m_topFrame = m_topFrame->Prev;
     }
 }
 
@@ -933,9 +1138,13 @@ char* CDomain::FormatMessage(const char* format, ...) const
 
 void* CDomain::GetSymbol(char* name) const
 {
+    // NOTE Always returns first-tier symbols with tiered compilation: their entries are patched to jump
+    // to the second tier anyway.
     void* r;
     if(m_icallImplSet.TryGet(name, &r)) {
         return r;
+    } else if(m_nativeImage) {
+        return m_nativeImage->GetSymbol(name);
     } else {
         return tcc_get_symbol(m_tccState, name);
     }
@@ -952,6 +1161,21 @@ void* CDomain::GetSymbolThreadSafe(char* name) const
 
 bool CDomain::IsSymbol(void* ptr) const
 {
+    if(m_nativeImage) {
+        return m_nativeImage->IsSymbol(ptr);
+    }
+
+    const CNativeImage* secondTier = tierUpImage();
+    if(secondTier && secondTier->IsSymbol(ptr)) {
+        return true;
+    }
+
+    for(int i = 0; i < m_lazyUnits->Count(); i++) {
+        if(tcc_is_symbol(m_lazyUnits->Array()[i], ptr)) {
+            return true;
+        }
+    }
+
     return m_tccState? tcc_is_symbol(m_tccState, ptr): false;
 }
 
@@ -1161,10 +1385,54 @@ void CDomain::registerICall(const char* name, void* ptr)
 {
     SKIZO_REQ(!m_icallImplSet.Contains(name), EC_ILLEGAL_ARGUMENT);
 
-    tcc_add_symbol(m_tccState, name, ptr);
+    // NOTE If the native compiler is used, there's no TCC state: icalls are linked in later, from m_icallImplSet.
+    if(m_tccState) {
+        tcc_add_symbol(m_tccState, name, ptr);
+    }
     m_icallImplSet.Set(name, ptr);
 }
 
+void CDomain::collectExternals(CHashMap<const char*, void*>* externals, CArrayList<char*>* ownedNames) const
+{
+    // The native image is linked against the same table TCC uses: icalls (including ThunkJIT-generated
+    // methods, see SThunkManager::CompileAndLinkMethods) and ecalls.
+    {
+        const char* name;
+        void* impl;
+        SHashMapEnumerator<const char*, void*> mapEnum (&m_icallImplSet);
+        while(mapEnum.MoveNext(&name, &impl)) {
+            externals->Set(name, impl);
+        }
+    }
+
+    for(int i = 0; i < m_eCalls->Count(); i++) {
+        CMethod* pMethod = (CMethod*)m_eCalls->Array()[i];
+        char* methodName = pMethod->GetCName();
+        ownedNames->Add(methodName);
+
+        externals->Set(methodName, pMethod->ECallDesc().ImplPtr);
+    }
+}
+
+void CDomain::compileNativeImage(const char* cCode)
+{
+    Auto<CHashMap<const char*, void*> > externals (new CHashMap<const char*, void*>());
+    CArrayList<char*> eCallNames;
+    collectExternals(externals, &eCallNames);
+
+    Utf8Auto compiler (m_nativeCompiler->ToUtf8());
+    m_nativeImage.SetPtr(CNativeImage::Compile(compiler, cCode, externals));
+
+    externals->Clear();
+    for(int i = 0; i < eCallNames.Count(); i++) {
+        CString::FreeUtf8(eCallNames.Array()[i]);
+    }
+
+    if(!m_nativeImage) {
+        CDomain::Abort("Couldn't compile the output machine code with the native compiler (invalid inline C code or a bug in the backend).");
+    }
+}
+
 void CDomain::verifyICallIsRegistered(CMethod* pMethod) const
 {
     // ECalls are to be loaded in runtime.
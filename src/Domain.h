@@ -17,16 +17,24 @@
 #include "Activator.h"
 #include "ArrayInitializationType.h"
 #include "ArrayList.h"
+#include "CallProfiler.h"
 #include "Class.h"
 #include "DomainCreation.h"
 #include "ECallCache.h"
 #include "Mutex.h"
 #include "HashMap.h"
 #include "MemoryManager.h"
+#include "NativeImage.h"
+#include "PerfMap.h"
+#include "GdbJit.h"
+#include "BreakpointPatcher.h"
+#include "CostCounter.h"
 #include "Queue.h"
 #include "Remoting.h"
+#include "SamplingProfiler.h"
 #include "Security.h"
 #include "SourceKind.h"
+#include "StartupTrace.h"
 #include "Stack.h"
 #include "skizoscript.h"
 #include "StringSlice.h"
@@ -49,6 +57,43 @@ namespace skizo { namespace script {
 class CClass;
 class CMethod;
 
+/**
+ * What constant folding did (see STransformer::foldConstants(..)). Reported in the dump of the emitted C code.
+ */
+struct SConstantFoldingStats
+{
+    // Arithmetic, comparisons and consts replaced with their values.
+    int FoldedExprCount;
+
+    // Uses of locals which are never reassigned replaced with their values.
+    int PropagatedLocalCount;
+
+    // "then"/"else" branches and loops removed as never taken.
+    int DeadBranchCount;
+
+    SConstantFoldingStats()
+        : FoldedExprCount(0),
+          PropagatedLocalCount(0),
+          DeadBranchCount(0)
+    {
+    }
+};
+
+/**
+ * A record of the shadow stack used for stack traces (see SDomainCreation::StackTraceEnabled).
+ * The emitted code declares one as a C local in every method ("struct _soX_frame", the layouts must match) and
+ * links it into the domain's list on entry (see CDomain::TopFrameAddress()), so pushing and popping a frame are
+ * a couple of stores, without calls into the runtime.
+ */
+struct SStackFrame
+{
+    SStackFrame* Prev; // the caller's frame, or null
+    CMethod* Method;
+
+    // Maintained by _soX_pushframe_prf only (the depth of the frame, 0 for the outermost), for SCallProfiler.
+    int Depth;
+};
+
 /**
  * A domain is an isolated instance of the runtime that consists of a set of modules, a separate memory manager, its own thread,
  * and a set of permissions.
@@ -63,6 +108,9 @@ class CDomain: public skizo::core::CObject
     friend void __DeinitDomain();
     friend struct SVirtualUnwinder;
     friend struct SThunkManager;
+    friend struct SPerfMap;
+    friend struct PerfMapPrivate;
+    friend struct SGdbJit;
 
 public:
     CDomain();
@@ -90,6 +138,12 @@ public:
     SSecurityManager& SecurityManager() { return m_securityMngr; }
     const SECallCache& ECallCache() const { return m_ecallCache; }
     SActivator& Activator() { return m_activator; }
+    SStartupTrace& StartupTrace() { return m_startupTrace; }
+    const SSamplingProfiler& SamplingProfiler() const { return m_samplingProfiler; }
+    SPerfMap& PerfMap() { return m_perfMap; }
+    SBreakpointPatcher& BreakpointPatcher() { return m_bpPatcher; }
+    SCostCounter& CostCounter() { return m_costCounter; }
+    const SCostCounter& CostCounter() const { return m_costCounter; }
 
     // ***********************
     //    Type resolution.
@@ -208,7 +262,8 @@ public:
     void* GetSymbolThreadSafe(char* name) const;
 
     /**
-     * Returns true if the symbol is found *pointer points to TCC-allocated machine code).
+     * Returns true if the symbol is found *pointer points to TCC-allocated machine code, or to the
+     * native image if SDomainCreation::NativeCompiler was set, including the second tier of tiered compilation).
      */
     bool IsSymbol(void* ptr) const;
 
@@ -278,6 +333,18 @@ public:
      */
     void Break();
 
+    /**
+     * Implements _soX_breakat, i.e. a breakpoint set at a patch point (see SBreakpointPatcher)
+     * Implemented in Debugging.cpp
+     */
+    void BreakAt(int patchPointId, void** localRefs, int size);
+
+    /**
+     * Sets or clears a breakpoint at the given line (see SBreakpointPatcher::SetBreakpoint(..))
+     * Returns false if patchable breakpoints are disabled or there's no statement at the line.
+     */
+    bool SetBreakpoint(const skizo::core::CString* filePath, int lineNumber, bool enable);
+
     /**
      * Converts a Skizo object into its string representation by dynamically executing the
      * "toString" method (if any).
@@ -323,10 +390,40 @@ public:
     skizo::core::CThread* Thread() const { return m_thread; }
 
     // Frame management. Do not call directly. TODO try to hide it
-    void PushFrame(CMethod* method) { m_stackFrames->Push((void*)method); }
-    CMethod* PopFrame() { return (CMethod*)m_stackFrames->Pop(); }
+    // The address is inlined into the emitted code which links/unlinks frames there.
+    SStackFrame** TopFrameAddress() { return &m_topFrame; }
+    SStackFrame* TopFrame() const { return m_topFrame; }
+    void SetTopFrame(SStackFrame* frame) { m_topFrame = frame; }
+    // Frames below this address are considered a stack overflow by the emitted code, where it's inlined.
+    // Null if the guard page of the stack is relied on instead (trusted domains on Unix).
+    void* StackLimit() const { return m_stackLimit; }
+    // The lowest address of the stack of the domain's thread. Can be null if the platform doesn't tell.
+    void* StackEnd() const { return m_stackEnd; }
     skizo::collections::CStack<void*>* DebugDataStack() const { return m_debugDataStack; }
-    int FrameCount() const { return m_stackFrames->Count(); }
+    SCallProfiler& CallProfiler() { return m_callProfiler; }
+
+    // ************************
+    //   Tiered compilation.
+    // ************************
+
+    /**
+     * Called by TCC-compiled code (see _soX_tierup) when the method's call counter exceeds SKIZO_TIERUP_THRESHOLD.
+     * The first call starts recompiling the program with the native compiler in the background; once the native
+     * image is ready, the method's TCC entry is patched to jump to the optimized version.
+     * Implemented in TieredCompilation.cpp
+     */
+    void TierUp(CMethod* method);
+
+    // **********************
+    //   Lazy compilation.
+    // **********************
+
+    /**
+     * Called by the compilation trampoline of a method marked with E_METHODFLAGS_IS_LAZY on its first call:
+     * emits and compiles the method's body and patches the trampoline to jump to it.
+     * Implemented in LazyCompilation.cpp
+     */
+    void CompileLazyMethod(CMethod* method, void* trampoline);
 
     // *************
     //   Remoting.
@@ -404,6 +501,14 @@ public:
     bool SoftDebuggingEnabled() const { return m_softDebuggingEnabled; }
     bool InlineBranching() const { return m_inlineBranching; }
     bool SafeCallbacks() const { return m_safeCallbacks; }
+    const skizo::core::CString* NativeCompiler() const { return m_nativeCompiler; } // can be null
+    bool TieredCompilation() const { return m_tieredCompilation; }
+    bool DeadCodeElimination() const { return m_deadCodeElimination; }
+    bool LazyCompilation() const { return m_lazyCompilation; }
+    bool DebugInfoEnabled() const { return m_gdbJit.IsEnabled(); }
+    bool PatchableBreakpoints() const { return m_bpPatcher.IsEnabled(); }
+    bool CostCountingEnabled() const { return m_costCounter.IsEnabled(); }
+    int StackSize() const { return m_stackSize; } // of threads of remote domains
     const skizo::collections::CArrayList<const skizo::core::CString*>* SearchPaths() const { return m_searchPaths; }
 
     // **********************
@@ -413,6 +518,7 @@ public:
     const skizo::collections::CArrayList<CClass*>* Classes() const { return m_klasses; }
 
     CClass* BoolClass() const { return m_boolClass; }
+    CClass* RangeClass() const { return m_rangeClass; }
     CClass* CharClass() const { return m_charClass; }
     CClass* ErrorClass() const { return m_errorClass; }
     CClass* StringClass() const { return m_stringClass; }
@@ -432,6 +538,26 @@ public:
     skizo::collections::CHashMap<SStringSlice, CClass*>* IdentityComparisonHelpers() const { return m_identCompHelperMap; }
     void AddForcedTypeRef(CForcedTypeRef* forcedTypeRef) { m_forcedTypeRefs->Add(forcedTypeRef); } // TODO delete
     skizo::collections::CArrayList<CForcedTypeRef*>* ForcedTypeRefs() const { return m_forcedTypeRefs; }
+
+    // The number of call sites which by-pass the vtable thanks to class hierarchy analysis (reported in the
+    // profiling dump).
+    int DevirtualizedCallCount() const { return m_devirtualizedCallCount; }
+    void SetDevirtualizedCallCount(int value) { m_devirtualizedCallCount = value; }
+
+    // The number of classes and static methods dropped by dead code elimination (reported in the profiling dump).
+    int DeadClassCount() const { return m_deadClassCount; }
+    int DeadMethodCount() const { return m_deadMethodCount; }
+
+    // The number of self-recursive calls in tail position which were turned into jumps (reported in the C dump).
+    int TailCallCount() const { return m_tailCallCount; }
+    void SetTailCallCount(int value) { m_tailCallCount = value; }
+
+    SConstantFoldingStats& ConstantFoldingStats() { return m_constantFoldingStats; }
+
+    // Allocates a zeroed monomorphic inline cache for an interface call site: the last seen vtable and the method
+    // implementation found for it (see _soX_icfind). Lives as long as the domain.
+    // NOTE Implemented in InterfaceDispatch.cpp
+    void** NewInlineCache();
     void AddAlias(CClass* alias) { m_aliases->Add(alias); }
     void AddExtension(CClass* klass) { m_extensions->Add(klass); }
     bool ContainsSource(const skizo::core::CString* source) { return m_sourceSet.Contains(source); }
@@ -461,6 +587,62 @@ private:
     // WARNING The method isn't automatically guarded with g_globalMutex
     void registerICall(const char* name, void* ptr);
 
+    // Compiles the emitted code with SDomainCreation::NativeCompiler instead of TCC.
+    // Icalls must be registered by then: they're linked in as externals together with ecalls.
+    void compileNativeImage(const char* cCode);
+
+    // Fills the map with everything the native image should link against (icalls, ecalls). Names which must be
+    // freed afterwards with CString::FreeUtf8(..) are added to "ownedNames".
+    void collectExternals(skizo::collections::CHashMap<const char*, void*>* externals,
+                          skizo::collections::CArrayList<char*>* ownedNames) const;
+
+    // Emits the second-tier code and starts compiling it in the background.
+    // NOTE Implemented in TieredCompilation.cpp
+    void startTierUp();
+
+    // Returns the second-tier image if it's already compiled and loaded, null otherwise.
+    // NOTE Implemented in TieredCompilation.cpp
+    CNativeImage* tierUpImage() const;
+
+    // Waits for the background compilation of the second tier to finish, if it was started.
+    // NOTE Implemented in TieredCompilation.cpp
+    void joinTierUp();
+
+    // Entrypoint names as specified in SDomainCreation, or "Program::main" by default.
+    void getEntryPointNames(skizo::core::Auto<const skizo::core::CString>& epClassName,
+                            skizo::core::Auto<const skizo::core::CString>& epMethodName) const;
+
+    // Marks classes and static methods which are reachable from the entrypoint and other roots, so that the emitter
+    // could skip the rest. See SDomainCreation::DeadCodeElimination
+    // NOTE Implemented in DeadCodeElimination.cpp
+    void eliminateDeadCode();
+
+    // Marks methods to be compiled on first call with E_METHODFLAGS_IS_LAZY, so that the emitter skipped them.
+    // NOTE Implemented in LazyCompilation.cpp
+    void markLazyMethods();
+
+    // Links compilation trampolines in place of methods marked by markLazyMethods().
+    // NOTE Implemented in LazyCompilation.cpp
+    void registerLazyMethods();
+
+    // Emits and compiles a lazy unit for the method and the pending lazy methods of its declaring class, patches
+    // their trampolines. The global lock must be held.
+    // NOTE Implemented in LazyCompilation.cpp
+    void compileLazyMethod(CMethod* method, void* trampoline);
+
+    // Frees TCC states of lazily compiled methods.
+    // NOTE Implemented in LazyCompilation.cpp
+    void deleteLazyUnits();
+
+    // Precomputes itables (see CClass::ITable()) for reachable classes and interfaces.
+    // NOTE Implemented in InterfaceDispatch.cpp
+    void buildITables();
+
+    // Precomputes class hierarchy displays and interface conformance bitsets for constant-time type tests
+    // (see CClass::Is(..)).
+    // NOTE Implemented in TypeTests.cpp
+    void buildTypeTests();
+
     // Verifies all native methods defined in Skizo code have actual machine code implementations linked in.
     void verifyICallIsRegistered(CMethod* pMethod) const;
 
@@ -489,6 +671,9 @@ private:
 
     // Initializes metadata for basic types.
     void initBasicClasses();
+
+    // Shared by Break() and BreakAt(..) Implemented in Debugging.cpp
+    void breakImpl(const CMethod* method, void** localRefs, int size);
     void initStringClass();
     void initRangeStruct();
     void initPredicateClass();
@@ -649,6 +834,25 @@ private:
     // Thunk Manager.
     SThunkManager m_thunkMngr;
 
+    // See SDomainCreation::StartupTracePath
+    SStartupTrace m_startupTrace;
+
+    // See SDomainCreation::SamplingFrequency
+    SSamplingProfiler m_samplingProfiler;
+    int m_samplingFrequency;
+
+    // See SDomainCreation::PerfMapEnabled
+    SPerfMap m_perfMap;
+
+    // See SDomainCreation::DebugInfoEnabled
+    SGdbJit m_gdbJit;
+
+    // See SDomainCreation::PatchableBreakpoints
+    SBreakpointPatcher m_bpPatcher;
+
+    // See SDomainCreation::CostCountingEnabled
+    SCostCounter m_costCounter;
+
     // External call (nmodules) cache.
     SECallCache m_ecallCache;
 
@@ -667,6 +871,24 @@ private:
     bool m_explicitNullCheck;
     bool m_safeCallbacks;
     bool m_inlineBranching;
+    skizo::core::Auto<const skizo::core::CString> m_nativeCompiler; // null if TCC is used
+    bool m_tieredCompilation; // TCC first, m_nativeCompiler in the background
+    bool m_deadCodeElimination;
+    bool m_lazyCompilation; // only with TCC
+    int m_stackSize;
+
+    // Lazy compilation: the header shared by all lazy units, main image symbols it refers to, a TCC state per
+    // compiled batch of methods, and names owned by the domain (freed with CString::FreeUtf8(..)).
+    char* m_lazyUnitHeader;
+    skizo::core::Auto<skizo::collections::CHashMap<const char*, void*> > m_lazyUnitExternals;
+    skizo::core::Auto<skizo::collections::CArrayList<TCCState*> > m_lazyUnits;
+    skizo::core::Auto<skizo::collections::CArrayList<char*> > m_lazyNames;
+
+    int m_devirtualizedCallCount;
+    int m_deadClassCount;
+    int m_deadMethodCount;
+    int m_tailCallCount;
+    SConstantFoldingStats m_constantFoldingStats;
 
     // ******************************************************
     //   Supporting structures for the "import" expression.
@@ -683,10 +905,18 @@ private:
 
     // *****************************************************
 
-    // A stack of references to CMethod*, populated at runtime by _soX_pushframe/
-    // _soX_popframe only, and if only SDomainCreation::StackTraceEnabled is set to true.
+    // The innermost frame of the shadow stack, linked/unlinked by the emitted code directly (or by
+    // _soX_pushframe_prf/_soX_popframe_prf), and if only SDomainCreation::StackTraceEnabled is set to true.
     // Allows to print nicer errors.
-    skizo::core::Auto<skizo::collections::CStack<void*>> m_stackFrames;
+    // The frames live on the C stack, so an abort snapshots them into m_abortFrames before unwinding and
+    // resets the list (see CDomain::abortImpl(..)); SVirtualUnwinder restores it.
+    SStackFrame* m_topFrame;
+    void* m_stackLimit;
+    void* m_stackEnd;
+
+    // References to CMethod*, the frames at the moment of the last abort, innermost first.
+    // Stack traces printed when the shadow stack is empty (by catch sites, after the unwinding) use it.
+    skizo::core::Auto<skizo::collections::CArrayList<void*>> m_abortFrames;
 
     // *******************
     //   Soft debugging.
@@ -703,7 +933,7 @@ private:
     //  c) N locals according to pMethod
     //  d) the total size of the frame (so that _soX_unreglocals could quickly unwind it)
     //
-    // The current pMethod is found via m_stackFrames because SoftDebuggingEnabled guarantees
+    // The current pMethod is found via m_topFrame because SoftDebuggingEnabled guarantees
     // stack tracing is enabled (see CDomain::CreateDomain).
     skizo::core::Auto<skizo::collections::CStack<void*>> m_debugDataStack;
 
@@ -712,7 +942,8 @@ private:
     // *************************
     //   Used by the profiler.
     // *************************
-    so_long m_time;
+    so_long m_time; // in nanoseconds
+    SCallProfiler m_callProfiler;
     skizo::core::Auto<const skizo::core::CString> m_domainName;
     // *************************
 
@@ -721,6 +952,8 @@ private:
 
     // Code generator.
     TCCState* m_tccState;
+    skizo::core::Auto<CNativeImage> m_nativeImage; // used instead of m_tccState if SDomainCreation::NativeCompiler is set
+    skizo::core::Auto<skizo::core::CThread> m_tierUpThread; // compiles the second tier (see TieredCompilation.cpp)
     bool m_readyForEpilog; // If the state is not ready at the time of an abort, don't call the epilog!
 
     // Used by NewUniqueId().
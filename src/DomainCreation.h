@@ -72,6 +72,15 @@ public:
      */
     void* StackBase;
 
+    /**
+     * The size of the stacks of threads which run remote domains created by this domain (see Domain::run..),
+     * in bytes. Inherited by remote domains. 0 (the default) means the platform's default.
+     * The stack of the current thread is controlled by the host.
+     * NOTE Stack overflows are detected against the actual bounds of the thread's stack: on Unix, with the guard
+     * page at its end, on Windows, proactively on frame entry (only if StackTraceEnabled is true).
+     */
+    int StackSize;
+
     /**
      * See SMemoryManager::MaxGCMemory
      */
@@ -128,6 +137,86 @@ public:
      */
     bool InlineBranching;
 
+    /**
+     * If non-null, the emitted C code is compiled with the specified optimizing system C compiler
+     * (for example, "cc", "gcc" or "clang") and loaded as a shared object instead of being compiled
+     * with the baseline C compiler (TCC). Startup is considerably slower, but the generated code is
+     * several times faster. Null by default.
+     * NOTE The compiler must be able to produce 32-bit code (-m32).
+     * NOTE So far, supported on Linux only.
+     * NOTE The stack scan of the GC accepts pointers into the middle of objects, as optimized code may keep
+     * no pointer to the start of an object which is still in use (see SMemoryManager::EnableInteriorPointers(..))
+     */
+    const char* NativeCompiler;
+
+    /**
+     * Only makes sense together with NativeCompiler. The domain starts up quickly with the baseline C compiler
+     * (TCC), while the program is recompiled with the native compiler in a background thread. Once the native
+     * image is ready, methods which were called more than SKIZO_TIERUP_THRESHOLD times are redirected to their
+     * optimized versions. False by default.
+     */
+    bool TieredCompilation;
+
+    /**
+     * Classes and static methods which can't be reached from the entrypoint, static constructors or forced types
+     * are neither emitted nor compiled. False by default.
+     * NOTE Code which is only ever called by the host through CDomain::GetFunctionPointer(..) is invisible to
+     * the analysis: such classes or methods should be marked with the [preserve] attribute before enabling
+     * the option.
+     */
+    bool DeadCodeElimination;
+
+    /**
+     * The main image contains only stubs for most methods: the body of a method is emitted and compiled with TCC
+     * on its first call. Improves startup time of large programs which use only a fraction of their code.
+     * Ignored if NativeCompiler is set. False by default.
+     */
+    bool LazyCompilation;
+
+    /**
+     * If non-null, the time spent on every phase of the startup (reading, tokenizing and parsing of every module,
+     * transformation passes, emission, compilation, relocation, static constructors) along with counts of tokens,
+     * expressions and classes, and memory usage, are saved to the specified file in the Chrome trace event format
+     * (JSON; see chrome://tracing). Null by default.
+     */
+    const char* StartupTracePath;
+
+    /**
+     * If non-zero, the domain's thread is sampled this many times per second of its CPU time while the entrypoint
+     * runs (see SamplingProfiler.h) Much cheaper and more precise than ProfilingEnabled, but statistical.
+     * Implies StackTraceEnabled, as samples are taken from the frame stack. Unix only. Zero by default.
+     */
+    int SamplingFrequency;
+
+    /**
+     * If true, every function compiled by TCC and every thunk is written to /tmp/perf-<pid>.map, so that Linux perf
+     * could attribute samples in generated code to Skizo methods (see PerfMap.h) Unix only. False by default.
+     */
+    bool PerfMapEnabled;
+
+    /**
+     * If true, TCC generates debug info, with line numbers pointing to the .skizo files, and every relocated unit
+     * is registered with GDB's JIT interface, so that GDB could show emitted methods and their source lines in
+     * backtraces and step through them (see GdbJit.h) Slows down compilation. Unix only. False by default.
+     */
+    bool DebugInfoEnabled;
+
+    /**
+     * If true, the debugger can set breakpoints at arbitrary lines without recompiling the program: every statement
+     * is preceded by a NOP which is patched into a jump once a breakpoint is set (see BreakpointPatcher.h) Unlike
+     * SoftDebuggingEnabled, costs nearly nothing until a breakpoint is hit, but increases the size of the code.
+     * Implies StackTraceEnabled, disables LazyCompilation. The domain isn't created if NativeCompiler is set, as only
+     * the baseline C compiler keeps locals where patch points can read them. False by default.
+     */
+    bool PatchableBreakpoints;
+
+    /**
+     * If true, the emitted code counts calls of every method, executed statements (weighted by kind) and calls
+     * of runtime helpers (see CostCounter.h) Unlike timings, the counts don't depend on the hardware and are
+     * the same from run to run. Slows down execution. False by default.
+     */
+    bool CostCountingEnabled;
+
     /**
      * Registers a new icall. Every native method defined in the Skizo code must have a corresponding ICall.
      * TODO the name is lowercause, unlike the other public methods.
@@ -159,6 +248,7 @@ public:
           EntryPointMethod(0),
           IsUntrusted(false),
           StackBase(nullptr),
+          StackSize(0),
           MaxGCMemory(SKIZO_MAX_GC_MEMORY),
           DumpCCode(false),
           StackTraceEnabled(false),
@@ -167,6 +257,16 @@ public:
           ExplicitNullCheck(true),
           SafeCallbacks(false),
           InlineBranching(true),
+          NativeCompiler(nullptr),
+          TieredCompilation(false),
+          DeadCodeElimination(false),
+          LazyCompilation(false),
+          StartupTracePath(nullptr),
+          SamplingFrequency(0),
+          PerfMapEnabled(false),
+          DebugInfoEnabled(false),
+          PatchableBreakpoints(false),
+          CostCountingEnabled(false),
           BreakpointCallback(nullptr),
           GCStatsEnabled(false),
           iCalls(new skizo::collections::CHashMap<const char*, void*>()),
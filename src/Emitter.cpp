@@ -17,6 +17,7 @@
 #include "Field.h"
 #include "Local.h"
 #include "Method.h"
+#include "ModuleDesc.h"
 #include "ScriptUtils.h"
 #include "StringBuilder.h"
 #include "StringSlice.h"
@@ -26,6 +27,21 @@ namespace skizo { namespace script {
 using namespace core;
 using namespace collections;
 
+// An inlined method call being emitted (see CCallExpression::IsInlined). While the method's return expression is
+// emitted, references to its params and to "self" are replaced with the argument expressions of the call, which are
+// emitted in the context of the caller (or with temporaries which hold them, see SEmitter::emitInlinedCallExpr(..)).
+struct SInlineFrame
+{
+    const CMethod* Method;
+    const CMethod* CallerMethod;
+    const CCallExpression* CallExpr;
+    const SInlineFrame* Parent;
+
+    // Ids of temporaries which hold the arguments evaluated in advance (item 0 is "self", then params), -1 for
+    // arguments emitted in place.
+    const CArrayList<int>* ArgTemps;
+};
+
 struct SEmitter
 {
     CDomain* domain;
@@ -38,14 +54,39 @@ struct SEmitter
     Auto<CArrayList<CField*>> staticHeapFields; // used when emitting static ctors
     Auto<CArrayList<CField*>> staticValueTypeFields; // valuetypes have special handling
 
-    SEmitter(CDomain* _domain, STextBuilder& cb)
+    // Tiered compilation: the second tier shares data (static fields, vtables) with the first tier.
+    // Names of such data symbols are collected here (to be freed with CString::FreeUtf8(..)).
+    CArrayList<char*>* sharedSymbols; // null for the first tier
+    STextBuilder sharedSymbolCB;
+
+    // Lazy compilation: lazily compiled methods are compiled in separate units which refer to the data and
+    // functions of the main image.
+    bool isLazyUnit;
+
+    // The innermost inlined call being emitted, or null.
+    const SInlineFrame* inlineFrame;
+
+    // Patchable breakpoints: ids of the patch points of the method being emitted (see SBreakpointPatcher).
+    Auto<CArrayList<int> > patchPoints;
+
+    SEmitter(CDomain* _domain, STextBuilder& cb, CArrayList<char*>* _sharedSymbols = nullptr)
         : domain(_domain),
           mainCB(cb),
           staticHeapFields(new CArrayList<CField*>()),
-          staticValueTypeFields(new CArrayList<CField*>())
+          staticValueTypeFields(new CArrayList<CField*>()),
+          sharedSymbols(_sharedSymbols),
+          isLazyUnit(false),
+          inlineFrame(nullptr),
+          patchPoints(new CArrayList<int>())
     {
     }
 
+    bool isSecondTier() const { return sharedSymbols != nullptr; }
+    void addSharedSymbol();
+
+    // Static fields and vtables are defined elsewhere.
+    bool refersToMainImage() const { return isSecondTier() || isLazyUnit; }
+
     void appendCapturePath(STextBuilder& cb,
                            const CClass* declClass,
                            const CMethod* useMethod,
@@ -54,10 +95,18 @@ struct SEmitter
 
     void emitStructHeader(const CClass* klass, bool isFull);
     void emitFunctionHeader(const CMethod* method, EMethodKind methodKind, bool isVirtualCallHelper = false);
+    // Emits a #line directive which maps the following C code to the .skizo source, if debug info is enabled.
+    void emitLineDirective(STextBuilder& cb, const CMethod* method, const SMetadataSource& source);
     void emitFunctionHeaders(const CClass* klass);
     void emitVCH(const CMethod* method, bool headerOnly); // VCH = virtual call helper
     void emitBodyExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr, bool isTop);
+    // Emits "get"/"set"/"length" on arrays as inline C expressions; returns false if it's not possible.
+    bool emitArrayAccessExpr(STextBuilder& cb, const CMethod* method, const CCallExpression* callExpr);
+    bool isBeingInlined(const CMethod* method) const;
+    void emitInlinedCallExpr(STextBuilder& cb, const CMethod* method, const CCallExpression* callExpr);
+    void emitInlinedArg(STextBuilder& cb, int argIndex, const STypeRef* expectedType); // 0 for "self"
+    bool emitInlinedIdentExpr(STextBuilder& cb, const CIdentExpression* identExpr);
     void emitIdentExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitIntConstExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitFloatConstExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
@@ -66,6 +115,9 @@ struct SEmitter
     void emitNullConstExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitBoolConstExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitReturnExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
+    // Self-recursive calls in tail position (see CCallExpression::IsTailCall).
+    bool isTailCall(const CExpression* expr) const;
+    void emitTailCall(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitCCodeExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
 
     // "expectedType" allows to automatically cast the value to the target type if an implicit cast occurs (upcast).
@@ -84,7 +136,17 @@ struct SEmitter
     void emitRefExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitBreakExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitInlinedCondExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
+    void emitInlinedLoopExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr);
     void emitBodyStatements(STextBuilder& cb, const CMethod* method, const CArrayList<CExpression*>* exprs);
+    // Emits a NOP to be patched into a jump once a breakpoint is set at the statement, if patchable breakpoints are enabled.
+    void emitPatchPoint(STextBuilder& cb, const CMethod* method, const SMetadataSource& source);
+    // Emits cold blocks, which patch points jump to, for the method being emitted.
+    void emitPatchPointHandlers(STextBuilder& cb, const CMethod* method);
+    // Emits an array of references to "self", parameters and locals named "arrayName"; returns the size of the array.
+    int emitLocalRefs(STextBuilder& cb, const CMethod* method, const char* arrayName);
+    // Cost counting: emits an increment of the method's cost by the weights of the statements of the basic block
+    // which starts at "startIndex" (see SCostCounter).
+    void emitCostCounter(STextBuilder& cb, const CMethod* method, const CArrayList<CExpression*>* exprs, int startIndex);
 
     // "specificClass" allows to override the type of "self" from what is defined in "method".
     // Situation: a base class implements a method, and a subclass doesn't override it.
@@ -98,6 +160,7 @@ struct SEmitter
     void emitStaticFieldName(STextBuilder& cb, const CField* field);
     void emitExplicitNullCheck(const CMethod* method);
     void emitInstanceMethod(const CMethod* method);
+    void emitStaticMethod(const CMethod* method);
     void emitInstanceCtor(const CClass* klass, const CMethod* method);
     void emitFunctionBody(STextBuilder& cb, const CMethod* method);
     void emitEventFire(STextBuilder& cb, const CMethod* method);
@@ -113,11 +176,14 @@ struct SEmitter
     void emitDtorName(const CMethod* method);
     void emitVTable(const CClass* klass);
     void emitStaticCtorDtor(const CClass* klass);
-    void emitArrayInitHelper(const CArrayInitializationType* initType, int helperId);
-    void emitIdentCompHelper(const CClass* valueTypeClass);
-    void emitUnboxHelper(const CClass* boxedClass);
+    void emitArrayInitHelper(const CArrayInitializationType* initType, int helperId, bool headerOnly);
+    void emitIdentCompHelper(const CClass* valueTypeClass, bool headerOnly);
+    void emitUnboxHelper(const CClass* boxedClass, bool headerOnly);
+    void emitHelpers(bool headerOnly);
 
+    void emitDeclarations();
     void emit();
+    void emitLazyUnitHeader();
 };
 
 void SEmitter::emitStaticFieldName(STextBuilder& cb, const CField* field)
@@ -263,7 +329,23 @@ void SEmitter::emitStructHeader(const CClass* klass, bool isFull)
         for(int i = 0; i < staticFields->Count(); i++) {
             const CField* field = staticFields->Array()[i];
 
-            mainCB.Emit("static %t ", &field->Type);
+            // The second tier refers to the static fields of the first tier. Hence, they're global with tiered
+            // compilation, or tcc_get_symbol(..) wouldn't be able to find them.
+            if(refersToMainImage()) {
+                mainCB.Emit("extern %t ", &field->Type);
+                emitStaticFieldName(mainCB, field);
+                mainCB.Emit(";\n");
+
+                if(isSecondTier()) {
+                    emitStaticFieldName(sharedSymbolCB, field);
+                    addSharedSymbol();
+                }
+                continue;
+            } else if(domain->TieredCompilation() || domain->LazyCompilation()) {
+                mainCB.Emit("%t ", &field->Type);
+            } else {
+                mainCB.Emit("static %t ", &field->Type);
+            }
             emitStaticFieldName(mainCB, field);
 
             if(field->Type.IsStructClass()) {
@@ -400,10 +482,23 @@ void SEmitter::emitVCH(const CMethod* method, bool headerOnly)
 // TODO Add only public/protected methods to the vtable.
 void SEmitter::emitVTable(const CClass* klass)
 {
-    if(klass->EmitVTable() && klass->HasVTable()) {
+    if(klass->EmitVTable() && klass->HasVTable() && klass->IsReachable()) {
         const CArrayList<CMethod*>* instanceMethods = klass->InstanceMethods();
         const int methodCount = instanceMethods->Count();
 
+        // Vtables are registered by the first tier's prolog, the second tier (and lazy units) reuse them.
+        if(refersToMainImage()) {
+            mainCB.Emit("extern void* _soX_vtbl_%s[%d];\n",
+                        &klass->FlatName(),
+                        methodCount + 1);
+
+            if(isSecondTier()) {
+                sharedSymbolCB.Emit("_soX_vtbl_%s", &klass->FlatName());
+                addSharedSymbol();
+            }
+            return;
+        }
+
         mainCB.Emit("void* _soX_vtbl_%s[%d] = {\n",
                     &klass->FlatName(),
                     methodCount + 1);
@@ -449,8 +544,43 @@ void SEmitter::emitFunctionName(STextBuilder& cb, const CMethod* method, bool is
     }
 }
 
+void SEmitter::emitLineDirective(STextBuilder& cb, const CMethod* method, const SMetadataSource& source)
+{
+    // Expressions inlined from other modules keep the line of the method they're inlined into.
+    if(!domain->DebugInfoEnabled()
+    || !source.Module
+    || !source.Module->FilePath
+    || source.Module != method->Source().Module
+    || source.LineNumber <= 0)
+    {
+        return;
+    }
+
+    // Backslashes in Windows paths and quotes must be escaped inside the C string literal.
+    Utf8Auto filePath (source.Module->FilePath->ToUtf8());
+    const size_t length = strlen(filePath);
+    char* escaped = new char[length * 2 + 1];
+    char* dst = escaped;
+    for(const char* src = filePath; *src; src++) {
+        if(*src == '\\' || *src == '"') {
+            *dst++ = '\\';
+        }
+        *dst++ = *src;
+    }
+    *dst = 0;
+
+    // The directive must start on a new line.
+    cb.Emit("\n#line %d \"%S\"\n", source.LineNumber, escaped);
+    delete [] escaped;
+}
+
 void SEmitter::emitFunctionHeader(const CMethod* method, EMethodKind methodKind, bool isVirtualCallHelper)
 {
+    // Definitions (and prototypes, which is harmless) start at the method's line.
+    if(!isVirtualCallHelper) {
+        emitLineDirective(mainCB, method, method->Source());
+    }
+
     switch(method->SpecialMethod()) {
         case E_SPECIALMETHOD_NATIVE:
         case E_SPECIALMETHOD_CLOSURE_CTOR:
@@ -594,6 +724,10 @@ void SEmitter::emitIdentExpr(STextBuilder& cb, const CMethod* method, const CExp
     SKIZO_REQ_EQUALS(expr->Kind(), E_EXPRESSIONKIND_IDENT);
     const CIdentExpression* identExpr = static_cast<const CIdentExpression*>(expr);
 
+    if(inlineFrame && method == inlineFrame->Method && emitInlinedIdentExpr(cb, identExpr)) {
+        return;
+    }
+
     // ********
     // Appends.
     // ********
@@ -719,13 +853,11 @@ void SEmitter::emitReturnExpr(STextBuilder& cb, const CMethod* method, const CEx
 
     if(domain->ProfilingEnabled() && !isUnsafe) {
         // Profiling emits a separate dedicated epilog, unlike stackTraceEnabled.
-        // NOTE _soX_tc in this code is a special variable that was returned by the epilog
-        // (_soX_pushframe_prf)
 
         cb.Emit("%t _soX_r = ", &method->Signature().ReturnType);
         emitValueExpr(cb, method, returnExpr->Expr, &method->Signature().ReturnType, true);
         cb.Emit(";\n"
-                "_soX_popframe_prf((void*)%p, _soX_tc);\n"
+                "_soX_popframe_prf((void*)%p, &_soX_frame);\n"
                 "return _soX_r;\n", (void*)domain);
     } else if(domain->StackTraceEnabled() && !isUnsafe) {
         // Stack trace information.
@@ -735,14 +867,49 @@ void SEmitter::emitReturnExpr(STextBuilder& cb, const CMethod* method, const CEx
         cb.Emit("%t _soX_r = ", &method->Signature().ReturnType);
         emitValueExpr(cb, method, returnExpr->Expr, &method->Signature().ReturnType, true);
         cb.Emit(";\n"
-                "_soX_popframe((void*)%p);\n"
-                "return _soX_r;\n", (void*)domain);
+                "_soX_POPFRAME(%p);\n"
+                "return _soX_r;\n", (void*)domain->TopFrameAddress());
     } else {
         cb.Emit("return ");
         emitValueExpr(cb, method, returnExpr->Expr, 0, true);
     }
 }
 
+bool SEmitter::isTailCall(const CExpression* expr) const
+{
+    // The label to jump to belongs to the function being emitted, not to a method inlined into it.
+    return expr
+        && !inlineFrame
+        && expr->Kind() == E_EXPRESSIONKIND_CALL
+        && static_cast<const CCallExpression*>(expr)->IsTailCall;
+}
+
+void SEmitter::emitTailCall(STextBuilder& cb, const CMethod* method, const CExpression* expr)
+{
+    const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+    SKIZO_REQ_EQUALS(callExpr->uTargetMethod, method);
+
+    const CArrayList<CParam*>* params = method->Signature().Params;
+    SKIZO_REQ_EQUALS(callExpr->Exprs->Count(), params->Count() + 2);
+
+    // All arguments are evaluated before any param is reassigned, as they may refer to the params.
+    cb.Emit("{\n");
+    for(int i = 0; i < params->Count(); i++) {
+        const CParam* param = params->Array()[i];
+
+        cb.Emit("%t _soX_arg%d = ", &param->Type, i);
+        emitValueExpr(cb, method, callExpr->Exprs->Array()[i + 2], &param->Type);
+        cb.Emit(";\n");
+    }
+    for(int i = 0; i < params->Count(); i++) {
+        cb.Emit("l_%s = _soX_arg%d;\n", &params->Array()[i]->Name, i);
+    }
+
+    // The frame pushed by the prolog (if any) is reused.
+    cb.Emit("goto _soX_start;\n"
+            "}\n");
+}
+
 void SEmitter::emitCCodeExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr)
 {
     SKIZO_REQ_EQUALS(expr->Kind(), E_EXPRESSIONKIND_CCODE);
@@ -755,7 +922,10 @@ void SEmitter::emitThisExpr(STextBuilder& cb, const CMethod* method, const CExpr
 {
     SKIZO_REQ_EQUALS(expr->Kind(), E_EXPRESSIONKIND_THIS);
 
-    if(method->ParentMethod()) {
+    if(inlineFrame && method == inlineFrame->Method) {
+        const STypeRef declTypeRef (method->DeclaringClass()->ToTypeRef());
+        emitInlinedArg(cb, 0, &declTypeRef);
+    } else if(method->ParentMethod()) {
         const CThisExpression* thisExpr = static_cast<const CThisExpression*>(expr);
         SKIZO_REQ_PTR(thisExpr->DeclMethod);
 
@@ -789,8 +959,15 @@ void SEmitter::emitCastExpr(STextBuilder& cb, const CMethod* method, const CExpr
 
             // Downcasts require dynamic check for the target type.
             case E_CASTTYPE_DOWNCAST:
-                // Hardcoded class reference.
-                cb.Emit("_soX_downcast((void*)%p, ", (void*)castExpr->InferredType.ResolvedClass);
+                // Hardcoded class reference. The exact class is checked inline only if the expression can be
+                // evaluated several times (objects are never instances of interfaces exactly).
+                if((castExpr->Expr->Kind() == E_EXPRESSIONKIND_IDENT || castExpr->Expr->Kind() == E_EXPRESSIONKIND_THIS)
+                 && castExpr->InferredType.ResolvedClass->SpecialClass() != E_SPECIALCLASS_INTERFACE)
+                {
+                    cb.Emit("_soX_DOWNCAST((void*)%p, ", (void*)castExpr->InferredType.ResolvedClass);
+                } else {
+                    cb.Emit("_soX_downcast((void*)%p, ", (void*)castExpr->InferredType.ResolvedClass);
+                }
                 break;
 
             case E_CASTTYPE_BOX:
@@ -937,6 +1114,23 @@ void SEmitter::emitBodyExpr(STextBuilder& cb, const CMethod* method, const CExpr
 
     cb.Emit("(%t)", &closureExpr->InferredType);
 
+    // ******************************************************************************
+    //   A closure which never escapes (see CBodyExpression::IsStackAllocated) lives
+    //   in the frame of the current function. The same storage is reused every
+    //   time the expression is evaluated, as the previous closure is dead by then.
+    // ******************************************************************************
+
+    if(closureExpr->IsStackAllocated) {
+        const int storageId = domain->NewUniqueId();
+        varSegCB.Emit("struct _soX_0Closure _soX_clo%d;\n", storageId);
+
+        cb.Emit("_soX_stackclosure(&_soX_clo%d, (void*)%p, %s)",
+                storageId,
+                (void*)closureExpr->GeneratedClosureClass,
+                method->ClosureEnvClass()? "_soX_newEnv": "0");
+        return;
+    }
+
     // ****************************
     //   Emits the function call.
     // ****************************
@@ -964,7 +1158,17 @@ void SEmitter::emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpr
         cb.Emit("(");
     }
 
-    if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL) {
+    if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL
+    && callExpr->IsInlined
+    && !isBeingInlined(callExpr->uTargetMethod))
+    {
+        emitInlinedCallExpr(cb, method, callExpr);
+    } else if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL
+    && callExpr->uTargetMethod->DeclaringClass()->SpecialClass() == E_SPECIALCLASS_ARRAY
+    && emitArrayAccessExpr(cb, method, callExpr))
+    {
+        // Done.
+    } else if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL) {
 
         const CMethod* targetMethod = callExpr->uTargetMethod;
 
@@ -976,11 +1180,11 @@ void SEmitter::emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpr
             primOpName = NeutralNameToPrimitiveOperator(targetMethod->Name(), domain);
 
             // **************************************************************************
-            // NOTE FIX "int::op_divide" isn't mapped to C's math operators so that the Emitter used a special function
-            // -- "_so_int_op_divide" -- which preemptively checks the divisor to avoid killing the whole process
-            // on divide by zero CPU fault.
+            // NOTE FIX "int::op_divide" and "int::op_modulo" aren't mapped to C's math operators so that the Emitter
+            // used special functions -- "_so_int_op_divide" and "_so_int_op_modulo" -- which preemptively check the
+            // divisor to avoid killing the whole process on divide by zero CPU fault.
             if(targetMethod->DeclaringClass()->PrimitiveType() == E_PRIMTYPE_INT
-            && primOpName.EqualsAscii("/"))
+            && (primOpName.EqualsAscii("/") || primOpName.EqualsAscii("%")))
             {
                 // Sets back to void.
                 primOpName.SetEmpty();
@@ -1049,17 +1253,24 @@ void SEmitter::emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpr
                     cb.Emit("(");
                     emitFunctionSig(cb, targetMethod, selfExpr->InferredType.ResolvedClass);
 
-                    cb.Emit("_soX_findmethod(");
+                    // Every call site has its own monomorphic inline cache. The cache is checked inline only if
+                    // "self" can be evaluated several times.
+                    void** inlineCache = domain->NewInlineCache();
+                    if(selfExpr->Kind() == E_EXPRESSIONKIND_IDENT || selfExpr->Kind() == E_EXPRESSIONKIND_THIS) {
+                        cb.Emit("_soX_ICFIND(");
+                    } else {
+                        cb.Emit("_soX_icfind(");
+                    }
                     emitValueExpr(cb, method, selfExpr);
 
-                    cb.Emit(", (void*)%p))(", (void*)targetMethod);
+                    cb.Emit(", (void**)%p, (void*)%p))(", (void*)inlineCache, (void*)targetMethod);
                     emitValueExpr(cb, method, selfExpr);
 
                     if((count - 2) > 0) {
                         cb.Emit(", ");
                     }
 
-                } else if(targetMethod->IsTrulyVirtual() || targetMethod->IsAbstract()) {
+                } else if((targetMethod->IsTrulyVirtual() && !targetMethod->IsEffectivelyFinal()) || targetMethod->IsAbstract()) {
 
                     // **************************************************************************
                     //   A virtual method call. Gets a function ptr by its index in the vtable,
@@ -1099,7 +1310,9 @@ void SEmitter::emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpr
                 } else {
 
                     // *************************************************************************
-                    // The method is not truly virtual: it's never overriden or never overrides.
+                    // The method is not truly virtual: it's never overriden or never overrides
+                    // (or it's the final implementation for every possible receiver, see
+                    // E_METHODFLAGS_IS_EFFECTIVELY_FINAL).
                     // We can by-pass the vtable system and call the method directly.
                     // *************************************************************************
 
@@ -1199,6 +1412,268 @@ void SEmitter::emitCallExpr(STextBuilder& cb, const CMethod* method, const CExpr
     }
 }
 
+// Mutually recursive methods are inlined only once.
+bool SEmitter::isBeingInlined(const CMethod* method) const
+{
+    for(const SInlineFrame* frame = inlineFrame; frame; frame = frame->Parent) {
+        if(frame->Method == method) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Arguments with side effects are evaluated into temporaries, then "self" is checked for null, as the callee's
+// prolog would do, then the return expression is evaluated: "(_soX_inl1 = arg, _soX_NN(self), expr)". With stack
+// traces, _soX_NNI(..) attributes a failed check to the inlined method.
+// See STransformer::canInlineCall(..)
+void SEmitter::emitInlinedCallExpr(STextBuilder& cb, const CMethod* method, const CCallExpression* callExpr)
+{
+    const CMethod* targetMethod = callExpr->uTargetMethod;
+    const CExpression* retExpr = static_cast<const CReturnExpression*>(targetMethod->Expression()->Exprs->Item(0))->Expr;
+    const CArrayList<CParam*>* params = targetMethod->Signature().Params;
+    const CClass* declClass = targetMethod->DeclaringClass();
+    const STypeRef declTypeRef (declClass->ToTypeRef());
+
+    const CExpression* selfExpr = targetMethod->Signature().IsStatic? nullptr: callExpr->Exprs->Item(0);
+    const bool isRefSelf = selfExpr && !declClass->IsValueType();
+    // With stack traces, the receiver is checked even without explicit null checks: a hardware fault would be
+    // attributed to the caller, as the inlined method has no frame of its own.
+    const bool nullCheck = isRefSelf
+                        && (domain->ExplicitNullCheck() || domain->StackTraceEnabled())
+                        && selfExpr->Kind() != E_EXPRESSIONKIND_THIS;
+
+    Auto<CArrayList<int> > argTemps (new CArrayList<int>());
+    bool needsComma = nullCheck;
+    for(int i = 0; i <= params->Count(); i++) {
+        const CExpression* argExpr = i? callExpr->Exprs->Item(i + 1): selfExpr;
+
+        if(argExpr && !argExpr->IsStable() && (i || isRefSelf)) {
+            const int tempId = domain->NewUniqueId();
+            varSegCB.Emit("%t _soX_inl%d;\n", i? &params->Item(i - 1)->Type: &declTypeRef, tempId);
+            argTemps->Add(tempId);
+            needsComma = true;
+        } else {
+            argTemps->Add(-1);
+        }
+    }
+
+    if(needsComma) {
+        cb.Emit("(");
+    }
+
+    for(int i = 0; i <= params->Count(); i++) {
+        const int tempId = argTemps->Item(i);
+
+        if(tempId != -1) {
+            cb.Emit("_soX_inl%d = ", tempId);
+            emitValueExpr(cb, method, i? callExpr->Exprs->Item(i + 1): selfExpr, i? &params->Item(i - 1)->Type: &declTypeRef);
+            cb.Emit(", ");
+        }
+    }
+
+    SInlineFrame frame;
+    frame.Method = targetMethod;
+    frame.CallerMethod = method;
+    frame.CallExpr = callExpr;
+    frame.Parent = inlineFrame;
+    frame.ArgTemps = argTemps;
+
+    // The callee's expression is emitted in the context of the callee.
+    inlineFrame = &frame;
+
+    if(nullCheck) {
+        // 2 == SKIZO_ERRORCODE_NULLDEREFERENCE (see icall.h)
+        cb.Emit(domain->StackTraceEnabled()? "_soX_NNI(": "_soX_NN(");
+        emitInlinedArg(cb, 0, &declTypeRef);
+        if(domain->StackTraceEnabled()) {
+            cb.Emit(", %p, %p", (void*)domain, (void*)targetMethod);
+        }
+        cb.Emit("), ");
+    }
+
+    emitValueExpr(cb, targetMethod, retExpr, &targetMethod->Signature().ReturnType);
+    inlineFrame = frame.Parent;
+
+    if(needsComma) {
+        cb.Emit(")");
+    }
+}
+
+// Argument expressions belong to the caller, which can be an inlined method itself.
+void SEmitter::emitInlinedArg(STextBuilder& cb, int argIndex, const STypeRef* expectedType)
+{
+    const SInlineFrame* frame = inlineFrame;
+
+    const int tempId = frame->ArgTemps->Item(argIndex);
+    if(tempId != -1) {
+        cb.Emit("_soX_inl%d", tempId);
+        return;
+    }
+
+    inlineFrame = frame->Parent;
+    cb.Emit("(");
+    emitValueExpr(cb, frame->CallerMethod, frame->CallExpr->Exprs->Item(argIndex? argIndex + 1: 0), expectedType);
+    cb.Emit(")");
+    inlineFrame = frame;
+}
+
+bool SEmitter::emitInlinedIdentExpr(STextBuilder& cb, const CIdentExpression* identExpr)
+{
+    const CMethod* targetMethod = inlineFrame->Method;
+    const SResolvedIdentType& resolvedIdent = identExpr->ResolvedIdent;
+
+    if(resolvedIdent.EType == E_RESOLVEDIDENTTYPE_PARAM) {
+        const CArrayList<CParam*>* params = targetMethod->Signature().Params;
+
+        for(int i = 0; i < params->Count(); i++) {
+            const CParam* param = params->Array()[i];
+
+            if(param == resolvedIdent.AsParam_) {
+                emitInlinedArg(cb, i + 1, &param->Type);
+                return true;
+            }
+        }
+
+        SKIZO_REQ_NEVER
+    } else if(resolvedIdent.EType == E_RESOLVEDIDENTTYPE_FIELD && !resolvedIdent.AsField_->IsStatic) {
+        const CClass* declClass = targetMethod->DeclaringClass();
+        const STypeRef declTypeRef (declClass->ToTypeRef());
+
+        // See STransformer::canInlineCall(..): valuetype "self" expressions are never temporaries.
+        emitInlinedArg(cb, 0, &declTypeRef);
+        cb.Emit(declClass->IsValueType()? ".": "->");
+        emitInstanceFieldName(cb, resolvedIdent.AsField_);
+        return true;
+    }
+
+    return false;
+}
+
+// Can the expression be evaluated twice with the same result and no side effects?
+static bool isSimpleArrayAccessArg(const CExpression* expr)
+{
+    return expr->Kind() == E_EXPRESSIONKIND_IDENT || expr->Kind() == E_EXPRESSIONKIND_INTCONSTANT;
+}
+
+// Can the value of the expression be changed by evaluating another expression? (Captured locals can be changed by
+// closures, fields can be changed by anything.)
+static bool isStableArrayAccessArg(const CExpression* expr)
+{
+    if(expr->Kind() == E_EXPRESSIONKIND_INTCONSTANT) {
+        return true;
+    } else if(expr->Kind() == E_EXPRESSIONKIND_IDENT) {
+        const SResolvedIdentType& resolvedIdent = static_cast<const CIdentExpression*>(expr)->ResolvedIdent;
+        return (resolvedIdent.EType == E_RESOLVEDIDENTTYPE_LOCAL || resolvedIdent.EType == E_RESOLVEDIDENTTYPE_PARAM)
+            && !resolvedIdent.AsLocal_->IsCaptured;
+    } else {
+        return false;
+    }
+}
+
+bool SEmitter::emitArrayAccessExpr(STextBuilder& cb, const CMethod* method, const CCallExpression* callExpr)
+{
+    const CMethod* targetMethod = callExpr->uTargetMethod;
+    const CExpression* selfExpr = callExpr->Exprs->Item(0);
+    const bool nullCheck = domain->ExplicitNullCheck();
+
+    // *********************
+    //   0Array_%d::length
+    // *********************
+
+    if(targetMethod->Name().EqualsAscii("length")) {
+        if(!nullCheck) {
+            cb.Emit("_soX_ARRLENGTH(");
+            emitValueExpr(cb, method, selfExpr);
+            cb.Emit(")");
+            return true;
+        } else if(isSimpleArrayAccessArg(selfExpr)) {
+            cb.Emit("(_soX_ARRNN(");
+            emitValueExpr(cb, method, selfExpr);
+            cb.Emit("), _soX_ARRLENGTH(");
+            emitValueExpr(cb, method, selfExpr);
+            cb.Emit("))");
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    // ****************************
+    //   0Array_%d::get/set
+    // ****************************
+
+    const bool isSet = targetMethod->Name().EqualsAscii("set");
+    if(!isSet && !targetMethod->Name().EqualsAscii("get")) {
+        return false;
+    }
+
+    const CExpression* indexExpr = callExpr->Exprs->Item(2);
+    const STypeRef& indexType = targetMethod->Signature().Params->Item(0)->Type;
+    const CExpression* valueExpr = isSet? callExpr->Exprs->Item(3): nullptr;
+    const STypeRef* valueType = isSet? &targetMethod->Signature().Params->Item(1)->Type: nullptr;
+    int valueTempId = -1; // -1 if the value isn't stored to a temporary
+
+    if(!callExpr->SkipRangeCheck) {
+        // "self" and the index are evaluated more than once: for the checks and for the access itself.
+        if(!isSimpleArrayAccessArg(selfExpr) || !isSimpleArrayAccessArg(indexExpr)) {
+            return false;
+        }
+
+        // Preserves the order of evaluation of the original call: the value can't change the array or the index
+        // after the checks.
+        if(isSet && (!isStableArrayAccessArg(selfExpr) || !isStableArrayAccessArg(indexExpr))) {
+            return false;
+        }
+
+        // Comma expressions with struct values are avoided.
+        const STypeRef& itemType = isSet? *valueType: targetMethod->Signature().ReturnType;
+        if(itemType.ResolvedClass && itemType.ResolvedClass->IsValueType() && itemType.PrimType == E_PRIMTYPE_OBJECT) {
+            return false;
+        }
+
+        // As with the call, the value is evaluated before the checks: if a check fails, its side effects have
+        // still taken place.
+        if(isSet && !isStableArrayAccessArg(valueExpr)) {
+            valueTempId = domain->NewUniqueId();
+            varSegCB.Emit("%t _soX_arrval%d;\n", valueType, valueTempId);
+
+            cb.Emit("(_soX_arrval%d = ", valueTempId);
+            emitValueExpr(cb, method, valueExpr, valueType);
+            cb.Emit(", ");
+        }
+
+        // 0 == SKIZO_ERRORCODE_RANGECHECK, 2 == SKIZO_ERRORCODE_NULLDEREFERENCE (see icall.h)
+        cb.Emit(nullCheck? "(_soX_ARRCHECKN(": "(_soX_ARRCHECK(");
+        emitValueExpr(cb, method, selfExpr);
+        cb.Emit(", ");
+        emitValueExpr(cb, method, indexExpr, &indexType);
+        cb.Emit("), ");
+    }
+
+    cb.Emit("_soX_ARRITEMS(");
+    emitValueExpr(cb, method, selfExpr);
+    cb.Emit(")[");
+    emitValueExpr(cb, method, indexExpr, &indexType);
+    cb.Emit("]");
+
+    if(isSet) {
+        cb.Emit(" = ");
+        if(valueTempId != -1) {
+            cb.Emit("_soX_arrval%d", valueTempId);
+        } else {
+            emitValueExpr(cb, method, valueExpr, valueType);
+        }
+    }
+
+    if(!callExpr->SkipRangeCheck) {
+        cb.Emit(valueTempId != -1? "))": ")");
+    }
+
+    return true;
+}
+
 void SEmitter::emitIdentCompExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr)
 {
     SKIZO_REQ_EQUALS(expr->Kind(), E_EXPRESSIONKIND_IDENTITYCOMPARISON);
@@ -1248,7 +1723,15 @@ void SEmitter::emitIsExpr(STextBuilder& cb, const CMethod* method, const CExpres
         //
         // Applying `is` to a null should always return false.
 
-        cb.Emit("_soX_is(");
+        // The exact class is checked inline only if the expression can be evaluated several times (objects are
+        // never instances of interfaces exactly).
+        if((isExpr->Expr->Kind() == E_EXPRESSIONKIND_IDENT || isExpr->Expr->Kind() == E_EXPRESSIONKIND_THIS)
+         && targetClass->SpecialClass() != E_SPECIALCLASS_INTERFACE)
+        {
+            cb.Emit("_soX_IS(");
+        } else {
+            cb.Emit("_soX_is(");
+        }
         emitValueExpr(cb, method, isExpr->Expr);
         cb.Emit(", (void*)%p)", (void*)targetClass);
     }
@@ -1317,6 +1800,63 @@ void SEmitter::emitInlinedCondExpr(STextBuilder& cb, const CMethod* method, cons
     cb.Emit("}\n");
 }
 
+void SEmitter::emitInlinedLoopExpr(STextBuilder& cb, const CMethod* method, const CExpression* expr)
+{
+    SKIZO_REQ_EQUALS(expr->Kind(), E_EXPRESSIONKIND_INLINED_LOOP);
+    const CInlinedLoopExpression* loopExpr = static_cast<const CInlinedLoopExpression*>(expr);
+
+    if(loopExpr->RangeExpr) {
+        // ***************************************************************************************
+        // Same semantics as _so_Range_loop/_so_Range_step: the range and the step are evaluated
+        // once, and the loop variable is a copy of the actual counter, so changing it inside the
+        // body doesn't affect the loop.
+        // ***************************************************************************************
+
+        const CClass* rangeClass = domain->RangeClass();
+        const STypeRef rangeTypeRef (rangeClass->ToTypeRef());
+        // See CDomain::initRangeStruct()
+        const CField* fromField = rangeClass->InstanceFields()->Item(0);
+        const CField* toField = rangeClass->InstanceFields()->Item(1);
+
+        cb.Emit("{\n%t _soX_range = ", &rangeTypeRef);
+        emitValueExpr(cb, method, loopExpr->RangeExpr);
+        cb.Emit(";\n");
+        if(loopExpr->StepExpr) {
+            cb.Emit("int _soX_step = ");
+            emitValueExpr(cb, method, loopExpr->StepExpr);
+            cb.Emit(";\n");
+        }
+
+        cb.Emit("int _soX_index;\n"
+                "for(_soX_index = _soX_range.");
+        emitInstanceFieldName(cb, fromField);
+        cb.Emit("; _soX_index < _soX_range.");
+        emitInstanceFieldName(cb, toField);
+        if(loopExpr->StepExpr) {
+            // Doesn't let the index overflow with a large step (see _so_Range_step)
+            cb.Emit("; _soX_index = (_soX_step <= 0 || ((unsigned int)_soX_range.");
+            emitInstanceFieldName(cb, toField);
+            cb.Emit(" - (unsigned int)_soX_index) > (unsigned int)_soX_step)? _soX_index + _soX_step: _soX_range.");
+            emitInstanceFieldName(cb, toField);
+            cb.Emit(") {\n");
+        } else {
+            cb.Emit("; _soX_index++) {\n");
+        }
+
+        emitIdentExpr(cb, method, loopExpr->IndexExpr);
+        cb.Emit(" = _soX_index;\n");
+        emitBodyStatements(cb, method, loopExpr->Body->Exprs);
+        cb.Emit("}\n"
+                "}\n");
+    } else {
+        cb.Emit("while(");
+        emitValueExpr(cb, method, loopExpr->Condition);
+        cb.Emit(") {\n");
+        emitBodyStatements(cb, method, loopExpr->Body->Exprs);
+        cb.Emit("}\n");
+    }
+}
+
 void SEmitter::emitFunctionSig(STextBuilder& cb,
                                const CMethod* method,
                                const CClass* specificClass)
@@ -1359,20 +1899,168 @@ void SEmitter::emitFunctionSig(STextBuilder& cb,
     cb.Emit("))");
 }
 
+// IMPORTANT the order of variables should be synchronized with the CWatchIterator::NextWatch
+int SEmitter::emitLocalRefs(STextBuilder& cb, const CMethod* method, const char* arrayName)
+{
+    Auto<CArrayList<CLocal*> > localList (new CArrayList<CLocal*>());
+    if(!method->Signature().IsStatic) {
+        localList->Add(nullptr); // signifies "this"
+    }
+    for(int i = 0; i < method->Signature().Params->Count(); i++) {
+        localList->Add(method->Signature().Params->Array()[i]);
+    }
+
+    CLocal* local;
+
+    if(method->Locals()) {
+        SHashMapEnumerator<SStringSlice, CLocal*> localsEnum (method->Locals());
+        SStringSlice localName;
+        while(localsEnum.MoveNext(&localName, &local)) {
+            localList->Add(local);
+        }
+    }
+
+    cb.Emit("void* %S[%d] = {\n", arrayName, localList->Count());
+    for(int i = 0; i < localList->Count(); i++) {
+        local = localList->Array()[i];
+        if(local) {
+            if(local->IsCaptured) {
+                cb.Emit("0"); // TODO watch capture locals, too
+            } else {
+                // NOTE adds "l_" not to conflict with C keywords
+                cb.Emit("&l_%s", &local->Name);
+            }
+        } else {
+            SKIZO_REQ_EQUALS(i, 0);
+            SKIZO_REQ(!method->Signature().IsStatic, EC_ILLEGAL_ARGUMENT);
+            cb.Emit("&self");
+        }
+        if(i < localList->Count() - 1) {
+            cb.Emit(", ");
+        }
+    }
+    cb.Emit("};\n");
+
+    return localList->Count();
+}
+
+void SEmitter::emitPatchPoint(STextBuilder& cb, const CMethod* method, const SMetadataSource& source)
+{
+    // Statements inlined from other modules have no meaningful line numbers in this method (see emitLineDirective(..))
+    // NOTE Unsafe methods have no frames for stack traces.
+    if(!domain->PatchableBreakpoints()
+    || inlineFrame
+    || method->IsUnsafe()
+    || !source.Module
+    || source.Module != method->Source().Module
+    || source.LineNumber <= 0)
+    {
+        return;
+    }
+
+    const int id = domain->BreakpointPatcher().AddPatchPoint(method, source.LineNumber);
+    patchPoints->Add(id);
+
+    // An 8-byte NOP aligned to 8 bytes (padded with 1-byte NOPs), so that it could be overwritten with "jmp rel32"
+    // by a single atomic store (see SBreakpointPatcher) The global label allows to find its address with
+    // tcc_get_symbol(..) after relocation. Execution continues at "_soX_bpr%d" after the breakpoint is handled.
+    cb.Emit("__asm__ __volatile__(\".align 8, 0x90\\n.globl _soX_bp%d\\n"
+            "_soX_bp%d: .byte 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00\");\n"
+            "_soX_bpr%d:;\n",
+            id, id, id);
+}
+
+void SEmitter::emitPatchPointHandlers(STextBuilder& cb, const CMethod* method)
+{
+    if(patchPoints->Count() == 0) {
+        return;
+    }
+
+    // Cold blocks are never reached by the normal flow.
+    cb.Emit("goto _soX_bpend;\n");
+    for(int i = 0; i < patchPoints->Count(); i++) {
+        const int id = patchPoints->Array()[i];
+
+        // NOTE Nothing has to be preserved here: TCC keeps locals on the stack and no values in registers between
+        // statements. The domain refuses to combine patchable breakpoints with other compilers (see CDomain::CreateDomain)
+        cb.Emit("__asm__ __volatile__(\".globl _soX_bpx%d\\n_soX_bpx%d:\");\n{\n", id, id);
+        const int localCount = emitLocalRefs(cb, method, "_soX_bplocals");
+        cb.Emit("_soX_breakat((void*)%p, %d, _soX_bplocals, %d);\n}\n"
+                "goto _soX_bpr%d;\n",
+                (void*)domain, id, localCount, id);
+    }
+    cb.Emit("_soX_bpend:;\n");
+
+    patchPoints->Clear();
+}
+
+// Bodies of inlined conditions and loops are separate basic blocks, with their own counters.
+static bool endsBasicBlock(const CExpression* expr)
+{
+    return expr->Kind() == E_EXPRESSIONKIND_INLINED_CONDITION
+        || expr->Kind() == E_EXPRESSIONKIND_INLINED_LOOP;
+}
+
+// Weights of statements for cost counting, in abstract units. Calls and checks weigh more than plain assignments;
+// the callees are accounted separately.
+static int statementCost(const CExpression* expr)
+{
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_CALL:
+        case E_EXPRESSIONKIND_ASSERT:
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+void SEmitter::emitCostCounter(STextBuilder& cb, const CMethod* method, const CArrayList<CExpression*>* exprs, int startIndex)
+{
+    if(!domain->CostCountingEnabled()) {
+        return;
+    }
+
+    int cost = 0;
+    for(int i = startIndex; i < exprs->Count(); i++) {
+        const CExpression* expr = exprs->Array()[i];
+        cost += statementCost(expr);
+        if(endsBasicBlock(expr)) {
+            break;
+        }
+    }
+
+    cb.Emit("_soX_COST(%p, %d);\n", (void*)&domain->CostCounter().ForMethod(method)->Cost, cost);
+}
+
 void SEmitter::emitBodyStatements(STextBuilder& cb, const CMethod* method, const CArrayList<CExpression*>* exprs)
 {
     // NOTE: not every expression is allowed in the top level.
     for(int i = 0; i < exprs->Count(); i++) {
         const CExpression* subExpr = exprs->Array()[i];
+        if(i == 0 || endsBasicBlock(exprs->Array()[i - 1])) {
+            emitCostCounter(cb, method, exprs, i);
+        }
+        emitLineDirective(cb, method, subExpr->Source);
+        emitPatchPoint(cb, method, subExpr->Source);
 
         switch(subExpr->Kind()) {
             case E_EXPRESSIONKIND_CALL:
-                emitCallExpr(cb, method, subExpr, true);
-                cb.Emit(";\n");
+                if(isTailCall(subExpr)) {
+                    emitTailCall(cb, method, subExpr);
+                } else {
+                    emitCallExpr(cb, method, subExpr, true);
+                    cb.Emit(";\n");
+                }
                 break;
             case E_EXPRESSIONKIND_RETURN:
-                emitReturnExpr(cb, method, subExpr);
-                cb.Emit(";\n");
+                if(isTailCall(static_cast<const CReturnExpression*>(subExpr)->Expr)) {
+                    emitTailCall(cb, method, static_cast<const CReturnExpression*>(subExpr)->Expr);
+                } else {
+                    emitReturnExpr(cb, method, subExpr);
+                    cb.Emit(";\n");
+                }
                 break;
             case E_EXPRESSIONKIND_CCODE:
                 emitCCodeExpr(cb, method, subExpr);
@@ -1391,6 +2079,9 @@ void SEmitter::emitBodyStatements(STextBuilder& cb, const CMethod* method, const
             case E_EXPRESSIONKIND_INLINED_CONDITION:
                 emitInlinedCondExpr(cb, method, subExpr);
                 break;
+            case E_EXPRESSIONKIND_INLINED_LOOP:
+                emitInlinedLoopExpr(cb, method, subExpr);
+                break;
             case E_EXPRESSIONKIND_BREAK:
                 emitBreakExpr(cb, method, subExpr);
                 break;
@@ -1674,10 +2365,20 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
         if(method->ClosureEnvClass()) {
             // Why managed constructors if we can have this directly in C?
 
-            varSegCB.Emit("struct _so_%s* _soX_newEnv = _soX_gc_alloc_env((void*)%p, (void*)%p);\n",
-                          &method->ClosureEnvClass()->FlatName(),
-                          &domain->MemoryManager(),
-                          method->ClosureEnvClass());
+            if(method->IsEnvOnStack()) {
+                // No closure created here outlives the call (see E_METHODFLAGS_IS_ENV_ON_STACK).
+                varSegCB.Emit("struct _so_%s _soX_envStorage;\n"
+                              "struct _so_%s* _soX_newEnv = _soX_stackenv(&_soX_envStorage, sizeof(struct _so_%s), (void*)%p);\n",
+                              &method->ClosureEnvClass()->FlatName(),
+                              &method->ClosureEnvClass()->FlatName(),
+                              &method->ClosureEnvClass()->FlatName(),
+                              method->ClosureEnvClass());
+            } else {
+                varSegCB.Emit("struct _so_%s* _soX_newEnv = _soX_gc_alloc_env((void*)%p, (void*)%p);\n",
+                              &method->ClosureEnvClass()->FlatName(),
+                              &domain->MemoryManager(),
+                              method->ClosureEnvClass());
+            }
 
             if(method->DeclaringClass()->SpecialClass() == E_SPECIALCLASS_METHODCLASS) {
                 SKIZO_REQ_EQUALS(method->DeclaringClass()->InstanceMethods()->Count(), 1);
@@ -1741,6 +2442,26 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
         // never use m_isUnsafe directly.
         const bool isUnsafe = method->IsUnsafe();
 
+        // ***************************************************
+        //   Tiered compilation: counts calls in the first tier.
+        // ***************************************************
+
+        if(domain->TieredCompilation() && !isSecondTier() && method->MethodKind() != E_METHODKIND_DTOR) {
+            cb.Emit("if(++*(int*)%p > %d) _soX_tierup((void*)%p, (void*)%p);\n",
+                    (void*)method->TierUpCounter(),
+                    SKIZO_TIERUP_THRESHOLD,
+                    (void*)domain,
+                    (void*)method);
+        }
+
+        // ***************************************************
+        //   Cost counting: counts calls.
+        // ***************************************************
+
+        if(domain->CostCountingEnabled()) {
+            cb.Emit("_soX_COST(%p, 1);\n", (void*)&domain->CostCounter().ForMethod(method)->Calls);
+        }
+
         // ***************************************************
         //   Stack trace information.
         // ***************************************************
@@ -1748,9 +2469,11 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
         // NOTE we can't correctly deal with pushframe/popframe if there is unsafe code in this method
         // (inline C code can return control early).
         if(domain->ProfilingEnabled() && !isUnsafe) {
-            cb.Emit("int _soX_tc = _soX_pushframe_prf((void*)%p, (void*)%p);\n", (void*)domain, (void*)method);
+            cb.Emit("struct _soX_frame _soX_frame;\n"
+                    "_soX_pushframe_prf((void*)%p, &_soX_frame, (void*)%p);\n", (void*)domain, (void*)method);
         } else if(domain->StackTraceEnabled() && !isUnsafe) {
-            cb.Emit("_soX_pushframe((void*)%p, (void*)%p);\n", (void*)domain, (void*)method);
+            // The frame is linked inline (see SStackFrame), the address of the list's head is inlined for speed.
+            cb.Emit("_soX_PUSHFRAME(%p, %p);\n", (void*)domain->TopFrameAddress(), (void*)method);
         }
 
         // *******************************************************************************************
@@ -1763,50 +2486,10 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
 
         // *****************************************************************
         //   Soft debugging.
-        // IMPORTANT the order of variables should be synchronized with the CWatchIterator::NextWatch
         if(method->ShouldEmitReglocalsCode()) {
             // With soft-debugging, we register/unregister locals at runtime.
-
-            Auto<CArrayList<CLocal*> > localList (new CArrayList<CLocal*>());
-            if(!method->Signature().IsStatic) {
-                localList->Add(nullptr); // signifies "this"
-            }
-            for(int i = 0; i < method->Signature().Params->Count(); i++) {
-                localList->Add(method->Signature().Params->Array()[i]);
-            }
-
-            CLocal* local;
-
-            if(method->Locals()) {
-                SHashMapEnumerator<SStringSlice, CLocal*> localsEnum (method->Locals());
-                SStringSlice localName;
-                while(localsEnum.MoveNext(&localName, &local)) {
-                    localList->Add(local);
-                }
-            }
-
-            cb.Emit("void* _soX_locals[%d] = {\n", localList->Count());
-            for(int i = 0; i < localList->Count(); i++) {
-                local = localList->Array()[i];
-                if(local) {
-                    if(local->IsCaptured) {
-                        cb.Emit("0"); // TODO watch capture locals, too
-                    } else {
-                        // NOTE adds "l_" not to conflict with C keywords
-                        cb.Emit("&l_%s", &local->Name);
-                    }
-                } else {
-                    SKIZO_REQ_EQUALS(i, 0);
-                    SKIZO_REQ(!method->Signature().IsStatic, EC_ILLEGAL_ARGUMENT);
-                    cb.Emit("&self");
-                }
-                if(i < localList->Count() - 1) {
-                    cb.Emit(", ");
-                }
-            }
-            cb.Emit("};\n");
-
-            cb.Emit("_soX_reglocals(_soX_locals, %d);\n", localList->Count());
+            const int localCount = emitLocalRefs(cb, method, "_soX_locals");
+            cb.Emit("_soX_reglocals(_soX_locals, %d);\n", localCount);
         }
         // *****************************************************************
 
@@ -1814,7 +2497,13 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
         //   Body.
         // *********
 
+        // Self-recursive calls in tail position jump here (see SEmitter::emitTailCall(..)).
+        if(method->HasTailCalls()) {
+            cb.Emit("_soX_start:;\n");
+        }
+
         emitBodyStatements(cb, method, bodyExpr->Exprs);
+        emitPatchPointHandlers(cb, method);
 
         // ***************************************************
         //   Stack trace information.
@@ -1835,9 +2524,9 @@ void SEmitter::emitFunctionBody(STextBuilder& cb, const CMethod* method)
             // *****************************************************************
 
             if(domain->ProfilingEnabled()) {
-                cb.Emit("_soX_popframe_prf((void*)%p, _soX_tc);\n", (void*)domain);
+                cb.Emit("_soX_popframe_prf((void*)%p, &_soX_frame);\n", (void*)domain);
             } else if(domain->StackTraceEnabled()) {
-                cb.Emit("_soX_popframe((void*)%p);\n", (void*)domain);
+                cb.Emit("_soX_POPFRAME(%p);\n", (void*)domain->TopFrameAddress());
             }
         }
     }
@@ -1868,6 +2557,14 @@ void SEmitter::emitInstanceMethod(const CMethod* method)
     }
 }
 
+void SEmitter::emitStaticMethod(const CMethod* method)
+{
+    emitFunctionHeader(method, E_METHODKIND_NORMAL);
+    mainCB.Emit( " {\n");
+    emitFunctionBody(methodBodyCB, method);
+    mainCB.Emit( "}\n");
+}
+
 void SEmitter::emitInstanceCtor(const CClass* klass, const CMethod* method)
 {
     SKIZO_REQ_EQUALS(method->MethodKind(), E_METHODKIND_CTOR);
@@ -1913,6 +2610,11 @@ void SEmitter::emitInstanceCtor(const CClass* klass, const CMethod* method)
 
 void SEmitter::emitFunctionBodies(const CClass* klass)
 {
+    // See CDomain::eliminateDeadCode()
+    if(!klass->IsReachable()) {
+        return;
+    }
+
     // ****************************
     // Emits instance constructors.
     // ****************************
@@ -1963,7 +2665,8 @@ void SEmitter::emitFunctionBodies(const CClass* klass)
 
             if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE
             && method->SpecialMethod() != E_SPECIALMETHOD_BOXED_METHOD
-            && (method->DeclaringClass() == klass)) // makes sure we don't emit methods defined in base classes
+            && (method->DeclaringClass() == klass) // makes sure we don't emit methods defined in base classes
+            && !method->IsLazy())                  // compiled on first call, see CDomain::CompileLazyMethod(..)
             {
                 emitInstanceMethod(method);
             }
@@ -1980,11 +2683,8 @@ void SEmitter::emitFunctionBodies(const CClass* klass)
         for(int i = 0; i < staticMethods->Count(); i++) {
             const CMethod* method = staticMethods->Array()[i];
 
-            if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE) {
-                emitFunctionHeader(method, E_METHODKIND_NORMAL);
-                mainCB.Emit( " {\n");
-                emitFunctionBody(methodBodyCB, method);
-                mainCB.Emit( "}\n");
+            if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE && method->IsReachable() && !method->IsLazy()) {
+                emitStaticMethod(method);
             }
         }
     }
@@ -2066,7 +2766,7 @@ void SEmitter::emitStaticCtorDtor(const CClass* klass)
     }
 }
 
-void SEmitter::emit()
+void SEmitter::emitDeclarations()
 {
     const CArrayList<CClass*>* klasses = domain->Classes();
 
@@ -2090,18 +2790,32 @@ void SEmitter::emit()
                 "#define _so_int_upto(from, to) (_so_Range_create(from, (to) + 1))\n"
                 "#define _so_int_toFloat(i) ((float)(i))\n"
                 "#define _so_float_toInt(f) ((int)(f))\n"
-                "#define _soX_TN if(!self) _soX_abort0(2);\n");
+                "#define _soX_TN if(!self) _soX_abort0(2);\n"
+                "#define _soX_NN(obj) (!(obj)? (_soX_abort0(2), 0): 0)\n");
 
     // Some shortcuts to emit less code.
     mainCB.Emit("#define _soX_ALIGNED __attribute__ ((aligned(sizeof(void*))))\n");
 
-    // This is needed for a faster access to "array::length".
+    // This is needed for a faster access to "array::length", "array::get" and "array::set" (see
+    // SEmitter::emitArrayAccessExpr).
     mainCB.Emit("struct _soX_ArrayHeader {\n"
                 "void** _soX_vtable;\n"
                 "int _soX_length;\n"
                 "char _soX_firstItem _soX_ALIGNED;\n"
                 "};\n"
-                "#define _soX_ARRLENGTH(self) (((struct _soX_ArrayHeader*)self)->_soX_length)\n");
+                "#define _soX_ARRLENGTH(self) (((struct _soX_ArrayHeader*)self)->_soX_length)\n"
+                "#define _soX_ARRITEMS(self) (&(self)->_soX_firstItem)\n"
+                "#define _soX_ARRNN(self) (!(self)? (_soX_abort0(2), 0): 0)\n"
+                "#define _soX_ARRCHECK(self, index) ((unsigned int)(index) >= (unsigned int)_soX_ARRLENGTH(self)? (_soX_abort0(0), 0): 0)\n"
+                "#define _soX_ARRCHECKN(self, index) (!(self)? (_soX_abort0(2), 0): _soX_ARRCHECK(self, index))\n");
+
+    // The fast path of interface calls (see _soX_icfind).
+    mainCB.Emit("#define _soX_ICFIND(obj, ic, m) (((obj) && *(void**)(obj) == (ic)[0])? (ic)[1]: _soX_icfind((obj), (ic), (m)))\n");
+
+    // The fast paths of type tests: the exact class of the object (vtable[0]) is compared inline, everything
+    // else (subclasses, interfaces, boxed values) is left to _soX_is/_soX_downcast.
+    mainCB.Emit("#define _soX_IS(obj, klass) ((obj)? (**(void***)(obj) == (klass)? _soX_TRUE: _soX_is((obj), (klass))): _soX_FALSE)\n");
+    mainCB.Emit("#define _soX_DOWNCAST(klass, obj) ((!(obj) || **(void***)(obj) == (klass))? (void*)(obj): _soX_downcast((klass), (obj)))\n");
 
     // All closures share the same structure.
     mainCB.Emit("struct _soX_0Closure {\n"
@@ -2118,6 +2832,8 @@ void SEmitter::emit()
     // Runtime helpers.
     mainCB.Emit("extern void* _soX_gc_alloc(void* mm, int sz, void** vtable);\n"
                 "extern void* _soX_gc_alloc_env(void* mm, void* objClass);\n"
+                "extern void* _soX_stackenv(void* env, int sz, void* objClass);\n"
+                "extern void* _soX_stackclosure(void* obj, void* objClass, void* env);\n"
                 "extern void _soX_gc_roots(void* mm, void** rootRefs, int count);\n"
                 "extern void _soX_static_vt(void* mm, void* obj, void* objClass);\n"
                 "extern void _soX_regvtable(void* klass, void** vtable);\n"
@@ -2126,27 +2842,64 @@ void SEmitter::emit()
                 "extern void _soX_unbox(void* vt, int vtSize, void* vtClass, void* intrfcObj);\n"
                 "extern void* _soX_findmethod(void* objptr, void* method);\n"
                 "extern void* _soX_findmethod2(void* objptr, void* msg);\n"
+                "extern void* _soX_icfind(void* objptr, void** cache, void* method);\n"
                 "extern _so_bool _soX_is(void* obj, void* type);\n"
                 "extern void _soX_zero(void* a, int sz);\n"
                 "extern _so_bool _soX_biteq(void* a, void* b, int sz)\n;"
                 "extern void* _soX_newarray(void* domain, int arrayLength, void** vtable);\n"
                 "extern void _soX_abort0(int errCode);\n"
                 "extern void _soX_abort_e(void* errObj);\n"
+                "extern void _soX_abort_inl(void* domain, void* method, int errCode);\n"
                 "extern void _soX_cctor(void* pClass, void* cctor);\n"
                 "extern void _soX_checktype(void* pClass);\n"
                 "extern void _soX_addhandler(void* event, void* handler);\n"
                 "extern void _soX_msgsnd_sync(void* hDomain, void* soObjName, void* method, void** args, void* blockingRet);\n"
                 "extern void _soX_msgsnd_async(void* hDomain, void* soObjName, void* method, void** args);\n"
                 "extern void _soX_unpack(void** args, void* daMsg, void* method);\n"
-                "extern int _so_int_op_divide(int a, int b);\n");
+                "extern int _so_int_op_divide(int a, int b);\n"
+                "extern int _so_int_op_modulo(int a, int b);\n");
+
+    // Cost counting: calls of runtime helpers go through function-like macros named after the helpers (a macro isn't
+    // expanded inside its own definition, so the helper itself is called eventually) See SCostCounter.
+    // NOTE Must be defined after the declarations of the helpers.
+    if(domain->CostCountingEnabled()) {
+        SCostCounter& costCounter = domain->CostCounter();
+
+        mainCB.Emit("#define _soX_COST(counter, n) (*(long long*)(counter) += (n))\n");
+        for(int i = 0; i < costCounter.HelperCount(); i++) {
+            mainCB.Emit("#define %S(...) (_soX_COST(%p, 1), %S(__VA_ARGS__))\n",
+                        costCounter.HelperName(i),
+                        (void*)costCounter.HelperCounter(i),
+                        costCounter.HelperName(i));
+        }
+    }
 
-    if(domain->StackTraceEnabled()) {
-        mainCB.Emit("extern void _soX_pushframe(void* domain, void* method);\n"
-                    "extern void _soX_popframe(void* domain);\n");
+    if(domain->StackTraceEnabled() || domain->ProfilingEnabled()) {
+        // IMPORTANT the layout should be synchronized with SStackFrame
+        mainCB.Emit("struct _soX_frame { struct _soX_frame* prev; void* method; int depth; };\n"
+                    "#define _soX_PUSHFRAME(top, m) struct _soX_frame _soX_frame; ");
+        // Stack overflows are detected proactively unless the domain relies on the guard page (see
+        // CDomain::StackLimit()). The check goes first, so that the overflowing method isn't linked.
+        if(domain->StackLimit()) {
+            mainCB.Emit("if((char*)&_soX_frame < (char*)%p) _soX_abort0(7); ", domain->StackLimit()); // SKIZO_ERRORCODE_STACK_OVERFLOW == 7
+        }
+        mainCB.Emit("_soX_frame.prev = *(struct _soX_frame**)(top); "
+                    "_soX_frame.method = (void*)(m); "
+                    "*(struct _soX_frame**)(top) = &_soX_frame\n"
+                    "#define _soX_POPFRAME(top) *(struct _soX_frame**)(top) = _soX_frame.prev\n"
+                    // Same as _soX_NN, except the failure is attributed to the inlined method (see _soX_abort_inl).
+                    "#define _soX_NNI(obj, domain, m) "
+                    "(!(obj)? (_soX_abort_inl((void*)(domain), (void*)(m), 2), 0): 0)\n");
     }
     if(domain->ProfilingEnabled()) {
-        mainCB.Emit("extern int _soX_pushframe_prf(void* domain, void* method);\n"
-                    "extern void _soX_popframe_prf(void* domain, int tc);\n");
+        mainCB.Emit("extern void _soX_pushframe_prf(void* domain, void* frame, void* method);\n"
+                    "extern void _soX_popframe_prf(void* domain, void* frame);\n");
+    }
+    if(domain->TieredCompilation() && !isSecondTier()) {
+        mainCB.Emit("extern void _soX_tierup(void* domain, void* method);\n");
+    }
+    if(domain->PatchableBreakpoints()) {
+        mainCB.Emit("extern void _soX_breakat(void* domain, int id, void** localRefs, int sz);\n");
     }
     if(domain->SoftDebuggingEnabled()) {
         mainCB.Emit("extern void _soX_break();\n"
@@ -2210,7 +2963,10 @@ void SEmitter::emit()
         const CClass* klass = klasses->Array()[i];
         emitVTable(klass);
     }
+}
 
+void SEmitter::emitHelpers(bool headerOnly)
+{
     // *************************
     // Emits array init helpers.
     // *************************
@@ -2220,7 +2976,7 @@ void SEmitter::emit()
         int helperId;
         SHashMapEnumerator<CArrayInitializationType*, int> mapEnum (domain->ArrayInitHelperRegistry());
         while(mapEnum.MoveNext(&initType, &helperId)) {
-            emitArrayInitHelper(initType, helperId);
+            emitArrayInitHelper(initType, helperId, headerOnly);
         }
     }
 
@@ -2234,7 +2990,7 @@ void SEmitter::emit()
         CClass* valueTypeClass;
         SHashMapEnumerator<SStringSlice, CClass*> mapEnum (domain->IdentityComparisonHelpers());
         while(mapEnum.MoveNext(&k, &valueTypeClass)) {
-            emitIdentCompHelper(valueTypeClass);
+            emitIdentCompHelper(valueTypeClass, headerOnly);
         }
     }
 
@@ -2247,9 +3003,17 @@ void SEmitter::emit()
         CClass* boxedClass;
         SHashMapEnumerator<SStringSlice, CClass*> mapEnum (domain->BoxedClasses());
         while(mapEnum.MoveNext(&k, &boxedClass)) {
-            emitUnboxHelper(boxedClass);
+            emitUnboxHelper(boxedClass, headerOnly);
         }
     }
+}
+
+void SEmitter::emit()
+{
+    const CArrayList<CClass*>* klasses = domain->Classes();
+
+    emitDeclarations();
+    emitHelpers(false);
 
     // **********************
     // Emits function bodies.
@@ -2289,7 +3053,7 @@ void SEmitter::emit()
     // Registers vtables.
     for(int i = 0; i < klasses->Count(); i++) {
         const CClass* klass = klasses->Array()[i];
-        if(klass->EmitVTable() && klass->HasVTable()) {
+        if(klass->EmitVTable() && klass->HasVTable() && klass->IsReachable()) {
             mainCB.Emit("_soX_regvtable((void*)%p, _soX_vtbl_%s);\n", klass, &klass->FlatName());
         }
     }
@@ -2302,7 +3066,7 @@ void SEmitter::emit()
     for(int i = 0; i < klasses->Count(); i++) {
         const CClass* klass = klasses->Array()[i];
 
-        if(klass->StaticCtor() || klass->StaticFields()->Count() > 0) {
+        if(klass->IsReachable() && (klass->StaticCtor() || klass->StaticFields()->Count() > 0)) {
             mainCB.Emit("_so_%s_static_ctor(0);\n", &klass->FlatName());
         }
     }
@@ -2312,7 +3076,7 @@ void SEmitter::emit()
     for(int i = 0; i < klasses->Count(); i++) {
         const CClass* klass = klasses->Array()[i];
 
-        if(klass->StaticCtor()) {
+        if(klass->IsReachable() && klass->StaticCtor()) {
             mainCB.Emit("_soX_cctor((void*)%p, &_so_%s_static_ctor);\n", (void*)klass, &klass->FlatName());
         }
     }
@@ -2327,7 +3091,7 @@ void SEmitter::emit()
     for(int i = 0; i < klasses->Count(); i++) {
         const CClass* klass = klasses->Array()[i];
 
-        if(klass->StaticDtor()) {
+        if(klass->IsReachable() && klass->StaticDtor()) {
             mainCB.Emit("_so_%s_static_dtor(1);\n", &klass->FlatName());
         }
     }
@@ -2335,13 +3099,17 @@ void SEmitter::emit()
     mainCB.Emit("}\n");
 }
 
-void SEmitter::emitArrayInitHelper(const CArrayInitializationType* initType, int helperId)
+void SEmitter::emitArrayInitHelper(const CArrayInitializationType* initType, int helperId, bool headerOnly)
 {
     // ***********
     //   Header.
     // ***********
 
-    mainCB.Emit("static %t _soX_arrInitHelper_%d(", &initType->ArrayType, helperId);
+    // Lazy units call the helper defined in the main image, so it must be visible to tcc_get_symbol(..)
+    if(!domain->LazyCompilation()) {
+        mainCB.Emit("static ");
+    }
+    mainCB.Emit("%t _soX_arrInitHelper_%d(", &initType->ArrayType, helperId);
     const STypeRef* subTypeRef = &initType->ArrayType.ResolvedClass->WrappedClass();
     for(int i = 0; i < initType->Arity; i++) {
         mainCB.Emit("%t _arg%d", subTypeRef, i);
@@ -2350,6 +3118,10 @@ void SEmitter::emitArrayInitHelper(const CArrayInitializationType* initType, int
             mainCB.Emit(", ");
         }
     }
+    if(headerOnly) {
+        mainCB.Emit(");\n");
+        return;
+    }
     mainCB.Emit(") {\n");
 
     // *********
@@ -2374,10 +3146,15 @@ void SEmitter::emitArrayInitHelper(const CArrayInitializationType* initType, int
                 "}\n");
 }
 
-void SEmitter::emitIdentCompHelper(const CClass* klass)
+void SEmitter::emitIdentCompHelper(const CClass* klass, bool headerOnly)
 {
     const STypeRef typeRef (klass->ToTypeRef());
 
+    if(headerOnly) {
+        mainCB.Emit("_so_bool _soX_idco_%s(%t a, %t b);\n", &klass->FlatName(), &typeRef, &typeRef);
+        return;
+    }
+
     mainCB.Emit("_so_bool _soX_idco_%s(%t a, %t b) {\n"
                 "return _soX_biteq(&a, &b, %d);\n"
                 "}\n",
@@ -2387,12 +3164,17 @@ void SEmitter::emitIdentCompHelper(const CClass* klass)
                 klass->GCInfo().ContentSize);
 }
 
-void SEmitter::emitUnboxHelper(const CClass* boxedClass)
+void SEmitter::emitUnboxHelper(const CClass* boxedClass, bool headerOnly)
 {
     SKIZO_REQ_EQUALS(boxedClass->SpecialClass(), E_SPECIALCLASS_BOXED);
     SKIZO_REQ_PTR(boxedClass->ResolvedWrappedClass());
 
     const STypeRef& subTypRef = boxedClass->WrappedClass();
+
+    if(headerOnly) {
+        mainCB.Emit("%t _soX_unbox_%s(void* _obj);\n", &subTypRef, &subTypRef.ResolvedClass->FlatName());
+        return;
+    }
     mainCB.Emit("%t _soX_unbox_%s(void* _obj) {\n"
                 "%t _soX_r;\n"
                 "_soX_unbox(&_soX_r, sizeof(%t), (void*)%p, _obj);\n"
@@ -2404,10 +3186,43 @@ void SEmitter::emitUnboxHelper(const CClass* boxedClass)
                 (void*)boxedClass->ResolvedWrappedClass());
 }
 
+void SEmitter::addSharedSymbol()
+{
+    sharedSymbols->Add(CString::CloneUtf8(sharedSymbolCB.Chars()));
+    sharedSymbolCB.Clear();
+}
+
 void SkizoEmit(CDomain* domain, STextBuilder& cb)
 {
     SEmitter emitter (domain, cb);
     emitter.emit();
 }
 
+void SkizoEmitSecondTier(CDomain* domain, STextBuilder& cb, CArrayList<char*>* sharedSymbols)
+{
+    SEmitter emitter (domain, cb, sharedSymbols);
+    emitter.emit();
+}
+
+void SkizoEmitLazyUnitHeader(CDomain* domain, STextBuilder& cb)
+{
+    SEmitter emitter (domain, cb);
+    emitter.isLazyUnit = true;
+    emitter.emitDeclarations();
+    emitter.emitHelpers(true);
+}
+
+void SkizoEmitLazyMethod(CDomain* domain, STextBuilder& cb, const CMethod* method)
+{
+    SKIZO_REQ(method->IsLazy(), EC_ILLEGAL_ARGUMENT);
+
+    SEmitter emitter (domain, cb);
+    emitter.isLazyUnit = true;
+    if(method->Signature().IsStatic) {
+        emitter.emitStaticMethod(method);
+    } else {
+        emitter.emitInstanceMethod(method);
+    }
+}
+
 } }
@@ -14,16 +14,37 @@
 #ifndef EMITTER_H_INCLUDED
 #define EMITTER_H_INCLUDED
 
+#include "ArrayList.h"
 #include "TextBuilder.h"
 
 namespace skizo { namespace script {
 class CDomain;
+class CMethod;
 
 /**
  * Emits expressions after parsing and transforming.
  */
 void SkizoEmit(CDomain* domain, STextBuilder& cb);
 
+/**
+ * Emits the same program for the second tier of tiered compilation (see SDomainCreation::TieredCompilation).
+ * Static fields and vtables aren't defined, they're referenced as externals instead: the second tier shares
+ * them with the first tier. Their names are added to "sharedSymbols" (to be freed with CString::FreeUtf8(..)).
+ */
+void SkizoEmitSecondTier(CDomain* domain, STextBuilder& cb, skizo::collections::CArrayList<char*>* sharedSymbols);
+
+/**
+ * Lazy compilation (see SDomainCreation::LazyCompilation): emits declarations of everything defined in the main
+ * image (structs, function headers, vtables, static fields and helpers) to be prepended to the code of every
+ * lazily compiled method.
+ */
+void SkizoEmitLazyUnitHeader(CDomain* domain, STextBuilder& cb);
+
+/**
+ * Emits the body of a method marked with E_METHODFLAGS_IS_LAZY. See SkizoEmitLazyUnitHeader(..)
+ */
+void SkizoEmitLazyMethod(CDomain* domain, STextBuilder& cb, const CMethod* method);
+
 } }
 
 #endif // EMITTER_H_INCLUDED
@@ -29,6 +29,34 @@ void CExpression::operator delete (void *p)
     // NOTHING
 }
 
+bool CExpression::IsStable() const
+{
+    switch(this->Kind()) {
+        case E_EXPRESSIONKIND_INTCONSTANT:
+        case E_EXPRESSIONKIND_FLOATCONSTANT:
+        case E_EXPRESSIONKIND_BOOLCONSTANT:
+        case E_EXPRESSIONKIND_NULLCONSTANT:
+        case E_EXPRESSIONKIND_CHARLITERAL:
+        case E_EXPRESSIONKIND_STRINGLITERAL:
+        case E_EXPRESSIONKIND_THIS:
+            return true;
+
+        case E_EXPRESSIONKIND_IDENT:
+        {
+            const SResolvedIdentType& resolvedIdent = static_cast<const CIdentExpression*>(this)->ResolvedIdent;
+
+            if(resolvedIdent.EType == E_RESOLVEDIDENTTYPE_CONST) {
+                return true;
+            }
+            return (resolvedIdent.EType == E_RESOLVEDIDENTTYPE_LOCAL || resolvedIdent.EType == E_RESOLVEDIDENTTYPE_PARAM)
+                && !resolvedIdent.AsLocal_->IsCaptured;
+        }
+
+        default:
+            return false;
+    }
+}
+
 // *******************
 //   CBodyExpression
 // *******************
@@ -39,7 +67,8 @@ CBodyExpression::CBodyExpression()
       ParentBody(nullptr),
       GeneratedClosureClass(nullptr),
       OwnsMethod(false),
-      ReturnAlreadyDefined(false)
+      ReturnAlreadyDefined(false),
+      IsStackAllocated(false)
 {
 }
 
@@ -325,6 +354,15 @@ EExpressionKind CInlinedConditionExpression::Kind() const
     return E_EXPRESSIONKIND_INLINED_CONDITION;
 }
 
+// **************************
+//   CInlinedLoopExpression
+// **************************
+
+EExpressionKind CInlinedLoopExpression::Kind() const
+{
+    return E_EXPRESSIONKIND_INLINED_LOOP;
+}
+
 // *****************
 //   CIsExpression
 // *****************
@@ -49,7 +49,8 @@ enum EExpressionKind
     E_EXPRESSIONKIND_ASSERT,
     E_EXPRESSIONKIND_REF,
     E_EXPRESSIONKIND_BREAK,
-    E_EXPRESSIONKIND_SIZEOF
+    E_EXPRESSIONKIND_SIZEOF,
+    E_EXPRESSIONKIND_INLINED_LOOP
 };
 
 class CExpression: public skizo::core::CObject
@@ -62,6 +63,13 @@ public:
     SMetadataSource Source;
 
     virtual EExpressionKind Kind() const = 0;
+
+    /**
+     * Can the expression be evaluated several times (or not at all) with the same result and no side effects?
+     * True for constants, literals, "this" and locals or params which aren't captured by closures.
+     * @note Valid only after the expression was inferred.
+     */
+    bool IsStable() const;
 };
 
 /**
@@ -95,6 +103,12 @@ public:
 
     bool ReturnAlreadyDefined;
 
+    /**
+     * Set by escape analysis if this body represents a closure which is only passed to callees that never store it:
+     * the emitter creates the closure object on the C stack instead of the heap.
+     */
+    bool IsStackAllocated;
+
     CBodyExpression();
     ~CBodyExpression();
 
@@ -181,6 +195,24 @@ public:
      */
     bool IsMarked; // short
 
+    /**
+     * Set by the transformer for "get"/"set" calls on arrays if the index is proven to be always within bounds
+     * (and the array is proven to be non-null), so that the emitter could omit the checks.
+     */
+    bool SkipRangeCheck; // short
+
+    /**
+     * Set by the transformer if the target method is small enough to be inlined at this call site (see
+     * STransformer::inlineCalls(..)): the emitter emits the method's return expression instead of a call.
+     */
+    bool IsInlined; // short
+
+    /**
+     * Set by the transformer for a self-recursive call in tail position (see STransformer::eliminateTailCalls(..)):
+     * the emitter reassigns the params and jumps to the start of the method instead of calling it.
+     */
+    bool IsTailCall; // short
+
     union {
         CConst* uTargetConst;   // If CallType==E_CALLEXPRESSION_CONSTACCESS
         CMethod* uTargetMethod; // If CallType==E_CALLEXPRESSION_METHODCALL
@@ -189,7 +221,10 @@ public:
     CCallExpression()
         : Exprs(new skizo::collections::CArrayList<CExpression*>()),
           CallType(E_CALLEXPRESSION_UNRESOLVED),
-          IsMarked(false)
+          IsMarked(false),
+          SkipRangeCheck(false),
+          IsInlined(false),
+          IsTailCall(false)
         {
         }
 
@@ -402,6 +437,30 @@ public:
     virtual EExpressionKind Kind() const override;
 };
 
+/**
+ * "(0 to 10) loop ^(i: int) {..}", "(0 to 10) step 2 ^(i: int) {..}" and "bool while ^(): bool { return x; } ^{..}"
+ * with literal closures are inlined as C loops.
+ */
+class CInlinedLoopExpression: public CExpression
+{
+public:
+    /**
+     * Range loops: the range, the step (null for "loop") and the loop variable (as a local of the enclosing method).
+     */
+    skizo::core::Auto<CExpression> RangeExpr;
+    skizo::core::Auto<CExpression> StepExpr;
+    skizo::core::Auto<CIdentExpression> IndexExpr;
+
+    /**
+     * While loops: the only expression returned by the predicate.
+     */
+    skizo::core::Auto<CExpression> Condition;
+
+    skizo::core::Auto<CBodyExpression> Body;
+
+    virtual EExpressionKind Kind() const override;
+};
+
 } }
 
 #endif // SEXPRESSION_H_INCLUDED
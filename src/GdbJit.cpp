@@ -0,0 +1,372 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "GdbJit.h"
+#include "Abort.h"
+#include "ArrayList.h"
+#include "Contract.h"
+#include "Domain.h"
+#include "FastByteBuffer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SKIZO_X
+    #include <elf.h>
+#endif
+
+// ***************************************************************************************
+//   The interface GDB expects (see "JIT Compilation Interface" in GDB's documentation).
+//   The names and the layout must be exactly as specified.
+// ***************************************************************************************
+
+extern "C" {
+
+enum jit_actions_t
+{
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN
+};
+
+struct jit_code_entry
+{
+    struct jit_code_entry* next_entry;
+    struct jit_code_entry* prev_entry;
+    const char* symfile_addr;
+    uint64_t symfile_size;
+};
+
+struct jit_descriptor
+{
+    uint32_t version;
+    uint32_t action_flag;
+    struct jit_code_entry* relevant_entry;
+    struct jit_code_entry* first_entry;
+};
+
+// GDB puts a breakpoint in this function.
+void __attribute__((noinline)) __jit_debug_register_code()
+{
+    __asm__ __volatile__("" ::: "memory");
+}
+
+struct jit_descriptor __jit_debug_descriptor = { 1, 0, nullptr, nullptr };
+
+}
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+#ifdef SKIZO_X
+
+#if defined(__x86_64__)
+    typedef Elf64_Ehdr SElfHeader;
+    typedef Elf64_Shdr SElfSectionHeader;
+    typedef Elf64_Sym SElfSymbol;
+    #define SKIZO_ELFCLASS ELFCLASS64
+    #define SKIZO_ELFMACHINE EM_X86_64
+#else
+    typedef Elf32_Ehdr SElfHeader;
+    typedef Elf32_Shdr SElfSectionHeader;
+    typedef Elf32_Sym SElfSymbol;
+    #define SKIZO_ELFCLASS ELFCLASS32
+    #define SKIZO_ELFMACHINE EM_386
+#endif
+
+// The order of sections in the generated object.
+enum
+{
+    E_GDBJITSECTION_NULL,
+    E_GDBJITSECTION_TEXT,
+    E_GDBJITSECTION_SYMTAB,
+    E_GDBJITSECTION_STRTAB,
+    E_GDBJITSECTION_STAB,
+    E_GDBJITSECTION_STABSTR,
+    E_GDBJITSECTION_SHSTRTAB,
+    E_GDBJITSECTION_COUNT
+};
+
+struct SElfBuilder
+{
+    SFastByteBuffer Symbols;
+    SFastByteBuffer Strings;
+
+    SElfBuilder()
+        : Symbols(4096),
+          Strings(4096)
+    {
+        // Both tables start with a null entry.
+        SElfSymbol nullSymbol;
+        memset(&nullSymbol, 0, sizeof(nullSymbol));
+        Symbols.AppendBytes((so_byte*)&nullSymbol, sizeof(nullSymbol));
+        Strings.AppendByte(0);
+    }
+};
+
+static void gdbJitTCCCallback(void* ctx, const char* name, const void* addr, unsigned long size)
+{
+    SElfBuilder* builder = (SElfBuilder*)ctx;
+
+    SElfSymbol symbol;
+    memset(&symbol, 0, sizeof(symbol));
+    symbol.st_name = builder->Strings.Size();
+    symbol.st_value = (size_t)addr;
+    symbol.st_size = size;
+    symbol.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+    symbol.st_shndx = E_GDBJITSECTION_TEXT;
+    builder->Symbols.AppendBytes((so_byte*)&symbol, sizeof(symbol));
+
+    builder->Strings.AppendBytes((const so_byte*)name, strlen(name) + 1);
+}
+
+static void appendAligned(SFastByteBuffer& bb, const void* data, size_t size)
+{
+    while(bb.Size() % sizeof(void*)) {
+        bb.AppendByte(0);
+    }
+    if(size) {
+        bb.AppendBytes((const so_byte*)data, size);
+    }
+}
+
+// Builds an ELF executable with no contents: only headers of the text section (which points to the code TCC
+// relocated), function symbols, and the stabs. Returns a malloc'd buffer.
+static char* buildSymfile(TCCState* tccState, size_t* out_size)
+{
+    const void* textData, *stabData, *stabstrData;
+    unsigned long textSize, stabSize = 0, stabstrSize = 0;
+    unsigned long textAddr, stabAddr, stabstrAddr;
+    if(!tcc_get_section(tccState, ".text", &textData, &textSize, &textAddr)) {
+        return nullptr;
+    }
+    if(!tcc_get_section(tccState, ".stab", &stabData, &stabSize, &stabAddr)
+    || !tcc_get_section(tccState, ".stabstr", &stabstrData, &stabstrSize, &stabstrAddr))
+    {
+        // Compiled without debug info: only the symbols are registered.
+        stabSize = stabstrSize = 0;
+    }
+
+    SElfBuilder builder;
+    tcc_list_functions(tccState, &builder, gdbJitTCCCallback);
+
+    const char shstrtab[] = "\0.text\0.symtab\0.strtab\0.stab\0.stabstr\0.shstrtab";
+    const int shstrtabOffsets[E_GDBJITSECTION_COUNT] = { 0, 1, 7, 15, 23, 29, 38 };
+
+    // ***********
+    //   Layout.
+    // ***********
+
+    SFastByteBuffer bb (4096);
+    SElfHeader header;
+    memset(&header, 0, sizeof(header));
+    bb.AppendBytes((so_byte*)&header, sizeof(header));
+
+    size_t offsets[E_GDBJITSECTION_COUNT] = { 0 };
+    size_t sizes[E_GDBJITSECTION_COUNT] = { 0 };
+
+    appendAligned(bb, nullptr, 0);
+    offsets[E_GDBJITSECTION_SYMTAB] = bb.Size();
+    sizes[E_GDBJITSECTION_SYMTAB] = builder.Symbols.Size();
+    appendAligned(bb, builder.Symbols.Bytes(), builder.Symbols.Size());
+
+    offsets[E_GDBJITSECTION_STRTAB] = bb.Size();
+    sizes[E_GDBJITSECTION_STRTAB] = builder.Strings.Size();
+    appendAligned(bb, builder.Strings.Bytes(), builder.Strings.Size());
+
+    offsets[E_GDBJITSECTION_STAB] = bb.Size();
+    sizes[E_GDBJITSECTION_STAB] = stabSize;
+    appendAligned(bb, stabData, stabSize);
+
+    offsets[E_GDBJITSECTION_STABSTR] = bb.Size();
+    sizes[E_GDBJITSECTION_STABSTR] = stabstrSize;
+    appendAligned(bb, stabstrData, stabstrSize);
+
+    offsets[E_GDBJITSECTION_SHSTRTAB] = bb.Size();
+    sizes[E_GDBJITSECTION_SHSTRTAB] = sizeof(shstrtab);
+    appendAligned(bb, shstrtab, sizeof(shstrtab));
+
+    // *********************
+    //   Section headers.
+    // *********************
+
+    appendAligned(bb, nullptr, 0);
+    const size_t sectionHeadersOffset = bb.Size();
+
+    for(int i = 0; i < E_GDBJITSECTION_COUNT; i++) {
+        SElfSectionHeader sh;
+        memset(&sh, 0, sizeof(sh));
+
+        if(i != E_GDBJITSECTION_NULL) {
+            sh.sh_name = shstrtabOffsets[i];
+            sh.sh_type = SHT_PROGBITS;
+            sh.sh_offset = offsets[i];
+            sh.sh_size = sizes[i];
+            sh.sh_addralign = 1;
+        }
+
+        switch(i) {
+            case E_GDBJITSECTION_TEXT:
+                // The code itself stays where TCC relocated it.
+                sh.sh_type = SHT_NOBITS;
+                sh.sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+                sh.sh_addr = textAddr;
+                sh.sh_offset = 0;
+                sh.sh_size = textSize;
+                sh.sh_addralign = 16;
+                break;
+            case E_GDBJITSECTION_SYMTAB:
+                sh.sh_type = SHT_SYMTAB;
+                sh.sh_link = E_GDBJITSECTION_STRTAB;
+                sh.sh_info = 1; // the index of the first global symbol
+                sh.sh_entsize = sizeof(SElfSymbol);
+                sh.sh_addralign = sizeof(void*);
+                break;
+            case E_GDBJITSECTION_STRTAB:
+            case E_GDBJITSECTION_STABSTR:
+            case E_GDBJITSECTION_SHSTRTAB:
+                sh.sh_type = SHT_STRTAB;
+                break;
+            case E_GDBJITSECTION_STAB:
+                sh.sh_link = E_GDBJITSECTION_STABSTR;
+                sh.sh_entsize = 12; // struct nlist
+                break;
+        }
+
+        bb.AppendBytes((so_byte*)&sh, sizeof(sh));
+    }
+
+    // ****************
+    //   File header.
+    // ****************
+
+    SElfHeader* pHeader = (SElfHeader*)bb.Bytes();
+    pHeader->e_ident[EI_MAG0] = ELFMAG0;
+    pHeader->e_ident[EI_MAG1] = ELFMAG1;
+    pHeader->e_ident[EI_MAG2] = ELFMAG2;
+    pHeader->e_ident[EI_MAG3] = ELFMAG3;
+    pHeader->e_ident[EI_CLASS] = SKIZO_ELFCLASS;
+    pHeader->e_ident[EI_DATA] = ELFDATA2LSB;
+    pHeader->e_ident[EI_VERSION] = EV_CURRENT;
+    pHeader->e_ident[EI_OSABI] = ELFOSABI_NONE;
+    pHeader->e_type = ET_EXEC; // addresses are final
+    pHeader->e_machine = SKIZO_ELFMACHINE;
+    pHeader->e_version = EV_CURRENT;
+    pHeader->e_ehsize = sizeof(SElfHeader);
+    pHeader->e_shoff = sectionHeadersOffset;
+    pHeader->e_shentsize = sizeof(SElfSectionHeader);
+    pHeader->e_shnum = E_GDBJITSECTION_COUNT;
+    pHeader->e_shstrndx = E_GDBJITSECTION_SHSTRTAB;
+
+    char* symfile = (char*)malloc(bb.Size());
+    memcpy(symfile, bb.Bytes(), bb.Size());
+    *out_size = bb.Size();
+    return symfile;
+}
+
+#endif // SKIZO_X
+
+struct GdbJitPrivate
+{
+    // Entries registered by this domain. Allocated with malloc, as well as their symfiles.
+    Auto<CArrayList<void*> > m_entries;
+
+    GdbJitPrivate()
+        : m_entries(new CArrayList<void*>())
+    {
+    }
+};
+
+SGdbJit::SGdbJit()
+    : p(nullptr)
+{
+}
+
+SGdbJit::~SGdbJit()
+{
+    if(!p) {
+        return;
+    }
+
+    // The descriptor is shared by all domains of the process.
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        for(int i = 0; i < p->m_entries->Count(); i++) {
+            jit_code_entry* entry = (jit_code_entry*)p->m_entries->Array()[i];
+
+            if(entry->prev_entry) {
+                entry->prev_entry->next_entry = entry->next_entry;
+            } else {
+                __jit_debug_descriptor.first_entry = entry->next_entry;
+            }
+            if(entry->next_entry) {
+                entry->next_entry->prev_entry = entry->prev_entry;
+            }
+
+            __jit_debug_descriptor.relevant_entry = entry;
+            __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+            __jit_debug_register_code();
+
+            free((void*)entry->symfile_addr);
+            free(entry);
+        }
+    } SKIZO_END_LOCK_AB_NOEXCEPT(CDomain::g_globalMutex);
+
+    delete p;
+}
+
+void SGdbJit::Enable()
+{
+#ifdef SKIZO_X
+    if(!p) {
+        p = new GdbJitPrivate();
+    }
+#endif
+}
+
+void SGdbJit::RegisterTCCState(TCCState* tccState)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ_PTR(tccState);
+
+#ifdef SKIZO_X
+    size_t symfileSize;
+    char* symfile = buildSymfile(tccState, &symfileSize);
+    if(!symfile) {
+        return;
+    }
+
+    jit_code_entry* entry = (jit_code_entry*)malloc(sizeof(jit_code_entry));
+    entry->symfile_addr = symfile;
+    entry->symfile_size = symfileSize;
+    entry->prev_entry = nullptr;
+    p->m_entries->Add((void*)entry);
+
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        entry->next_entry = __jit_debug_descriptor.first_entry;
+        if(entry->next_entry) {
+            entry->next_entry->prev_entry = entry;
+        }
+        __jit_debug_descriptor.first_entry = entry;
+
+        __jit_debug_descriptor.relevant_entry = entry;
+        __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+        __jit_debug_register_code();
+    } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+#endif
+}
+
+} }
@@ -0,0 +1,55 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef GDBJIT_H_INCLUDED
+#define GDBJIT_H_INCLUDED
+
+#include "basedefs.h"
+
+struct TCCState;
+
+namespace skizo { namespace script {
+
+/**
+ * Registers code relocated by TCC with GDB's JIT compilation interface (__jit_debug_register_code), so that
+ * GDB could show names of emitted functions in backtraces and map their addresses to lines of the original
+ * .skizo files: for every relocated TCC state (the main image and lazy units), an in-memory ELF object is built
+ * out of its function symbols and the stabs debug info TCC generates (the emitter inserts #line directives which
+ * point to the Skizo source, see SDomainCreation::DebugInfoEnabled).
+ *
+ * Registered objects are unregistered when the domain is destroyed. All methods do nothing unless enabled.
+ * Unix only: does nothing on other platforms.
+ *
+ * To be embedded into CDomain.
+ */
+struct SGdbJit
+{
+public:
+    SGdbJit();
+    ~SGdbJit();
+
+    void Enable();
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * To be called after the state is relocated. The state must be compiled with "-g".
+     */
+    void RegisterTCCState(TCCState* tccState);
+
+private:
+    struct GdbJitPrivate* p;
+};
+
+} }
+
+#endif // GDBJIT_H_INCLUDED
@@ -0,0 +1,37 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef HARDWAREEXCEPTIONS_H_INCLUDED
+#define HARDWAREEXCEPTIONS_H_INCLUDED
+
+namespace skizo { namespace script {
+class CDomain;
+} }
+
+namespace skizo { namespace script { namespace HardwareExceptions {
+
+/**
+ * Converts hardware exceptions raised by the machine code generated for domains into domain aborts: null
+ * dereferences if explicit null checks are off (see SDomainCreation::ExplicitNullCheck) and stack overflows which
+ * get past the proactive check or happen in domains which don't check (see CDomain::StackLimit()). Unix only for
+ * stack overflows: on Windows, an overflow past the proactive check isn't recoverable.
+ * Exceptions raised anywhere else are left to the OS or to whatever handled them before.
+ *
+ * The handler is process-wide and is installed only once; per-thread state is prepared for the calling thread.
+ * To be called by CDomain::CreateDomain(..) on the thread of the domain.
+ */
+void Install(const CDomain* domain);
+
+} } }
+
+#endif // HARDWAREEXCEPTIONS_H_INCLUDED
@@ -0,0 +1,110 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "Domain.h"
+#include "Method.h"
+
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// Interface calls are dispatched in two steps:
+// 1) Every call site has a monomorphic inline cache: the vtable seen last at the call site and the method
+//    implementation found for it. If the vtable of the receiver matches, the emitted code calls the cached
+//    implementation right away (see _soX_ICFIND in SEmitter).
+// 2) On a miss, _soX_icfind(..) looks up the receiver's class in its itable, which maps interface methods to
+//    vtable slots. With structural typing, any class can implement any interface, so itables are computed for
+//    every pair of a reachable class and a reachable interface the class conforms to. Classes and interfaces
+//    created after startup fall back to the by-name search in _soX_findmethod(..)
+
+void CDomain::buildITables()
+{
+    // Every method of a reachable interface is assigned a dense index into itables.
+    Auto<CArrayList<CClass*> > intrfcs (new CArrayList<CClass*>());
+    int itableSize = 0;
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        CClass* klass = m_klasses->Array()[i];
+
+        if(klass->SpecialClass() == E_SPECIALCLASS_INTERFACE && klass->IsReachable()) {
+            intrfcs->Add(klass);
+
+            const CArrayList<CMethod*>* intrfcMethods = klass->InstanceMethods();
+            for(int j = 0; j < intrfcMethods->Count(); j++) {
+                intrfcMethods->Array()[j]->SetITableIndex(itableSize++);
+            }
+        }
+    }
+
+    if(!itableSize) {
+        return;
+    }
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        CClass* klass = m_klasses->Array()[i];
+
+        if(!klass->IsReachable()
+        || !klass->HasVTable()
+        || klass->IsAbstract()
+        || klass->SpecialClass() == E_SPECIALCLASS_INTERFACE)
+        {
+            continue;
+        }
+
+        int* itable = nullptr;
+
+        for(int j = 0; j < intrfcs->Count(); j++) {
+            const CClass* intrfc = intrfcs->Array()[j];
+            if(!klass->Is(intrfc)) {
+                continue;
+            }
+
+            if(!itable) {
+                itable = (int*)m_memMngr.BumpPointerAllocator().Allocate(itableSize * sizeof(int), E_SKIZOALLOCATIONTYPE_CLASS);
+                for(int k = 0; k < itableSize; k++) {
+                    itable[k] = -1;
+                }
+            }
+
+            // Same as _soX_findmethod(..)
+            const CArrayList<CMethod*>* intrfcMethods = intrfc->InstanceMethods();
+            for(int k = 0; k < intrfcMethods->Count(); k++) {
+                const CMethod* intrfcMethod = intrfcMethods->Array()[k];
+
+                CMethod* instanceMethod = nullptr;
+                if(klass->TryGetInstanceMethodByName(intrfcMethod->Name(), &instanceMethod)) {
+                    instanceMethod->Unref();
+
+                    if(instanceMethod->VTableIndex() != -1
+                    && instanceMethod->Signature().Equals(&intrfcMethod->Signature()))
+                    {
+                        itable[intrfcMethod->ITableIndex()] = instanceMethod->VTableIndex();
+                    }
+                }
+            }
+        }
+
+        klass->SetITable(itable);
+    }
+}
+
+void** CDomain::NewInlineCache()
+{
+    void** cache = (void**)m_memMngr.BumpPointerAllocator().Allocate(2 * sizeof(void*), E_SKIZOALLOCATIONTYPE_MEMBER);
+    memset(cache, 0, 2 * sizeof(void*));
+    return cache;
+}
+
+} }
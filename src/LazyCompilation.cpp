@@ -0,0 +1,286 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "Abort.h"
+#include "Domain.h"
+#include "Emitter.h"
+#include "Method.h"
+#include "String.h"
+
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// Lazy compilation works as follows:
+// 1) Before emission, ordinary methods of user classes are marked with E_METHODFLAGS_IS_LAZY. The emitter
+//    emits their headers (so that the rest of the code can call them) but no bodies.
+// 2) Every such method is linked to a compilation trampoline (see SThunkManager::GetCompilationTrampoline),
+//    in the same way boxed methods are. Vtables refer to trampolines as well.
+// 3) On the first call, the trampoline calls CDomain::CompileLazyMethod(..), which emits the method's body as
+//    a separate unit and compiles it with a new TCC state. The unit starts with declarations of everything
+//    defined in the main image; static fields, vtables and functions are linked in from the main image (this is
+//    why they're global with lazy compilation, see SEmitter). Finally, the trampoline is patched to jump to the
+//    compiled body directly.
+// The header is about as large as the main image's declarations, so compiling it for every method would make
+// the total cost quadratic. Instead, the unit also includes the rest of the pending (not yet compiled) lazy
+// methods of the method's declaring class, on the assumption that methods of a class are used together: there's
+// at most one unit per class.
+// Constructors, destructors, static constructors, closures and other compiler-generated code are compiled
+// eagerly, as they're either small or called by the runtime directly.
+
+static __cdecl void lazyMethodJit(void* trampoline, void* pMethod)
+{
+    CMethod* method = (CMethod*)pMethod;
+    method->DeclaringClass()->DeclaringDomain()->CompileLazyMethod(method, trampoline);
+}
+
+static bool canBeCompiledLazily(const CMethod* method)
+{
+    return method->SpecialMethod() == E_SPECIALMETHOD_NONE
+        && method->MethodKind() == E_METHODKIND_NORMAL
+        && !method->IsAbstract();
+}
+
+static bool isIdentChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+void CDomain::markLazyMethods()
+{
+    if(!m_lazyCompilation) {
+        return;
+    }
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        const CClass* klass = m_klasses->Array()[i];
+        if(!klass->IsReachable() || klass->IsCompilerGenerated()) {
+            continue;
+        }
+
+        const CArrayList<CMethod*>* instanceMethods = klass->InstanceMethods();
+        for(int j = 0; j < instanceMethods->Count(); j++) {
+            CMethod* method = instanceMethods->Array()[j];
+
+            // Inherited methods are taken care of by their declaring classes.
+            if(method->DeclaringClass() == klass && canBeCompiledLazily(method)) {
+                method->Flags() |= E_METHODFLAGS_IS_LAZY;
+            }
+        }
+
+        const CArrayList<CMethod*>* staticMethods = klass->StaticMethods();
+        for(int j = 0; j < staticMethods->Count(); j++) {
+            CMethod* method = staticMethods->Array()[j];
+
+            if(method->IsReachable() && canBeCompiledLazily(method)) {
+                method->Flags() |= E_METHODFLAGS_IS_LAZY;
+            }
+        }
+    }
+}
+
+void CDomain::registerLazyMethods()
+{
+    if(!m_lazyCompilation) {
+        return;
+    }
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        const CClass* klass = m_klasses->Array()[i];
+
+        for(int k = 0; k < 2; k++) {
+            const CArrayList<CMethod*>* methods = k? klass->StaticMethods(): klass->InstanceMethods();
+
+            for(int j = 0; j < methods->Count(); j++) {
+                const CMethod* method = methods->Array()[j];
+
+                if(method->IsLazy() && method->DeclaringClass() == klass) {
+                    void* trampoline = m_thunkMngr.GetCompilationTrampoline(method, lazyMethodJit);
+                    char* cName = method->GetCName();
+                    m_lazyNames->Add(cName);
+
+                    registerICall(cName, trampoline);
+                }
+            }
+        }
+    }
+}
+
+void CDomain::CompileLazyMethod(CMethod* method, void* trampoline)
+{
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        // Another thread may have compiled the method while this one was waiting for the lock.
+        // The patched trampoline has "leave" at the patched label (see SThunkManager::PatchCompilationTrampoline).
+        if(((so_byte*)trampoline)[4] != 0xC9) {
+            compileLazyMethod(method, trampoline);
+        }
+    } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+}
+
+void CDomain::compileLazyMethod(CMethod* method, void* trampoline)
+{
+    // ********************************************************
+    //   The header is emitted and linked once, on first use.
+    // ********************************************************
+
+    if(!m_lazyUnitHeader) {
+        STextBuilder headerCB;
+        SkizoEmitLazyUnitHeader(this, headerCB);
+        m_lazyUnitHeader = CString::CloneUtf8(headerCB.Chars());
+
+        // Every symbol the header refers to which is found in the main image (functions, vtables, static fields,
+        // helpers, icalls) is to be linked into lazy units. All the names emitted by SEmitter start with "_so".
+        const char* cs = m_lazyUnitHeader;
+        for(int i = 0; cs[i]; i++) {
+            if(cs[i] != '_' || cs[i + 1] != 's' || cs[i + 2] != 'o' || (i > 0 && isIdentChar(cs[i - 1]))) {
+                continue;
+            }
+
+            int end = i;
+            while(isIdentChar(cs[end])) {
+                end++;
+            }
+
+            char* name = new char[end - i + 1];
+            memcpy(name, &cs[i], end - i);
+            name[end - i] = 0;
+
+            void* ptr = m_lazyUnitExternals->Contains(name)? nullptr: GetSymbol(name);
+            if(ptr) {
+                char* ownedName = CString::CloneUtf8(name);
+                m_lazyNames->Add(ownedName);
+                m_lazyUnitExternals->Set(ownedName, ptr);
+            }
+
+            delete [] name;
+            i = end - 1;
+        }
+    }
+
+    // ******************************************************************
+    //   The method and the pending lazy methods of its declaring class.
+    // ******************************************************************
+
+    Auto<CArrayList<const CMethod*> > batch (new CArrayList<const CMethod*>());
+    Auto<CArrayList<void*> > trampolines (new CArrayList<void*>());
+    batch->Add(method);
+    trampolines->Add(trampoline);
+
+    const CClass* klass = method->DeclaringClass();
+    for(int k = 0; k < 2; k++) {
+        const CArrayList<CMethod*>* methods = k? klass->StaticMethods(): klass->InstanceMethods();
+
+        for(int i = 0; i < methods->Count(); i++) {
+            const CMethod* otherMethod = methods->Array()[i];
+            if(otherMethod == method || !otherMethod->IsLazy() || otherMethod->DeclaringClass() != klass) {
+                continue;
+            }
+
+            // See ::registerLazyMethods()
+            Utf8Auto otherCName (otherMethod->GetCName());
+            void* otherTrampoline;
+            if(m_icallImplSet.TryGet(otherCName, &otherTrampoline) && ((so_byte*)otherTrampoline)[4] != 0xC9) {
+                batch->Add(otherMethod);
+                trampolines->Add(otherTrampoline);
+            }
+        }
+    }
+
+    STextBuilder cb;
+    cb.Emit("%S", m_lazyUnitHeader);
+    for(int i = 0; i < batch->Count(); i++) {
+        SkizoEmitLazyMethod(this, cb, batch->Array()[i]);
+    }
+
+    TCCState* tccState = tcc_new();
+    SKIZO_REQ_PTR(tccState);
+    if(m_gdbJit.IsEnabled()) {
+        tcc_set_options(tccState, "-g");
+    }
+    tcc_set_output_type(tccState, TCC_OUTPUT_MEMORY);
+
+    if(tcc_compile_string(tccState, cb.Chars()) == -1) {
+        tcc_delete(tccState);
+        CDomain::Abort("Couldn't compile the output machine code (invalid inline C code or a bug in the backend).");
+    }
+
+    // The unit defines the methods of the batch itself, the main image only has their trampolines.
+    Auto<CArrayList<char*> > cNames (new CArrayList<char*>());
+    for(int i = 0; i < batch->Count(); i++) {
+        char* cName = batch->Array()[i]->GetCName();
+        m_lazyNames->Add(cName);
+        cNames->Add(cName);
+    }
+
+    {
+        const char* name;
+        void* ptr;
+        SHashMapEnumerator<const char*, void*> mapEnum (m_lazyUnitExternals);
+        while(mapEnum.MoveNext(&name, &ptr)) {
+            bool isInBatch = false;
+            for(int i = 0; i < cNames->Count(); i++) {
+                if(strcmp(name, cNames->Array()[i]) == 0) {
+                    isInBatch = true;
+                    break;
+                }
+            }
+
+            if(!isInBatch) {
+                tcc_add_symbol(tccState, name, ptr);
+            }
+        }
+    }
+
+#ifdef SKIZO_WIN
+    void* chkstk;
+    if(m_icallImplSet.TryGet("__chkstk", &chkstk)) {
+        tcc_add_symbol(tccState, "__chkstk", chkstk);
+    }
+#endif
+
+    if(tcc_relocate(tccState, TCC_RELOCATE_AUTO) < 0) {
+        tcc_delete(tccState);
+        CDomain::Abort("Relocation error (invalid inline C code or a bug in the backend).");
+    }
+
+    m_lazyUnits->Add(tccState);
+    m_perfMap.AddTCCState(tccState);
+    m_gdbJit.RegisterTCCState(tccState);
+
+    for(int i = 0; i < batch->Count(); i++) {
+        void* impl = tcc_get_symbol(tccState, cNames->Array()[i]);
+        SKIZO_REQ_PTR(impl);
+        m_thunkMngr.PatchCompilationTrampoline(trampolines->Array()[i], impl);
+    }
+}
+
+void CDomain::deleteLazyUnits()
+{
+    for(int i = 0; i < m_lazyUnits->Count(); i++) {
+        tcc_delete(m_lazyUnits->Array()[i]);
+    }
+    m_lazyUnits->Clear();
+
+    m_lazyUnitExternals->Clear();
+    for(int i = 0; i < m_lazyNames->Count(); i++) {
+        CString::FreeUtf8(m_lazyNames->Array()[i]);
+    }
+    m_lazyNames->Clear();
+
+    CString::FreeUtf8(m_lazyUnitHeader);
+    m_lazyUnitHeader = nullptr;
+}
+
+} }
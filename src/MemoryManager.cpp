@@ -12,11 +12,14 @@
 // *****************************************************************************
 
 #include "MemoryManager.h"
+#include "Application.h"
 #include "Contract.h"
 #include "Domain.h"
 #include "icall.h"
 #include "RuntimeHelpers.h"
 #include "Stopwatch.h"
+#include <setjmp.h>
+#include <string.h>
 
 namespace skizo { namespace script {
 using namespace skizo::core;
@@ -38,6 +41,7 @@ SMemoryManager::SMemoryManager():
     m_mapClass(nullptr),
     m_lastGCTime(0),
     m_gcStatsEnabled(false),
+    m_interiorPointersEnabled(false),
     m_dtorsEnabled(true)
 {
 }
@@ -97,6 +101,9 @@ void* SMemoryManager::Allocate(int sz, void** vtable)
     }
     memset(obj, 0, sz);
 
+    m_stats.AllocationCount++;
+    m_stats.AllocatedBytes += sz;
+
     if(pClass->SpecialClass() == E_SPECIALCLASS_ARRAY) {
         m_allocdMemory += sz;
     } else {
@@ -120,22 +127,37 @@ void* SKIZO_API _soX_gc_alloc(SMemoryManager* mm, int sz, void** vtable)
     return mm->Allocate(sz, vtable);
 }
 
-// WARNING don't introduce RAII
-void* _soX_gc_alloc_env(SMemoryManager* mm, void* _objClass)
+// Creates the vtable of a closure env on demand. It will be deleted in the class' destructor (there's a special
+// clause there for closure envs).
+// NOTE that closure env's vtables are pretty simple, they have no methods.
+static void** envVirtualTable(CClass* objClass)
 {
-    CClass* objClass = (CClass*)_objClass;
     SKIZO_REQ_EQUALS(objClass->SpecialClass(), E_SPECIALCLASS_CLOSUREENV);
 
-    // Creates the vtable on demand. It will be deleted in the class' destructor (there's a special clause there
-    // for closure envs).
-    // NOTE that closure env's vtables are pretty simple, they have no methods.
     if(!objClass->VirtualTable()) {
         void** vtable = new void*[1];
-        vtable[0] = _objClass;
+        vtable[0] = objClass;
         objClass->SetVirtualTable(vtable);
     }
 
-    return _soX_gc_alloc(mm, objClass->GCInfo().ContentSize, objClass->VirtualTable());
+    return objClass->VirtualTable();
+}
+
+// WARNING don't introduce RAII
+void* _soX_gc_alloc_env(SMemoryManager* mm, void* _objClass)
+{
+    CClass* objClass = (CClass*)_objClass;
+    void** vtable = envVirtualTable(objClass);
+
+    return _soX_gc_alloc(mm, objClass->GCInfo().ContentSize, vtable);
+}
+
+// WARNING don't introduce RAII
+void* _soX_stackenv(void* env, int sz, void* objClass)
+{
+    memset(env, 0, sz);
+    ((SObjectHeader*)env)->vtable = envVirtualTable((CClass*)objClass);
+    return env;
 }
 
 void SMemoryManager::AddGCRoots(void** rootRefs, int count)
@@ -282,15 +304,28 @@ bool SMemoryManager::IsValidObject(void* ptr) const
 // WARNING Doesn't work for architectures without a growing stack.
 void SMemoryManager::scanStack()
 {
+    // Spills callee-saved registers to the stack so that references held in registers by optimized
+    // code (see SDomainCreation::NativeCompiler) were scanned as well.
+    jmp_buf regs;
+    setjmp(regs);
+
     void** start = (void**)m_stackBase;
-    void** end = (void**)&start;
+    void** end = (void**)&regs;
 
     // The descending order for X86/64-based CPUs.
     SKIZO_REQ(end < start, EC_PLATFORM_DEPENDENT);
     for(void** i = end; i < start; i++) {
         void* v = *i;
 
-        if(this->IsValidObject(v)) {
+        if(m_interiorPointersEnabled) {
+            // Any pointer into the heap, aligned or not.
+            if(v && v >= m_heapStart && v < m_heapEnd) {
+                void* objStart = m_poolAllocator.FindObjectStart(v);
+                if(objStart) {
+                    gcMark(objStart);
+                }
+            }
+        } else if(this->IsValidObject(v)) {
             gcMark(v);
         }
     }
@@ -341,6 +376,7 @@ void SMemoryManager::CollectGarbage(bool domainTeardown)
     }
     SStopwatch stopwatch;
     stopwatch.Start();
+    const so_long startTime = Application::MicroTickCount();
 
     // ***************
     //   Mark phase.
@@ -429,6 +465,14 @@ doGC:
     // ***********************************
 
     m_lastGCTime = (long int)stopwatch.End();
+    if(!domainTeardown) {
+        const so_long pause = Application::MicroTickCount() - startTime;
+        m_stats.GCCount++;
+        m_stats.TotalGCTimeInUs += pause;
+        if(pause > m_stats.MaxGCTimeInUs) {
+            m_stats.MaxGCTimeInUs = pause;
+        }
+    }
     if(m_gcStatsEnabled) {
         printf("Memory after GC: %d, time: %ld | Object count after GC: %d\n",
             (int)m_allocdMemory,
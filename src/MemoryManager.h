@@ -35,6 +35,30 @@ public:
     CGCRootHolder(void* p): pSkizoObject(p) { }
 };
 
+/**
+ * Cumulative allocation and GC counters of a domain, reported by the benchmark runner (see launcher.cpp)
+ * Always collected: it's a couple of additions per allocation.
+ */
+struct SMemoryStats
+{
+    so_long AllocationCount;
+    so_long AllocatedBytes;
+
+    // Collections on domain teardown aren't counted.
+    int GCCount;
+    so_long TotalGCTimeInUs;
+    so_long MaxGCTimeInUs;
+
+    SMemoryStats()
+        : AllocationCount(0),
+          AllocatedBytes(0),
+          GCCount(0),
+          TotalGCTimeInUs(0),
+          MaxGCTimeInUs(0)
+    {
+    }
+};
+
 /**
  * This struct is to be embedded into Domain.
  */
@@ -131,6 +155,15 @@ public:
 
     void EnableGCStats(bool value) { m_gcStatsEnabled = value; }
 
+    /**
+     * If true, the stack scan treats pointers into the middle of objects as references to the objects: optimized code
+     * (see SDomainCreation::NativeCompiler) may keep nothing but a derived pointer, such as the address of an array
+     * element or a field, while the object is still in use. Slows down the stack scan. False by default.
+     */
+    void EnableInteriorPointers(bool value) { m_interiorPointersEnabled = value; }
+
+    const SMemoryStats& Stats() const { return m_stats; }
+
     /**
      * Set in CDomain::CreateDomain(..); used by GC to quickly check if an object is a map (they have special GC maps).
      */
@@ -172,6 +205,8 @@ private:
 
     long int m_lastGCTime; // for profiling
     bool m_gcStatsEnabled; // for profiling
+    bool m_interiorPointersEnabled;
+    SMemoryStats m_stats;
 
     SPoolAllocator m_poolAllocator;
     SBumpPointerAllocator m_bumpPointerAllocator;
@@ -33,9 +33,10 @@ CMethod::CMethod(CClass* declaringClass)
           m_access(E_ACCESSMODIFIER_PUBLIC),
           m_specialMethod(E_SPECIALMETHOD_NONE),
           m_vtableIndex(-1),
+          m_itableIndex(-1),
           m_baseMethod(nullptr), m_parentMethod(nullptr),
           m_closureEnvClass(nullptr),
-          m_numberOfCalls(0), m_totalTimeInMs(0),
+          m_tierUpCounter(0),
           m_targetField(nullptr),
           m_serverStubImpl(nullptr)
 {
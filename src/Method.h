@@ -16,6 +16,7 @@
 
 #include "AccessModifier.h"
 #include "Attribute.h"
+#include "CallProfiler.h"
 #include "ECallDesc.h"
 #include "Expression.h"
 #include "Member.h"
@@ -78,6 +79,11 @@ public:
     bool ECallAttributesResolved() const { return m_flags & E_METHODFLAGS_ECALL_ATTRIBUTES_RESOLVED; }
     bool IsInferred() const { return m_flags & E_METHODFLAGS_IS_INFERRED; }
     bool IsInlinable() const { return m_flags & E_METHODFLAGS_IS_INLINABLE; }
+    bool IsReachable() const { return m_flags & E_METHODFLAGS_IS_REACHABLE; }
+    bool IsLazy() const { return m_flags & E_METHODFLAGS_IS_LAZY; }
+    bool IsEffectivelyFinal() const { return m_flags & E_METHODFLAGS_IS_EFFECTIVELY_FINAL; }
+    bool IsEnvOnStack() const { return m_flags & E_METHODFLAGS_IS_ENV_ON_STACK; }
+    bool HasTailCalls() const { return m_flags & E_METHODFLAGS_HAS_TAIL_CALLS; }
     bool IsCompilerGenerated() const { return m_flags & E_METHODFLAGS_COMPILER_GENERATED; }
 
     /**
@@ -118,6 +124,13 @@ public:
     int VTableIndex() const { return m_vtableIndex; }
     void SetVTableIndex(int value) { m_vtableIndex = value; }
 
+    /**
+     * For interface methods: the index of the method in itables (see CClass::ITable()), -1 if the interface
+     * wasn't reachable when itables were built.
+     */
+    int ITableIndex() const { return m_itableIndex; }
+    void SetITableIndex(int value) { m_itableIndex = value; }
+
     /**
      * The base method in the virtual method chain
      */
@@ -166,10 +179,16 @@ public:
 
     EMethodFlags& Flags() { return m_flags; }
     
-    int NumberOfCalls() const { return m_numberOfCalls; }
-    int TotalTimeInMs() const { return m_totalTimeInMs; }
-    void AddTotalTimeInMs(int delta) { m_totalTimeInMs += delta; }
-    void AddNumberOfCalls(int delta) { m_numberOfCalls += delta; }
+    /**
+     * Data collected by the instrumented profiler (see SCallProfiler).
+     */
+    SMethodProfile& Profile() { return m_profile; }
+    const SMethodProfile& Profile() const { return m_profile; }
+
+    /**
+     * With tiered compilation, first-tier code increments this counter on every call (see _soX_tierup).
+     */
+    int* TierUpCounter() const { return &m_tierUpCounter; }
 
     // ********************************************************
     // Used by the Emitter in the function body emission phase.
@@ -319,6 +338,7 @@ private:
     ESpecialMethod m_specialMethod;
     SECallDesc m_ecallDesc;
     int m_vtableIndex;
+    int m_itableIndex;
     CMethod* m_baseMethod;
     CMethod* m_parentMethod;
     skizo::core::Auto<CBodyExpression> m_expression;
@@ -327,8 +347,10 @@ private:
     class CClass* m_closureEnvClass;
 
     // NOTE Unused if profiling wasn't enabled via SDomainCreation::ProfilingEnabled.
-    int m_numberOfCalls;
-    int m_totalTimeInMs; // Average time is calculated as (m_totalTimeInMs/m_numberOfCalls)
+    SMethodProfile m_profile;
+
+    // NOTE Unused if tiered compilation wasn't enabled via SDomainCreation::TieredCompilation.
+    mutable int m_tierUpCounter;
 
     class CField* m_targetField;
     mutable SThunkInfo m_thunkInfo;
@@ -81,6 +81,37 @@ typedef int EMethodFlags;
 
 #define E_METHODFLAGS_COMPILER_GENERATED (1 << 11)
 
+/**
+ * Set by the dead code elimination pass (see CDomain::eliminateDeadCode()) if the method can be called at runtime.
+ * Only static methods are checked by the emitter; instance methods are kept alive together with their classes.
+ */
+#define E_METHODFLAGS_IS_REACHABLE (1 << 12)
+
+/**
+ * The method's body isn't part of the main image: it's compiled on first call (see SDomainCreation::LazyCompilation).
+ */
+#define E_METHODFLAGS_IS_LAZY (1 << 13)
+
+/**
+ * Set by class hierarchy analysis (see STransformer::devirtualizeCalls()) for a truly virtual method which is never
+ * overriden in subclasses of its declaring class. Wherever such a method is the target of a call, the receiver can't
+ * have a different implementation, so the emitter calls it directly, by-passing the vtable.
+ */
+#define E_METHODFLAGS_IS_EFFECTIVELY_FINAL (1 << 14)
+
+/**
+ * Set by escape analysis (see STransformer::allocateClosuresOnStack()) if no closure created in the method (or in
+ * closures nested in it) can outlive the call, so the closure environment is allocated on the C stack instead of the
+ * heap.
+ */
+#define E_METHODFLAGS_IS_ENV_ON_STACK (1 << 15)
+
+/**
+ * The method has self-recursive calls in tail position (see CCallExpression::IsTailCall), so the emitter places a
+ * label to jump to after the prolog.
+ */
+#define E_METHODFLAGS_HAS_TAIL_CALLS (1 << 16)
+
 } }
 
 #endif // METHODFLAGS_H_INCLUDED
@@ -17,10 +17,22 @@
 
 namespace skizo { namespace script {
 using namespace skizo::core;
+using namespace skizo::collections;
 
 // TODO use an API for creating classes
 // TODO use api to create method classes from signatures
 
+// Same as "[noescape]" in script code: the native method only invokes the closures passed to it and never stores
+// them, so that closure literals passed to it can be allocated on the stack (see STransformer::allocateClosuresOnStack())
+static void markNoEscape(CDomain* domain, CMethod* method)
+{
+    Auto<CArrayList<CAttribute*> > attrs (new CArrayList<CAttribute*>());
+    Auto<CAttribute> attr (new CAttribute());
+    attr->Name = domain->NewSlice("noescape");
+    attrs->Add(attr);
+    method->AddAttributes(attrs);
+}
+
 void CDomain::initPredicateClass()
 {
     Auto<CClass> klass (CClass::CreateIncompleteMethodClass(this));
@@ -108,6 +120,7 @@ void CDomain::initRangeStruct()
         Auto<CMethod> nMethod (new CMethod(rangeClass));
         nMethod->SetName(this->NewSlice("loop"));
         nMethod->SetSpecialMethod(E_SPECIALMETHOD_NATIVE);
+        markNoEscape(this, nMethod);
         {
             Auto<CParam> param1 (new CParam());
             param1->Type.SetObject(this->NewSlice("RangeLooper"));
@@ -124,6 +137,7 @@ void CDomain::initRangeStruct()
         Auto<CMethod> nMethod (new CMethod(rangeClass));
         nMethod->SetName(this->NewSlice("step"));
         nMethod->SetSpecialMethod(E_SPECIALMETHOD_NATIVE);
+        markNoEscape(this, nMethod);
         {
             Auto<CParam> param1 (new CParam());
             param1->Type.SetPrimType(E_PRIMTYPE_INT);
@@ -735,6 +749,7 @@ void CDomain::initBasicClasses()
             // ((a == a) then ^{ /* do something */ }) else ^{ /* do something */ };
             nMethod->Signature().ReturnType.SetPrimType(E_PRIMTYPE_BOOL);
             nMethod->SetSpecialMethod(E_SPECIALMETHOD_NATIVE);
+            markNoEscape(this, nMethod);
             {
                 Auto<CParam> param1 (new CParam());
                 param1->Type.SetObject(this->NewSlice("Action"));
@@ -753,6 +768,7 @@ void CDomain::initBasicClasses()
             // Returns an inverted value.
             nMethod->Signature().ReturnType.SetPrimType(E_PRIMTYPE_BOOL);
             nMethod->SetSpecialMethod(E_SPECIALMETHOD_NATIVE);
+            markNoEscape(this, nMethod);
             {
                 Auto<CParam> param1 (new CParam());
                 param1->Type.SetObject(this->NewSlice("Action"));
@@ -770,6 +786,7 @@ void CDomain::initBasicClasses()
             nMethod->SetName(this->NewSlice("while"));
             nMethod->Signature().IsStatic = true;
             nMethod->SetSpecialMethod(E_SPECIALMETHOD_NATIVE);
+            markNoEscape(this, nMethod);
             {
                 Auto<CParam> param1 (new CParam());
                 param1->Type.SetObject(this->NewSlice("Predicate"));
@@ -0,0 +1,64 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef NATIVEIMAGE_H_INCLUDED
+#define NATIVEIMAGE_H_INCLUDED
+
+#include "HashMap.h"
+
+namespace skizo { namespace script {
+
+/**
+ * An alternative to the baseline C compiler (TCC): the emitted C code is compiled with an optimizing
+ * system C compiler (GCC, Clang) into a shared object, which is then loaded into the process.
+ * Considerably slows down startup, but compute-heavy code runs several times faster.
+ *
+ * See SDomainCreation::NativeCompiler
+ */
+class CNativeImage final: public skizo::core::CObject
+{
+public:
+    /**
+     * Compiles the given C code with the specified compiler (such as "cc", "gcc" or "clang") and
+     * loads the result.
+     *
+     * @param externals Functions the C code refers to but does not define (icalls, ecalls, thunks) mapped
+     * to their addresses. They're linked into the image as absolute symbols, i.e. the same table which is
+     * used to link TCC-compiled code is reused here.
+     * @return null if compilation failed; the compiler's diagnostics are printed to the console.
+     */
+    static CNativeImage* Compile(const char* compiler,
+                                 const char* cCode,
+                                 const skizo::collections::CHashMap<const char*, void*>* externals);
+
+    virtual ~CNativeImage();
+
+    /**
+     * Returns the address of a function defined in the image, or null if nothing found.
+     */
+    void* GetSymbol(const char* name) const;
+
+    /**
+     * Returns true if the pointer points to machine code inside the image.
+     */
+    bool IsSymbol(void* ptr) const;
+
+private:
+    struct NativeImagePrivate* p;
+
+    CNativeImage();
+};
+
+} }
+
+#endif // NATIVEIMAGE_H_INCLUDED
@@ -2182,13 +2182,20 @@ void SParser::parseTopLevel()
 
 void SkizoParse(CDomain* domain, const CString* filePath, const CString* code, bool isBaseModule)
 {
+    SStartupTrace& startupTrace = domain->StartupTrace();
+
+    startupTrace.Begin("parsing", "tokenize");
     Auto<CArrayList<CToken*> > tokens (Tokenizer::Tokenize(domain, filePath, code));
+    startupTrace.AddArg("tokens", tokens->Count());
+    startupTrace.End();
 
     Auto<CModuleDesc> module (new CModuleDesc(filePath, isBaseModule));
     domain->AddModule(module);
 
+    startupTrace.Begin("parsing", "parse");
     SParser parser (tokens, module, domain);
     parser.parseTopLevel();
+    startupTrace.End();
 }
 
 } }
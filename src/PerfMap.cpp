@@ -0,0 +1,202 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "PerfMap.h"
+#include "Abort.h"
+#include "ArrayList.h"
+#include "Class.h"
+#include "Contract.h"
+#include "Domain.h"
+#include "HashMap.h"
+#include "Method.h"
+#include "String.h"
+#include "TextBuilder.h"
+
+#include <stdio.h>
+
+#ifdef SKIZO_X
+    #include <unistd.h>
+#endif
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// The file is shared by all domains of the process. Guarded by CDomain::g_globalMutex
+static FILE* g_perfMapFile = nullptr;
+static int g_perfMapRefCount = 0;
+
+struct PerfMapPrivate
+{
+    const CDomain* m_domain;
+
+    // Maps C names of methods to methods, to name functions found in TCC states. Built on first use.
+    // The keys are owned by m_cNames.
+    Auto<CHashMap<const char*, CMethod*> > m_methodsByCName;
+    Auto<CArrayList<char*> > m_cNames;
+
+    explicit PerfMapPrivate(const CDomain* domain)
+        : m_domain(domain),
+          m_cNames(new CArrayList<char*>())
+    {
+    }
+
+    ~PerfMapPrivate()
+    {
+        m_methodsByCName.SetPtr(nullptr);
+        for(int i = 0; i < m_cNames->Count(); i++) {
+            CString::FreeUtf8(m_cNames->Array()[i]);
+        }
+    }
+
+    void addMethod(CMethod* method)
+    {
+        if(method && !method->IsAbstract()) {
+            char* cName = method->GetCName();
+            if(m_methodsByCName->Contains(cName)) {
+                CString::FreeUtf8(cName);
+            } else {
+                m_cNames->Add(cName);
+                m_methodsByCName->Set(cName, method);
+            }
+        }
+    }
+
+    void buildMethodMap()
+    {
+        m_methodsByCName.SetPtr(new CHashMap<const char*, CMethod*>());
+
+        const CArrayList<CClass*>* klasses = m_domain->Classes();
+        for(int i = 0; i < klasses->Count(); i++) {
+            const CClass* klass = klasses->Array()[i];
+
+            const CArrayList<CMethod*>* methodLists[] = { klass->InstanceCtors(), klass->InstanceMethods(), klass->StaticMethods() };
+            for(int j = 0; j < 3; j++) {
+                for(int k = 0; k < methodLists[j]->Count(); k++) {
+                    CMethod* method = methodLists[j]->Array()[k];
+                    if(method->DeclaringClass() == klass) {
+                        addMethod(method);
+                    }
+                }
+            }
+
+            addMethod(klass->StaticCtor());
+            addMethod(klass->InstanceDtor());
+            addMethod(klass->StaticDtor());
+        }
+    }
+
+    void write(const void* code, unsigned long size, const char* name)
+    {
+        SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+            if(g_perfMapFile) {
+                fprintf(g_perfMapFile, "%lx %lx %s\n", (unsigned long)(size_t)code, size, name);
+                // perf can read the file while the process is still running.
+                fflush(g_perfMapFile);
+            }
+        } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+    }
+};
+
+SPerfMap::SPerfMap()
+    : p(nullptr)
+{
+}
+
+SPerfMap::~SPerfMap()
+{
+    if(!p) {
+        return;
+    }
+
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        if(--g_perfMapRefCount == 0 && g_perfMapFile) {
+            fclose(g_perfMapFile);
+            g_perfMapFile = nullptr;
+        }
+    } SKIZO_END_LOCK_AB_NOEXCEPT(CDomain::g_globalMutex);
+
+    delete p;
+}
+
+void SPerfMap::Enable(const CDomain* domain)
+{
+    SKIZO_REQ_PTR(domain);
+
+#ifdef SKIZO_X
+    if(p) {
+        return;
+    }
+    p = new PerfMapPrivate(domain);
+
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        if(g_perfMapRefCount++ == 0) {
+            char path[64];
+            sprintf(path, "/tmp/perf-%d.map", (int)getpid());
+
+            // Appends, in case a previous run of the host in this process already created the file.
+            g_perfMapFile = fopen(path, "a");
+            if(!g_perfMapFile) {
+                printf("Failed to open '%s' for writing.\n", path);
+            }
+        }
+    } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+#endif
+}
+
+static void perfMapTCCCallback(void* ctx, const char* name, const void* addr, unsigned long size)
+{
+    PerfMapPrivate* p = (PerfMapPrivate*)ctx;
+
+    CMethod* method;
+    if(p->m_methodsByCName->TryGet(name, &method)) {
+        STextBuilder cb;
+        cb.Emit("%C::%s", method->DeclaringClass(), &method->Name());
+        p->write(addr, size, cb.Chars());
+        method->Unref();
+    } else {
+        // Runtime helpers defined in the emitted code and inline C functions.
+        p->write(addr, size, name);
+    }
+}
+
+void SPerfMap::AddTCCState(TCCState* tccState)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ_PTR(tccState);
+
+    if(!p->m_methodsByCName) {
+        p->buildMethodMap();
+    }
+
+    tcc_list_functions(tccState, p, perfMapTCCCallback);
+}
+
+void SPerfMap::AddThunk(const void* code, int size, const char* kind, const CMethod* method)
+{
+    if(!p) {
+        return;
+    }
+
+    STextBuilder cb;
+    if(method) {
+        cb.Emit("[%S] %C::%s", kind, method->DeclaringClass(), &method->Name());
+    } else {
+        cb.Emit("[%S]", kind);
+    }
+    p->write(code, (unsigned long)size, cb.Chars());
+}
+
+} }
@@ -0,0 +1,65 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef PERFMAP_H_INCLUDED
+#define PERFMAP_H_INCLUDED
+
+#include "basedefs.h"
+
+struct TCCState;
+
+namespace skizo { namespace script {
+
+class CDomain;
+class CMethod;
+
+/**
+ * Describes code generated at runtime to Linux perf, which otherwise sees it as unknown addresses: every function
+ * relocated by TCC (the main image and lazy units) and every thunk generated by SThunkManager is appended to
+ * /tmp/perf-<pid>.map as "<start> <size> <name>", the format perf reads for JIT-compiled code.
+ * Methods are named "Class::method", thunks are additionally prefixed with their kind ("[closure thunk]" etc.)
+ * Code compiled with SDomainCreation::NativeCompiler is a regular shared object which perf can symbolize on its own.
+ *
+ * The file is shared by all domains of the process. All methods do nothing unless the map is enabled.
+ * Unix only: does nothing on other platforms.
+ *
+ * See SDomainCreation::PerfMapEnabled
+ * To be embedded into CDomain.
+ */
+struct SPerfMap
+{
+public:
+    SPerfMap();
+    ~SPerfMap();
+
+    void Enable(const CDomain* domain);
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * Adds every function defined in a relocated TCC state.
+     */
+    void AddTCCState(TCCState* tccState);
+
+    /**
+     * Adds a piece of generated code. The kind is a string literal ("closure thunk", "trampoline" etc.)
+     * The method can be null.
+     */
+    void AddThunk(const void* code, int size, const char* kind, const CMethod* method);
+
+private:
+    struct PerfMapPrivate* p;
+};
+
+} }
+
+#endif // PERFMAP_H_INCLUDED
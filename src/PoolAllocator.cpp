@@ -16,7 +16,6 @@
 #include <assert.h>
 
 // TODO allocation requests bigger than N should be allocated from common heap
-// TODO if a pointer points to interior, it will crash when trying to scan as a root
 
 namespace skizo { namespace script {
 using namespace skizo::collections;
@@ -154,6 +153,7 @@ SPoolAllocator::SPoolAllocator()
     : m_pools(new CHashMap<size_t, CPool*>()),
       m_arenas(new CArrayList<void*>()),
       m_objectsToFree(new CArrayList<void*>()),
+      m_largeObjects(new CHashMap<void*, int>()),
       m_objectCount(0),
       m_isEnumerating(false)
 {
@@ -166,9 +166,10 @@ SPoolAllocator::~SPoolAllocator()
         free(arena);
     }
 
-    SPointerSetEnumerator largeObjectEnum (m_largeObjectSet);
+    SHashMapEnumerator<void*, int> largeObjectEnum (m_largeObjects);
     void* largeObject;
-    while(largeObjectEnum.MoveNext(&largeObject)) {
+    int largeObjectSize;
+    while(largeObjectEnum.MoveNext(&largeObject, &largeObjectSize)) {
         free(largeObject);
     }
 }
@@ -204,7 +205,7 @@ void* SPoolAllocator::Allocate(size_t objectSize)
             _soX_abort0(SKIZO_ERRORCODE_OUT_OF_MEMORY);
         }
 
-        m_largeObjectSet.Set(largeObject);
+        m_largeObjects->Set(largeObject, (int)objectSize);
         m_objectCount++;
 
         return largeObject;
@@ -230,9 +231,9 @@ void SPoolAllocator::Free(void* ptr)
         return;
     }
 
-    if(m_largeObjectSet.Contains(ptr)) {
+    if(m_largeObjects->Contains(ptr)) {
         free(ptr);
-        m_largeObjectSet.Remove(ptr);
+        m_largeObjects->Remove(ptr);
     } else {
         SElementHeader* element = GetElementHeader(ptr);
         CPool* pool = element->Pool;
@@ -268,7 +269,46 @@ bool SPoolAllocator::IsValidPointer(void* objectStart) const
     }
 
     // Nothing found => try in the large object set.
-    return m_largeObjectSet.Contains(objectStart);
+    return m_largeObjects->Contains(objectStart);
+}
+
+void* SPoolAllocator::FindObjectStart(void* ptr) const
+{
+    char* bytePtr = reinterpret_cast<char*>(ptr);
+
+    void** arenas = m_arenas->Array();
+    const int count = m_arenas->Count();
+
+    for(int i = 0; i < count; i++) {
+        const SArenaHeader* arena = reinterpret_cast<SArenaHeader*>(arenas[i]);
+
+        if(bytePtr >= arena->Start && bytePtr < arena->End) {
+            // The element the pointer falls into.
+            const size_t offset = ((uintptr_t)bytePtr - (uintptr_t)arena->Start) % arena->ElementSize;
+            SElementHeader* elementHeader = reinterpret_cast<SElementHeader*>(bytePtr - offset);
+            char* objectStart = GetObjectStart(elementHeader);
+
+            // The element should be allocated; a pointer into its header points to no object.
+            if(!elementHeader->Pool || bytePtr < objectStart) {
+                return nullptr;
+            }
+            return objectStart;
+        }
+    }
+
+    // Nothing found => try in the large object set.
+    // NOTE A linear search, but there are normally few large objects.
+    SHashMapEnumerator<void*, int> largeObjectEnum (m_largeObjects);
+    void* largeObject;
+    int largeObjectSize;
+    while(largeObjectEnum.MoveNext(&largeObject, &largeObjectSize)) {
+        char* largeObjectStart = reinterpret_cast<char*>(largeObject);
+        if(bytePtr >= largeObjectStart && bytePtr < largeObjectStart + largeObjectSize) {
+            return largeObject;
+        }
+    }
+
+    return nullptr;
 }
 
 int SPoolAllocator::GetObjectCount() const
@@ -312,9 +352,10 @@ void SPoolAllocator::EnumerateObjects(void(*enumProc)(void* obj, void* ctx), voi
             }
         }
 
-        SPointerSetEnumerator largeObjectEnum (m_largeObjectSet);
+        SHashMapEnumerator<void*, int> largeObjectEnum (m_largeObjects);
         void* largeObject;
-        while(largeObjectEnum.MoveNext(&largeObject)) {
+        int largeObjectSize;
+        while(largeObjectEnum.MoveNext(&largeObject, &largeObjectSize)) {
             enumProc(largeObject, ctx);
         }
 
@@ -16,7 +16,6 @@
 
 #include "ArrayList.h"
 #include "HashMap.h"
-#include "PointerSet.h"
 
 namespace skizo { namespace script {
 
@@ -61,6 +60,12 @@ public:
      */
     bool IsValidPointer(void* ptr) const;
 
+    /**
+     * Same as ::IsValidPointer(..), except that the pointer can point anywhere inside an allocated object.
+     * @return the start of the object; null if the pointer doesn't point inside an allocated object.
+     */
+    void* FindObjectStart(void* ptr) const;
+
     /**
      * Returns the total number of allocated objects. Useful for debugging.
      */
@@ -84,8 +89,8 @@ private:
     // are postponed.
     skizo::core::Auto<skizo::collections::CArrayList<void*>> m_objectsToFree;
 
-    // Large objects are allocated outside of the general heap and stored entirely here.
-    SPointerSet m_largeObjectSet;
+    // Large objects are allocated outside of the general heap and stored entirely here, together with their sizes.
+    skizo::core::Auto<skizo::collections::CHashMap<void*, int>> m_largeObjects;
 
     int m_objectCount;
     bool m_isEnumerating;
@@ -12,9 +12,11 @@
 // *****************************************************************************
 
 #include "Profiling.h"
+#include "ModuleDesc.h"
 #include "TextBuilder.h"
 
-// TODO the overflow problem; see how other frameworks deal with it
+#include <stdio.h>
+#include <string.h>
 
 namespace skizo { namespace script {
 using namespace skizo::core;
@@ -27,32 +29,50 @@ CProfilingInfo::CProfilingInfo(const CDomain* domain)
     m_domain.SetVal(domain);
 }
 
-static int cmpTotalTimeInMs(CMethod* m1, CMethod* m2)
+// Descending order. Values are 64-bit, so they can't be simply subtracted.
+static int cmpDescending(so_long v1, so_long v2)
 {
-    return (int)(m2->TotalTimeInMs() - m1->TotalTimeInMs());
+    return v1 > v2? -1: (v1 < v2? 1: 0);
 }
 
-static int cmpAverageTimeInMs(CMethod* m1, CMethod* m2)
+static so_long averageTimeInNs(const SMethodProfile& profile)
 {
-    const int averageTimeInMs1 = m1->NumberOfCalls()? (m1->TotalTimeInMs() / m1->NumberOfCalls()): 0;
-    const int averageTimeInMs2 = m2->NumberOfCalls()? (m2->TotalTimeInMs() / m2->NumberOfCalls()): 0;
+    return profile.NumberOfCalls? (profile.TotalTimeInNs / profile.NumberOfCalls): 0;
+}
+
+static int cmpTotalTime(CMethod* m1, CMethod* m2)
+{
+    return cmpDescending(m1->Profile().TotalTimeInNs, m2->Profile().TotalTimeInNs);
+}
+
+static int cmpSelfTime(CMethod* m1, CMethod* m2)
+{
+    return cmpDescending(m1->Profile().SelfTimeInNs, m2->Profile().SelfTimeInNs);
+}
 
-    return averageTimeInMs2 - averageTimeInMs1;
+static int cmpAverageTime(CMethod* m1, CMethod* m2)
+{
+    return cmpDescending(averageTimeInNs(m1->Profile()), averageTimeInNs(m2->Profile()));
 }
 
 static int cmpNumberOfCalls(CMethod* m1, CMethod* m2)
 {
-    return (int)(m2->NumberOfCalls() - m1->NumberOfCalls());
+    return cmpDescending(m1->Profile().NumberOfCalls, m2->Profile().NumberOfCalls);
 }
 
-void CProfilingInfo::SortByTotalTimeInMs()
+void CProfilingInfo::SortByTotalTime()
 {
-    m_methods->Sort(cmpTotalTimeInMs);
+    m_methods->Sort(cmpTotalTime);
 }
 
-void CProfilingInfo::SortByAverageTimeInMs()
+void CProfilingInfo::SortBySelfTime()
 {
-    m_methods->Sort(cmpAverageTimeInMs);
+    m_methods->Sort(cmpSelfTime);
+}
+
+void CProfilingInfo::SortByAverageTime()
+{
+    m_methods->Sort(cmpAverageTime);
 }
 
 void CProfilingInfo::SortByNumberOfCalls()
@@ -110,33 +130,39 @@ void CProfilingInfo::_dumpImpl(bool dumpToDisk) const
     cb.Emit("\tStatic methods: %d\n", cntStaticMethods);
     cb.Emit("\tInstance ctors: %d\n", cntInstanceCtors);
     cb.Emit("\tInstance dtors: %d\n", cntInstanceDtors);
+    cb.Emit("Devirtualized call sites: %d\n", m_domain->DevirtualizedCallCount());
+    cb.Emit("Removed as dead code:\n");
+    cb.Emit("\tClasses: %d\n", m_domain->DeadClassCount());
+    cb.Emit("\tStatic methods: %d\n", m_domain->DeadMethodCount());
 
     cb.Emit("\n==============\n"
             "Profiling data\n"
             "==============\n");
 
+    // Times are printed in milliseconds with a microsecond precision.
+    char buf[128];
+
     for(int i = 0; i < m_methods->Count(); i++) {
         const CMethod* method = m_methods->Array()[i];
-
-        const int totalTimeInMs = method->TotalTimeInMs();
-        const int numberOfCalls = method->NumberOfCalls();
-        const int averageTimeInMs = method->NumberOfCalls()? (method->TotalTimeInMs() / method->NumberOfCalls()) : 0;
-        // TODO self time
-
-        const CString* niceClassName0 = method->DeclaringClass()->NiceName();
-
-        // CCodeBuilder we rely on recognizes only string slices.
-        const SStringSlice niceClassName (niceClassName0, 0, niceClassName0->Length());
-
-        cb.Emit("%s::%s | totalTime: %d ms | numberOfCalls: %d | averageTime: %d\n",
-                        &niceClassName,
-                        &method->Name(),
-                        totalTimeInMs,
-                        numberOfCalls,
-                        averageTimeInMs);
+        const SMethodProfile& profile = method->Profile();
+
+        sprintf(buf, "totalTime: %.3f ms | selfTime: %.3f ms | numberOfCalls: %lld | averageTime: %.3f ms",
+                profile.TotalTimeInNs / 1000000.0,
+                profile.SelfTimeInNs / 1000000.0,
+                (long long)profile.NumberOfCalls,
+                averageTimeInNs(profile) / 1000000.0);
+        cb.Emit("%C::%s | %S\n", method->DeclaringClass(), &method->Name(), buf);
+
+        for(const SCallEdge* edge = profile.Callees; edge; edge = edge->Next) {
+            sprintf(buf, "totalTime: %.3f ms | numberOfCalls: %lld",
+                    edge->TotalTimeInNs / 1000000.0,
+                    (long long)edge->NumberOfCalls);
+            cb.Emit("    -> %C::%s | %S\n", edge->Callee->DeclaringClass(), &edge->Callee->Name(), buf);
+        }
     }
 
-    cb.Emit("Total execution time: %d ms.\n", (int)m_totalTime); // TODO casts long to int?
+    sprintf(buf, "%.3f", m_totalTime / 1000000.0);
+    cb.Emit("Total execution time: %S ms.\n", buf);
 
     cb.Emit("\n====================\n"
               "Runtime memory statistics\n"
@@ -167,4 +193,63 @@ void CProfilingInfo::DumpToDisk() const
     _dumpImpl(true);
 }
 
+// Emits "fl=", "fn=" or "cfl=", "cfn=" lines which identify the method.
+static void emitCallgrindMethod(STextBuilder& cb, const CMethod* method, bool isCallee)
+{
+    const char* prefix = isCallee? "c": "";
+
+    if(method->Source().Module) {
+        cb.Emit("%Sfl=%o\n", prefix, (const CObject*)method->Source().Module->FilePath);
+    } else {
+        cb.Emit("%Sfl=???\n", prefix);
+    }
+    cb.Emit("%Sfn=%C::%s\n", prefix, method->DeclaringClass(), &method->Name());
+}
+
+void CProfilingInfo::DumpCallgrindToDisk() const
+{
+    STextBuilder cb;
+    char buf[64];
+
+    cb.Emit("# callgrind format\n"
+            "version: 1\n"
+            "creator: skizo\n"
+            "positions: line\n"
+            "events: ns\n");
+    sprintf(buf, "summary: %lld\n", (long long)m_totalTime);
+    cb.Emit("%S\n", buf);
+
+    for(int i = 0; i < m_methods->Count(); i++) {
+        const CMethod* method = m_methods->Array()[i];
+        const SMethodProfile& profile = method->Profile();
+        const int line = method->Source().LineNumber;
+
+        emitCallgrindMethod(cb, method, false);
+        sprintf(buf, "%d %lld\n", line, (long long)profile.SelfTimeInNs);
+        cb.Emit("%S", buf);
+
+        // Every call edge is followed by its inclusive cost.
+        for(const SCallEdge* edge = profile.Callees; edge; edge = edge->Next) {
+            emitCallgrindMethod(cb, edge->Callee, true);
+            sprintf(buf, "calls=%lld %d\n%d %lld\n",
+                    (long long)edge->NumberOfCalls,
+                    edge->Callee->Source().LineNumber,
+                    line,
+                    (long long)edge->TotalTimeInNs);
+            cb.Emit("%S", buf);
+        }
+
+        cb.Emit("\n");
+    }
+
+    FILE* f = fopen("callgrind.out", "wb");
+    if(!f) {
+        printf("Failed to write the call graph to 'callgrind.out'.\n");
+        return;
+    }
+    const char* cs = cb.Chars();
+    fwrite(cs, strlen(cs), 1, f);
+    fclose(f);
+}
+
 } }
@@ -20,6 +20,9 @@
 namespace skizo { namespace script {
 
 /**
+ * Data collected by the instrumented profiler (see SCallProfiler): for every method, the number of calls,
+ * total (inclusive) and self (exclusive) time, and the methods it called.
+ *
  * @note Native methods, methods defined in primitives (int, bool etc.), inlined methods, methods that were never
  * called are omitted.
  */
@@ -28,8 +31,9 @@ class CProfilingInfo: public skizo::core::CObject
     friend class CDomain;
 
 public:
-    void SortByTotalTimeInMs();
-    void SortByAverageTimeInMs();
+    void SortByTotalTime();
+    void SortBySelfTime();
+    void SortByAverageTime();
     void SortByNumberOfCalls();
 
     /**
@@ -42,10 +46,16 @@ public:
      */
     void DumpToDisk() const;
 
+    /**
+     * Dumps the call graph into file "callgrind.out" in the current directory, in the format of Valgrind's
+     * callgrind tool (to be viewed in KCachegrind, QCachegrind etc.) The cost is measured in nanoseconds.
+     */
+    void DumpCallgrindToDisk() const;
+
 protected: // internal
     skizo::core::Auto<const CDomain> m_domain;
     skizo::core::Auto<skizo::collections::CArrayList<CMethod*> > m_methods;
-    so_long m_totalTime;
+    so_long m_totalTime; // in nanoseconds
     CProfilingInfo(const CDomain* domain);
 
     void _dumpImpl(bool dumpToDisk) const;
@@ -197,14 +197,14 @@ public:
     SDomainCreation DomainCreation;
 
     // NOTE UTF8 strings are used to avoid unsafe thread sharing of CString's.
-    char *Source, *EntryPointClass, *EntryPointMethod;
+    char *Source, *EntryPointClass, *EntryPointMethod, *NativeCompiler;
     Auto<CArrayList<char*>> SearchPaths;
     Auto<CArrayList<char*>> Permissions;
 
     Auto<CDomainHandle> DomainHandle;
 
     CRemoteDomainThread()
-        : Source(nullptr), EntryPointClass(nullptr), EntryPointMethod(nullptr),
+        : Source(nullptr), EntryPointClass(nullptr), EntryPointMethod(nullptr), NativeCompiler(nullptr),
           SearchPaths(new CArrayList<char*>()),
           Permissions(new CArrayList<char*>())
     {
@@ -215,6 +215,7 @@ public:
         CString::FreeUtf8(this->Source);
         CString::FreeUtf8(this->EntryPointClass);
         CString::FreeUtf8(this->EntryPointMethod);
+        CString::FreeUtf8(this->NativeCompiler);
 
         for(int i = 0; i < this->SearchPaths->Count(); i++) {
             CString::FreeUtf8(this->SearchPaths->Array()[i]);
@@ -230,6 +231,7 @@ public:
         this->DomainHandle.SetPtr(new CDomainHandle());
 
         prepareDomainCreationOnCurrentThread(source, sourceKind, permArray);
+        this->SetStackSize(this->DomainCreation.StackSize);
         this->Start();
 
         // The domain handle will be wrapped by a Skizo object. It will hold a strong reference to this object (tied to GC collections).
@@ -277,6 +279,13 @@ private:
         this->DomainCreation.ExplicitNullCheck = pCurDomain->ExplicitNullCheck();
         this->DomainCreation.InlineBranching = pCurDomain->InlineBranching();
         this->DomainCreation.SoftDebuggingEnabled = pCurDomain->SoftDebuggingEnabled();
+        if(pCurDomain->NativeCompiler()) {
+            this->NativeCompiler = pCurDomain->NativeCompiler()->ToUtf8();
+        }
+        this->DomainCreation.TieredCompilation = pCurDomain->TieredCompilation();
+        this->DomainCreation.DeadCodeElimination = pCurDomain->DeadCodeElimination();
+        this->DomainCreation.LazyCompilation = pCurDomain->LazyCompilation();
+        this->DomainCreation.StackSize = pCurDomain->StackSize();
 
         // Inherits the search paths.
         const CArrayList<const CString*>* searchPaths = pCurDomain->SearchPaths();
@@ -300,6 +309,7 @@ private:
         this->DomainCreation.Source = CString::FromUtf8(this->Source);
         this->DomainCreation.EntryPointClass = this->EntryPointClass? CString::FromUtf8(this->EntryPointClass): nullptr;
         this->DomainCreation.EntryPointMethod = this->EntryPointMethod? CString::FromUtf8(this->EntryPointMethod): nullptr;
+        this->DomainCreation.NativeCompiler = this->NativeCompiler;
 
         for(int i = 0; i < this->SearchPaths->Count(); i++) {
             char* searchPath = this->SearchPaths->Array()[i];
@@ -137,6 +137,16 @@ void* SKIZO_API _soX_findmethod(void* objptr, void* _pMethod)
     CMethod* pMethod = (CMethod*)_pMethod;
     CClass* pClass = so_class_of(objptr);
 
+    // Precomputed itables (see CDomain::buildITables()).
+    const int* itable = pClass->ITable();
+    if(itable && pMethod->ITableIndex() != -1) {
+        const int vtableIndex = itable[pMethod->ITableIndex()];
+        if(vtableIndex != -1) {
+            return so_virtmeth_of(objptr, vtableIndex);
+        }
+    }
+
+    // Classes and interfaces created after startup.
     void* methodImpl = pClass->TryGetMethodImplForInterfaceMethod(pMethod);
     if(!methodImpl) {
         CMethod* instanceMethod = nullptr;
@@ -154,6 +164,19 @@ void* SKIZO_API _soX_findmethod(void* objptr, void* _pMethod)
     return methodImpl;
 }
 
+void* SKIZO_API _soX_icfind(void* objptr, void** cache, void* pMethod)
+{
+    SKIZO_NULL_CHECK(objptr);
+
+    void** vtable = ((SObjectHeader*)objptr)->vtable;
+    if(cache[0] != vtable) {
+        cache[1] = _soX_findmethod(objptr, pMethod);
+        cache[0] = vtable;
+    }
+
+    return cache[1];
+}
+
 // ***************
 //      Abort.
 // ***************
@@ -181,6 +204,20 @@ void SKIZO_API _soX_abort_e(void* _errObj)
     }
 }
 
+void SKIZO_API _soX_abort_inl(void* _domain, void* pMethod, int errCode)
+{
+    CDomain* domain = (CDomain*)_domain;
+
+    // The frame dies with the abort: the list of frames is saved and reset by CDomain::Abort(..)
+    SStackFrame frame;
+    frame.Prev = domain->TopFrame();
+    frame.Method = (CMethod*)pMethod;
+    frame.Depth = frame.Prev? frame.Prev->Depth + 1: 0;
+    domain->SetTopFrame(&frame);
+
+    CDomain::Abort(errCode);
+}
+
 // **************
 //   _soX_cctor
 // **************
@@ -216,51 +253,37 @@ void SKIZO_API _soX_checktype(void* pClass)
 //     Frame registration & stackoverflow detection.
 // ****************************************************
 
-#ifdef SKIZO_WIN
-    // TODO x86 only? check for x64
-    // NOTE: The standard stack size on Win32 is 1 MB. We consider a stack bigger than 900k a stack overflow
-    // in order to leave some space for internal functions to run which will abort the domain, print
-    // the stack trace etc.
-    #define SO_DETECT_STACK_OVERFLOW \
-                        if(((char*)domain->MemoryManager().StackBase() - (char*)&_domain) > (900 * 1024)) \
-                            _soX_abort0(SKIZO_ERRORCODE_STACK_OVERFLOW);
-#else
-    // The stack size of Linux is conservatively 1 MB as well.
-    #define SO_DETECT_STACK_OVERFLOW \
-                        if(((char*)domain->MemoryManager().StackBase() - (char*)&_domain) > (900 * 1024)) \
-                            _soX_abort0(SKIZO_ERRORCODE_STACK_OVERFLOW);
-#endif
-
-void SKIZO_API _soX_pushframe(void* _domain, void* pMethod)
+// NOTE Without profiling, the emitted code links frames and checks for stack overflows inline
+// (see SEmitter and SStackFrame). The stack limit is null if the guard page is relied on instead.
+
+void SKIZO_API _soX_pushframe_prf(void* _domain, void* _frame, void* _pMethod)
 {
     CDomain* domain = (CDomain*)_domain;
-    SO_DETECT_STACK_OVERFLOW
-    domain->PushFrame((CMethod*)pMethod);
-}
+    SStackFrame* frame = (SStackFrame*)_frame;
+    if(domain->StackLimit() && (void*)frame < domain->StackLimit()) {
+        _soX_abort0(SKIZO_ERRORCODE_STACK_OVERFLOW);
+    }
 
-void SKIZO_API _soX_popframe(void* domain)
-{
-    ((CDomain*)domain)->PopFrame();
+    SStackFrame* prev = domain->TopFrame();
+    frame->Prev = prev;
+    frame->Method = (CMethod*)_pMethod;
+    frame->Depth = prev? prev->Depth + 1: 0;
+
+    domain->CallProfiler().Enter(frame->Method, frame->Depth);
+    domain->SetTopFrame(frame);
 }
 
-int SKIZO_API _soX_pushframe_prf(void* _domain, void* _pMethod)
+void SKIZO_API _soX_popframe_prf(void* _domain, void* _frame)
 {
     CDomain* domain = (CDomain*)_domain;
-    SO_DETECT_STACK_OVERFLOW
-
-    CMethod* pMethod = (CMethod*)_pMethod;
-    pMethod->AddNumberOfCalls(1);
-    domain->PushFrame(pMethod);
-    return (int)Application::TickCount(); // TODO outside of Win32 tickCount can be >int32
+    SStackFrame* frame = (SStackFrame*)_frame;
+    domain->SetTopFrame(frame->Prev);
+    domain->CallProfiler().Leave(frame->Depth);
 }
 
-void SKIZO_API _soX_popframe_prf(void* domain, int tc)
+void SKIZO_API _soX_tierup(void* domain, void* pMethod)
 {
-    CMethod* pMethod = ((CDomain*)domain)->PopFrame();
-
-    // TODO int<=>long cast Win32 only?
-    int delta = (int)Application::TickCount() - tc;
-    pMethod->AddTotalTimeInMs(delta);
+    ((CDomain*)domain)->TierUp((CMethod*)pMethod);
 }
 
 // ***********************
@@ -312,10 +335,25 @@ int SKIZO_API _so_int_op_divide(int a, int b)
     if(!b) {
         CDomain::Abort("Division by zero.");
     }
+    if(b == -1) {
+        return (int)(0u - (so_uint32)a);
+    }
 
     return a / b;
 }
 
+int SKIZO_API _so_int_op_modulo(int a, int b)
+{
+    if(!b) {
+        CDomain::Abort("Division by zero.");
+    }
+    if(b == -1) {
+        return 0;
+    }
+
+    return a % b;
+}
+
 // *******************
 //   Soft debugging.
 // *******************
@@ -359,6 +397,19 @@ CWatchIterator::~CWatchIterator()
 // IMPORTANT the order of variables should be synchronized with the emitter
 bool CWatchIterator::NextWatch(SKIZO_WATCHINFO* watchInfo)
 {
+    // Static methods have no "this": starts with the first parameter, so that methods without locals are handled too.
+    if(this->CurIndex == -1 && pMethod->Signature().IsStatic) {
+        this->CurIndex = 0;
+    }
+
+    // Captured locals are not watched yet (see the emitter).
+    while(this->CurIndex >= 0
+       && this->CurIndex < this->Size
+       && !this->LocalRefs[pMethod->Signature().IsStatic? this->CurIndex: this->CurIndex + 1])
+    {
+        this->CurIndex++;
+    }
+
     if(this->CurIndex >= this->Size) {
         return false;
     }
@@ -400,25 +451,27 @@ bool CWatchIterator::NextWatch(SKIZO_WATCHINFO* watchInfo)
 
 SVirtualUnwinder::SVirtualUnwinder(CDomain* domain)
     : m_domain(domain),
-      m_stackFrameCnt(-1),
+      m_topFrame(nullptr),
+      m_isRemembered(false),
       m_debugDataStackCnt(-1)
 {
 }
 
 void SVirtualUnwinder::Remember()
 {
-    m_stackFrameCnt = m_domain->m_stackFrames->Count();
+    m_topFrame = m_domain->m_topFrame;
+    m_isRemembered = true;
     m_debugDataStackCnt = m_domain->m_debugDataStack->Count();
 }
 
 void SVirtualUnwinder::Unwind()
 {
     // forgot to call ::Remember()
-    SKIZO_REQ(m_stackFrameCnt != -1 && m_debugDataStackCnt != -1, EC_INVALID_STATE);
+    SKIZO_REQ(m_isRemembered && m_debugDataStackCnt != -1, EC_INVALID_STATE);
 
-    while(m_domain->m_stackFrames->Count() > m_stackFrameCnt) {
-        m_domain->m_stackFrames->Pop();
-    }
+    // The frames above the remembered one are dead by now: simply relinks the list.
+    m_domain->m_topFrame = m_topFrame;
+    m_domain->m_abortFrames->Clear();
     while(m_domain->m_debugDataStack->Count() > m_debugDataStackCnt) {
         m_domain->m_debugDataStack->Pop();
     }
@@ -47,6 +47,7 @@ public:
 
 class CDomain;
 struct SMemoryManager;
+struct SStackFrame;
 
 /**
  * Internal.
@@ -63,7 +64,8 @@ public:
 
 private:
     CDomain* m_domain;
-    int m_stackFrameCnt;
+    SStackFrame* m_topFrame;
+    bool m_isRemembered;
     int m_debugDataStackCnt;
 };
 
@@ -84,6 +86,19 @@ void* SKIZO_API _soX_gc_alloc(SMemoryManager* mm, int sz, void** vtable);
  */
 void* _soX_gc_alloc_env(SMemoryManager* mm, void* objClass);
 
+/**
+ * Initializes a closure environment allocated on the C stack by a method whose closures never escape (see
+ * E_METHODFLAGS_IS_ENV_ON_STACK): zeroes it out and sets the vtable. Such environments are never seen by the GC as
+ * objects, the references they hold are found by the conservative scan of the stack.
+ */
+void* _soX_stackenv(void* env, int sz, void* objClass);
+
+/**
+ * Initializes a closure object allocated on the C stack (see CBodyExpression::IsStackAllocated). The vtable is
+ * generated on demand, just like in the closure constructor.
+ */
+void* SKIZO_API _soX_stackclosure(void* obj, void* objClass, void* env);
+
 /**
  * This function is to be used by the emitted machine code. Registers root sets which are
  * usually static variables. This function accepts a list of references to static variables
@@ -135,6 +150,13 @@ void SKIZO_API _soX_unbox(void* vt, int vtSize, void* vtClass, void* intrfcObj);
  */
 void* SKIZO_API _soX_findmethod(void* objptr, void* pMethod);
 
+/**
+ * Same as _soX_findmethod(..), except the result is remembered in a monomorphic inline cache of the call site
+ * (see CDomain::NewInlineCache()), so that the next call with an object of the same class finds it right away.
+ * The emitted code checks the cache inline and calls this function on a miss.
+ */
+void* SKIZO_API _soX_icfind(void* objptr, void** cache, void* pMethod);
+
 /**
  * Another dynamic dispatcher, except it relies on data provided in 'msg' (typed to CDomainMessage*)
  * Used in server stubs for cross-domain method calls.
@@ -180,6 +202,13 @@ void SKIZO_API _soX_unreglocals();
  */
 void SKIZO_API _soX_break();
 
+/**
+ * If patchable breakpoints are enabled, the cold block of a patch point calls this function once the debugger
+ * sets a breakpoint there (see SBreakpointPatcher). "localRefs" are laid out as for _soX_reglocals.
+ * Implemented in Debugging.cpp
+ */
+void SKIZO_API _soX_breakat(CDomain* domain, int patchPointId, void** localRefs, int size);
+
 // WARNING resolveArrayClass,
 //         _resolveNullableStruct
 //         resolveFailableStruct
@@ -210,6 +239,12 @@ void SKIZO_API _soX_abort(void* msg);
  */
 void SKIZO_API _soX_abort_e(void* errObj);
 
+/**
+ * Failures of methods inlined into their callers (see STransformer::canInlineCall(..)): links the frame which
+ * the inlined method would have had, so that the stack trace shows the method, then aborts.
+ */
+void SKIZO_API _soX_abort_inl(void* domain, void* pMethod, int errCode);
+
 /**
  * A special invoker of 2-stage static constructor code (equivalent to v(1)).
  * Sets the class as uninitialized on abort.
@@ -229,30 +264,24 @@ void SKIZO_API _soX_checktype(void* pClass);
 void* SKIZO_API _soX_newarray(void* domain, int arrayLength, void** vtable);
 
 /**
- * If SDomainCreation::StackTraceInfo is set true, the emitter emits this code at the beginning
- * of every method.
+ * If SDomainCreation::ProfilingEnabled is set true, the emitter emits this code at the beginning of every method,
+ * instead of linking the frame inline (see SStackFrame). Also profiles the method (see SCallProfiler).
+ * @param frame the SStackFrame local of the method
  */
-void SKIZO_API _soX_pushframe(void* domain, void* pMethod);
+void SKIZO_API _soX_pushframe_prf(void* domain, void* frame, void* pMethod);
 
 /**
- * If SDomainCreation::StackTraceInfo is set true, the emitter emits this code at the end of
- * every method.
+ * If SDomainCreation::ProfilingEnabled is set true, the emitter emits this code at the end of every method.
  *
- * @see _soX_pushframe
+ * @see _soX_pushframe_prf
  */
-void SKIZO_API _soX_popframe(void* domain);
+void SKIZO_API _soX_popframe_prf(void* domain, void* frame);
 
 /**
- * Same as _soX_pushframe(..), except also profiles the method.
- * @note returns the tick count to be used by _soX_popframe_prf(..)
+ * If SDomainCreation::TieredCompilation is set true, TCC-compiled code calls this function once a method's
+ * call counter exceeds SKIZO_TIERUP_THRESHOLD. See CDomain::TierUp(..)
  */
-int SKIZO_API _soX_pushframe_prf(void* domain, void* pMethod);
-
-/**
- * Same as _soX_popframe(..), except also profiles the method.
- * @note Accepts the tick count returned by the previous _soX_pushframe_prf(..).
- */
-void SKIZO_API _soX_popframe_prf(void* domain, int tc);
+void SKIZO_API _soX_tierup(void* domain, void* pMethod);
 
 /**
  * Adds a new handler to an event.
@@ -263,9 +292,16 @@ void SKIZO_API _soX_addhandler(void* event, void* handler);
  * Checks at runtime if "b" is zero -- and aborts in that case.
  * Avoids crashing the whole process (with all the domains inside) due to divide by zero
  * (OS-specific handlers are hard to deal with).
+ * The only other case which faults on x86, the minimal integer divided by -1, wraps around to itself, the same way
+ * addition and multiplication wrap around on overflow.
  */
 int SKIZO_API _so_int_op_divide(int a, int b);
 
+/**
+ * Same as _so_int_op_divide(..), but for "int::op_modulo".
+ */
+int SKIZO_API _so_int_op_modulo(int a, int b);
+
 // *************
 //   Remoting.
 // *************
@@ -0,0 +1,427 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "SamplingProfiler.h"
+#include "ArrayList.h"
+#include "Class.h"
+#include "Contract.h"
+#include "Domain.h"
+#include "HashMap.h"
+#include "Method.h"
+#include "String.h"
+#include "TextBuilder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SKIZO_X
+    #include <signal.h>
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+
+    // Older glibc doesn't expose the field under its documented name.
+    #ifndef sigev_notify_thread_id
+        #define sigev_notify_thread_id _sigev_un._tid
+    #endif
+#endif
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// In words: several minutes of sampling fairly deep stacks at 1000 Hz. Samples which don't fit are dropped.
+#define SKIZO_SAMPLINGPROFILER_BUFFER_SIZE (4 * 1024 * 1024)
+
+// Deeper stacks are truncated to their innermost frames.
+#define SKIZO_SAMPLINGPROFILER_MAX_DEPTH 256
+
+#define SKIZO_SAMPLINGPROFILER_MAX_FREQUENCY 10000
+
+// The number of methods listed in each section of the report.
+#define SKIZO_SAMPLINGPROFILER_TOP_COUNT 40
+
+struct SamplingProfilerPrivate
+{
+    SStackFrame* const* m_topFrame;
+    int m_frequency;
+
+    // Every sample is stored as its depth followed by its frames (CMethod*), the innermost frame last.
+    void** m_buffer;
+    volatile int m_bufferPos;
+
+    volatile int m_sampleCount;
+    volatile int m_droppedCount;
+    volatile bool m_isRunning;
+
+#ifdef SKIZO_X
+    timer_t m_timer;
+#endif
+
+    SamplingProfilerPrivate(SStackFrame* const* topFrame, int frequency)
+        : m_topFrame(topFrame),
+          m_frequency(frequency),
+          m_buffer(new void*[SKIZO_SAMPLINGPROFILER_BUFFER_SIZE]),
+          m_bufferPos(0),
+          m_sampleCount(0),
+          m_droppedCount(0),
+          m_isRunning(false)
+    {
+    }
+
+    ~SamplingProfilerPrivate()
+    {
+        delete [] m_buffer;
+    }
+
+    // Called from the signal handler, so it must neither allocate nor lock anything.
+    void takeSample()
+    {
+        // The emitted code initializes a frame before linking it, so the list is consistent at any point the
+        // thread can be interrupted at.
+        const SStackFrame* const topFrame = *m_topFrame;
+
+        int count = 0;
+        for(const SStackFrame* frame = topFrame; frame && count < SKIZO_SAMPLINGPROFILER_MAX_DEPTH; frame = frame->Prev) {
+            count++;
+        }
+
+        if(m_bufferPos + count + 1 > SKIZO_SAMPLINGPROFILER_BUFFER_SIZE) {
+            m_droppedCount++;
+            return;
+        }
+
+        void** sample = m_buffer + m_bufferPos;
+        sample[0] = (void*)(size_t)count;
+        const SStackFrame* frame = topFrame;
+        for(int i = count; i > 0; i--) {
+            sample[i] = (void*)frame->Method;
+            frame = frame->Prev;
+        }
+
+        m_bufferPos += count + 1;
+        m_sampleCount++;
+    }
+};
+
+#ifdef SKIZO_X
+static void sigprofHandler(int sig, siginfo_t* info, void* context)
+{
+    if(info->si_code != SI_TIMER) {
+        return;
+    }
+
+    SamplingProfilerPrivate* prof = (SamplingProfilerPrivate*)info->si_value.sival_ptr;
+    if(prof && prof->m_isRunning) {
+        prof->takeSample();
+    }
+}
+#endif
+
+SSamplingProfiler::SSamplingProfiler()
+    : p(nullptr)
+{
+}
+
+SSamplingProfiler::~SSamplingProfiler()
+{
+    Stop();
+    delete p;
+}
+
+void SSamplingProfiler::Start(int frequency, SStackFrame* const* topFrame)
+{
+    SKIZO_REQ_PTR(topFrame);
+
+    if(p || frequency <= 0) {
+        return;
+    }
+    if(frequency > SKIZO_SAMPLINGPROFILER_MAX_FREQUENCY) {
+        frequency = SKIZO_SAMPLINGPROFILER_MAX_FREQUENCY;
+    }
+
+#ifdef SKIZO_X
+    // The handler is shared by all domains: every timer passes its own profiler as the signal's value.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigprofHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, nullptr) != 0) {
+        printf("Failed to start the sampling profiler.\n");
+        return;
+    }
+
+    p = new SamplingProfilerPrivate(topFrame, frequency);
+
+    // CPU time of the current thread only: time spent sleeping or waiting isn't sampled, and the signal is
+    // always delivered to the thread which owns the frame stack.
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_value.sival_ptr = p;
+    event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &p->m_timer) != 0) {
+        printf("Failed to start the sampling profiler.\n");
+        delete p;
+        p = nullptr;
+        return;
+    }
+
+    const long intervalInNs = 1000000000L / frequency;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = intervalInNs / 1000000000L;
+    spec.it_interval.tv_nsec = intervalInNs % 1000000000L;
+    spec.it_value = spec.it_interval;
+
+    p->m_isRunning = true;
+    timer_settime(p->m_timer, 0, &spec, nullptr);
+#endif
+}
+
+void SSamplingProfiler::Stop()
+{
+    if(!p || !p->m_isRunning) {
+        return;
+    }
+
+    p->m_isRunning = false;
+#ifdef SKIZO_X
+    timer_delete(p->m_timer);
+#endif
+}
+
+// ***************
+//   Aggregation.
+// ***************
+
+struct SMethodSamples
+{
+    const CMethod* Method;
+    char* Name; // computed on demand
+    int SelfCount;
+    int TotalCount;
+    int LastSampleIndex; // recursive methods are counted once per sample
+
+    explicit SMethodSamples(const CMethod* method)
+        : Method(method), Name(nullptr), SelfCount(0), TotalCount(0), LastSampleIndex(-1)
+    {
+    }
+
+    ~SMethodSamples()
+    {
+        if(Name) {
+            CString::FreeUtf8(Name);
+        }
+    }
+
+    const char* GetName()
+    {
+        if(!Name) {
+            STextBuilder cb;
+            cb.Emit("%C::%s", Method->DeclaringClass(), &Method->Name());
+            Name = CString::CloneUtf8(cb.Chars());
+
+            // Spaces and semicolons are separators in the folded format.
+            for(char* c = Name; *c; c++) {
+                if(*c == ' ' || *c == ';') {
+                    *c = '_';
+                }
+            }
+        }
+
+        return Name;
+    }
+};
+
+static void addMethod(CMethod* method,
+                      CHashMap<void*, SMethodSamples*>* map,
+                      CArrayList<SMethodSamples*>* list)
+{
+    if(method && !map->Contains((void*)method)) {
+        SMethodSamples* methodSamples = new SMethodSamples(method);
+        map->Set((void*)method, methodSamples);
+        list->Add(methodSamples);
+    }
+}
+
+// Frames are read asynchronously: a sample taken while the frame stack was being reallocated may contain garbage,
+// so only pointers to methods known to the domain are trusted.
+static void addMethods(const CDomain* domain,
+                       CHashMap<void*, SMethodSamples*>* map,
+                       CArrayList<SMethodSamples*>* list)
+{
+    const CArrayList<CClass*>* klasses = domain->Classes();
+
+    for(int i = 0; i < klasses->Count(); i++) {
+        const CClass* klass = klasses->Array()[i];
+
+        const CArrayList<CMethod*>* methodLists[] = { klass->InstanceCtors(), klass->InstanceMethods(), klass->StaticMethods() };
+        for(int j = 0; j < 3; j++) {
+            for(int k = 0; k < methodLists[j]->Count(); k++) {
+                addMethod(methodLists[j]->Array()[k], map, list);
+            }
+        }
+
+        addMethod(klass->StaticCtor(), map, list);
+        addMethod(klass->InstanceDtor(), map, list);
+        addMethod(klass->StaticDtor(), map, list);
+    }
+}
+
+static int cmpSelfCount(SMethodSamples* ms1, SMethodSamples* ms2)
+{
+    return ms2->SelfCount - ms1->SelfCount;
+}
+
+static int cmpTotalCount(SMethodSamples* ms1, SMethodSamples* ms2)
+{
+    return ms2->TotalCount - ms1->TotalCount;
+}
+
+static void dumpTopMethods(FILE* f, CArrayList<SMethodSamples*>* list, bool isSelf, int sampleCount)
+{
+    fprintf(f, "\n%s\n\n", isSelf? "Self (top of the stack):": "Total (anywhere in the stack):");
+
+    const int count = list->Count() < SKIZO_SAMPLINGPROFILER_TOP_COUNT? list->Count(): SKIZO_SAMPLINGPROFILER_TOP_COUNT;
+    for(int i = 0; i < count; i++) {
+        SMethodSamples* methodSamples = list->Array()[i];
+
+        const int methodCount = isSelf? methodSamples->SelfCount: methodSamples->TotalCount;
+        if(methodCount == 0) {
+            break;
+        }
+
+        fprintf(f, "%10d %6.2f%%  %s\n",
+                methodCount,
+                sampleCount? (100.0 * methodCount / sampleCount): 0.0,
+                methodSamples->GetName());
+    }
+}
+
+void SSamplingProfiler::DumpToDisk(const CDomain* domain) const
+{
+    SKIZO_REQ_PTR(domain);
+
+    if(!p) {
+        return;
+    }
+
+    Auto<CHashMap<void*, SMethodSamples*> > methodMap (new CHashMap<void*, SMethodSamples*>());
+    Auto<CArrayList<SMethodSamples*> > methodList (new CArrayList<SMethodSamples*>());
+    addMethods(domain, methodMap, methodList);
+
+    // Distinct stacks in the order of their first appearance. The keys are owned by stackList.
+    Auto<CHashMap<const char*, int> > stackMap (new CHashMap<const char*, int>());
+    Auto<CArrayList<char*> > stackList (new CArrayList<char*>());
+
+    STextBuilder cb;
+    int sampleCount = 0, discardedCount = 0;
+    SMethodSamples* frames[SKIZO_SAMPLINGPROFILER_MAX_DEPTH];
+
+    for(int pos = 0, sampleIndex = 0; pos < p->m_bufferPos; sampleIndex++) {
+        const int depth = (int)(size_t)p->m_buffer[pos];
+        void** rawFrames = p->m_buffer + pos + 1;
+        pos += depth + 1;
+
+        bool isValid = true;
+        for(int i = 0; i < depth; i++) {
+            if(!methodMap->TryGet(rawFrames[i], &frames[i])) {
+                isValid = false;
+                break;
+            }
+        }
+        if(!isValid) {
+            discardedCount++;
+            continue;
+        }
+        sampleCount++;
+
+        cb.Clear();
+        if(depth == 0) {
+            // Outside of any method which registers frames (for example, the runtime itself).
+            cb.Emit("[unknown]");
+        } else {
+            for(int i = 0; i < depth; i++) {
+                SMethodSamples* methodSamples = frames[i];
+
+                if(i) {
+                    cb.Emit(";");
+                }
+                cb.Emit("%S", methodSamples->GetName());
+
+                if(methodSamples->LastSampleIndex != sampleIndex) {
+                    methodSamples->LastSampleIndex = sampleIndex;
+                    methodSamples->TotalCount++;
+                }
+            }
+
+            frames[depth - 1]->SelfCount++;
+        }
+
+        int stackCount;
+        if(stackMap->TryGet(cb.Chars(), &stackCount)) {
+            stackMap->Set(cb.Chars(), stackCount + 1);
+        } else {
+            char* key = CString::CloneUtf8(cb.Chars());
+            stackList->Add(key);
+            stackMap->Set(key, 1);
+        }
+    }
+
+    // *****************
+    //   Folded stacks.
+    // *****************
+
+    FILE* f = fopen("profile.folded", "w");
+    if(f) {
+        for(int i = 0; i < stackList->Count(); i++) {
+            const char* key = stackList->Array()[i];
+            fprintf(f, "%s %d\n", key, stackMap->Get(key));
+        }
+        fclose(f);
+    } else {
+        printf("Failed to write the sampled stacks to 'profile.folded'.\n");
+    }
+
+    // **********
+    //   Report.
+    // **********
+
+    f = fopen("profile_samples.txt", "w");
+    if(f) {
+        fprintf(f, "Samples: %d (%d per second of CPU time)\n", sampleCount, p->m_frequency);
+        fprintf(f, "Dropped (the buffer was full): %d\n", (int)p->m_droppedCount);
+        fprintf(f, "Discarded (torn frame stack): %d\n", discardedCount);
+
+        methodList->Sort(cmpSelfCount);
+        dumpTopMethods(f, methodList, true, sampleCount);
+        methodList->Sort(cmpTotalCount);
+        dumpTopMethods(f, methodList, false, sampleCount);
+
+        fclose(f);
+    } else {
+        printf("Failed to write the sampling report to 'profile_samples.txt'.\n");
+    }
+
+    for(int i = 0; i < stackList->Count(); i++) {
+        CString::FreeUtf8(stackList->Array()[i]);
+    }
+    for(int i = 0; i < methodList->Count(); i++) {
+        delete methodList->Array()[i];
+    }
+}
+
+} }
@@ -0,0 +1,72 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef SAMPLINGPROFILER_H_INCLUDED
+#define SAMPLINGPROFILER_H_INCLUDED
+
+
+namespace skizo { namespace script {
+
+class CDomain;
+struct SStackFrame;
+
+/**
+ * A statistical profiler: a per-thread CPU timer interrupts the domain's thread at the given frequency, and the
+ * signal handler copies the domain's shadow stack (the list of SStackFrame maintained by the emitted code for stack
+ * traces) into a preallocated buffer. Nothing else is done while the program runs, so unlike /profile, method
+ * calls are not slowed down and time is attributed with sub-millisecond precision, statistically.
+ * Inlined methods are attributed to their callers.
+ *
+ * The samples are aggregated only when dumped: as folded stacks ("profile.folded", one line per distinct stack,
+ * root first, followed by the number of samples; the input format of flamegraph.pl and speedscope) and as a
+ * report of the methods with the most self (on top of the stack) and total (anywhere in the stack) samples
+ * ("profile_samples.txt").
+ *
+ * Unix only: does nothing on other platforms.
+ *
+ * See SDomainCreation::SamplingFrequency
+ * To be embedded into CDomain.
+ */
+struct SSamplingProfiler
+{
+public:
+    SSamplingProfiler();
+    ~SSamplingProfiler();
+
+    /**
+     * Starts sampling the shadow stack of the current thread every 1/frequency seconds of its CPU time.
+     * Does nothing if the frequency is zero or the profiler was already started.
+     * @param topFrame the address of the domain's innermost frame (see CDomain::TopFrameAddress())
+     */
+    void Start(int frequency, SStackFrame* const* topFrame);
+
+    /**
+     * Stops sampling. Samples taken so far are retained.
+     */
+    void Stop();
+
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * Writes the folded stacks and the report into the current directory. To be called after ::Stop()
+     * Prints an error to the console if the files can't be written.
+     */
+    void DumpToDisk(const CDomain* domain) const;
+
+private:
+    struct SamplingProfilerPrivate* p;
+};
+
+} }
+
+#endif // SAMPLINGPROFILER_H_INCLUDED
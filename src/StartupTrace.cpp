@@ -0,0 +1,222 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "StartupTrace.h"
+#include "Application.h"
+#include "Contract.h"
+#include "String.h"
+#include "TextBuilder.h"
+
+#include <stdio.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+
+// Phases are hardly ever nested deeper than this (startup => transform => pass).
+#define SKIZO_STARTUPTRACE_MAX_DEPTH 8
+
+struct SStartupTraceEvent
+{
+    const char* Category;
+    const char* Name;
+    so_long StartTime;
+    STextBuilder Args;
+
+    SStartupTraceEvent()
+        : Category(nullptr),
+          Name(nullptr),
+          StartTime(0),
+          Args(256)
+    {
+    }
+};
+
+struct StartupTracePrivate
+{
+    char* m_path;
+
+    // Timestamps are relative to the moment tracing was enabled.
+    so_long m_baseTime;
+
+    // Completed events, already serialized.
+    STextBuilder m_events;
+    bool m_isFirstEvent;
+
+    SStartupTraceEvent m_stack[SKIZO_STARTUPTRACE_MAX_DEPTH];
+    int m_depth;
+
+    StartupTracePrivate(const char* path)
+        : m_path(CString::CloneUtf8(path)),
+          m_baseTime(Application::MicroTickCount()),
+          m_isFirstEvent(true),
+          m_depth(0)
+    {
+    }
+
+    ~StartupTracePrivate()
+    {
+        CString::FreeUtf8(m_path);
+    }
+
+    void beginEvent()
+    {
+        if(m_isFirstEvent) {
+            m_isFirstEvent = false;
+        } else {
+            m_events.Emit(",\n");
+        }
+    }
+};
+
+// Escapes quotes, backslashes and control characters (Windows paths, for example).
+static void emitJsonString(STextBuilder& cb, const char* str)
+{
+    char buf[8];
+
+    cb.Emit("\"");
+    for(const char* c = str; *c; c++) {
+        if(*c == '"' || *c == '\\') {
+            buf[0] = '\\';
+            buf[1] = *c;
+            buf[2] = 0;
+        } else if((unsigned char)*c < 0x20) {
+            sprintf(buf, "\\u%04x", (int)(unsigned char)*c);
+        } else {
+            buf[0] = *c;
+            buf[1] = 0;
+        }
+        cb.Emit("%S", buf);
+    }
+    cb.Emit("\"");
+}
+
+SStartupTrace::SStartupTrace()
+    : p(nullptr)
+{
+}
+
+SStartupTrace::~SStartupTrace()
+{
+    delete p;
+}
+
+void SStartupTrace::Enable(const char* path)
+{
+    SKIZO_REQ_PTR(path);
+
+    if(!p) {
+        p = new StartupTracePrivate(path);
+    }
+}
+
+void SStartupTrace::Begin(const char* category, const char* name)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ(p->m_depth < SKIZO_STARTUPTRACE_MAX_DEPTH, EC_INVALID_STATE);
+
+    SStartupTraceEvent& event = p->m_stack[p->m_depth++];
+    event.Category = category;
+    event.Name = name;
+    event.Args.Clear();
+    event.StartTime = Application::MicroTickCount();
+}
+
+void SStartupTrace::AddArg(const char* key, so_long value)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ(p->m_depth > 0, EC_INVALID_STATE);
+
+    SStartupTraceEvent& event = p->m_stack[p->m_depth - 1];
+    event.Args.Emit(", ");
+    emitJsonString(event.Args, key);
+
+    char buf[32];
+    sprintf(buf, ": %lld", (long long)value);
+    event.Args.Emit("%S", buf);
+}
+
+void SStartupTrace::AddArg(const char* key, const CString* value)
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ(p->m_depth > 0, EC_INVALID_STATE);
+
+    SStartupTraceEvent& event = p->m_stack[p->m_depth - 1];
+    event.Args.Emit(", ");
+    emitJsonString(event.Args, key);
+    event.Args.Emit(": ");
+
+    if(value) {
+        Utf8Auto cValue (value->ToUtf8());
+        emitJsonString(event.Args, cValue);
+    } else {
+        event.Args.Emit("null");
+    }
+}
+
+void SStartupTrace::End()
+{
+    if(!p) {
+        return;
+    }
+    SKIZO_REQ(p->m_depth > 0, EC_INVALID_STATE);
+
+    const so_long endTime = Application::MicroTickCount();
+    SStartupTraceEvent& event = p->m_stack[--p->m_depth];
+
+    char buf[256];
+
+    // A "complete" event: the phase with its duration.
+    p->beginEvent();
+    p->m_events.Emit("{\"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"cat\": ");
+    emitJsonString(p->m_events, event.Category);
+    p->m_events.Emit(", \"name\": ");
+    emitJsonString(p->m_events, event.Name);
+    sprintf(buf, ", \"ts\": %lld, \"dur\": %lld",
+            (long long)(event.StartTime - p->m_baseTime),
+            (long long)(endTime - event.StartTime));
+    p->m_events.Emit("%S, \"args\": {\"depth\": %d", buf, p->m_depth);
+    p->m_events.Append(event.Args);
+    p->m_events.Emit("}}");
+
+    // A counter event: memory usage after the phase.
+    p->beginEvent();
+    sprintf(buf, "{\"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"name\": \"memory\", \"ts\": %lld, \"args\": {\"bytes\": %lld}}",
+            (long long)(endTime - p->m_baseTime),
+            (long long)Application::GetMemoryUsage());
+    p->m_events.Emit("%S", buf);
+}
+
+void SStartupTrace::Save()
+{
+    if(!p) {
+        return;
+    }
+
+    FILE* f = fopen(p->m_path, "w");
+    if(!f) {
+        printf("Failed to write the startup trace to '%s'.\n", p->m_path);
+        return;
+    }
+
+    const char* events = p->m_events.Chars();
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n%s\n]}\n", events);
+    fclose(f);
+}
+
+} }
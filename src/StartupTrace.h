@@ -0,0 +1,74 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#ifndef STARTUPTRACE_H_INCLUDED
+#define STARTUPTRACE_H_INCLUDED
+
+#include "basedefs.h"
+
+namespace skizo { namespace core {
+    class CString;
+} }
+
+namespace skizo { namespace script {
+
+/**
+ * Records how much time each phase of the domain's startup takes (reading/tokenizing/parsing every module,
+ * transformation passes, emission, compilation, relocation, static constructors etc.) and saves it as a
+ * Chrome trace event file, which can be viewed in chrome://tracing or Perfetto.
+ * Timestamps are in microseconds. Every event can have arguments (counts of tokens, expressions, classes etc.);
+ * process memory usage is recorded as a counter every time an event ends.
+ *
+ * Phases can be nested. All methods do nothing unless the trace is enabled.
+ *
+ * See SDomainCreation::StartupTracePath
+ * To be embedded into CDomain.
+ */
+struct SStartupTrace
+{
+public:
+    SStartupTrace();
+    ~SStartupTrace();
+
+    void Enable(const char* path);
+    bool IsEnabled() const { return p != nullptr; }
+
+    /**
+     * Starts a new phase. The name and the category must be string literals.
+     */
+    void Begin(const char* category, const char* name);
+
+    /**
+     * Adds an argument to the innermost phase which is not ended yet.
+     */
+    void AddArg(const char* key, so_long value);
+    void AddArg(const char* key, const skizo::core::CString* value);
+
+    /**
+     * Ends the innermost phase.
+     */
+    void End();
+
+    /**
+     * Writes everything recorded to the file specified in ::Enable(..) To be called once, after the startup is over.
+     * Prints an error to the console if the file can't be written.
+     */
+    void Save();
+
+private:
+    struct StartupTracePrivate* p;
+};
+
+} }
+
+#endif // STARTUPTRACE_H_INCLUDED
@@ -122,6 +122,15 @@ public:
      */
     void SetPriority(int priority);
 
+    /**
+     * Sets the size of the thread's stack, in bytes. 0 means the platform's default.
+     * The size may be rounded up by the underlying platform.
+     *
+     * @throw EC_ILLEGAL_ARGUMENT if size is negative.
+     * @throw EC_INVALID_STATE if the thread is already running
+     */
+    void SetStackSize(int size);
+
     /**
      * Sets the name of the thread. For debugging.
      */
@@ -246,6 +246,8 @@ void* SThunkManager::GetClosureThunk(void* soObj) const
     fwrite(v, bb.Size(), 1, f);
     fclose(f);*/
 
+    klass->DeclaringDomain()->PerfMap().AddThunk(v, bb.Size(), "closure thunk", invokeMethod);
+
     header->codeOffset = v;
     return v;
 }
@@ -411,6 +413,7 @@ static __cdecl void boxedMethodJit(void* trampoline, void* pMethod)
 
     void* v = domain->ThunkManager().p->allocExecutableMem(bb.Size());
     memcpy(v, bb.Bytes(), bb.Size());
+    domain->PerfMap().AddThunk(v, bb.Size(), "boxed method", wrapperMethod);
 
     // *************************************
     //   Patches the original trampoline.
@@ -498,6 +501,7 @@ void* ThunkManagerPrivate::compileBoxedCtor(const CMethod* method)
 
     void* v = allocExecutableMem(sizeof(cc));
     memcpy(v, cc, sizeof(cc));
+    method->DeclaringClass()->DeclaringDomain()->PerfMap().AddThunk(v, sizeof(cc), "boxed ctor", method);
 
     // Uncomment for debugging.
     /*FILE* f = fopen("boxedctor.bin", "wb");
@@ -511,18 +515,15 @@ void* ThunkManagerPrivate::compileBoxedCtor(const CMethod* method)
     //   ClosureCtor
     // ***************
 
-static void* closureCtorHelper(CMethod* method, void* env)
+// The VTable is created on demand, on the first use of the constructor.
+static void** closureVirtualTable(CClass* declClass)
 {
-    CClass* declClass = method->DeclaringClass();
-    CDomain* declDomain = declClass->DeclaringDomain();
-
-    // The VTable is created on demand, on the first use of the constructor.
     if(!declClass->VirtualTable()) {
         void** vtable = new void*[2];
         vtable[0] = declClass; // first slot - class pointer
         assert(declClass->InvokeMethod());
         // the second and the only method slot -- "invoke" method.
-        vtable[1] = declDomain->GetFunctionPointer(declClass->InvokeMethod());
+        vtable[1] = declClass->DeclaringDomain()->GetFunctionPointer(declClass->InvokeMethod());
         assert(vtable[1]);
 
         declClass->SetVirtualTable(vtable);
@@ -531,11 +532,29 @@ static void* closureCtorHelper(CMethod* method, void* env)
         declClass->CalcGCMap();
     }
 
-    SClosureHeader* obj = (SClosureHeader*)declDomain->MemoryManager().Allocate(sizeof(SClosureHeader), declClass->VirtualTable());
+    return declClass->VirtualTable();
+}
+
+static void* closureCtorHelper(CMethod* method, void* env)
+{
+    CClass* declClass = method->DeclaringClass();
+    void** vtable = closureVirtualTable(declClass);
+
+    SClosureHeader* obj = (SClosureHeader*)declClass->DeclaringDomain()->MemoryManager().Allocate(sizeof(SClosureHeader), vtable);
     obj->env = env;
     return obj;
 }
 
+// Same as closureCtorHelper(..), except the memory is provided by the caller (see CBodyExpression::IsStackAllocated).
+void* SKIZO_API _soX_stackclosure(void* obj, void* objClass, void* env)
+{
+    SClosureHeader* closure = (SClosureHeader*)obj;
+    closure->vtable = closureVirtualTable((CClass*)objClass);
+    closure->env = env;
+    closure->codeOffset = nullptr;
+    return closure;
+}
+
 // TODO x86-only
 // Closure constructor forwards everything to a special helper, closureCtorHelper(..), see above.
 void* ThunkManagerPrivate::compileClosureCtor(const CMethod* method)
@@ -563,6 +582,7 @@ void* ThunkManagerPrivate::compileClosureCtor(const CMethod* method)
 
     void* v = allocExecutableMem(sizeof(cc));
     memcpy(v, cc, sizeof(cc));
+    method->DeclaringClass()->DeclaringDomain()->PerfMap().AddThunk(v, sizeof(cc), "closure ctor", method);
 
     /*FILE* f = fopen("thunk.bin", "wb");
     fwrite(v, 26, 1, f);
@@ -816,6 +836,8 @@ void* SThunkManager::GetReflectionThunk(const CMethod* method) const
     fclose(f);*/
     //exit(1);
 
+    method->DeclaringClass()->DeclaringDomain()->PerfMap().AddThunk(v, bb.Size(), "reflection thunk", method);
+
     method->ThunkInfo().pReflectionThunk = v;
 
     return v;
@@ -863,6 +885,7 @@ void* SThunkManager::GetCompilationTrampoline(const CMethod* wrapperMethod, FJit
     const void* jf = (void*)jitFunc;
     memcpy(&cc[22], &jf, 4);
     memcpy(v, &cc[0], sizeof(cc));
+    wrapperMethod->DeclaringClass()->DeclaringDomain()->PerfMap().AddThunk(v, sizeof(cc), "trampoline", wrapperMethod);
 
     // Uncomment for debugging.
     /*FILE* f = fopen("thunk.bin", "wb");
@@ -872,6 +895,21 @@ void* SThunkManager::GetCompilationTrampoline(const CMethod* wrapperMethod, FJit
     return v;
 }
 
+void SThunkManager::PatchCompilationTrampoline(void* trampoline, void* target) const
+{
+    // The trampoline's frame is dropped before jumping to the target: at the patched label, ESP equals EBP,
+    // so "leave" only restores the caller's EBP, leaving the stack exactly as it was on entry.
+    so_byte patch[6] = {
+        0xC9,                         // leave
+        0xE9, 0xFF, 0xFF, 0xFF, 0xFF  // jmp target (relative to the end of the instruction)
+    };
+    const int rel = (int)((char*)target - ((char*)trampoline + 4 + sizeof(patch)));
+    memcpy(&patch[2], &rel, sizeof(int));
+
+    // The patch area of the trampoline starts at offset 4, see ::GetCompilationTrampoline.
+    memcpy(&(((char*)trampoline)[4]), patch, sizeof(patch));
+}
+
 // *************************
 //   CompileAndLinkMethods
 // *************************
@@ -916,6 +954,27 @@ void SThunkManager::CompileAndLinkMethods(CDomain* domain)
     p->m_boxedCtors->Clear();
 }
 
+void SThunkManager::PatchFunctionEntry(void* func, void* newTarget) const
+{
+    // The entry is an 8-byte NOP, a single instruction: another thread either hasn't started executing it yet or
+    // is already past it, so it never sees a partially patched instruction.
+    static const so_byte patchableEntry[8] = { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    SKIZO_REQ(((size_t)func & 7) == 0 && memcmp(func, patchableEntry, sizeof(patchableEntry)) == 0, EC_ILLEGAL_ARGUMENT);
+
+    so_byte patch[8] = {
+        0xE9, 0xFF, 0xFF, 0xFF, 0xFF, // jmp rel32
+        0xCC, 0xCC, 0xCC              // never reached
+    };
+    const int rel = (int)((char*)newTarget - ((char*)func + 5));
+    memcpy(&patch[1], &rel, sizeof(int));
+
+    // NOTE Frames of the function which are currently on the stack aren't affected: return addresses never
+    // point into the entry.
+    so_long value;
+    memcpy(&value, patch, sizeof(value));
+    __atomic_store_n((so_long*)func, value, __ATOMIC_SEQ_CST);
+}
+
 #ifdef SKIZO_X
 bool SThunkManager::IsThunk(void* ptr) const
 {
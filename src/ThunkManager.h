@@ -89,6 +89,13 @@ struct SThunkManager
      */
     void* GetCompilationTrampoline(const CMethod* wrapperMethod, FJitFunction jitFunc) const;
 
+    /**
+     * To be called from a JIT function passed to ::GetCompilationTrampoline(..) Patches the trampoline to jump to
+     * a compiled function which sets up its own stack frame (unlike code generated for boxed methods, which
+     * reuses the trampoline's frame), i.e. a C function compiled with TCC.
+     */
+    void PatchCompilationTrampoline(void* trampoline, void* target) const;
+
         // *******************************
         //   ThunkJIT-generated methods.
         // *******************************
@@ -105,10 +112,23 @@ struct SThunkManager
      */
     void CompileAndLinkMethods(CDomain* domain);
 
+        // *************************
+        //   Tiered compilation.
+        // *************************
+
+    /**
+     * Overwrites the first bytes of the function's machine code with a jump to "newTarget". Used to redirect
+     * first-tier methods to their optimized versions (see CDomain::TierUp(..)). Safe to call while other threads
+     * run the function: the entry is replaced with a single atomic store.
+     * @warning The function must be compiled by TCC with patchable entries (see tcc_set_patchable_entries(..)).
+     */
+    void PatchFunctionEntry(void* func, void* newTarget) const;
+
 #ifdef SKIZO_X
     /**
      * Returns true if the pointer points to ThunkJIT-generated machine code.
-     * So far only used by unwind.unix.cpp and not implemented for other platforms.
+     * So far only used by unwind.unix.cpp and the SIGSEGV handler (hardware null checks), not implemented for other
+     * platforms.
      */
     bool IsThunk(void* ptr) const;
 #endif
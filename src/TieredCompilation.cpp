@@ -0,0 +1,167 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "Abort.h"
+#include "Domain.h"
+#include "Emitter.h"
+#include "Exception.h"
+#include "Method.h"
+#include "String.h"
+#include <atomic>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// Tiered compilation works as follows:
+// 1) The domain starts up with TCC. The emitter inserts a call counter at the beginning of every method
+//    (see SEmitter::emitFunctionBody) which calls _soX_tierup once the method becomes hot.
+// 2) The first time any method becomes hot, the whole program is emitted once again as the second tier and
+//    compiled with the native compiler in a background thread, while the program keeps running in TCC code.
+//    The second tier has no data of its own: static fields and vtables are linked in as externals pointing to
+//    the first tier's data, the same way icalls and ecalls are.
+// 3) Once the image is loaded, every method which is reported hot gets its TCC entry patched with a jump to
+//    the second tier. Methods which never become hot stay in TCC code.
+// NOTE There's no on-stack replacement: a method which is already running keeps running in TCC code until it
+// returns. Loops aren't affected by this as loop bodies are closures which are called on every iteration.
+
+// ******************
+//   TierUpThread.
+// ******************
+
+class CTierUpThread: public CThread
+{
+public:
+    STextBuilder Code;
+    Auto<CHashMap<const char*, void*> > Externals;
+
+    // Strings referenced by Externals which are owned by this object.
+    Auto<CArrayList<char*> > OwnedNames;
+
+    char* Compiler;
+    bool IsStarted;
+
+    // Set by the background thread. Image is only read after IsDone becomes true: the release store in OnStart()
+    // publishes Image to the acquire load in CDomain::tierUpImage().
+    Auto<CNativeImage> Image;
+    std::atomic<bool> IsDone;
+
+    CTierUpThread()
+        : Externals(new CHashMap<const char*, void*>()),
+          OwnedNames(new CArrayList<char*>()),
+          Compiler(nullptr),
+          IsStarted(false),
+          IsDone(false)
+    {
+        this->SetName("TierUp");
+    }
+
+    virtual ~CTierUpThread()
+    {
+        CString::FreeUtf8(this->Compiler);
+
+        for(int i = 0; i < this->OwnedNames->Count(); i++) {
+            CString::FreeUtf8(this->OwnedNames->Array()[i]);
+        }
+    }
+
+protected:
+    virtual void OnStart() override
+    {
+        try {
+            this->Image.SetPtr(CNativeImage::Compile(this->Compiler, this->Code.Chars(), this->Externals));
+        } catch (const SException& e) {
+            printf("Tiered compilation failed: %s\n", e.Message());
+        }
+
+        this->IsDone.store(true, std::memory_order_release);
+    }
+};
+
+void CDomain::startTierUp()
+{
+    Auto<CTierUpThread> thread (new CTierUpThread());
+    m_tierUpThread.SetVal(thread);
+
+    SkizoEmitSecondTier(this, thread->Code, thread->OwnedNames);
+
+    // Shared data symbols are the only names in OwnedNames so far.
+    bool isComplete = true;
+    SKIZO_LOCK_AB(CDomain::g_globalMutex) {
+        for(int i = 0; i < thread->OwnedNames->Count(); i++) {
+            char* name = thread->OwnedNames->Array()[i];
+            void* addr = tcc_get_symbol(m_tccState, name);
+
+            // Classes which were created after the domain had started up aren't known to the first tier.
+            if(!addr) {
+                isComplete = false;
+                break;
+            }
+
+            thread->Externals->Set(name, addr);
+        }
+
+        collectExternals(thread->Externals, thread->OwnedNames);
+    } SKIZO_END_LOCK_AB(CDomain::g_globalMutex);
+
+    if(isComplete) {
+        thread->Compiler = m_nativeCompiler->ToUtf8();
+        thread->IsStarted = true;
+        thread->Start();
+    } else {
+        // The program stays in the first tier.
+        thread->IsDone.store(true, std::memory_order_release);
+    }
+}
+
+CNativeImage* CDomain::tierUpImage() const
+{
+    const CTierUpThread* thread = static_cast<const CTierUpThread*>(m_tierUpThread.Ptr());
+    return (thread && thread->IsDone.load(std::memory_order_acquire))? thread->Image.Ptr(): nullptr;
+}
+
+void CDomain::joinTierUp()
+{
+    const CTierUpThread* thread = static_cast<const CTierUpThread*>(m_tierUpThread.Ptr());
+    if(thread && thread->IsStarted) {
+        CThread::Join(thread);
+    }
+}
+
+void CDomain::TierUp(CMethod* method)
+{
+    // The method will report again after another SKIZO_TIERUP_THRESHOLD calls if it can't be patched right now
+    // (the second tier is still compiling).
+    *method->TierUpCounter() = 0;
+
+    if(!m_tierUpThread) {
+        startTierUp();
+        return;
+    }
+
+    const CNativeImage* secondTier = tierUpImage();
+    if(!secondTier) {
+        return;
+    }
+
+    Utf8Auto cName (method->GetCName());
+    void* firstTierEntry = GetSymbolThreadSafe(cName);
+    void* secondTierEntry = secondTier->GetSymbol(cName);
+
+    // After patching, the counter is never reached again.
+    if(firstTierEntry && secondTierEntry) {
+        m_thunkMngr.PatchFunctionEntry(firstTierEntry, secondTierEntry);
+    }
+}
+
+} }
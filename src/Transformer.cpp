@@ -17,10 +17,16 @@
 #include "Const.h"
 #include "Contract.h"
 #include "Domain.h"
+#include "HashMap.h"
 #include "ModuleDesc.h"
 #include "Queue.h"
 #include "ScriptUtils.h"
 
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 // TODO NOTE
 // Code duplication between return/call/assignment/parameter passing when it comes to:
 //
@@ -85,6 +91,55 @@ struct STransformer
     // canInlineBranches is usually true if the expression is a top-level body statement, and false otherwise.
     CExpression* inferCallExpr(CCallExpression* callExpr, bool canInlineBranches = false);
 
+    // Marks "get"/"set" calls on arrays inside "(0 to (arr length)) loop ^(i: int) { .. }" for which range checks
+    // are redundant (see CCallExpression::SkipRangeCheck). The step is null for "loop".
+    void eliminateRangeChecks(const CExpression* rangeExpr, const CExpression* stepExpr, CBodyExpression* looperBody);
+
+    // Returns a CInlinedLoopExpression if the call is a range loop or a while loop which can be inlined, null otherwise.
+    // See inferCallExpr(..)
+    CExpression* inlineLoop(CCallExpression* callExpr);
+
+    // Renames the loop variable and locals declared in an inlined loop body, as they become locals of the
+    // enclosing method (the same names can be reused by other loops).
+    void renameLoopLocals(CBodyExpression* bodyExpr);
+    SStringSlice newLoopLocalName(const SStringSlice& name);
+
+    // Constant folding: replaces arithmetic and comparisons over constants of primitive types (and consts) with their
+    // values, propagates constants through locals which are never reassigned, removes "then"/"else" branches and
+    // loops which are never taken. Runs right after all classes are inferred, so that the passes which follow see
+    // simplified trees. See CDomain::ConstantFoldingStats()
+    void foldConstants(CClass* pClass);
+    void foldConstants(CExpression* expr, const CHashMap<const void*, CExpression*>* constLocals);
+    void foldBodyStatements(CBodyExpression* bodyExpr, const CHashMap<const void*, CExpression*>* constLocals);
+    // Returns an add-ref'd constant expression which should replace the passed expression, or null.
+    CExpression* evalConstExpr(const CExpression* expr, const CHashMap<const void*, CExpression*>* constLocals);
+    CExpression* evalPrimitiveOp(const CCallExpression* callExpr);
+    CExpression* newConstExpr(const CClass* klass, const SVariant& value, const CExpression* origExpr);
+
+    // Class hierarchy analysis: marks truly virtual methods which are never overriden in subclasses as effectively
+    // final (see E_METHODFLAGS_IS_EFFECTIVELY_FINAL) and counts call sites which become direct calls.
+    void devirtualizeCalls();
+
+    // Escape analysis for closures: a closure literal which is only passed to callees that never store it (they only
+    // invoke it or pass it further to such callees) is created on the C stack (see CBodyExpression::IsStackAllocated).
+    // If no closure created in a method can escape, its closure environment goes to the C stack as well (see
+    // E_METHODFLAGS_IS_ENV_ON_STACK). Runs after devirtualizeCalls() as it only trusts statically bound callees.
+    void allocateClosuresOnStack();
+    bool markStackClosures(CExpression* expr, CHashMap<const void*, bool>* nonEscapingParams);
+    bool isNonEscapingArg(const CCallExpression* callExpr, int argIndex, CHashMap<const void*, bool>* nonEscapingParams);
+    bool doesParamEscape(const CExpression* expr, const CParam* param, CHashMap<const void*, bool>* nonEscapingParams);
+
+    // Marks self-recursive calls in tail position (see CCallExpression::IsTailCall), so that deep recursion runs in
+    // constant stack space. Returns the number of such calls. See CDomain::TailCallCount()
+    int eliminateTailCalls(CClass* pClass);
+    int markTailCalls(CBodyExpression* bodyExpr, CMethod* method);
+
+    // Marks call expressions which the emitter can replace with the bodies of their target methods (see
+    // CCallExpression::IsInlined). Runs after all classes are inferred, as it depends on the final class hierarchy.
+    void inlineCalls(CClass* pClass);
+    void inlineCalls(CExpression* expr, const CMethod* callerMethod);
+    bool canInlineCall(const CCallExpression* callExpr, const CMethod* callerMethod) const;
+
     void inferRetExpr(CReturnExpression* retExpr);
     void inferCastExpr(CCastExpression* castExpr);
     void inferSizeofExpr(CSizeofExpression* sizeofExpr);
@@ -328,9 +383,12 @@ void STransformer::mergeExtensions()
 void SkizoTransform(CDomain* domain)
 {
     STransformer transformer (domain);
+    SStartupTrace& startupTrace = domain->StartupTrace();
 
     // Important to do it before everything else.
+    startupTrace.Begin("transform", "mergeExtensions");
     transformer.mergeExtensions();
+    startupTrace.End();
 
     // Aliases are transformed first, so that the rest of the classes could rewrite aliases to basetypes
     // as if aliases never existed.
@@ -346,8 +404,10 @@ void SkizoTransform(CDomain* domain)
         aliasClass->Flags() |= E_CLASSFLAGS_IS_INFERRED;
     }
 
+    startupTrace.Begin("transform", "inferHierarchies");
     transformer.inferHierarchies();
     transformer.inferForcedTypeRefs();
+    startupTrace.End();
 
     // The rest of the classes.
     const CArrayList<CClass*>* klasses = domain->Classes();
@@ -364,6 +424,7 @@ void SkizoTransform(CDomain* domain)
     // Infers types and verifies method parameters etc.
     // ************************************************
 
+    startupTrace.Begin("transform", "inferClasses");
     while(!transformer.classesToProcess->IsEmpty()) {
         Auto<CClass> klass (transformer.classesToProcess->Dequeue());
         CClass* pClass = klass;
@@ -406,11 +467,44 @@ void SkizoTransform(CDomain* domain)
 
         pClass->Flags() |= E_CLASSFLAGS_IS_INFERRED;
     }
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "foldConstants");
+    for(int i = 0; i < klasses->Count(); i++) {
+        transformer.foldConstants(klasses->Array()[i]);
+    }
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "devirtualizeCalls");
+    transformer.devirtualizeCalls();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "allocateClosuresOnStack");
+    transformer.allocateClosuresOnStack();
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "inlineCalls");
+    for(int i = 0; i < klasses->Count(); i++) {
+        transformer.inlineCalls(klasses->Array()[i]);
+    }
+    startupTrace.End();
+
+    startupTrace.Begin("transform", "eliminateTailCalls");
+    {
+        int tailCallCount = 0;
+        for(int i = 0; i < klasses->Count(); i++) {
+            tailCallCount += transformer.eliminateTailCalls(klasses->Array()[i]);
+        }
+        domain->SetTailCallCount(tailCallCount);
+    }
+    startupTrace.End();
 
+    startupTrace.Begin("transform", "calcGCMaps");
     while(!transformer.classesToProcess2->IsEmpty()) {
         Auto<CClass> klass (transformer.classesToProcess2->Dequeue());
         klass->CalcGCMap();
     }
+    startupTrace.End();
 }
 
 void STransformer::inferConsts(CClass* pClass)
@@ -1667,6 +1761,17 @@ CExpression* STransformer::inferCallExpr(CCallExpression* callExpr, bool canInli
                 }
             }
 
+            // ****************
+            //   InlinedLoop
+            // ****************
+
+            if(canInlineBranches && domain->InlineBranching()) {
+                CExpression* inlinedLoopExpr = inlineLoop(callExpr);
+                if(inlinedLoopExpr) {
+                    return inlinedLoopExpr;
+                }
+            }
+
             // ************************
 
         } else {
@@ -1934,9 +2039,309 @@ CExpression* STransformer::inferCallExpr(CCallExpression* callExpr, bool canInli
         ScriptUtils::FailE("Unknown type declared for call expression's return.", callExpr);
     }
 
+    if(targetMethod->DeclaringClass() == domain->RangeClass()) {
+        CExpression* looperExpr = callExpr->Exprs->Item(callExpr->Exprs->Count() - 1);
+
+        if(looperExpr->Kind() == E_EXPRESSIONKIND_BODY) {
+            if(targetMethod->Name().EqualsAscii("loop")) {
+                eliminateRangeChecks(callTargetExpr, nullptr, static_cast<CBodyExpression*>(looperExpr));
+            } else if(targetMethod->Name().EqualsAscii("step")) {
+                eliminateRangeChecks(callTargetExpr, callExpr->Exprs->Item(2), static_cast<CBodyExpression*>(looperExpr));
+            }
+        }
+    }
+
     return nullptr;
 }
 
+// ****************************
+//   Range check elimination.
+// ****************************
+
+// A uniform way to walk expression trees for the analysis below. Children can be null.
+static int subExprCount(const CExpression* expr)
+{
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_BODY:
+            return static_cast<const CBodyExpression*>(expr)->Exprs->Count();
+        case E_EXPRESSIONKIND_CALL:
+            return static_cast<const CCallExpression*>(expr)->Exprs->Count();
+        case E_EXPRESSIONKIND_ARRAYINIT:
+            return static_cast<const CArrayInitExpression*>(expr)->Exprs->Count();
+        case E_EXPRESSIONKIND_RETURN:
+        case E_EXPRESSIONKIND_CAST:
+        case E_EXPRESSIONKIND_ARRAYCREATION:
+        case E_EXPRESSIONKIND_IS:
+        case E_EXPRESSIONKIND_ABORT:
+        case E_EXPRESSIONKIND_ASSERT:
+        case E_EXPRESSIONKIND_REF:
+            return 1;
+        case E_EXPRESSIONKIND_IDENTITYCOMPARISON:
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+            return 2;
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+            return 3;
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+static CExpression* subExprAt(const CExpression* expr, int index)
+{
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_BODY:
+            return static_cast<const CBodyExpression*>(expr)->Exprs->Item(index);
+        case E_EXPRESSIONKIND_CALL:
+            return static_cast<const CCallExpression*>(expr)->Exprs->Item(index);
+        case E_EXPRESSIONKIND_ARRAYINIT:
+            return static_cast<const CArrayInitExpression*>(expr)->Exprs->Item(index);
+        case E_EXPRESSIONKIND_RETURN:
+            return static_cast<const CReturnExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_CAST:
+            return static_cast<const CCastExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_ARRAYCREATION:
+            return static_cast<const CArrayCreationExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_IS:
+            return static_cast<const CIsExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_ABORT:
+            return static_cast<const CAbortExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_ASSERT:
+            return static_cast<const CAssertExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_REF:
+            return static_cast<const CRefExpression*>(expr)->Expr;
+        case E_EXPRESSIONKIND_IDENTITYCOMPARISON:
+        {
+            const CIdentityComparisonExpression* identCompExpr = static_cast<const CIdentityComparisonExpression*>(expr);
+            return index == 0? identCompExpr->Expr1: identCompExpr->Expr2;
+        }
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+        {
+            const CAssignmentExpression* assExpr = static_cast<const CAssignmentExpression*>(expr);
+            return index == 0? assExpr->Expr1: assExpr->Expr2;
+        }
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+        {
+            const CInlinedConditionExpression* condExpr = static_cast<const CInlinedConditionExpression*>(expr);
+            if(index == 0) {
+                return condExpr->IfCondition;
+            } else if(index == 1) {
+                return condExpr->ElseCondition;
+            } else {
+                return condExpr->Body.Ptr();
+            }
+        }
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+        {
+            const CInlinedLoopExpression* loopExpr = static_cast<const CInlinedLoopExpression*>(expr);
+            switch(index) {
+                case 0: return loopExpr->RangeExpr;
+                case 1: return loopExpr->StepExpr;
+                case 2: return loopExpr->IndexExpr.Ptr();
+                case 3: return loopExpr->Condition;
+                default: return loopExpr->Body.Ptr();
+            }
+        }
+        default:
+            SKIZO_REQ_NEVER
+            return nullptr;
+    }
+}
+
+static bool isIdentNamed(const CExpression* expr, const SStringSlice& name)
+{
+    return expr
+        && expr->Kind() == E_EXPRESSIONKIND_IDENT
+        && static_cast<const CIdentExpression*>(expr)->Name.Equals(name);
+}
+
+// Counts declarations of and assignments to the variable named `name`. Taking a reference to the variable or any
+// inline C code is considered an assignment, too, as anything can happen there.
+static void findAssignments(const CExpression* expr, const SStringSlice& name, int* declCount, int* assignCount)
+{
+    if(!expr) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_ASSIGNMENT) {
+        const CIdentExpression* lValueExpr = static_cast<const CIdentExpression*>(static_cast<const CAssignmentExpression*>(expr)->Expr1.Ptr());
+
+        if(lValueExpr->Name.Equals(name)) {
+            if(lValueExpr->IsAuto || !lValueExpr->TypeAsInCode.IsVoid()) {
+                (*declCount)++;
+            } else {
+                (*assignCount)++;
+            }
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_REF) {
+        if(isIdentNamed(static_cast<const CRefExpression*>(expr)->Expr, name)) {
+            (*assignCount)++;
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_CCODE) {
+        (*assignCount)++;
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        findAssignments(subExprAt(expr, i), name, declCount, assignCount);
+    }
+}
+
+static bool declaresParam(const CBodyExpression* bodyExpr, const SStringSlice& name)
+{
+    if(!bodyExpr->Method) {
+        return false;
+    }
+
+    const CArrayList<CParam*>* params = bodyExpr->Method->Signature().Params;
+    for(int i = 0; i < params->Count(); i++) {
+        if(params->Array()[i]->Name.Equals(name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void skipRangeChecks(CExpression* expr, const SStringSlice& arrayName, const SStringSlice& indexName)
+{
+    if(!expr) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_BODY) {
+        // A nested closure whose params shadow the names refers to different variables.
+        const CBodyExpression* bodyExpr = static_cast<const CBodyExpression*>(expr);
+        if(declaresParam(bodyExpr, arrayName) || declaresParam(bodyExpr, indexName)) {
+            return;
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_CALL) {
+        // "arr get i" or "arr set i value" (inference later makes sure it's indeed an array).
+        CCallExpression* callExpr = static_cast<CCallExpression*>(expr);
+        const CArrayList<CExpression*>* exprs = callExpr->Exprs;
+
+        if((exprs->Count() == 3 || exprs->Count() == 4)
+        && isIdentNamed(exprs->Item(0), arrayName)
+        && isIdentNamed(exprs->Item(2), indexName))
+        {
+            const SStringSlice& methodName = static_cast<const CIdentExpression*>(exprs->Item(1))->Name;
+
+            if((exprs->Count() == 3 && methodName.EqualsAscii("get"))
+            || (exprs->Count() == 4 && methodName.EqualsAscii("set")))
+            {
+                callExpr->SkipRangeCheck = true;
+            }
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        skipRangeChecks(subExprAt(expr, i), arrayName, indexName);
+    }
+}
+
+// In "(0 to (arr length)) loop ^(i: int) { (arr get i) }", the index is always within the bounds of the array
+// (and the array is non-null) as long as neither "arr" nor "i" are ever reassigned, as array lengths are immutable.
+// The analysis is done before the body of the closure is inferred (closures are inferred later, see
+// inferClosureExpr(..)), so it's mostly syntactic and very conservative.
+void STransformer::eliminateRangeChecks(const CExpression* rangeExpr, const CExpression* stepExpr, CBodyExpression* looperBody)
+{
+    // "Range::step" is OK with a positive constant step, however large: the index never overflows and never wraps
+    // around to a negative value (see _so_Range_step and SEmitter::emitInlinedLoopExpr(..)).
+    if(stepExpr
+    && (stepExpr->Kind() != E_EXPRESSIONKIND_INTCONSTANT
+     || static_cast<const CIntegerConstantExpression*>(stepExpr)->Value <= 0))
+    {
+        return;
+    }
+
+    // ******************************************
+    //   The range: "(from to (arr length))".
+    // ******************************************
+
+    if(rangeExpr->Kind() != E_EXPRESSIONKIND_CALL) {
+        return;
+    }
+
+    const CCallExpression* toCallExpr = static_cast<const CCallExpression*>(rangeExpr);
+    if(toCallExpr->CallType != E_CALLEXPRESSION_METHODCALL
+    || toCallExpr->Exprs->Count() != 3
+    || toCallExpr->uTargetMethod->DeclaringClass()->PrimitiveType() != E_PRIMTYPE_INT
+    || !toCallExpr->uTargetMethod->Name().EqualsAscii("to"))
+    {
+        return;
+    }
+
+    // Negative indices are never valid.
+    const CExpression* fromExpr = toCallExpr->Exprs->Item(0);
+    if(fromExpr->Kind() != E_EXPRESSIONKIND_INTCONSTANT
+    || static_cast<const CIntegerConstantExpression*>(fromExpr)->Value < 0)
+    {
+        return;
+    }
+
+    const CExpression* lengthExpr = toCallExpr->Exprs->Item(2);
+    if(lengthExpr->Kind() != E_EXPRESSIONKIND_CALL) {
+        return;
+    }
+
+    const CCallExpression* lengthCallExpr = static_cast<const CCallExpression*>(lengthExpr);
+    if(lengthCallExpr->CallType != E_CALLEXPRESSION_METHODCALL
+    || lengthCallExpr->uTargetMethod->DeclaringClass()->SpecialClass() != E_SPECIALCLASS_ARRAY
+    || !lengthCallExpr->uTargetMethod->Name().EqualsAscii("length")
+    || lengthCallExpr->Exprs->Item(0)->Kind() != E_EXPRESSIONKIND_IDENT)
+    {
+        return;
+    }
+
+    // Fields can be changed by any call; only locals and params of the current method are considered.
+    const CIdentExpression* arrayExpr = static_cast<const CIdentExpression*>(lengthCallExpr->Exprs->Item(0));
+    const SResolvedIdentType& resolvedArray = arrayExpr->ResolvedIdent;
+    if((resolvedArray.EType != E_RESOLVEDIDENTTYPE_LOCAL && resolvedArray.EType != E_RESOLVEDIDENTTYPE_PARAM)
+    || resolvedArray.AsLocal_->DeclaringMethod != curMethod
+    || !curMethod->Expression())
+    {
+        return;
+    }
+
+    // *****************************
+    //   The loop: "^(i: int) {..}"
+    // *****************************
+
+    if(!looperBody->Method || !looperBody->IsCastableToRangeLooper()) {
+        return;
+    }
+
+    const SStringSlice& arrayName = arrayExpr->Name;
+    const SStringSlice& indexName = looperBody->Method->Signature().Params->Item(0)->Name;
+    if(arrayName.Equals(indexName)) {
+        return;
+    }
+
+    // *****************************************************************
+    //   Neither the array nor the index can be reassigned (anywhere in
+    //   the method, as closures share captured variables).
+    // *****************************************************************
+
+    int declCount = 0, assignCount = 0;
+    findAssignments(curMethod->Expression(), arrayName, &declCount, &assignCount);
+    if(assignCount > 0 || declCount > (resolvedArray.EType == E_RESOLVEDIDENTTYPE_LOCAL? 1: 0)) {
+        return;
+    }
+
+    declCount = assignCount = 0;
+    findAssignments(looperBody, indexName, &declCount, &assignCount);
+    if(assignCount > 0 || declCount > 0) {
+        return;
+    }
+
+    // NOTE The loop body itself declares the index, so it's skipped by skipRangeChecks(..) directly.
+    for(int i = 0; i < looperBody->Exprs->Count(); i++) {
+        skipRangeChecks(looperBody->Exprs->Array()[i], arrayName, indexName);
+    }
+}
+
 void STransformer::inferCastExpr(CCastExpression* castExpr)
 {
     CExpression* inputValueExpr = castExpr->Expr;
@@ -2222,4 +2627,1599 @@ void STransformer::inferArrayInitExpr(CArrayInitExpression* arrayInitExpr, bool
     arrayInitExpr->HelperId = helperId;
 }
 
+// *******************
+//   Loop inlining.
+// *******************
+
+// Inline C code and closures (other than those which are inlined themselves) can't be part of an inlined loop, as
+// they may depend on the loop variable being a separate variable for each iteration.
+static bool containsClosures(const CExpression* expr)
+{
+    if(!expr) {
+        return false;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_BODY || expr->Kind() == E_EXPRESSIONKIND_CCODE) {
+        return true;
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        if(containsClosures(subExprAt(expr, i))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// "^(): bool { return x; }" => "x"
+static CExpression* predicateCondition(const CExpression* expr)
+{
+    if(expr->Kind() != E_EXPRESSIONKIND_BODY) {
+        return nullptr;
+    }
+
+    const CBodyExpression* bodyExpr = static_cast<const CBodyExpression*>(expr);
+    if(!bodyExpr->Method
+    || bodyExpr->Method->Signature().Params->Count() != 0
+    || bodyExpr->Method->Signature().ReturnType.PrimType != E_PRIMTYPE_BOOL
+    || bodyExpr->Exprs->Count() != 1
+    || bodyExpr->Exprs->Item(0)->Kind() != E_EXPRESSIONKIND_RETURN)
+    {
+        return nullptr;
+    }
+
+    CExpression* condExpr = static_cast<const CReturnExpression*>(bodyExpr->Exprs->Item(0))->Expr;
+    if(!condExpr || containsClosures(condExpr)) {
+        return nullptr;
+    }
+
+    return condExpr;
+}
+
+static bool canInlineLoopBody(const CBodyExpression* bodyExpr);
+
+// Nested "then" branches and loops are inlined as well (if they're really of type "bool" or "Range"; otherwise it's
+// a rare call to a user method with a matching name).
+static bool canInlineNestedStatement(const CExpression* expr)
+{
+    if(expr->Kind() != E_EXPRESSIONKIND_CALL) {
+        return !containsClosures(expr);
+    }
+
+    const CArrayList<CExpression*>* exprs = static_cast<const CCallExpression*>(expr)->Exprs;
+    const int count = exprs->Count();
+    if(count < 3 || exprs->Item(1)->Kind() != E_EXPRESSIONKIND_IDENT) {
+        return !containsClosures(expr);
+    }
+
+    const SStringSlice& name = static_cast<const CIdentExpression*>(exprs->Item(1))->Name;
+    const CExpression* lastExpr = exprs->Item(count - 1);
+    if(lastExpr->Kind() != E_EXPRESSIONKIND_BODY) {
+        return !containsClosures(expr);
+    }
+
+    const CBodyExpression* bodyExpr = static_cast<const CBodyExpression*>(lastExpr);
+    if(!bodyExpr->Method) {
+        return false;
+    }
+
+    if(count == 3 && name.EqualsAscii("then")) {
+        return bodyExpr->IsCastableToAction() && !containsClosures(exprs->Item(0)) && canInlineLoopBody(bodyExpr);
+    } else if(count == 3 && name.EqualsAscii("loop")) {
+        return bodyExpr->IsCastableToRangeLooper() && !containsClosures(exprs->Item(0)) && canInlineLoopBody(bodyExpr);
+    } else if(count == 4 && name.EqualsAscii("step")) {
+        return bodyExpr->IsCastableToRangeLooper()
+            && !containsClosures(exprs->Item(0))
+            && !containsClosures(exprs->Item(2))
+            && canInlineLoopBody(bodyExpr);
+    } else if(count == 4 && name.EqualsAscii("while")) {
+        return bodyExpr->IsCastableToAction() && predicateCondition(exprs->Item(2)) && canInlineLoopBody(bodyExpr);
+    } else {
+        return false;
+    }
+}
+
+// Returns are not allowed in inlined bodies (same as with inlined conditions).
+static bool canInlineLoopBody(const CBodyExpression* bodyExpr)
+{
+    for(int i = 0; i < bodyExpr->Exprs->Count(); i++) {
+        const CExpression* subExpr = bodyExpr->Exprs->Array()[i];
+
+        if(subExpr->Kind() == E_EXPRESSIONKIND_RETURN || !canInlineNestedStatement(subExpr)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool isLoopLocalName(const SStringSlice& name)
+{
+    // See STransformer::newLoopLocalName(..)
+    return name.Start < name.End && name.String->Chars()[name.Start] == SKIZO_CHAR('0');
+}
+
+// Does the body declare a param with the name? Locals can't shadow anything (see CMethod::NewLocal(..)), but
+// params of closures can shadow params of enclosing closures: "(0 to 3) loop ^(i: int) { (0 to 3) loop ^(i: int) {..} }"
+static bool bodyDeclaresParam(const CExpression* expr, const SStringSlice& name)
+{
+    if(expr->Kind() != E_EXPRESSIONKIND_BODY) {
+        return false;
+    }
+
+    const CMethod* method = static_cast<const CBodyExpression*>(expr)->Method;
+    return method && method->ParamByName(name);
+}
+
+// Doesn't touch method names in call expressions. Nested bodies which rebind the name are skipped, as the name
+// refers to something else there.
+static void renameIdents(CExpression* expr, const SStringSlice& name, const SStringSlice& newName)
+{
+    if(!expr || bodyDeclaresParam(expr, name)) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_IDENT) {
+        CIdentExpression* identExpr = static_cast<CIdentExpression*>(expr);
+        if(identExpr->Name.Equals(name)) {
+            identExpr->Name = newName;
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        if(i != 1 || expr->Kind() != E_EXPRESSIONKIND_CALL) {
+            renameIdents(subExprAt(expr, i), name, newName);
+        }
+    }
+}
+
+// The body itself may declare the name as its param (the index of a loop).
+static void renameIdentsInBody(CBodyExpression* bodyExpr, const SStringSlice& name, const SStringSlice& newName)
+{
+    for(int i = 0; i < bodyExpr->Exprs->Count(); i++) {
+        renameIdents(bodyExpr->Exprs->Array()[i], name, newName);
+    }
+}
+
+static void findLoopLocals(const CExpression* expr, CArrayList<SStringSlice>* names)
+{
+    if(!expr) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_ASSIGNMENT) {
+        const CIdentExpression* lValueExpr = static_cast<const CIdentExpression*>(static_cast<const CAssignmentExpression*>(expr)->Expr1.Ptr());
+
+        if((lValueExpr->IsAuto || !lValueExpr->TypeAsInCode.IsVoid())
+        && !isLoopLocalName(lValueExpr->Name)
+        && !names->Contains(lValueExpr->Name))
+        {
+            names->Add(lValueExpr->Name);
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        findLoopLocals(subExprAt(expr, i), names);
+    }
+}
+
+// NOTE Names which start with a digit can't be produced by the parser, so they never conflict with user names.
+SStringSlice STransformer::newLoopLocalName(const SStringSlice& name)
+{
+    Auto<const CString> oldName (name.ToString());
+    Auto<const CString> newName (CString::Format("0%o_%d", static_cast<const CObject*>(oldName.Ptr()), domain->NewUniqueId()));
+    return domain->NewSlice(newName);
+}
+
+void STransformer::renameLoopLocals(CBodyExpression* bodyExpr)
+{
+    Auto<CArrayList<SStringSlice> > names (new CArrayList<SStringSlice>());
+    findLoopLocals(bodyExpr, names);
+
+    for(int i = 0; i < names->Count(); i++) {
+        const SStringSlice& name = names->Array()[i];
+        renameIdentsInBody(bodyExpr, name, newLoopLocalName(name));
+    }
+}
+
+// Range loops and while loops with literal closures are converted to C loops which call no closures, so that
+// numeric loops run at C speed. The bodies become part of the enclosing method, the same way inlined conditions
+// do (see CInlinedConditionExpression).
+CExpression* STransformer::inlineLoop(CCallExpression* callExpr)
+{
+    const CArrayList<CExpression*>* exprs = callExpr->Exprs;
+    const int count = exprs->Count();
+    CExpression* targetExpr = exprs->Item(0);
+    CExpression* lastExpr = exprs->Item(count - 1);
+
+    if(exprs->Item(1)->Kind() != E_EXPRESSIONKIND_IDENT || lastExpr->Kind() != E_EXPRESSIONKIND_BODY) {
+        return nullptr;
+    }
+
+    const SStringSlice& name = static_cast<const CIdentExpression*>(exprs->Item(1))->Name;
+    CBodyExpression* bodyExpr = static_cast<CBodyExpression*>(lastExpr);
+    if(!bodyExpr->Method) {
+        return nullptr;
+    }
+
+    if(targetExpr->InferredType.ResolvedClass == domain->RangeClass()) {
+
+        // ********************************************************************************
+        //   "(0 to 10) loop ^(i: int) {..}" or "(0 to 10) step 2 ^(i: int) {..}"
+        // ********************************************************************************
+
+        const bool isStep = (count == 4) && name.EqualsAscii("step");
+        if(!isStep && !((count == 3) && name.EqualsAscii("loop"))) {
+            return nullptr;
+        }
+
+        if(!bodyExpr->IsCastableToRangeLooper() || !canInlineLoopBody(bodyExpr)) {
+            return nullptr;
+        }
+
+        CExpression* stepExpr = isStep? exprs->Item(2): nullptr;
+        eliminateRangeChecks(targetExpr, stepExpr, bodyExpr);
+
+        CInlinedLoopExpression* loopExpr = new CInlinedLoopExpression();
+        loopExpr->Source = callExpr->Source;
+        loopExpr->RangeExpr.SetVal(targetExpr);
+
+        if(stepExpr) {
+            inferValueExpr(stepExpr, 2);
+
+            if(stepExpr->InferredType.PrimType != E_PRIMTYPE_INT) {
+                ScriptUtils::FailE(domain->FormatMessage("Argument type mismatch for argument '0' of call to 'Range::step': expected 'int', found '%T'.",
+                                                         &stepExpr->InferredType),
+                                   stepExpr);
+            }
+
+            loopExpr->StepExpr.SetVal(stepExpr);
+        }
+
+        // The loop variable becomes a local of the enclosing method.
+        const SStringSlice& indexName = bodyExpr->Method->Signature().Params->Item(0)->Name;
+        const SStringSlice newIndexName (newLoopLocalName(indexName));
+        renameIdentsInBody(bodyExpr, indexName, newIndexName);
+        renameLoopLocals(bodyExpr);
+
+        STypeRef indexType;
+        indexType.SetPrimType(E_PRIMTYPE_INT);
+        bool b = ResolveTypeRef(indexType);
+        (void)b;
+        SKIZO_REQ(b, EC_INVALID_STATE);
+
+        loopExpr->IndexExpr.SetPtr(new CIdentExpression(newIndexName));
+        loopExpr->IndexExpr->Source = bodyExpr->Source;
+        loopExpr->IndexExpr->InferredType = indexType;
+        loopExpr->IndexExpr->ResolvedIdent.EType = E_RESOLVEDIDENTTYPE_LOCAL;
+        loopExpr->IndexExpr->ResolvedIdent.AsLocal_ = curMethod->NewLocal(newIndexName, indexType);
+
+        loopExpr->Body.SetVal(bodyExpr);
+        inferBodyStatements(bodyExpr, nullptr, true);
+        return loopExpr;
+
+    } else if((targetExpr->Kind() == E_EXPRESSIONKIND_IDENT)
+           && (static_cast<CIdentExpression*>(targetExpr)->ResolvedIdent.EType == E_RESOLVEDIDENTTYPE_CLASS)
+           && (static_cast<CIdentExpression*>(targetExpr)->ResolvedIdent.AsClass_ == domain->BoolClass())
+           && (count == 4)
+           && name.EqualsAscii("while"))
+    {
+
+        // ***********************************************
+        //   "bool while ^(): bool { return x; } ^{..}"
+        // ***********************************************
+
+        CExpression* condExpr = predicateCondition(exprs->Item(2));
+        if(!condExpr || !bodyExpr->IsCastableToAction() || !canInlineLoopBody(bodyExpr)) {
+            return nullptr;
+        }
+
+        CInlinedLoopExpression* loopExpr = new CInlinedLoopExpression();
+        loopExpr->Source = callExpr->Source;
+
+        inferValueExpr(condExpr, 1);
+        if(condExpr->InferredType.ResolvedClass != domain->BoolClass()) {
+            ScriptUtils::FailE(domain->FormatMessage("Type mismatch in the condition of 'bool::while': expected 'bool', found '%T'.",
+                                                     &condExpr->InferredType),
+                               condExpr);
+        }
+        loopExpr->Condition.SetVal(condExpr);
+
+        renameLoopLocals(bodyExpr);
+        loopExpr->Body.SetVal(bodyExpr);
+        inferBodyStatements(bodyExpr, nullptr, true);
+        return loopExpr;
+
+    } else {
+        return nullptr;
+    }
+}
+
+// *********************
+//   Method inlining.
+// *********************
+
+static bool hasNoInlineAttribute(const CMethod* method)
+{
+    const CArrayList<CAttribute*>* attrs = method->Attributes();
+    if(attrs) {
+        for(int i = 0; i < attrs->Count(); i++) {
+            if(attrs->Array()[i]->Name.EqualsAscii("noinline")) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static int exprSize(const CExpression* expr)
+{
+    if(!expr) {
+        return 0;
+    }
+
+    int size = 1;
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        size += exprSize(subExprAt(expr, i));
+    }
+
+    return size;
+}
+
+// Built-in operations which the emitter maps to C operators (see NeutralNameToPrimitiveOperator(..)) never fail,
+// except for integer division which checks the divisor (see _so_int_op_divide).
+static bool isNonFailingPrimitiveOp(const CCallExpression* callExpr)
+{
+    if(callExpr->CallType != E_CALLEXPRESSION_METHODCALL || callExpr->Exprs->Count() != 3) {
+        return false;
+    }
+
+    const CClass* klass = callExpr->uTargetMethod->DeclaringClass();
+    if(klass->PrimitiveType() == E_PRIMTYPE_OBJECT || klass->PrimitiveType() == E_PRIMTYPE_VOID) {
+        return false;
+    }
+
+    const SStringSlice& name = callExpr->uTargetMethod->Name();
+    if(name.EqualsAscii("op_divide") || name.EqualsAscii("op_modulo")) {
+        return klass->PrimitiveType() != E_PRIMTYPE_INT;
+    }
+
+    return name.EqualsAscii("op_add")
+        || name.EqualsAscii("op_subtract")
+        || name.EqualsAscii("op_multiply")
+        || name.EqualsAscii("op_equals")
+        || name.EqualsAscii("op_greaterThan")
+        || name.EqualsAscii("op_lessThan")
+        || name.EqualsAscii("op_or")
+        || name.EqualsAscii("op_and");
+}
+
+// An inlined expression is emitted inside the caller, so anything that depends on the callee's own C frame (locals,
+// closures, inline C, non-local control flow) disqualifies the method. Fields are accessed through the caller's
+// "self" expression, so only the callee's own fields are supported.
+// If "allowCalls" is false, only calls which can't fail are allowed (see isNonFailingPrimitiveOp(..)).
+static bool isInlinableExpr(const CExpression* expr, const CMethod* method, bool allowCalls)
+{
+    if(!expr) {
+        return true;
+    }
+
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_IDENT:
+        {
+            const SResolvedIdentType& resolvedIdent = static_cast<const CIdentExpression*>(expr)->ResolvedIdent;
+
+            if(resolvedIdent.EType == E_RESOLVEDIDENTTYPE_LOCAL) {
+                return false;
+            }
+            if(resolvedIdent.EType == E_RESOLVEDIDENTTYPE_FIELD
+            && !resolvedIdent.AsField_->IsStatic
+            && resolvedIdent.AsField_->DeclaringClass != method->DeclaringClass())
+            {
+                return false;
+            }
+        }
+        break;
+
+        case E_EXPRESSIONKIND_CALL:
+            if(!allowCalls && !isNonFailingPrimitiveOp(static_cast<const CCallExpression*>(expr))) {
+                return false;
+            }
+            break;
+
+        case E_EXPRESSIONKIND_BODY:
+        case E_EXPRESSIONKIND_CCODE:
+        case E_EXPRESSIONKIND_REF:
+        case E_EXPRESSIONKIND_ARRAYINIT:
+        case E_EXPRESSIONKIND_RETURN:
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+        case E_EXPRESSIONKIND_ABORT:
+        case E_EXPRESSIONKIND_ASSERT:
+        case E_EXPRESSIONKIND_BREAK:
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+            return false;
+
+        default:
+            break;
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        if(!isInlinableExpr(subExprAt(expr, i), method, allowCalls)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns the expression to inline if the method consists of a single small return statement and can be called
+// directly (static methods, valuetype methods and methods which are never overriden or effectively final), null
+// otherwise.
+static const CExpression* inlinableReturnExpr(const CMethod* method, bool allowCalls)
+{
+    if(method->SpecialMethod() != E_SPECIALMETHOD_NONE
+    || method->MethodKind() != E_METHODKIND_NORMAL
+    || method->IsAbstract()
+    || (method->IsTrulyVirtual() && !method->IsEffectivelyFinal())
+    || method->IsUnsafe()
+    || method->HasBreakExprs()
+    || method->ClosureEnvClass()
+    || method->ParentMethod()
+    || method->DeclaringClass()->SpecialClass() != E_SPECIALCLASS_NONE
+    || hasNoInlineAttribute(method))
+    {
+        return nullptr;
+    }
+
+    // Static methods of classes with static constructors check if the class was initialized (see _soX_checktype).
+    if(method->Signature().IsStatic && method->DeclaringClass()->StaticCtor()) {
+        return nullptr;
+    }
+
+    const CBodyExpression* bodyExpr = method->Expression();
+    if(!bodyExpr || bodyExpr->Exprs->Count() != 1 || bodyExpr->Exprs->Item(0)->Kind() != E_EXPRESSIONKIND_RETURN) {
+        return nullptr;
+    }
+
+    const CExpression* retExpr = static_cast<const CReturnExpression*>(bodyExpr->Exprs->Item(0))->Expr;
+    if(!retExpr || exprSize(retExpr) > SKIZO_INLINE_MAX_SIZE || !isInlinableExpr(retExpr, method, allowCalls)) {
+        return nullptr;
+    }
+
+    return retExpr;
+}
+
+// Comma expressions with struct values are avoided (see SEmitter::emitInlinedCallExpr(..)).
+static bool isStructType(const STypeRef& typeRef)
+{
+    return typeRef.ResolvedClass && typeRef.ResolvedClass->IsValueType() && typeRef.PrimType == E_PRIMTYPE_OBJECT;
+}
+
+bool STransformer::canInlineCall(const CCallExpression* callExpr, const CMethod* callerMethod) const
+{
+    const CMethod* targetMethod = callExpr->uTargetMethod;
+    if(targetMethod == callerMethod) {
+        return false;
+    }
+
+    // Stack traces: inlined methods have no frames of their own, so only expressions which can't fail (and
+    // therefore never show up in a stack trace) are inlined, except for the null check of the receiver, which
+    // attributes the failure to the inlined method itself (see SEmitter::emitInlinedCallExpr(..)).
+    const CExpression* retExpr = inlinableReturnExpr(targetMethod, !domain->StackTraceEnabled());
+    if(!retExpr) {
+        return false;
+    }
+
+    // Arguments are evaluated where the params are referenced. Arguments with side effects are evaluated
+    // exactly once, into temporaries, before the return expression (which becomes the last operand of a comma
+    // expression), the same as with a call. See SEmitter::emitInlinedCallExpr(..)
+    const CArrayList<CParam*>* params = targetMethod->Signature().Params;
+    if(callExpr->Exprs->Count() != params->Count() + 2) {
+        return false;
+    }
+
+    bool needsComma = false;
+    for(int i = 0; i < params->Count(); i++) {
+        if(!callExpr->Exprs->Item(i + 2)->IsStable()) {
+            if(isStructType(params->Item(i)->Type)) {
+                return false;
+            }
+            needsComma = true;
+        }
+    }
+
+    if(!targetMethod->Signature().IsStatic) {
+        const CExpression* selfExpr = callExpr->Exprs->Item(0);
+
+        if(targetMethod->DeclaringClass()->IsValueType()) {
+            // Fields of temporary valuetype objects aren't accessed directly (see SEmitter::emitCallExpr(..) for
+            // simple getters).
+            if(selfExpr->Kind() != E_EXPRESSIONKIND_IDENT && selfExpr->Kind() != E_EXPRESSIONKIND_THIS) {
+                return false;
+            }
+        } else {
+            // The null check of the callee's prolog is emitted inline.
+            if(selfExpr->Kind() != E_EXPRESSIONKIND_THIS && (domain->ExplicitNullCheck() || domain->StackTraceEnabled())) {
+                needsComma = true;
+            }
+
+            if(!selfExpr->IsStable()) {
+                needsComma = true;
+            }
+        }
+    }
+
+    return !needsComma || !isStructType(targetMethod->Signature().ReturnType);
+}
+
+void STransformer::inlineCalls(CExpression* expr, const CMethod* callerMethod)
+{
+    if(!expr) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_CALL) {
+        CCallExpression* callExpr = static_cast<CCallExpression*>(expr);
+
+        if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL) {
+            callExpr->IsInlined = canInlineCall(callExpr, callerMethod);
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        inlineCalls(subExprAt(expr, i), callerMethod);
+    }
+}
+
+// Methods with bodies declared in the class (inherited methods are taken care of by their declaring classes).
+static void getMethodsWithBodies(const CClass* pClass, CArrayList<CMethod*>* out)
+{
+    for(int k = 0; k < 3; k++) {
+        const CArrayList<CMethod*>* methods;
+        switch(k) {
+            case 0: methods = pClass->InstanceCtors(); break;
+            case 1: methods = pClass->InstanceMethods(); break;
+            default: methods = pClass->StaticMethods(); break;
+        }
+
+        for(int j = 0; j < methods->Count(); j++) {
+            CMethod* method = methods->Array()[j];
+
+            if(method->DeclaringClass() == pClass && method->Expression()) {
+                out->Add(method);
+            }
+        }
+    }
+
+    CMethod* specialMethods[] = { pClass->StaticCtor(), pClass->InstanceDtor(), pClass->StaticDtor() };
+    for(int j = 0; j < 3; j++) {
+        if(specialMethods[j] && specialMethods[j]->Expression()) {
+            out->Add(specialMethods[j]);
+        }
+    }
+}
+
+void STransformer::inlineCalls(CClass* pClass)
+{
+    // The profiler and the soft debugger work on a per-method basis.
+    if(domain->ProfilingEnabled() || domain->SoftDebuggingEnabled()) {
+        return;
+    }
+
+    Auto<CArrayList<CMethod*> > methods (new CArrayList<CMethod*>());
+    getMethodsWithBodies(pClass, methods);
+
+    for(int i = 0; i < methods->Count(); i++) {
+        CMethod* method = methods->Array()[i];
+        inlineCalls(method->Expression(), method);
+    }
+}
+
+// *********************
+//   Constant folding.
+// *********************
+
+static bool isConstExpr(const CExpression* expr)
+{
+    if(!expr) {
+        return false;
+    }
+
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_INTCONSTANT:
+        case E_EXPRESSIONKIND_FLOATCONSTANT:
+        case E_EXPRESSIONKIND_BOOLCONSTANT:
+        case E_EXPRESSIONKIND_CHARLITERAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isBoolConstExpr(const CExpression* expr, bool value)
+{
+    return expr
+        && expr->Kind() == E_EXPRESSIONKIND_BOOLCONSTANT
+        && static_cast<const CBoolConstantExpression*>(expr)->Value == value;
+}
+
+static SVariant constExprValue(const CExpression* expr)
+{
+    SVariant r;
+
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_INTCONSTANT:
+            r.SetInt(static_cast<const CIntegerConstantExpression*>(expr)->Value);
+            break;
+        case E_EXPRESSIONKIND_FLOATCONSTANT:
+            r.SetFloat(static_cast<const CFloatConstantExpression*>(expr)->Value);
+            break;
+        case E_EXPRESSIONKIND_BOOLCONSTANT:
+            r.SetBool(static_cast<const CBoolConstantExpression*>(expr)->Value);
+            break;
+        case E_EXPRESSIONKIND_CHARLITERAL:
+            r.SetInt((int)static_cast<const CCharLiteralExpression*>(expr)->CharValue);
+            break;
+        default:
+            SKIZO_REQ_NEVER
+            break;
+    }
+
+    return r;
+}
+
+// Float constants are emitted with "%f" (see SEmitter::emitFloatConstExpr(..)), so folding works on the values the
+// C compiler actually sees.
+static float emittedFloat(float value)
+{
+    char buf[128];
+    sprintf(buf, "%f", value);
+    return (float)strtod(buf, nullptr);
+}
+
+static bool isCallTo(const CExpression* expr, const CClass* klass, const char* methodName, int exprCount)
+{
+    if(expr->Kind() != E_EXPRESSIONKIND_CALL) {
+        return false;
+    }
+
+    const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+    return callExpr->CallType == E_CALLEXPRESSION_METHODCALL
+        && callExpr->Exprs->Count() == exprCount
+        && callExpr->uTargetMethod->DeclaringClass() == klass
+        && callExpr->uTargetMethod->Name().EqualsAscii(methodName);
+}
+
+// Children which hold values (as opposed to method names, lvalues, loop variables and bodies) can be replaced with
+// constants. Statements are taken care of by STransformer::foldBodyStatements(..)
+static bool isValueSubExpr(const CExpression* expr, int index)
+{
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_BODY:
+        case E_EXPRESSIONKIND_REF:
+            return false;
+        case E_EXPRESSIONKIND_CALL:
+            return index != 1;
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+            return index == 1;
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+            return index != 2;
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+            return index == 1 || index == 3;
+        default:
+            return true;
+    }
+}
+
+// See isValueSubExpr(..)
+static void setSubExprAt(CExpression* expr, int index, CExpression* subExpr)
+{
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_CALL:
+            static_cast<CCallExpression*>(expr)->Exprs->Set(index, subExpr);
+            break;
+        case E_EXPRESSIONKIND_ARRAYINIT:
+            static_cast<CArrayInitExpression*>(expr)->Exprs->Set(index, subExpr);
+            break;
+        case E_EXPRESSIONKIND_RETURN:
+            static_cast<CReturnExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_CAST:
+            static_cast<CCastExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_ARRAYCREATION:
+            static_cast<CArrayCreationExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_IS:
+            static_cast<CIsExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_ABORT:
+            static_cast<CAbortExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_ASSERT:
+            static_cast<CAssertExpression*>(expr)->Expr.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_IDENTITYCOMPARISON:
+        {
+            CIdentityComparisonExpression* identCompExpr = static_cast<CIdentityComparisonExpression*>(expr);
+            if(index == 0) {
+                identCompExpr->Expr1.SetVal(subExpr);
+            } else {
+                identCompExpr->Expr2.SetVal(subExpr);
+            }
+        }
+        break;
+        case E_EXPRESSIONKIND_ASSIGNMENT:
+            SKIZO_REQ_EQUALS(index, 1);
+            static_cast<CAssignmentExpression*>(expr)->Expr2.SetVal(subExpr);
+            break;
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+        {
+            CInlinedConditionExpression* condExpr = static_cast<CInlinedConditionExpression*>(expr);
+            if(index == 0) {
+                condExpr->IfCondition.SetVal(subExpr);
+            } else {
+                condExpr->ElseCondition.SetVal(subExpr);
+            }
+        }
+        break;
+        case E_EXPRESSIONKIND_INLINED_LOOP:
+        {
+            CInlinedLoopExpression* loopExpr = static_cast<CInlinedLoopExpression*>(expr);
+            if(index == 1) {
+                loopExpr->StepExpr.SetVal(subExpr);
+            } else {
+                SKIZO_REQ_EQUALS(index, 3);
+                loopExpr->Condition.SetVal(subExpr);
+            }
+        }
+        break;
+        default:
+            SKIZO_REQ_NEVER
+            break;
+    }
+}
+
+// Finds locals which are assigned only once, in their declarations, and to constants: such locals can be replaced
+// with their values everywhere, including nested closures (locals are identified by their CLocal objects, so
+// shadowing is not a problem). Any other assignment or taking a reference disqualifies a local; inline C code can
+// change any local.
+static void findConstLocals(const CExpression* expr,
+                            CHashMap<const void*, CExpression*>* constLocals,
+                            CHashMap<const void*, bool>* disqualified,
+                            bool* hasCCode)
+{
+    if(!expr) {
+        return;
+    }
+
+    const CIdentExpression* localExpr = nullptr;
+    const CExpression* valueExpr = nullptr;
+
+    if(expr->Kind() == E_EXPRESSIONKIND_ASSIGNMENT) {
+        const CAssignmentExpression* assExpr = static_cast<const CAssignmentExpression*>(expr);
+
+        if(assExpr->Expr1->Kind() == E_EXPRESSIONKIND_IDENT) {
+            localExpr = static_cast<const CIdentExpression*>(assExpr->Expr1.Ptr());
+
+            // Only declarations with initial values are candidates.
+            if(localExpr->IsAuto || !localExpr->TypeAsInCode.IsVoid()) {
+                valueExpr = assExpr->Expr2;
+            }
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_REF) {
+        const CExpression* refExpr = static_cast<const CRefExpression*>(expr)->Expr;
+
+        if(refExpr && refExpr->Kind() == E_EXPRESSIONKIND_IDENT) {
+            localExpr = static_cast<const CIdentExpression*>(refExpr);
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_CCODE) {
+        *hasCCode = true;
+    }
+
+    if(localExpr && localExpr->ResolvedIdent.EType == E_RESOLVEDIDENTTYPE_LOCAL) {
+        const CLocal* local = localExpr->ResolvedIdent.AsLocal_;
+
+        if(isConstExpr(valueExpr)
+        && local->Type.ResolvedClass == valueExpr->InferredType.ResolvedClass
+        && !constLocals->Contains(local)
+        && !disqualified->Contains(local))
+        {
+            constLocals->Set(local, const_cast<CExpression*>(valueExpr));
+        } else {
+            constLocals->Remove(local);
+            disqualified->Set(local, true);
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        findConstLocals(subExprAt(expr, i), constLocals, disqualified, hasCCode);
+    }
+}
+
+CExpression* STransformer::newConstExpr(const CClass* klass, const SVariant& value, const CExpression* origExpr)
+{
+    CExpression* r;
+
+    switch(klass->PrimitiveType()) {
+        case E_PRIMTYPE_INT:
+        {
+            CIntegerConstantExpression* intConstExpr = new CIntegerConstantExpression(value.IntValue());
+            inferIntConstExpr(intConstExpr);
+            r = intConstExpr;
+        }
+        break;
+
+        case E_PRIMTYPE_FLOAT:
+        {
+            CFloatConstantExpression* floatConstExpr = new CFloatConstantExpression(value.FloatValue());
+            inferFloatConstExpr(floatConstExpr);
+            r = floatConstExpr;
+        }
+        break;
+
+        case E_PRIMTYPE_BOOL:
+        {
+            CBoolConstantExpression* boolConstExpr = new CBoolConstantExpression(value.BoolValue());
+            inferBoolConstExpr(boolConstExpr);
+            r = boolConstExpr;
+        }
+        break;
+
+        case E_PRIMTYPE_CHAR:
+        {
+            CCharLiteralExpression* charLitExpr = new CCharLiteralExpression((so_char16)value.IntValue());
+            inferCharLitExpr(charLitExpr);
+            r = charLitExpr;
+        }
+        break;
+
+        default:
+            SKIZO_REQ_NEVER
+            return nullptr;
+    }
+
+    r->Source = origExpr->Source;
+    return r;
+}
+
+// Built-in operations of int, float, bool and char with constant operands (the same methods the emitter maps to C
+// operators, see NeutralNameToPrimitiveOperator(..)), plus "bool::not" and branches which are never taken.
+CExpression* STransformer::evalPrimitiveOp(const CCallExpression* callExpr)
+{
+    const CClass* klass = callExpr->uTargetMethod->DeclaringClass();
+    const SStringSlice& name = callExpr->uTargetMethod->Name();
+    const CArrayList<CExpression*>* exprs = callExpr->Exprs;
+    const CExpression* selfExpr = exprs->Item(0);
+
+    if(!isConstExpr(selfExpr) || selfExpr->InferredType.ResolvedClass != klass) {
+        return nullptr;
+    }
+
+    SVariant r;
+    const CClass* resultClass = klass;
+
+    if(exprs->Count() == 2) {
+        if(klass == domain->BoolClass() && name.EqualsAscii("not")) {
+            r.SetBool(!static_cast<const CBoolConstantExpression*>(selfExpr)->Value);
+        } else {
+            return nullptr;
+        }
+    } else if(exprs->Count() == 3 && klass == domain->BoolClass()
+           && (name.EqualsAscii("then") || name.EqualsAscii("else")))
+    {
+        // "then" returns the same value, "else" returns an inverted value; the closure is run only if the value is
+        // true (false for "else").
+        const bool value = static_cast<const CBoolConstantExpression*>(selfExpr)->Value;
+        if(name.EqualsAscii("then") == value) {
+            return nullptr;
+        }
+
+        domain->ConstantFoldingStats().DeadBranchCount++;
+        r.SetBool(false);
+        return newConstExpr(domain->BoolClass(), r, callExpr);
+    } else if(exprs->Count() == 3) {
+        const CExpression* argExpr = exprs->Item(2);
+        if(!isConstExpr(argExpr) || argExpr->Kind() != selfExpr->Kind()) {
+            return nullptr;
+        }
+
+        const SVariant a (constExprValue(selfExpr));
+        const SVariant b (constExprValue(argExpr));
+
+        switch(selfExpr->Kind()) {
+            case E_EXPRESSIONKIND_INTCONSTANT:
+            {
+                const int x = a.IntValue(), y = b.IntValue();
+
+                // Same as in C: wraps around on overflow.
+                if(name.EqualsAscii("op_add")) {
+                    r.SetInt((int)((so_uint32)x + (so_uint32)y));
+                } else if(name.EqualsAscii("op_subtract")) {
+                    r.SetInt((int)((so_uint32)x - (so_uint32)y));
+                } else if(name.EqualsAscii("op_multiply")) {
+                    r.SetInt((int)((so_uint32)x * (so_uint32)y));
+                } else if(name.EqualsAscii("op_divide") || name.EqualsAscii("op_modulo")) {
+                    // Division by zero aborts at runtime (see _so_int_op_divide). Division by -1 wraps around on
+                    // overflow, the same way it does at runtime.
+                    if(y == 0) {
+                        return nullptr;
+                    } else if(y == -1) {
+                        r.SetInt(name.EqualsAscii("op_divide")? (int)(0u - (so_uint32)x): 0);
+                    } else {
+                        r.SetInt(name.EqualsAscii("op_divide")? (x / y): (x % y));
+                    }
+                } else if(name.EqualsAscii("op_and")) {
+                    r.SetInt(x & y);
+                } else if(name.EqualsAscii("op_or")) {
+                    r.SetInt(x | y);
+                } else if(name.EqualsAscii("op_equals")) {
+                    r.SetBool(x == y);
+                } else if(name.EqualsAscii("op_greaterThan")) {
+                    r.SetBool(x > y);
+                } else if(name.EqualsAscii("op_lessThan")) {
+                    r.SetBool(x < y);
+                } else {
+                    return nullptr;
+                }
+
+                // "-2147483648" isn't an int literal in C.
+                if(r.Type() == E_VARIANTTYPE_INT && r.IntValue() == INT_MIN) {
+                    return nullptr;
+                }
+            }
+            break;
+
+            case E_EXPRESSIONKIND_FLOATCONSTANT:
+            {
+                const float x = emittedFloat(a.FloatValue()), y = emittedFloat(b.FloatValue());
+
+                if(name.EqualsAscii("op_add")) {
+                    r.SetFloat(x + y);
+                } else if(name.EqualsAscii("op_subtract")) {
+                    r.SetFloat(x - y);
+                } else if(name.EqualsAscii("op_multiply")) {
+                    r.SetFloat(x * y);
+                } else if(name.EqualsAscii("op_divide")) {
+                    r.SetFloat(x / y);
+                } else if(name.EqualsAscii("op_equals")) {
+                    r.SetBool(x == y);
+                } else if(name.EqualsAscii("op_greaterThan")) {
+                    r.SetBool(x > y);
+                } else if(name.EqualsAscii("op_lessThan")) {
+                    r.SetBool(x < y);
+                } else {
+                    return nullptr;
+                }
+
+                // Results the emitter can't reproduce exactly are left to runtime.
+                if(r.Type() == E_VARIANTTYPE_FLOAT
+                && (!isfinite(r.FloatValue()) || emittedFloat(r.FloatValue()) != r.FloatValue()))
+                {
+                    return nullptr;
+                }
+            }
+            break;
+
+            case E_EXPRESSIONKIND_BOOLCONSTANT:
+            case E_EXPRESSIONKIND_CHARLITERAL:
+            {
+                if(name.EqualsAscii("op_equals")) {
+                    r.SetBool(selfExpr->Kind() == E_EXPRESSIONKIND_BOOLCONSTANT? (a.BoolValue() == b.BoolValue())
+                                                                                : (a.IntValue() == b.IntValue()));
+                } else {
+                    return nullptr;
+                }
+            }
+            break;
+
+            default:
+                return nullptr;
+        }
+    } else {
+        return nullptr;
+    }
+
+    if(r.Type() == E_VARIANTTYPE_BOOL) {
+        resultClass = domain->BoolClass();
+    }
+
+    domain->ConstantFoldingStats().FoldedExprCount++;
+    return newConstExpr(resultClass, r, callExpr);
+}
+
+CExpression* STransformer::evalConstExpr(const CExpression* expr, const CHashMap<const void*, CExpression*>* constLocals)
+{
+    const CConst* konst = nullptr;
+
+    if(expr->Kind() == E_EXPRESSIONKIND_IDENT) {
+        const CIdentExpression* identExpr = static_cast<const CIdentExpression*>(expr);
+
+        if(identExpr->ResolvedIdent.EType == E_RESOLVEDIDENTTYPE_LOCAL && constLocals) {
+            CExpression* valueExpr;
+            if(constLocals->TryGet(identExpr->ResolvedIdent.AsLocal_, &valueExpr)) {
+                Auto<CExpression> valueExprRef (valueExpr); // TryGet(..) adds a reference
+
+                domain->ConstantFoldingStats().PropagatedLocalCount++;
+                return newConstExpr(valueExpr->InferredType.ResolvedClass, constExprValue(valueExpr), expr);
+            }
+        } else if(identExpr->ResolvedIdent.EType == E_RESOLVEDIDENTTYPE_CONST) {
+            konst = identExpr->ResolvedIdent.AsConst_;
+        }
+    } else if(expr->Kind() == E_EXPRESSIONKIND_CALL) {
+        const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+
+        if(callExpr->CallType == E_CALLEXPRESSION_CONSTACCESS) {
+            konst = callExpr->uTargetConst;
+        } else if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL) {
+            return evalPrimitiveOp(callExpr);
+        }
+    }
+
+    // String consts are left as they are.
+    if(konst
+    && (konst->Type.PrimType == E_PRIMTYPE_INT
+     || konst->Type.PrimType == E_PRIMTYPE_FLOAT
+     || konst->Type.PrimType == E_PRIMTYPE_BOOL
+     || konst->Type.PrimType == E_PRIMTYPE_CHAR))
+    {
+        SKIZO_REQ_PTR(konst->Type.ResolvedClass);
+
+        domain->ConstantFoldingStats().FoldedExprCount++;
+        return newConstExpr(konst->Type.ResolvedClass, konst->Value, expr);
+    }
+
+    return nullptr;
+}
+
+void STransformer::foldConstants(CExpression* expr, const CHashMap<const void*, CExpression*>* constLocals)
+{
+    if(!expr) {
+        return;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_BODY) {
+        foldBodyStatements(static_cast<CBodyExpression*>(expr), constLocals);
+        return;
+    }
+
+    // Bottom-up, so that "(1 + 2) * 3" is folded in one go.
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        CExpression* subExpr = subExprAt(expr, i);
+        if(!subExpr) {
+            continue;
+        }
+
+        foldConstants(subExpr, constLocals);
+
+        if(isValueSubExpr(expr, i)) {
+            Auto<CExpression> constExpr (evalConstExpr(subExpr, constLocals));
+            if(constExpr) {
+                setSubExprAt(expr, i, constExpr);
+            }
+        }
+    }
+}
+
+void STransformer::foldBodyStatements(CBodyExpression* bodyExpr, const CHashMap<const void*, CExpression*>* constLocals)
+{
+    const CArrayList<CExpression*>* exprs = bodyExpr->Exprs;
+    Auto<CArrayList<CExpression*> > newExprs (new CArrayList<CExpression*>());
+    bool isChanged = false;
+
+    for(int i = 0; i < exprs->Count(); i++) {
+        CExpression* subExpr = exprs->Array()[i];
+        foldConstants(subExpr, constLocals);
+
+        if(subExpr->Kind() == E_EXPRESSIONKIND_INLINED_CONDITION) {
+            const CInlinedConditionExpression* condExpr = static_cast<const CInlinedConditionExpression*>(subExpr);
+
+            // Locals of inlined bodies are locals of the enclosing method, so the statements can be moved as is.
+            if(condExpr->IfCondition->Kind() == E_EXPRESSIONKIND_BOOLCONSTANT) {
+                if(static_cast<const CBoolConstantExpression*>(condExpr->IfCondition.Ptr())->Value) {
+                    newExprs->AddRange(condExpr->Body->Exprs);
+                }
+
+                domain->ConstantFoldingStats().DeadBranchCount++;
+                isChanged = true;
+                continue;
+            }
+        } else if(subExpr->Kind() == E_EXPRESSIONKIND_INLINED_LOOP) {
+            if(isBoolConstExpr(static_cast<const CInlinedLoopExpression*>(subExpr)->Condition, false)) {
+                domain->ConstantFoldingStats().DeadBranchCount++;
+                isChanged = true;
+                continue;
+            }
+        } else if(isCallTo(subExpr, domain->BoolClass(), "else", 3)) {
+            // "(true then ^{..}) else ^{..}" as a statement (the return value is discarded).
+            CExpression* thenExpr = static_cast<const CCallExpression*>(subExpr)->Exprs->Item(0);
+
+            if(isCallTo(thenExpr, domain->BoolClass(), "then", 3)
+            && isBoolConstExpr(static_cast<const CCallExpression*>(thenExpr)->Exprs->Item(0), true))
+            {
+                newExprs->Add(thenExpr);
+
+                domain->ConstantFoldingStats().DeadBranchCount++;
+                isChanged = true;
+                continue;
+            }
+        }
+
+        // A statement which evaluates to a constant has no side effects (the emitter doesn't accept constants as
+        // statements anyway).
+        Auto<CExpression> constExpr (evalConstExpr(subExpr, constLocals));
+        if(constExpr) {
+            isChanged = true;
+            continue;
+        }
+
+        newExprs->Add(subExpr);
+    }
+
+    if(isChanged) {
+        bodyExpr->Exprs.SetVal(newExprs);
+    }
+}
+
+void STransformer::foldConstants(CClass* pClass)
+{
+    Auto<CArrayList<CMethod*> > methods (new CArrayList<CMethod*>());
+    getMethodsWithBodies(pClass, methods);
+
+    for(int i = 0; i < methods->Count(); i++) {
+        CBodyExpression* bodyExpr = methods->Array()[i]->Expression();
+
+        foldConstants(bodyExpr, nullptr);
+
+        // Locals are found after the first pass, as their initial values may need folding themselves. The second
+        // pass folds expressions which become constant after propagation.
+        Auto<CHashMap<const void*, CExpression*> > constLocals (new CHashMap<const void*, CExpression*>());
+        Auto<CHashMap<const void*, bool> > disqualified (new CHashMap<const void*, bool>());
+        bool hasCCode = false;
+        findConstLocals(bodyExpr, constLocals, disqualified, &hasCCode);
+
+        if(!hasCCode && constLocals->Size() > 0) {
+            foldConstants(bodyExpr, constLocals);
+        }
+    }
+}
+
+// ***********************
+//   Devirtualization.
+// ***********************
+
+// NOTE Closures are skipped: they're counted as bodies of their generated classes. Bodies of inlined conditions
+// and loops have no generated classes.
+static int countDevirtualizedCalls(const CExpression* expr, bool isRoot = true)
+{
+    if(!expr) {
+        return 0;
+    }
+    if(!isRoot
+    && expr->Kind() == E_EXPRESSIONKIND_BODY
+    && static_cast<const CBodyExpression*>(expr)->GeneratedClosureClass)
+    {
+        return 0;
+    }
+
+    int r = 0;
+    if(expr->Kind() == E_EXPRESSIONKIND_CALL) {
+        const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+
+        if(callExpr->CallType == E_CALLEXPRESSION_METHODCALL && callExpr->uTargetMethod->IsEffectivelyFinal()) {
+            r++;
+        }
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        r += countDevirtualizedCalls(subExprAt(expr, i), false);
+    }
+
+    return r;
+}
+
+// The whole program is known at this point (there's no separate compilation), so if no subclass replaces a method
+// in its vtable slot, every receiver which has the method in the slot ends up calling this very method.
+void STransformer::devirtualizeCalls()
+{
+    const CArrayList<CClass*>* klasses = domain->Classes();
+
+    // Vtable slots are assigned by CClass::MakeSureMethodsFinalized(): a subclass' list of instance methods starts
+    // with the methods of the base class, overriden methods replace the base ones at the same indices.
+    for(int i = 0; i < klasses->Count(); i++) {
+        CClass* klass = klasses->Array()[i];
+        if(klass->SpecialClass() == E_SPECIALCLASS_ALIAS) {
+            continue;
+        }
+        klass->MakeSureMethodsFinalized();
+
+        if(klass->SpecialClass() != E_SPECIALCLASS_NONE) {
+            continue;
+        }
+
+        const CArrayList<CMethod*>* methods = klass->InstanceMethods();
+        for(int j = 0; j < methods->Count(); j++) {
+            CMethod* method = methods->Array()[j];
+
+            if(method->DeclaringClass() == klass && method->IsTrulyVirtual() && !method->IsAbstract()) {
+                method->Flags() |= E_METHODFLAGS_IS_EFFECTIVELY_FINAL;
+            }
+        }
+    }
+
+    for(int i = 0; i < klasses->Count(); i++) {
+        const CClass* klass = klasses->Array()[i];
+        const CClass* baseClass = klass->ResolvedBaseClass();
+        if(klass->SpecialClass() == E_SPECIALCLASS_ALIAS || !baseClass) {
+            continue;
+        }
+
+        const CArrayList<CMethod*>* methods = klass->InstanceMethods();
+        const CArrayList<CMethod*>* baseMethods = baseClass->InstanceMethods();
+        for(int j = 0; j < baseMethods->Count(); j++) {
+            CMethod* baseMethod = baseMethods->Array()[j];
+
+            if(j >= methods->Count() || methods->Array()[j] != baseMethod) {
+                baseMethod->Flags() &= ~E_METHODFLAGS_IS_EFFECTIVELY_FINAL;
+            }
+        }
+    }
+
+    int devirtualizedCallCount = 0;
+    Auto<CArrayList<CMethod*> > methods (new CArrayList<CMethod*>());
+    for(int i = 0; i < klasses->Count(); i++) {
+        const CClass* klass = klasses->Array()[i];
+        if(klass->SpecialClass() == E_SPECIALCLASS_ALIAS) {
+            continue;
+        }
+
+        methods->Clear();
+        getMethodsWithBodies(klass, methods);
+        for(int j = 0; j < methods->Count(); j++) {
+            devirtualizedCallCount += countDevirtualizedCalls(methods->Array()[j]->Expression());
+        }
+    }
+    domain->SetDevirtualizedCallCount(devirtualizedCallCount);
+}
+
+// ****************************************
+//   Escape analysis for closures.
+// ****************************************
+
+// The same rules the emitter uses to by-pass the vtable (see SEmitter::emitCallExpr(..)): only then the callee which
+// is analyzed is the callee which is actually called.
+static bool isStaticallyBound(const CMethod* method)
+{
+    if(method->DeclaringClass()->SpecialClass() == E_SPECIALCLASS_INTERFACE || method->IsAbstract()) {
+        return false;
+    }
+
+    return method->Signature().IsStatic
+        || method->MethodKind() == E_METHODKIND_CTOR
+        || !method->IsTrulyVirtual()
+        || method->IsEffectivelyFinal();
+}
+
+// Native methods marked with "[noescape]" only invoke the closures passed to them and never store them (see
+// icalls/bool.cpp, icalls/Range.cpp and icalls/Map.cpp). Methods with bodies are analyzed instead, so the attribute
+// isn't trusted for them.
+static bool isNonStoringNativeMethod(const CMethod* method)
+{
+    if(method->SpecialMethod() != E_SPECIALMETHOD_NATIVE) {
+        return false;
+    }
+
+    const CArrayList<CAttribute*>* attrs = method->Attributes();
+    if(attrs) {
+        for(int i = 0; i < attrs->Count(); i++) {
+            if(attrs->Array()[i]->Name.EqualsAscii("noescape")) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool isParamIdent(const CExpression* expr, const CParam* param)
+{
+    if(expr->Kind() != E_EXPRESSIONKIND_IDENT) {
+        return false;
+    }
+
+    const SResolvedIdentType& resolvedIdent = static_cast<const CIdentExpression*>(expr)->ResolvedIdent;
+    return resolvedIdent.EType == E_RESOLVEDIDENTTYPE_PARAM && resolvedIdent.AsParam_ == param;
+}
+
+static bool isClosureLiteral(const CExpression* expr)
+{
+    return expr->Kind() == E_EXPRESSIONKIND_BODY && static_cast<const CBodyExpression*>(expr)->GeneratedClosureClass;
+}
+
+bool STransformer::isNonEscapingArg(const CCallExpression* callExpr,
+                                    int argIndex,
+                                    CHashMap<const void*, bool>* nonEscapingParams)
+{
+    if(callExpr->CallType != E_CALLEXPRESSION_METHODCALL) {
+        return false;
+    }
+
+    const CMethod* targetMethod = callExpr->uTargetMethod;
+    if(!isStaticallyBound(targetMethod)) {
+        return false;
+    }
+    if(isNonStoringNativeMethod(targetMethod)) {
+        return true;
+    }
+
+    // Everything else which has no body (ECalls, foreign methods etc.) is opaque. Closures' "invoke" methods are
+    // cloned from anonymous methods, so their bodies may refer to the params of the originals.
+    const CArrayList<CParam*>* params = targetMethod->Signature().Params;
+    if(!targetMethod->Expression()
+    || targetMethod->DeclaringClass()->SpecialClass() == E_SPECIALCLASS_METHODCLASS
+    || (argIndex - 2) >= params->Count())
+    {
+        return false;
+    }
+
+    const CParam* param = params->Array()[argIndex - 2];
+    if(param->IsCaptured) {
+        return false;
+    }
+
+    bool r;
+    if(nonEscapingParams->TryGet(param, &r)) {
+        return r;
+    }
+
+    // Recursive methods are conservatively assumed to store the param until proven otherwise.
+    nonEscapingParams->Set(param, false);
+    r = !doesParamEscape(targetMethod->Expression(), param, nonEscapingParams);
+    nonEscapingParams->Set(param, r);
+
+    return r;
+}
+
+// The param doesn't escape if it's only ever invoked or passed to non-escaping params of other methods.
+bool STransformer::doesParamEscape(const CExpression* expr,
+                                   const CParam* param,
+                                   CHashMap<const void*, bool>* nonEscapingParams)
+{
+    if(!expr) {
+        return false;
+    }
+
+    switch(expr->Kind()) {
+        case E_EXPRESSIONKIND_IDENT:
+            return isParamIdent(expr, param);
+
+        // Inline C code can do anything with the param.
+        case E_EXPRESSIONKIND_CCODE:
+            return true;
+
+        case E_EXPRESSIONKIND_CALL:
+        {
+            const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+            if(callExpr->CallType != E_CALLEXPRESSION_METHODCALL) {
+                break;
+            }
+
+            for(int i = 0; i < callExpr->Exprs->Count(); i++) {
+                const CExpression* subExpr = callExpr->Exprs->Array()[i];
+
+                if(subExpr && isParamIdent(subExpr, param)) {
+                    if(i == 0
+                    && callExpr->uTargetMethod->DeclaringClass()->SpecialClass() == E_SPECIALCLASS_METHODCLASS
+                    && !callExpr->uTargetMethod->Signature().IsStatic)
+                    {
+                        continue; // "param invoke ..."
+                    }
+                    if(i >= 2 && isNonEscapingArg(callExpr, i, nonEscapingParams)) {
+                        continue;
+                    }
+
+                    return true;
+                }
+
+                if(doesParamEscape(subExpr, param, nonEscapingParams)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        default:
+            break;
+    }
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        if(doesParamEscape(subExprAt(expr, i), param, nonEscapingParams)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns true if every closure literal found in the expression (nested closures included) doesn't escape.
+bool STransformer::markStackClosures(CExpression* expr, CHashMap<const void*, bool>* nonEscapingParams)
+{
+    if(!expr) {
+        return true;
+    }
+
+    if(expr->Kind() == E_EXPRESSIONKIND_CALL) {
+        const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+
+        for(int i = 2; i < callExpr->Exprs->Count(); i++) {
+            CExpression* argExpr = callExpr->Exprs->Array()[i];
+
+            if(argExpr && isClosureLiteral(argExpr) && isNonEscapingArg(callExpr, i, nonEscapingParams)) {
+                static_cast<CBodyExpression*>(argExpr)->IsStackAllocated = true;
+            }
+        }
+    }
+
+    bool r = !isClosureLiteral(expr) || static_cast<const CBodyExpression*>(expr)->IsStackAllocated;
+
+    const int count = subExprCount(expr);
+    for(int i = 0; i < count; i++) {
+        if(!markStackClosures(subExprAt(expr, i), nonEscapingParams)) {
+            r = false;
+        }
+    }
+
+    return r;
+}
+
+void STransformer::allocateClosuresOnStack()
+{
+    // The soft debugger may keep references to closures and environments between breakpoints.
+    if(domain->SoftDebuggingEnabled()) {
+        return;
+    }
+
+    const CArrayList<CClass*>* klasses = domain->Classes();
+    Auto<CHashMap<const void*, bool> > nonEscapingParams (new CHashMap<const void*, bool>());
+    Auto<CArrayList<CMethod*> > methods (new CArrayList<CMethod*>());
+
+    for(int i = 0; i < klasses->Count(); i++) {
+        const CClass* klass = klasses->Array()[i];
+        if(klass->SpecialClass() == E_SPECIALCLASS_ALIAS) {
+            continue;
+        }
+
+        methods->Clear();
+        getMethodsWithBodies(klass, methods);
+        for(int j = 0; j < methods->Count(); j++) {
+            CMethod* method = methods->Array()[j];
+            CExpression* rootExpr = method->Expression();
+
+            // The root of a closure's "invoke" is the closure literal itself, which is analyzed in the context of the
+            // enclosing method, so only its contents are visited here.
+            bool noEscapingClosures = true;
+            const int count = subExprCount(rootExpr);
+            for(int k = 0; k < count; k++) {
+                if(!markStackClosures(subExprAt(rootExpr, k), nonEscapingParams)) {
+                    noEscapingClosures = false;
+                }
+            }
+
+            if(noEscapingClosures && method->ClosureEnvClass()) {
+                method->Flags() |= E_METHODFLAGS_IS_ENV_ON_STACK;
+            }
+        }
+    }
+}
+
+// ***********************
+//   Tail calls.
+// ***********************
+
+static bool isSelfTailCall(const CExpression* expr, const CMethod* method)
+{
+    if(!expr || expr->Kind() != E_EXPRESSIONKIND_CALL) {
+        return false;
+    }
+
+    const CCallExpression* callExpr = static_cast<const CCallExpression*>(expr);
+    if(callExpr->CallType != E_CALLEXPRESSION_METHODCALL
+    || callExpr->uTargetMethod != method
+    || callExpr->IsInlined
+    || callExpr->Exprs->Count() != method->Signature().Params->Count() + 2)
+    {
+        return false;
+    }
+
+    // "self" stays the same, so instance methods only qualify if they're called on "this", and the receiver can't
+    // have a different implementation.
+    if(!method->Signature().IsStatic) {
+        return callExpr->Exprs->Item(0)->Kind() == E_EXPRESSIONKIND_THIS && isStaticallyBound(method);
+    }
+
+    return true;
+}
+
+int STransformer::markTailCalls(CBodyExpression* bodyExpr, CMethod* method)
+{
+    const int count = bodyExpr->Exprs->Count();
+    if(!count) {
+        return 0;
+    }
+
+    CExpression* lastExpr = bodyExpr->Exprs->Item(count - 1);
+    CExpression* callExpr = nullptr;
+
+    switch(lastExpr->Kind()) {
+        case E_EXPRESSIONKIND_CALL:
+            // Methods which return nothing.
+            callExpr = lastExpr;
+            break;
+
+        case E_EXPRESSIONKIND_RETURN:
+            callExpr = static_cast<CReturnExpression*>(lastExpr)->Expr;
+            break;
+
+        // Nothing follows the last statement of an inlined branch which is itself in tail position.
+        case E_EXPRESSIONKIND_INLINED_CONDITION:
+            return markTailCalls(static_cast<CInlinedConditionExpression*>(lastExpr)->Body, method);
+
+        default:
+            break;
+    }
+
+    if(!isSelfTailCall(callExpr, method)) {
+        return 0;
+    }
+
+    static_cast<CCallExpression*>(callExpr)->IsTailCall = true;
+    method->Flags() |= E_METHODFLAGS_HAS_TAIL_CALLS;
+    return 1;
+}
+
+int STransformer::eliminateTailCalls(CClass* pClass)
+{
+    // Same as for inlining: the profiler and the soft debugger work on a per-method basis.
+    if(domain->ProfilingEnabled() || domain->SoftDebuggingEnabled()) {
+        return 0;
+    }
+
+    Auto<CArrayList<CMethod*> > methods (new CArrayList<CMethod*>());
+    getMethodsWithBodies(pClass, methods);
+
+    int r = 0;
+    for(int i = 0; i < methods->Count(); i++) {
+        CMethod* method = methods->Array()[i];
+
+        // Inline C code can return early or jump anywhere; closures may capture params and locals which
+        // must be fresh on every call.
+        if(method->MethodKind() != E_METHODKIND_NORMAL
+        || method->SpecialMethod() != E_SPECIALMETHOD_NONE
+        || method->ParentMethod()
+        || method->ClosureEnvClass()
+        || method->IsUnsafe())
+        {
+            continue;
+        }
+
+        r += markTailCalls(method->Expression(), method);
+    }
+
+    return r;
+}
+
 } }
@@ -0,0 +1,91 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "Domain.h"
+
+#include <string.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// Type tests ("is" and downcasts) are answered in constant time with two precomputed tables:
+// 1) Class hierarchy displays. Every class stores its depth in the hierarchy and the list of its ancestors
+//    from the root down to the class itself, so "A is a subclass of B" is a single lookup: A.display[B.depth] == B.
+// 2) Interface conformance bitsets. Every reachable interface is assigned a dense ID, and every reachable class
+//    stores a bitset of the interfaces it conforms to. With structural typing, conformance can't be derived
+//    from the hierarchy, so it's computed here once instead of on demand.
+// Classes and interfaces created after startup have no tables and fall back to the slow path in CClass::Is(..)
+
+static void buildDisplay(CClass* klass, SBumpPointerAllocator& allocator)
+{
+    if(klass->Display()) {
+        return;
+    }
+
+    CClass* baseClass = klass->IsClassHierarchyRoot()? nullptr: klass->ResolvedBaseClass();
+    int depth = 0;
+    if(baseClass) {
+        buildDisplay(baseClass, allocator);
+        depth = baseClass->Depth() + 1;
+    }
+
+    const CClass** display = (const CClass**)allocator.Allocate((depth + 1) * sizeof(CClass*), E_SKIZOALLOCATIONTYPE_CLASS);
+    if(baseClass) {
+        memcpy(display, baseClass->Display(), depth * sizeof(CClass*));
+    }
+    display[depth] = klass;
+
+    klass->SetDisplay(display, depth);
+}
+
+void CDomain::buildTypeTests()
+{
+    SBumpPointerAllocator& allocator = m_memMngr.BumpPointerAllocator();
+
+    Auto<CArrayList<CClass*> > intrfcs (new CArrayList<CClass*>());
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        CClass* klass = m_klasses->Array()[i];
+
+        if(klass->SpecialClass() == E_SPECIALCLASS_INTERFACE && klass->IsReachable()) {
+            klass->SetInterfaceId(intrfcs->Count());
+            intrfcs->Add(klass);
+        }
+    }
+
+    const int wordCount = (intrfcs->Count() + 31) / 32;
+
+    for(int i = 0; i < m_klasses->Count(); i++) {
+        CClass* klass = m_klasses->Array()[i];
+
+        if(!klass->IsReachable() || klass->SpecialClass() == E_SPECIALCLASS_INTERFACE) {
+            continue;
+        }
+
+        buildDisplay(klass, allocator);
+
+        // NOTE Allocated even if there are no interfaces: a null bitset means "unknown, use the slow path".
+        so_uint32* bits = (so_uint32*)allocator.Allocate((wordCount? wordCount: 1) * sizeof(so_uint32), E_SKIZOALLOCATIONTYPE_CLASS);
+        memset(bits, 0, (wordCount? wordCount: 1) * sizeof(so_uint32));
+
+        for(int j = 0; j < intrfcs->Count(); j++) {
+            if(klass->DoesImplementInterfaceNoCache(intrfcs->Array()[j])) {
+                bits[j >> 5] |= (so_uint32)1 << (j & 31);
+            }
+        }
+
+        klass->SetInterfaceBits(bits);
+    }
+}
+
+} }
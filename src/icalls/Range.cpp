@@ -39,8 +39,15 @@ void SKIZO_API _so_Range_step(SRange range, int step, void* rangeLooper)
     typedef void (SKIZO_API * _FRangeLooper)(void*, int);
     _FRangeLooper rangeLoopFunc = (_FRangeLooper)so_invokemethod_of(rangeLooper);
 
+    // "i += step" would overflow with a large step and wrap around to a value which is still less than "range.to":
+    // the loop ends instead once the next value is past the end. The distance is computed in unsigned arithmetic,
+    // as "range.to - i" itself can overflow. Should be synchronized with SEmitter::emitInlinedLoopExpr(..)
     for(int i = range.from; i < range.to; i += step) {
          rangeLoopFunc(rangeLooper, i);
+
+         if(step > 0 && ((so_uint32)range.to - (so_uint32)i) <= (so_uint32)step) {
+             break;
+         }
     }
 }
 
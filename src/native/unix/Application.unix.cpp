@@ -108,6 +108,20 @@ so_long TickCount()
     return theTick;
 }
 
+so_long MicroTickCount()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (so_long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+so_long NanoTickCount()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (so_long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
    // *******************
    //      Launch
    // *******************
@@ -0,0 +1,166 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "../../HardwareExceptions.h"
+#include "../../Domain.h"
+#include "../../RuntimeHelpers.h"
+
+#include <atomic>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+// *****************************************************************************
+// See the comments for the Win32 implementation for additional information.
+// *****************************************************************************
+
+namespace skizo { namespace script { namespace HardwareExceptions {
+using namespace skizo::core;
+
+#define SKIZO_SIGNAL_STACK_SIZE (64 * 1024)
+
+static struct sigaction g_prevSegvAction;
+
+// The stack the domain is aborted on after a stack overflow, as nothing is left of the thread's own stack.
+// NOTE Like the alternate signal stack, it's never freed, the OS reclaims it on process exit.
+static __thread char* g_overflowStack = nullptr;
+
+// A stack overflow faults on the guard page at the end of the thread's stack (or below the end of the main thread's
+// stack which can't grow any further). Frames of emitted code are small, so the faulting address is close to the end.
+static bool isStackOverflow(const CDomain* domain, uintptr_t addr)
+{
+    const uintptr_t stackEnd = (uintptr_t)domain->StackEnd();
+    return stackEnd && addr < (stackEnd + 64 * 1024) && (addr + 64 * 1024) >= stackEnd;
+}
+
+// The faulting context is redirected here: the domain is aborted after the signal handler returns, on an ordinary
+// stack, the same way explicit checks abort it.
+static void abortStub(int errorCode)
+{
+    CDomain::Abort(errorCode);
+}
+
+// Makes the faulting thread resume in abortStub(..) as if the faulting instruction called it with the given stack
+// pointer, so that stack walkers see the faulting frame as the caller.
+static void redirectToAbortStub(ucontext_t* uc, int errorCode, uintptr_t sp)
+{
+    greg_t* regs = uc->uc_mcontext.gregs;
+
+#ifdef __x86_64__
+    // Skips the red zone of the faulting function, the stack is 16-byte aligned at the call.
+    sp = ((sp - 128) & ~(uintptr_t)15) - sizeof(void*);
+    *(greg_t*)sp = regs[REG_RIP];
+    regs[REG_RSP] = (greg_t)sp;
+    regs[REG_RDI] = (greg_t)errorCode;
+    regs[REG_RIP] = (greg_t)&abortStub;
+#else
+    // The argument, then the return address; the stack is 16-byte aligned at the call.
+    sp = (sp & ~(uintptr_t)15) - 16;
+    *(int*)sp = errorCode;
+    sp -= sizeof(void*);
+    *(greg_t*)sp = regs[REG_EIP];
+    regs[REG_ESP] = (greg_t)sp;
+    regs[REG_EIP] = (greg_t)&abortStub;
+#endif
+}
+
+// Faults which aren't ours go to whoever handled SIGSEGV before. The default action (or ignoring, which the OS doesn't
+// allow for faults anyway) is restored for the faulting instruction, which is restarted once the handler returns,
+// faults again and terminates the process as usual. Our handler stays installed in every other case.
+static void forwardToPreviousHandler(int sig, siginfo_t* info, void* context)
+{
+    if(g_prevSegvAction.sa_flags & SA_SIGINFO) {
+        g_prevSegvAction.sa_sigaction(sig, info, context);
+    } else if(g_prevSegvAction.sa_handler == SIG_DFL || g_prevSegvAction.sa_handler == SIG_IGN) {
+        signal(SIGSEGV, SIG_DFL);
+    } else {
+        g_prevSegvAction.sa_handler(sig);
+    }
+}
+
+static void segvHandler(int sig, siginfo_t* info, void* context)
+{
+    const uintptr_t addr = (uintptr_t)info->si_addr;
+
+    ucontext_t* uc = (ucontext_t*)context;
+#ifdef __x86_64__
+    void* pc = (void*)uc->uc_mcontext.gregs[REG_RIP];
+    const uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+#else
+    void* pc = (void*)uc->uc_mcontext.gregs[REG_EIP];
+    const uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_ESP];
+#endif
+
+    // Tries to conservatively discern a random access violation from a simple null dereference: the faulting address
+    // is close to zero (same value as on Windows) and the faulting instruction belongs to machine code generated for
+    // the domain. Faults in the runtime itself are bugs and should crash as usual.
+    CDomain* domain = CDomain::ForCurrentThreadRelaxed();
+    if(domain) {
+        const bool isGeneratedCode = domain->IsSymbol(pc) || domain->ThunkManager().IsThunk(pc);
+
+        // NOTE Unwinding the runtime from an arbitrary point isn't safe, so a stack overflow inside the runtime itself
+        // is left to the previous handler, like any other fault. Untrusted domains check the stack proactively
+        // and never get that far (see CDomain::StackLimit()).
+        if(isGeneratedCode && isStackOverflow(domain, addr) && g_overflowStack) {
+            redirectToAbortStub(uc, SKIZO_ERRORCODE_STACK_OVERFLOW, (uintptr_t)(g_overflowStack + SKIZO_SIGNAL_STACK_SIZE));
+            return;
+        } else if(isGeneratedCode && addr < (64 * 1024) && !domain->ExplicitNullCheck()) {
+            redirectToAbortStub(uc, SKIZO_ERRORCODE_NULLDEREFERENCE, sp);
+            return;
+        }
+    }
+
+    forwardToPreviousHandler(sig, info, context);
+}
+
+// The handler runs on an alternate stack, as the fault may be caused by the exhaustion of the thread's stack.
+// Signal dispositions are process-wide, alternate stacks are per thread.
+// NOTE The alternate stack is never freed, the OS reclaims it on process exit.
+void Install(const CDomain* domain)
+{
+    static __thread bool isAltStackSet = false;
+    if(!isAltStackSet) {
+        isAltStackSet = true;
+
+        stack_t altStack;
+        altStack.ss_size = SIGSTKSZ < SKIZO_SIGNAL_STACK_SIZE? SKIZO_SIGNAL_STACK_SIZE: SIGSTKSZ;
+        altStack.ss_sp = malloc(altStack.ss_size);
+        altStack.ss_flags = 0;
+        if(!altStack.ss_sp || sigaltstack(&altStack, nullptr) != 0) {
+            CDomain::Abort("Couldn't set the alternate signal stack for hardware null checks and stack overflow detection.");
+        }
+
+        g_overflowStack = (char*)malloc(SKIZO_SIGNAL_STACK_SIZE);
+        if(!g_overflowStack) {
+            CDomain::Abort("Couldn't allocate the stack for stack overflow detection.");
+        }
+    }
+
+    // NOTE No SA_NODEFER: the handler always returns normally (the abort itself happens in abortStub(..)), which
+    // unblocks SIGSEGV. A fault inside the handler kills the process instead of recursing.
+    static std::atomic<bool> isHandlerSet (false);
+    if(!isHandlerSet.exchange(true)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = segvHandler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        if(sigaction(SIGSEGV, &action, &g_prevSegvAction) != 0) {
+            CDomain::Abort("Couldn't set the signal handler for hardware null checks and stack overflow detection.");
+        }
+    }
+}
+
+} } }
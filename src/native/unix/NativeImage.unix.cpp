@@ -0,0 +1,205 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "../../NativeImage.h"
+#include "../../Contract.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+struct NativeImagePrivate
+{
+    void* m_hModule;
+
+    // Used by IsSymbol(..) to discern pointers to code inside the image.
+    void* m_imageBase;
+
+    NativeImagePrivate()
+        : m_hModule(nullptr),
+          m_imageBase(nullptr)
+    {
+    }
+};
+
+CNativeImage::CNativeImage()
+    : p (new NativeImagePrivate())
+{
+}
+
+CNativeImage::~CNativeImage()
+{
+    if(p->m_hModule) {
+        dlclose(p->m_hModule);
+    }
+
+    delete p;
+}
+
+static bool writeFile(const char* path, const char* text)
+{
+    FILE* f = fopen(path, "w");
+    if(!f) {
+        return false;
+    }
+
+    const size_t len = strlen(text);
+    const bool r = fwrite(text, 1, len, f) == len;
+    fclose(f);
+    return r;
+}
+
+// Externals are fed to the linker as an implicit linker script which consists of absolute symbol
+// assignments: "name = address;"
+// NOTE Calls to such symbols go through the PLT and are resolved by the dynamic linker,
+// which correctly handles absolute symbols starting with glibc 2.28.
+static bool writeLinkerScript(const char* path, const CHashMap<const char*, void*>* externals)
+{
+    FILE* f = fopen(path, "w");
+    if(!f) {
+        return false;
+    }
+
+    const char* name;
+    void* impl;
+    SHashMapEnumerator<const char*, void*> mapEnum (externals);
+    while(mapEnum.MoveNext(&name, &impl)) {
+        fprintf(f, "%s = %p;\n", name, impl);
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Launches the compiler and waits for it to exit. Returns true if the exit code is zero.
+static bool runCompiler(const char* const* args)
+{
+    const pid_t pid = fork();
+    if(pid < 0) {
+        return false;
+    }
+
+    if(pid == 0) { // Child process.
+        // WARNING No complex functions should be between fork() and execvp(..)
+        execvp(args[0], (char* const*)args);
+        _exit(127);
+    }
+
+    int status;
+    if(waitpid(pid, &status, 0) != pid) {
+        return false;
+    }
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static void removeTempDir(const char* dir, const char* cPath, const char* ldPath, const char* soPath)
+{
+    unlink(cPath);
+    unlink(ldPath);
+    unlink(soPath);
+    rmdir(dir);
+}
+
+CNativeImage* CNativeImage::Compile(const char* compiler,
+                                    const char* cCode,
+                                    const CHashMap<const char*, void*>* externals)
+{
+    SKIZO_REQ_PTR(compiler);
+    SKIZO_REQ_PTR(cCode);
+    SKIZO_REQ_PTR(externals);
+
+    char dir[] = "/tmp/skizo-XXXXXX";
+    if(!mkdtemp(dir)) {
+        printf("Failed to create a temporary directory for the native compiler.\n");
+        return nullptr;
+    }
+
+    char cPath[sizeof(dir) + 16], ldPath[sizeof(dir) + 16], soPath[sizeof(dir) + 16];
+    sprintf(cPath, "%s/image.c", dir);
+    sprintf(ldPath, "%s/image.ld", dir);
+    sprintf(soPath, "%s/image.so", dir);
+
+    if(!writeFile(cPath, cCode) || !writeLinkerScript(ldPath, externals)) {
+        printf("Failed to write input files for the native compiler.\n");
+        removeTempDir(dir, cPath, ldPath, soPath);
+        return nullptr;
+    }
+
+    // -w: the emitted code relies on TCC's leniency (mismatched pointer types etc.)
+    // -mstackrealign: TCC-compiled code and ThunkJIT thunks don't keep the stack 16-byte aligned.
+    // -fno-semantic-interposition: allows direct calls between functions of the image (no PLT).
+    const char* const args[] = {
+        compiler,
+        "-O2", "-m32", "-fPIC", "-shared", "-w",
+        "-fno-strict-aliasing",
+        "-mstackrealign",
+        "-fno-semantic-interposition",
+        "-o", soPath,
+        cPath,
+        ldPath,
+        nullptr
+    };
+
+    if(!runCompiler(args)) {
+        printf("Native compiler '%s' failed to compile the output machine code.\n", compiler);
+        removeTempDir(dir, cPath, ldPath, soPath);
+        return nullptr;
+    }
+
+    // RTLD_LOCAL: several domains can load images which define same names.
+    void* hModule = dlopen(soPath, RTLD_NOW | RTLD_LOCAL);
+
+    // The image is already mapped into memory, the files aren't needed anymore.
+    removeTempDir(dir, cPath, ldPath, soPath);
+
+    if(!hModule) {
+        printf("Failed to load the native image: %s\n", dlerror());
+        return nullptr;
+    }
+
+    CNativeImage* r = new CNativeImage();
+    r->p->m_hModule = hModule;
+
+    // Every image has a prolog, which is used to find out the base of the image.
+    void* prolog = dlsym(hModule, "_soX_prolog");
+    Dl_info info;
+    if(prolog && dladdr(prolog, &info)) {
+        r->p->m_imageBase = info.dli_fbase;
+    }
+
+    return r;
+}
+
+void* CNativeImage::GetSymbol(const char* name) const
+{
+    return dlsym(p->m_hModule, name);
+}
+
+bool CNativeImage::IsSymbol(void* ptr) const
+{
+    Dl_info info;
+    return p->m_imageBase
+        && dladdr(ptr, &info)
+        && (info.dli_fbase == p->m_imageBase);
+}
+
+} }
@@ -24,6 +24,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 
 // *************************************************************************
 // See the comments for the Win32 implementation for additional information.
@@ -52,6 +54,9 @@ struct ThreadPrivate
 
     int m_procId, m_priority;
 
+    // 0 for the default.
+    int m_stackSize;
+
     char* m_name;
 
     // The main thread's handle should not be disposed as it's managed by the OS.
@@ -62,6 +67,7 @@ struct ThreadPrivate
     ThreadPrivate()
         : m_handle(0),
           m_state(E_THREADSTATE_UNSTARTED), m_procId(0), m_priority(50),
+          m_stackSize(0),
           m_name(nullptr),
           m_isMain(false),
           m_tlsData(new CHashMap<int, SVariant>())
@@ -189,6 +195,18 @@ void CThread::SetPriority(int priority)
     p->m_priority = priority;
 }
 
+void CThread::SetStackSize(int size)
+{
+    if(size < 0) {
+        SKIZO_THROW(EC_ILLEGAL_ARGUMENT);
+    }
+    if(p->m_state != E_THREADSTATE_UNSTARTED) {
+        SKIZO_THROW_WITH_MSG(EC_INVALID_STATE, "The thread is already running.");
+    }
+
+    p->m_stackSize = size;
+}
+
 void ThreadPrivate::freeHandle()
 {
     if(m_handle != 0) {
@@ -288,11 +306,24 @@ void CThread::Start()
     // onStart sub and deleted.
     this->Ref();
 
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if(p->m_stackSize) {
+        // The size should be a multiple of the page size and not less than PTHREAD_STACK_MIN.
+        const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t stackSize = ((size_t)p->m_stackSize + pageSize - 1) / pageSize * pageSize;
+        if(stackSize < (size_t)PTHREAD_STACK_MIN) {
+            stackSize = (size_t)PTHREAD_STACK_MIN;
+        }
+        pthread_attr_setstacksize(&attr, stackSize);
+    }
+
     int r;
     r = pthread_create(&p->m_handle,
-                        0,
+                        &attr,
                         &PosixToSkizo,  /* Wrapper. */
                         (void*)this);
+    pthread_attr_destroy(&attr);
 
     if(r) {
         this->Unref();
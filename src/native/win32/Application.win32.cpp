@@ -74,6 +74,29 @@ so_long TickCount(void)
     return (so_long)timeGetTime();
 }
 
+so_long MicroTickCount(void)
+{
+    LARGE_INTEGER freq, counter;
+    if(QueryPerformanceFrequency(&freq) && freq.QuadPart > 0 && QueryPerformanceCounter(&counter)) {
+        return (so_long)(double(counter.QuadPart) * 1000000.0 / double(freq.QuadPart));
+    }
+
+    return (so_long)timeGetTime() * 1000;
+}
+
+so_long NanoTickCount(void)
+{
+    LARGE_INTEGER freq, counter;
+    if(QueryPerformanceFrequency(&freq) && freq.QuadPart > 0 && QueryPerformanceCounter(&counter)) {
+        // Splits the counter to avoid overflowing 64 bits.
+        const so_long seconds = counter.QuadPart / freq.QuadPart;
+        const so_long remainder = counter.QuadPart % freq.QuadPart;
+        return seconds * 1000000000 + remainder * 1000000000 / freq.QuadPart;
+    }
+
+    return (so_long)timeGetTime() * 1000000;
+}
+
 void Launch(EApplication app, const CString* args)
 {
     switch(app) {
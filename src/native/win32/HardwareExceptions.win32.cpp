@@ -0,0 +1,65 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "../../HardwareExceptions.h"
+#include "../../Application.h"
+#include "../../Domain.h"
+
+#include <atomic>
+
+namespace skizo { namespace script { namespace HardwareExceptions {
+using namespace skizo::core;
+
+static LONG WINAPI unhandledExceptionFilter(struct _EXCEPTION_POINTERS *lpTopLevelExceptionFilter)
+{
+    switch(lpTopLevelExceptionFilter->ExceptionRecord->ExceptionCode) {
+        case EXCEPTION_ACCESS_VIOLATION:
+        {
+            // TODO estimate whether it's access violation or null reference check
+            const uintptr_t addr = (uintptr_t)lpTopLevelExceptionFilter->ExceptionRecord->ExceptionInformation[1];
+
+            // Tries to conservatively discern a random access violation from a simple null dereference.
+            // NOTE The number is equal to ROTOR's value.
+            if(addr < (64 * 1024)) {
+                CDomain::Abort("Null dereference.");
+            }
+        }
+        break;
+
+        case EXCEPTION_STACK_OVERFLOW:
+        {
+            // Can get here if proactive stack overflow detection is disabled or there's a bug in the runtime.
+            // Not recoverable.
+            // TODO don't kill other threads
+            Application::FailFast("Stack overflow.")
+        }
+        break;
+    }
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void Install(const CDomain* domain)
+{
+    // Sets an exception handler to catch null reference errors without testing for them at runtime.
+    // NOTE One handler for all threads. See MSDN:
+    // "Issuing SetUnhandledExceptionFilter replaces the existing top-level exception filter for all
+    // existing and all future threads in the calling process".
+    static std::atomic<bool> isHandlerSet (false);
+    if(!domain->ExplicitNullCheck() && !isHandlerSet.exchange(true)) {
+        //SetUnhandledExceptionFilter(unhandledExceptionFilter);
+        AddVectoredExceptionHandler(0, unhandledExceptionFilter);
+    }
+}
+
+} } }
@@ -0,0 +1,51 @@
+// *****************************************************************************
+//
+//  Copyright (c) Konstantin Geist. All rights reserved.
+//
+//  The use and distribution terms for this software are contained in the file
+//  named License.txt, which can be found in the root of this distribution.
+//  By using this software in any fashion, you are agreeing to be bound by the
+//  terms of this license.
+//
+//  You must not remove this notice, or any other, from this software.
+//
+// *****************************************************************************
+
+#include "../../NativeImage.h"
+#include "../../Contract.h"
+
+namespace skizo { namespace script {
+using namespace skizo::core;
+using namespace skizo::collections;
+
+// TODO Windows has no equivalent of absolute symbols in DLLs; externals should be patched via
+// an import table generated by the emitter instead.
+
+CNativeImage::CNativeImage()
+    : p (nullptr)
+{
+}
+
+CNativeImage::~CNativeImage()
+{
+}
+
+CNativeImage* CNativeImage::Compile(const char* compiler,
+                                    const char* cCode,
+                                    const CHashMap<const char*, void*>* externals)
+{
+    SKIZO_THROW_WITH_MSG(EC_NOT_IMPLEMENTED, "Native compilation isn't supported for this platform.");
+    return nullptr;
+}
+
+void* CNativeImage::GetSymbol(const char* name) const
+{
+    return nullptr;
+}
+
+bool CNativeImage::IsSymbol(void* ptr) const
+{
+    return false;
+}
+
+} }
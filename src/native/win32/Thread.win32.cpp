@@ -60,6 +60,9 @@ struct ThreadPrivate
     std::atomic<EThreadState> m_state;
     int m_procId, m_priority;
 
+    // 0 for the default.
+    int m_stackSize;
+
     char* m_name;
 
     // The main thread's handle should not be disposed as it's managed by the OS.
@@ -71,6 +74,7 @@ struct ThreadPrivate
         : m_handle(NULL),
           m_isOwned(true),
           m_state(E_THREADSTATE_UNSTARTED), m_procId(0), m_priority(50),
+          m_stackSize(0),
           m_name(nullptr),
           m_isMain(false),
           m_tlsData(new CHashMap<int, SVariant>())
@@ -231,6 +235,22 @@ void CThread::SetPriority(int priority)
     p->m_priority = priority;
 }
 
+void CThread::SetStackSize(int size)
+{
+    if(!p->m_isOwned) {
+        SKIZO_THROW_WITH_MSG(EC_INVALID_STATE, "Cannot set the stack size of a non-owned thread.");
+    }
+
+    if(size < 0) {
+        SKIZO_THROW(EC_ILLEGAL_ARGUMENT);
+    }
+    if(p->m_state != E_THREADSTATE_UNSTARTED) {
+        SKIZO_THROW_WITH_MSG(EC_INVALID_STATE, "The thread is already running.");
+    }
+
+    p->m_stackSize = size;
+}
+
 void ThreadPrivate::freeHandle()
 {
     if(m_handle != NULL) {
@@ -342,7 +362,13 @@ void CThread::Start()
     // onStart sub and deleted.
     this->Ref();
 
-    p->m_handle = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)&WinToSkizo, (LPVOID)this, 0, 0); //-V513
+    // Reserves (not commits) the given size of the stack.
+    p->m_handle = CreateThread(NULL,
+                               (SIZE_T)p->m_stackSize,
+                               (LPTHREAD_START_ROUTINE)&WinToSkizo,
+                               (LPVOID)this,
+                               p->m_stackSize? STACK_SIZE_PARAM_IS_A_RESERVATION: 0,
+                               0); //-V513
     if(p->m_handle == 0) {
         this->Unref();
         CoreUtils::ThrowWin32Error();
@@ -69,4 +69,16 @@
  */
 #define SKIZO_MAX_GC_MEMORY (10 * 1024 * 1024)
 
+/**
+ * With tiered compilation, a method is switched to its optimized version once it's called this many times.
+ * @see SDomainCreation::TieredCompilation
+ */
+#define SKIZO_TIERUP_THRESHOLD 1000
+
+/**
+ * Methods whose return expression has more nodes than this are never inlined.
+ * @see STransformer::inlineCalls(..)
+ */
+#define SKIZO_INLINE_MAX_SIZE 8
+
 #endif // OPTIONS_H_INCLUDED
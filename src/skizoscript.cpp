@@ -84,6 +84,7 @@ skizo_domain SKIZO_API SKIZOCreateDomain(SKIZO_DOMAINCREATION* cDC)
         domainCreation.InlineBranching = cDC->inlineBranching;
         domainCreation.SafeCallbacks = cDC->safeCallbacks;
         domainCreation.BreakpointCallback = cDC->breakpointCallback;
+        domainCreation.PatchableBreakpoints = cDC->patchableBreakpoints;
 
         for(int i = 0; i < cDC->searchPathCount; i++) {
             SKIZO_NULL_CHECK(cDC->searchPaths[i]);
@@ -214,10 +215,13 @@ skizo_result SKIZO_API SKIZOSortProfilingData(skizo_profdata profdata, SKIZO_PRO
     try {
         switch(sort) {
             case SKIZO_PROFDATA_SORT_TOTALTIME:
-                profinfo->SortByTotalTimeInMs();
+                profinfo->SortByTotalTime();
                 break;
             case SKIZO_PROFDATA_SORT_AVERAGETIME:
-                profinfo->SortByAverageTimeInMs();
+                profinfo->SortByAverageTime();
+                break;
+            case SKIZO_PROFDATA_SORT_SELFTIME:
+                profinfo->SortBySelfTime();
                 break;
             case SKIZO_PROFDATA_SORT_NUMBEROFCALLS:
                 profinfo->SortByNumberOfCalls();
@@ -245,6 +249,9 @@ skizo_result SKIZO_API SKIZODumpProfilingData(skizo_profdata profdata, SKIZO_PRO
             case SKIZO_PROFDATA_DUMP_TO_DISK:
                 profinfo->DumpToDisk();
                 break;
+            case SKIZO_PROFDATA_DUMP_CALLGRIND:
+                profinfo->DumpCallgrindToDisk();
+                break;
             default:
                 return SKIZO_FAILURE;
         }
@@ -263,6 +270,20 @@ skizo_result SKIZO_API SKIZONextWatch(skizo_watchiterator wi, SKIZO_WATCHINFO* w
     return watchIterator->NextWatch(watchInfo)? SKIZO_SUCCESS: SKIZO_FAILURE;
 }
 
+skizo_result SKIZO_API SKIZOSetBreakpoint(skizo_domain domain, const char* filePath, int lineNumber, so_bool enable)
+{
+    if(!domain || !filePath) {
+        return SKIZO_FAILURE;
+    }
+
+    try {
+        Auto<const CString> daFilePath (CString::FromUtf8(filePath));
+        return ((CDomain*)domain)->SetBreakpoint(daFilePath, lineNumber, enable)? SKIZO_SUCCESS: SKIZO_FAILURE;
+    } catch (...) {
+        return SKIZO_FAILURE;
+    }
+}
+
 // **********************
 //   Work with objects.
 // **********************
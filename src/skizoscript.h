@@ -61,12 +61,14 @@ typedef void (SKIZO_API * SKIZO_BREAKPOINTCALLBACK)(SKIZO_BREAKPOINTINFO* info);
 typedef enum {
     SKIZO_PROFDATA_SORT_TOTALTIME,
     SKIZO_PROFDATA_SORT_AVERAGETIME,
-    SKIZO_PROFDATA_SORT_NUMBEROFCALLS
+    SKIZO_PROFDATA_SORT_NUMBEROFCALLS,
+    SKIZO_PROFDATA_SORT_SELFTIME
 } SKIZO_PROFDATA_SORT;
 
 typedef enum {
     SKIZO_PROFDATA_DUMP_TO_CONSOLE,
-    SKIZO_PROFDATA_DUMP_TO_DISK
+    SKIZO_PROFDATA_DUMP_TO_DISK,
+    SKIZO_PROFDATA_DUMP_CALLGRIND // "callgrind.out" in the current directory
 } SKIZO_PROFDATA_DUMP;
 
 // ********************
@@ -96,6 +98,7 @@ typedef struct {
     so_bool isUntrusted;
     int permissionCount;
     char** permissions;
+    so_bool patchableBreakpoints;
 } SKIZO_DOMAINCREATION;
 
     // **********************************************
@@ -153,6 +156,13 @@ skizo_result SKIZO_API SKIZODumpProfilingData(skizo_profdata profinfo, SKIZO_PRO
 
 skizo_result SKIZO_API SKIZONextWatch(skizo_watchiterator watchiter, SKIZO_WATCHINFO* watchInfo);
 
+/** Sets or clears a breakpoint at the given line of a module. Requires patchableBreakpoints. Should be called
+ * from the domain's thread: before SKIZOInvokeEntryPoint(..) or from the breakpoint callback.
+ * @param filePath the path to the module, or its trailing part ("main.skizo")
+ * @return SKIZO_FAILURE if patchable breakpoints are disabled or no statement was found at the line.
+ */
+skizo_result SKIZO_API SKIZOSetBreakpoint(skizo_domain domain, const char* filePath, int lineNumber, so_bool enable);
+
 // ******
 //   ?
 // ******
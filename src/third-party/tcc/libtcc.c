@@ -1979,6 +1979,11 @@ PUB_FUNC void tcc_print_stats(TCCState *s, int64_t total_time)
 // ***********************
 //      Skizo change
 // ***********************
+LIBTCCAPI void tcc_set_patchable_entries(TCCState *s1, int value)
+{
+    s1->patchable_entries = value;
+}
+
 LIBTCCAPI int tcc_is_symbol(TCCState *s1, const void* ptr_to_compare)
 {
     for(int i = 1; i < s1->nb_sections; i++) {
@@ -1996,4 +2001,32 @@ LIBTCCAPI int tcc_is_symbol(TCCState *s1, const void* ptr_to_compare)
     }
     return 0;
 }
+
+LIBTCCAPI void tcc_list_functions(TCCState *s1, void *ctx,
+    void (*callback)(void *ctx, const char *name, const void *addr, unsigned long size))
+{
+    Section* symtab = s1->symtab;
+    ElfW(Sym)* sym_end = (ElfW(Sym)*)(symtab->data + symtab->data_offset);
+    for(ElfW(Sym)* sym = (ElfW(Sym)*)symtab->data + 1; sym < sym_end; sym++) {
+        if (ELFW(ST_TYPE)(sym->st_info) == STT_FUNC && sym->st_shndx != SHN_UNDEF && sym->st_size > 0) {
+            const char* name = (const char*)symtab->link->data + sym->st_name;
+            callback(ctx, name, (const void*)(uintptr_t)sym->st_value, sym->st_size);
+        }
+    }
+}
+
+LIBTCCAPI int tcc_get_section(TCCState *s1, const char *name,
+    const void **data, unsigned long *size, unsigned long *addr)
+{
+    for(int i = 1; i < s1->nb_sections; i++) {
+        Section* s = s1->sections[i];
+        if (0 == strcmp(s->name, name)) {
+            *data = s->data;
+            *size = s->data_offset;
+            *addr = s->sh_addr;
+            return 1;
+        }
+    }
+    return 0;
+}
 // ***********************
@@ -97,6 +97,15 @@ LIBTCCAPI void *tcc_get_symbol(TCCState *s, const char *name);
 //      Skizo change
 // ***********************
 LIBTCCAPI int tcc_is_symbol(TCCState *s, const void* ptr);
+/* if non-zero, every function compiled afterwards starts with an 8-byte aligned 8-byte NOP which can be
+   atomically replaced with a jump */
+LIBTCCAPI void tcc_set_patchable_entries(TCCState *s, int value);
+/* calls 'callback' for every function defined in the relocated state */
+LIBTCCAPI void tcc_list_functions(TCCState *s, void *ctx,
+    void (*callback)(void *ctx, const char *name, const void *addr, unsigned long size));
+/* returns the contents of a section and its address once relocated, or 0 if there's no such section */
+LIBTCCAPI int tcc_get_section(TCCState *s, const char *name,
+    const void **data, unsigned long *size, unsigned long *addr);
 // ***********************
 
 #ifdef __cplusplus
@@ -538,6 +538,9 @@ struct TCCState {
 
     /* compile with debug symbol (and use them if error during execution) */
     int do_debug;
+
+    /* Skizo change: every function starts with an 8-byte aligned 8-byte NOP (see tcc_set_patchable_entries) */
+    int patchable_entries;
 #ifdef CONFIG_TCC_BCHECK
     /* compile with built-in memory and bounds checker */
     int do_bounds_check;
@@ -5447,6 +5447,14 @@ static void put_func_debug(Sym *sym)
 {
     char buf[512];
 
+    // ***********************
+    //      Skizo change
+    // ***********************
+    /* #line directives can switch files between functions, so the file of every function is
+       specified explicitly */
+    put_stabs_r(file->filename, N_SOL, 0, 0, 0, cur_text_section, sym->c);
+    // ***********************
+
     /* stabs info */
     /* XXX: we put here a dummy type */
     snprintf(buf, sizeof(buf), "%s:%c1", 
@@ -5515,10 +5523,33 @@ static void gen_function(Sym *sym)
     int saved_nocode_wanted = nocode_wanted;
     nocode_wanted = 0;
     ind = cur_text_section->data_offset;
+
+    // ***********************
+    //      Skizo change
+    // ***********************
+    /* The entry can be overwritten with a jump by a single aligned 8-byte store, and no thread can be
+       in the middle of the NOP as it's a single instruction. */
+    if (tcc_state->patchable_entries) {
+        while (ind & 7)
+            g(0x90);
+    }
+    // ***********************
+
     /* NOTE: we patch the symbol size later */
     put_extern_sym(sym, cur_text_section, ind, 0);
     funcname = get_tok_str(sym->v, NULL);
     func_ind = ind;
+
+    // ***********************
+    //      Skizo change
+    // ***********************
+    if (tcc_state->patchable_entries) {
+        /* nopl 0x0(%eax,%eax,1) with a 32-bit displacement */
+        g(0x0f); g(0x1f); g(0x84); g(0x00);
+        g(0x00); g(0x00); g(0x00); g(0x00);
+    }
+    // ***********************
+
     /* put debug symbol */
     if (tcc_state->do_debug)
         put_func_debug(sym);